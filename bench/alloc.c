@@ -0,0 +1,68 @@
+/* alloc.c - counting the allocations done by the code under test
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "bench_common.h"
+
+#include <stdlib.h>
+
+#ifndef __has_feature
+# define __has_feature(x) 0
+#endif
+
+/* glibc lets the program replace malloc() and friends for everyone,
+ * including libsrsirc itself and libc's internal users (strdup(3), ...),
+ * while still offering the originals under these names.  Sanitizers
+ * bring their own allocator; don't get in their way.  Elsewhere, we
+ * just don't count. */
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) \
+    && !defined(__SANITIZE_THREAD__) && !__has_feature(address_sanitizer) \
+    && !__has_feature(thread_sanitizer)
+# define COUNT_ALLOCS 1
+#else
+# define COUNT_ALLOCS 0
+#endif
+
+
+static uint64_t s_nallocs; // the benchmarks are single-threaded
+
+
+#if COUNT_ALLOCS
+extern void *__libc_malloc(size_t sz);
+extern void *__libc_calloc(size_t nmemb, size_t sz);
+extern void *__libc_realloc(void *ptr, size_t sz);
+
+void *
+malloc(size_t sz)
+{
+	s_nallocs++;
+	return __libc_malloc(sz);
+}
+
+void *
+calloc(size_t nmemb, size_t sz)
+{
+	s_nallocs++;
+	return __libc_calloc(nmemb, sz);
+}
+
+void *
+realloc(void *ptr, size_t sz)
+{
+	s_nallocs++;
+	return __libc_realloc(ptr, sz);
+}
+#endif
+
+
+bool
+bench_counting_allocs(void)
+{
+	return COUNT_ALLOCS;
+}
+
+uint64_t
+bench_nallocs(void)
+{
+	return s_nallocs;
+}
@@ -0,0 +1,51 @@
+/* bench_common.h - microbenchmark harness, interface
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIBSRSIRC_BENCH_COMMON_H
+#define LIBSRSIRC_BENCH_COMMON_H 1
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* A benchmark is timed in passes.  setup() and teardown() run around each
+ * pass and aren't measured; run() does the actual work and returns how many
+ * operations it did.  setup() and teardown() may be NULL. */
+struct bench {
+	const char *name;
+	void (*setup)(void);
+	size_t (*run)(void);
+	void (*teardown)(void);
+};
+
+/* The corpus (see corpus/), loaded once at startup */
+struct cline {
+	char *line;      // as found in the corpus, NUL-terminated
+	size_t len;
+	char *body;      // points past the tags within `line' (or at `line')
+	size_t bodylen;
+};
+
+extern struct cline *g_corpus;
+extern size_t g_ncorpus;
+
+/* Allocation counting; see alloc.c */
+bool bench_counting_allocs(void);
+uint64_t bench_nallocs(void);
+
+/* The benchmarks, each array terminated by an entry with name == NULL */
+extern const struct bench g_bench_parse[];
+extern const struct bench g_bench_dispatch[];
+extern const struct bench g_bench_skmap[];
+extern const struct bench g_bench_ucbase[];
+extern const struct bench g_bench_io[];
+
+/* Deterministic PRNG, so that every run does the same work */
+uint32_t bench_rand(void);
+void bench_srand(uint32_t seed);
+
+
+#endif /* LIBSRSIRC_BENCH_COMMON_H */
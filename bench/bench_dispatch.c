@@ -0,0 +1,299 @@
+/* bench_dispatch.c - message dispatch benchmark
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "bench_common.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libsrsirc/irc_ext.h>
+#include <libsrsirc/irc_track.h>
+#include <libsrsirc/util.h>
+
+#include <libsrsirc/intdefs.h>
+#include <libsrsirc/irc_msghnd.h>
+#include <libsrsirc/irc_track_int.h>
+#include <libsrsirc/msg.h>
+#include <libsrsirc/v3.h>
+
+
+#define NS_USERS 4000 // in the big channel
+#define NS_SIDE 8     // small channels, every other user is in one of them
+#define NS_SPLIT 2000 // users lost in the netsplit
+#define NS_BACK 1000  // of those, users who come back in the netjoin
+#define NS_NAMES 40   // nicks per 353
+
+
+static void d_setup(void);
+static size_t d_run(void);
+static void d_teardown(void);
+static void su_netsplit(void);
+static void su_netsplit_perquit(void);
+static size_t r_netsplit(void);
+static bool uhnd(irc *ctx, tokarr *msg, size_t nargs, bool pre);
+static void logon(void);
+static void ns_setup(const char *reason);
+static void ns_feed(const char *fmt, ...);
+static void ns_add(const char *fmt, ...);
+
+
+/* The whole corpus is replayed into a fresh context, with the core, IRCv3
+ * and tracking handlers in place and a few user handlers on top, like a
+ * typical bot would have.  The logon part (up to the 005 which tells the
+ * casemapping and thereby enables tracking) isn't measured.
+ *
+ * netsplit replays a netsplit as seen in a big channel of NS_USERS users,
+ * every other one of them also in one of NS_SIDE small channels.  NS_SPLIT
+ * of them QUIT due to the split, the first NS_BACK rejoin all their channels
+ * in the netjoin, and the grace period ends with the next lsi_trk_tick().
+ * The QUITs give the netsplit reason, so the users are collected and those
+ * who don't come back are dropped in one pass.  netsplit_perquit gives them
+ * an ordinary reason instead, which drops every user right away and adds
+ * the returning ones back, as every QUIT used to.  An op is one line. */
+const struct bench g_bench_dispatch[] = {
+	{ "dispatch", d_setup, d_run, d_teardown },
+	{ "netsplit", su_netsplit, r_netsplit, d_teardown },
+	{ "netsplit_perquit", su_netsplit_perquit, r_netsplit, d_teardown },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static irc *s_irc;
+static char *s_lines;    // copies of the corpus lines, tokenized
+static tokarr *s_toks;
+static size_t s_first;   // first line to be measured
+static volatile size_t s_sink;
+
+static char (*s_nsbuf)[128]; // the netsplit and netjoin, tokenized
+static tokarr *s_nstoks;
+static size_t s_nns;
+
+
+static void
+d_setup(void)
+{
+	size_t total = 0;
+	for (size_t i = 0; i < g_ncorpus; i++)
+		total += g_corpus[i].bodylen + 1;
+
+	if (!s_lines && (!(s_lines = malloc(total))
+	    || !(s_toks = malloc(g_ncorpus * sizeof *s_toks)))) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	char *p = s_lines;
+	for (size_t i = 0; i < g_ncorpus; i++) {
+		memcpy(p, g_corpus[i].body, g_corpus[i].bodylen + 1);
+		if (!lsi_ut_tokenize(p, &s_toks[i]))
+			s_toks[i][1] = NULL;
+		p += g_corpus[i].bodylen + 1;
+	}
+
+	logon();
+	return;
+}
+
+static size_t
+d_run(void)
+{
+	size_t n = 0;
+	for (size_t i = s_first; i < g_ncorpus; i++) {
+		if (!s_toks[i][1])
+			continue;
+
+		lsi_msg_handle(s_irc, &s_toks[i], false);
+		n++;
+	}
+
+	return n;
+}
+
+static void
+su_netsplit(void)
+{
+	ns_setup("hub.example.net leaf.example.net");
+	return;
+}
+
+static void
+su_netsplit_perquit(void)
+{
+	ns_setup("Quit: bye");
+	return;
+}
+
+static size_t
+r_netsplit(void)
+{
+	for (size_t i = 0; i < s_nns; i++) {
+		lsi_msg_handle(s_irc, &s_nstoks[i], false);
+		lsi_trk_tick(s_irc, &s_nstoks[i]);
+	}
+
+	/* the grace period is over */
+	irc_track_splitgrace(s_irc, 0);
+	lsi_trk_tick(s_irc, NULL);
+
+	if (irc_num_members(s_irc, "#big") != NS_USERS - NS_SPLIT + NS_BACK) {
+		fprintf(stderr, "netsplit: wrong membership afterwards\n");
+		exit(EXIT_FAILURE);
+	}
+
+	return s_nns;
+}
+
+static void
+d_teardown(void)
+{
+	irc_dispose(s_irc);
+	s_irc = NULL;
+	return;
+}
+
+static bool
+uhnd(irc *ctx, tokarr *msg, size_t nargs, bool pre)
+{
+	s_sink += nargs + (*msg)[1][0];
+	return true;
+}
+
+/* a fresh context with the logon part of the corpus (up to the 005 which
+ * tells the casemapping and thereby enables tracking) handled */
+static void
+logon(void)
+{
+	if (!(s_irc = irc_init())
+	    || !lsi_imh_regall(s_irc, false) || !lsi_v3_regall(s_irc, false)) {
+		fprintf(stderr, "failed to set up an irc context\n");
+		exit(EXIT_FAILURE);
+	}
+
+	irc_set_track(s_irc, true);
+	irc_reg_msghnd(s_irc, "PRIVMSG", uhnd, false);
+	irc_reg_msghnd(s_irc, "NOTICE", uhnd, false);
+	irc_reg_msghnd(s_irc, "JOIN", uhnd, false);
+	irc_reg_msghnd(s_irc, "PRIVMSG", uhnd, true);
+
+	/* what irc_connect() would have done */
+	tokarr *me = &s_toks[0];
+	snprintf(s_irc->mynick, sizeof s_irc->mynick, "%s",
+	    (*me)[1] && (*me)[2] ? (*me)[2] : "me");
+
+	for (s_first = 0; s_first < g_ncorpus; s_first++) {
+		tokarr *t = &s_toks[s_first];
+		if (!(*t)[1])
+			continue;
+
+		lsi_msg_handle(s_irc, t, false);
+		if (irc_tracking_enab(s_irc)) {
+			s_first++;
+			break;
+		}
+	}
+
+	return;
+}
+
+/* log on, join the channels, and prepare the netsplit and netjoin lines,
+ * with `reason' as the QUIT reason */
+static void
+ns_setup(const char *reason)
+{
+	d_setup();
+	irc_track_splitgrace(s_irc, 60000000);
+
+	size_t nmax = NS_SPLIT + 2 * NS_BACK;
+	if (!s_nsbuf && (!(s_nsbuf = malloc(nmax * sizeof *s_nsbuf))
+	    || !(s_nstoks = malloc(nmax * sizeof *s_nstoks)))) {
+		perror("malloc");
+		exit(EXIT_FAILURE);
+	}
+
+	const char *me = s_irc->mynick;
+	char names[NS_NAMES * 8 + 1];
+	for (size_t c = 0; c <= NS_SIDE; c++) {
+		char chan[16];
+		if (c == NS_SIDE)
+			snprintf(chan, sizeof chan, "#big");
+		else
+			snprintf(chan, sizeof chan, "#side%zu", c);
+
+		ns_feed(":%s!u@h JOIN %s", me, chan);
+		size_t len = 0;
+		for (size_t i = 0; i < NS_USERS; i++) {
+			if (c < NS_SIDE && (i % 2 || i / 2 % NS_SIDE != c))
+				continue;
+
+			len += (size_t)snprintf(names + len, sizeof names - len,
+			    "%s%su%04zu", len ? " " : "", i % 16 ? "" : "@", i);
+			if (len > sizeof names - 8) {
+				ns_feed(":srv 353 %s = %s :%s", me, chan, names);
+				len = 0;
+			}
+		}
+
+		if (len)
+			ns_feed(":srv 353 %s = %s :%s", me, chan, names);
+		ns_feed(":srv 366 %s %s :End of /NAMES list.", me, chan);
+	}
+
+	s_nns = 0;
+	for (size_t i = 0; i < NS_SPLIT; i++)
+		ns_add(":u%04zu!id@host%zu.example.net QUIT :%s", i, i, reason);
+
+	for (size_t i = 0; i < NS_BACK; i++) {
+		ns_add(":u%04zu!id@host%zu.example.net JOIN #big", i, i);
+		if (i % 2 == 0)
+			ns_add(":u%04zu!id@host%zu.example.net JOIN #side%zu",
+			    i, i, i / 2 % NS_SIDE);
+	}
+
+	return;
+}
+
+/* handle a line right away, not measured */
+static void
+ns_feed(const char *fmt, ...)
+{
+	char line[1024];
+	tokarr tok;
+	va_list l;
+	va_start(l, fmt);
+	vsnprintf(line, sizeof line, fmt, l);
+	va_end(l);
+
+	if (!lsi_ut_tokenize(line, &tok)) {
+		fprintf(stderr, "netsplit: failed to tokenize '%s'\n", line);
+		exit(EXIT_FAILURE);
+	}
+
+	lsi_msg_handle(s_irc, &tok, false);
+	return;
+}
+
+/* add a line to what r_netsplit() replays */
+static void
+ns_add(const char *fmt, ...)
+{
+	va_list l;
+	va_start(l, fmt);
+	vsnprintf(s_nsbuf[s_nns], sizeof s_nsbuf[s_nns], fmt, l);
+	va_end(l);
+
+	if (!lsi_ut_tokenize(s_nsbuf[s_nns], &s_nstoks[s_nns])) {
+		fprintf(stderr, "netsplit: failed to tokenize '%s'\n",
+		    s_nsbuf[s_nns]);
+		exit(EXIT_FAILURE);
+	}
+
+	s_nns++;
+	return;
+}
@@ -0,0 +1,209 @@
+/* bench_io.c - socket read/write path benchmarks
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "bench_common.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if HAVE_POLL_H
+# include <poll.h>
+#endif
+
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <platform/base_net.h>
+
+#include <libsrsirc/defs.h>
+
+#include <libsrsirc/intdefs.h>
+#include <libsrsirc/io.h>
+
+
+#define DRAINEVERY 32 // lines written before we empty the socket again
+
+
+static void su_pair(void);
+static size_t r_read_select(void);
+#if HAVE_POLL_H
+static size_t r_read_poll(void);
+#endif
+static size_t r_read_eager(void);
+static size_t r_write_split(void);
+static size_t r_write_joined(void);
+static void td_pair(void);
+static void feed(size_t i);
+static void drain(void);
+
+
+/* Every corpus line goes through a socketpair, one line per wakeup, which
+ * is the worst case for the per-read overhead (and the common one on a
+ * quiet connection).  The read benchmarks write a line and then read it
+ * back with the respective method: select() then read(), as lsi_b_read()
+ * used to; poll() then read(); and lsi_b_read(), which tries a nonblocking
+ * recv() first.  The write benchmarks send every line with its CRLF in two
+ * writes, as lsi_io_write() used to, or via lsi_io_write(), which sends it
+ * in one.  An op is one line. */
+const struct bench g_bench_io[] = {
+	{ "io_read_select", su_pair, r_read_select, td_pair },
+#if HAVE_POLL_H
+	{ "io_read_poll", su_pair, r_read_poll, td_pair },
+#endif
+	{ "io_read_eager", su_pair, r_read_eager, td_pair },
+	{ "io_write_split", su_pair, r_write_split, td_pair },
+	{ "io_write_joined", su_pair, r_write_joined, td_pair },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static int s_sp[2] = { -1, -1 }; // we write to [0] and read from [1]
+static char s_buf[WORKBUF_SZ + 1];
+static volatile size_t s_sink;
+
+
+static void
+su_pair(void)
+{
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, s_sp) == -1) {
+		perror("socketpair");
+		exit(EXIT_FAILURE);
+	}
+
+	return;
+}
+
+static size_t
+r_read_select(void)
+{
+	for (size_t i = 0; i < g_ncorpus; i++) {
+		feed(i);
+
+		fd_set fds;
+		FD_ZERO(&fds);
+		FD_SET(s_sp[1], &fds);
+		struct timeval tv = { 1, 0 };
+		if (select(s_sp[1] + 1, &fds, NULL, NULL, &tv) != 1)
+			return 0;
+
+		s_sink += (size_t)read(s_sp[1], s_buf, sizeof s_buf - 1);
+	}
+
+	return g_ncorpus;
+}
+
+#if HAVE_POLL_H
+static size_t
+r_read_poll(void)
+{
+	for (size_t i = 0; i < g_ncorpus; i++) {
+		feed(i);
+
+		struct pollfd pfd = { s_sp[1], POLLIN, 0 };
+		if (poll(&pfd, 1, 1000) != 1)
+			return 0;
+
+		s_sink += (size_t)read(s_sp[1], s_buf, sizeof s_buf - 1);
+	}
+
+	return g_ncorpus;
+}
+#endif
+
+static size_t
+r_read_eager(void)
+{
+	for (size_t i = 0; i < g_ncorpus; i++) {
+		feed(i);
+
+		long r = lsi_b_read(s_sp[1], s_buf, sizeof s_buf - 1, 1000000);
+		if (r <= 0)
+			return 0;
+
+		s_sink += (size_t)r;
+	}
+
+	return g_ncorpus;
+}
+
+static size_t
+r_write_split(void)
+{
+	for (size_t i = 0; i < g_ncorpus; i++) {
+		if (lsi_b_write(s_sp[0], g_corpus[i].line, g_corpus[i].len) <= 0
+		    || lsi_b_write(s_sp[0], "\r\n", 2) <= 0)
+			return 0;
+
+		if (i % DRAINEVERY == DRAINEVERY - 1)
+			drain();
+	}
+
+	return g_ncorpus;
+}
+
+static size_t
+r_write_joined(void)
+{
+	struct irc_stats st = { 0 };
+	sckhld sh = { s_sp[0], NULL };
+
+	for (size_t i = 0; i < g_ncorpus; i++) {
+		if (!lsi_io_write(sh, &st, g_corpus[i].line))
+			return 0;
+
+		if (i % DRAINEVERY == DRAINEVERY - 1)
+			drain();
+	}
+
+	return g_ncorpus;
+}
+
+static void
+td_pair(void)
+{
+	close(s_sp[0]);
+	close(s_sp[1]);
+	s_sp[0] = s_sp[1] = -1;
+	return;
+}
+
+/* put one line into the socket, the way a server would: in one piece */
+static void
+feed(size_t i)
+{
+	size_t len = g_corpus[i].len;
+	if (len > sizeof s_buf - 3)
+		len = sizeof s_buf - 3;
+
+	memcpy(s_buf, g_corpus[i].line, len);
+	memcpy(s_buf + len, "\r\n", 2);
+	if (write(s_sp[0], s_buf, len + 2) != (ssize_t)(len + 2)) {
+		perror("write");
+		exit(EXIT_FAILURE);
+	}
+
+	return;
+}
+
+static void
+drain(void)
+{
+	ssize_t r;
+	while ((r = recv(s_sp[1], s_buf, sizeof s_buf, MSG_DONTWAIT)) > 0)
+		s_sink += (size_t)r;
+
+	if (r == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		perror("recv");
+		exit(EXIT_FAILURE);
+	}
+
+	return;
+}
@@ -0,0 +1,83 @@
+/* bench_parse.c - tokenizer and tag extraction benchmarks
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "bench_common.h"
+
+#include <string.h>
+
+#include <libsrsirc/defs.h>
+#include <libsrsirc/util.h>
+
+
+#define MAX_TAGS 32
+
+
+static size_t b_copy(void);
+static size_t b_tokenize(void);
+static size_t b_extract_tags(void);
+
+
+/* Both functions work in place, so every operation includes copying the
+ * line first; `copy' measures just that, for reference */
+const struct bench g_bench_parse[] = {
+	{ "copy", NULL, b_copy, NULL },
+	{ "tokenize", NULL, b_tokenize, NULL },
+	{ "extract_tags", NULL, b_extract_tags, NULL },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static char s_buf[8192];
+static volatile size_t s_sink;
+
+
+static size_t
+b_copy(void)
+{
+	for (size_t i = 0; i < g_ncorpus; i++) {
+		memcpy(s_buf, g_corpus[i].body, g_corpus[i].bodylen + 1);
+		s_sink += (unsigned char)s_buf[0];
+	}
+
+	return g_ncorpus;
+}
+
+static size_t
+b_tokenize(void)
+{
+	tokarr tok;
+
+	for (size_t i = 0; i < g_ncorpus; i++) {
+		memcpy(s_buf, g_corpus[i].body, g_corpus[i].bodylen + 1);
+		if (lsi_ut_tokenize(s_buf, &tok))
+			s_sink += (size_t)tok[1][0];
+	}
+
+	return g_ncorpus;
+}
+
+static size_t
+b_extract_tags(void)
+{
+	char *tags[MAX_TAGS];
+	size_t n = 0;
+
+	for (size_t i = 0; i < g_ncorpus; i++) {
+		struct cline *l = &g_corpus[i];
+		if (l->body == l->line)
+			continue;
+
+		memcpy(s_buf, l->line + 1, l->len);
+		size_t ntags = MAX_TAGS;
+		if (lsi_ut_extract_tags(s_buf, tags, &ntags))
+			s_sink += ntags;
+		n++;
+	}
+
+	return n;
+}
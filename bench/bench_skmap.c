@@ -0,0 +1,182 @@
+/* bench_skmap.c - string-keyed hashmap benchmarks
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "bench_common.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <libsrsirc/defs.h>
+#include <libsrsirc/skmap.h>
+
+
+#define NKEYS 4096
+#define BUCKETS 4096 // what the user map in ucbase.c uses
+
+
+static void su_empty_rfc(void);
+static void su_empty_strict(void);
+static void su_empty_ascii(void);
+static void su_full_rfc(void);
+static void su_full_strict(void);
+static void su_full_ascii(void);
+static size_t r_put(void);
+static size_t r_get(void);
+static size_t r_del(void);
+static void td(void);
+static void mkmap(int cmap, bool fill);
+static void mkkeys(void);
+
+
+/* Keys look like nicknames.  Lookups use the same keys with the case of
+ * the letters flipped, so that the casemapping actually has work to do */
+const struct bench g_bench_skmap[] = {
+	{ "skmap_put_rfc1459", su_empty_rfc, r_put, td },
+	{ "skmap_get_rfc1459", su_full_rfc, r_get, td },
+	{ "skmap_del_rfc1459", su_full_rfc, r_del, td },
+	{ "skmap_put_strict", su_empty_strict, r_put, td },
+	{ "skmap_get_strict", su_full_strict, r_get, td },
+	{ "skmap_del_strict", su_full_strict, r_del, td },
+	{ "skmap_put_ascii", su_empty_ascii, r_put, td },
+	{ "skmap_get_ascii", su_full_ascii, r_get, td },
+	{ "skmap_del_ascii", su_full_ascii, r_del, td },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static skmap *s_map;
+static char s_keys[NKEYS][24];
+static char s_ikeys[NKEYS][24]; // case-flipped
+static bool s_haskeys;
+static volatile size_t s_sink;
+
+
+static void
+su_empty_rfc(void)
+{
+	mkmap(CMAP_RFC1459, false);
+	return;
+}
+
+static void
+su_empty_strict(void)
+{
+	mkmap(CMAP_STRICT_RFC1459, false);
+	return;
+}
+
+static void
+su_empty_ascii(void)
+{
+	mkmap(CMAP_ASCII, false);
+	return;
+}
+
+static void
+su_full_rfc(void)
+{
+	mkmap(CMAP_RFC1459, true);
+	return;
+}
+
+static void
+su_full_strict(void)
+{
+	mkmap(CMAP_STRICT_RFC1459, true);
+	return;
+}
+
+static void
+su_full_ascii(void)
+{
+	mkmap(CMAP_ASCII, true);
+	return;
+}
+
+static size_t
+r_put(void)
+{
+	for (size_t i = 0; i < NKEYS; i++)
+		lsi_skmap_put(s_map, s_keys[i], s_keys[i]);
+
+	return NKEYS;
+}
+
+static size_t
+r_get(void)
+{
+	for (size_t i = 0; i < NKEYS; i++)
+		s_sink += lsi_skmap_get(s_map, s_ikeys[i]) != NULL;
+
+	return NKEYS;
+}
+
+static size_t
+r_del(void)
+{
+	for (size_t i = 0; i < NKEYS; i++)
+		s_sink += lsi_skmap_del(s_map, s_ikeys[i]) != NULL;
+
+	return NKEYS;
+}
+
+static void
+td(void)
+{
+	if (s_sink % NKEYS)
+		fprintf(stderr, "skmap: lookups failed?\n");
+
+	lsi_skmap_dispose(s_map);
+	s_map = NULL;
+	return;
+}
+
+static void
+mkmap(int cmap, bool fill)
+{
+	mkkeys();
+	if (!(s_map = lsi_skmap_init(BUCKETS, cmap))) {
+		fprintf(stderr, "lsi_skmap_init failed\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (fill)
+		r_put();
+
+	return;
+}
+
+static void
+mkkeys(void)
+{
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz"
+	    "ABCDEFGHIJKLMNOPQRSTUVWXYZ_-[]{}\\|^`";
+
+	if (s_haskeys)
+		return;
+
+	bench_srand(1459);
+	for (size_t i = 0; i < NKEYS; i++) {
+		/* unique by the number; its length varies like a nick's */
+		size_t len = 3 + bench_rand() % 9, j;
+		for (j = 0; j < len; j++)
+			s_keys[i][j] = chars[bench_rand() % (sizeof chars - 1)];
+		snprintf(s_keys[i] + j, sizeof s_keys[i] - j, "%zu", i);
+
+		for (j = 0; s_keys[i][j]; j++) {
+			unsigned char c = (unsigned char)s_keys[i][j];
+			s_ikeys[i][j] = (char)(islower(c) ? toupper(c)
+			    : isupper(c) ? tolower(c) : c);
+		}
+		s_ikeys[i][j] = '\0';
+	}
+
+	s_haskeys = true;
+	return;
+}
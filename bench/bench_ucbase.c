@@ -0,0 +1,169 @@
+/* bench_ucbase.c - user and channel base churn benchmark
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "bench_common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <libsrsirc/irc_ext.h>
+
+#include <libsrsirc/intdefs.h>
+#include <libsrsirc/ucbase.h>
+
+
+#define NSLOTS 2000
+#define NCHANS 8
+#define NOPS 20000
+
+
+static void u_setup(void);
+static size_t u_run(void);
+static void u_teardown(void);
+static void mknick(size_t i);
+
+
+/* A random mix of what tracking does all day: users joining and leaving
+ * channels (and thereby coming and going altogether), nick changes, ident
+ * updates and op/deop.  Every pass does the same sequence of operations,
+ * starting from empty channels. */
+const struct bench g_bench_ucbase[] = {
+	{ "ucbase_churn", u_setup, u_run, u_teardown },
+	{ NULL, NULL, NULL, NULL }
+};
+
+static struct slot {
+	char nick[24];
+	unsigned chans;  // bit i set: member of s_chans[i]
+	unsigned ops;    // bit i set: has '@' in s_chans[i]
+	unsigned gen;    // bumped on nick change
+} s_slots[NSLOTS];
+
+static irc *s_irc;
+static chan *s_chans[NCHANS];
+
+
+static void
+u_setup(void)
+{
+	if (!(s_irc = irc_init()) || !lsi_ucb_init(s_irc)) {
+		fprintf(stderr, "failed to set up the user/channel base\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (size_t i = 0; i < NCHANS; i++) {
+		char name[16];
+		snprintf(name, sizeof name, "#chan%zu", i);
+		if (!(s_chans[i] = lsi_ucb_add_chan(s_irc, name))) {
+			fprintf(stderr, "failed to add '%s'\n", name);
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	memset(s_slots, 0, sizeof s_slots);
+	for (size_t i = 0; i < NSLOTS; i++)
+		mknick(i);
+
+	return;
+}
+
+static size_t
+u_run(void)
+{
+	char ident[64];
+
+	for (size_t n = 0; n < NOPS; n++) {
+		uint32_t r = bench_rand();
+		struct slot *s = &s_slots[r % NSLOTS];
+		unsigned ci = (r >> 12) % NCHANS, bit = 1u << ci;
+		chan *c = s_chans[ci];
+		user *u;
+
+		if (!s->chans) {
+			/* JOIN of someone we don't know yet */
+			snprintf(ident, sizeof ident, "%s!~u%u@host-%zu.example",
+			    s->nick, s->gen, (size_t)(s - s_slots));
+			if (!(u = lsi_ucb_add_user(s_irc, ident))
+			    || !lsi_ucb_add_memb(s_irc, c, u, ""))
+				goto fail;
+			s->chans = bit;
+			continue;
+		}
+
+		if (!(u = lsi_ucb_get_user(s_irc, s->nick, true)))
+			goto fail;
+
+		switch ((r >> 24) % 8) {
+		case 0: case 1: case 2: case 3:
+			/* JOIN or PART (the latter possibly the last one) */
+			if (s->chans & bit) {
+				lsi_ucb_drop_memb(s_irc, c, u, true, true);
+				s->chans &= ~bit;
+				s->ops &= ~bit;
+			} else {
+				if (!lsi_ucb_add_memb(s_irc, c, u, ""))
+					goto fail;
+				s->chans |= bit;
+			}
+		break;case 4: case 5:
+			{
+			/* NICK */
+			char old[sizeof s->nick];
+			strcpy(old, s->nick);
+			s->gen++;
+			mknick((size_t)(s - s_slots));
+			if (!lsi_ucb_rename_user(s_irc, old, s->nick, NULL))
+				goto fail;
+			}
+		break;case 6:
+			/* any message carrying the full ident */
+			snprintf(ident, sizeof ident, "%s!~u%u@host-%zu.example",
+			    s->nick, s->gen, (size_t)(s - s_slots));
+			if (!lsi_ucb_touch_user(s_irc, ident, true))
+				goto fail;
+		break;default:
+			/* MODE +o/-o */
+			if (!(s->chans & bit))
+				break;
+			if (!lsi_ucb_update_modepfx(s_irc, c, s->nick, '@',
+			    !(s->ops & bit)))
+				goto fail;
+			s->ops ^= bit;
+		}
+	}
+
+	return NOPS;
+
+fail:
+	fprintf(stderr, "ucbase_churn: unexpected failure\n");
+	exit(EXIT_FAILURE);
+}
+
+static void
+u_teardown(void)
+{
+	irc_dispose(s_irc);
+	s_irc = NULL;
+	return;
+}
+
+static void
+mknick(size_t i)
+{
+	struct slot *s = &s_slots[i];
+	static const char *const base[] = {
+		"alice", "Bob", "carol`", "DAVE", "erin[m]", "Frank_", "grace^",
+		"heidi|away"
+	};
+
+	snprintf(s->nick, sizeof s->nick, "%s%zu%s", base[(i + s->gen) % 8],
+	    i, s->gen % 2 ? "_" : "");
+	return;
+}
@@ -0,0 +1,297 @@
+/* lsibench.c - microbenchmarks for the hot paths of libsrsirc
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "bench_common.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <platform/base_misc.h>
+#include <platform/base_time.h>
+
+
+#ifndef BENCH_CORPUS
+# define BENCH_CORPUS "corpus/session.irc"
+#endif
+
+#define DEF_MINTIME_MS 300
+#define DEF_MINPASSES 5
+#define MAX_PASSES 10000
+
+
+struct cline *g_corpus;
+size_t g_ncorpus;
+
+static const struct bench *s_suites[] = {
+	g_bench_parse, g_bench_dispatch, g_bench_skmap, g_bench_ucbase,
+	g_bench_io
+};
+
+static uint64_t s_mintime_ns = DEF_MINTIME_MS * 1000000ull;
+static size_t s_minpasses = DEF_MINPASSES;
+static bool s_json;
+static uint32_t s_rnd;
+
+
+static void usage(FILE *str, const char *a0, int ec);
+static bool load_corpus(const char *path);
+static bool selected(const char *name, int nfilt, char **filt);
+static void runbench(const struct bench *b);
+static int cmpdbl(const void *a, const void *b);
+
+
+int
+main(int argc, char **argv)
+{
+	const char *corpus = BENCH_CORPUS;
+	bool list = false;
+	char *a0 = argv[0];
+
+	for (int ch; (ch = lsi_b_getopt(argc, argv, "c:t:p:jlh")) != -1;) {
+		switch (ch) {
+		      case 'c':
+			corpus = lsi_b_optarg();
+		break;case 't':
+			s_mintime_ns =
+			    strtoull(lsi_b_optarg(), NULL, 10) * 1000000ull;
+		break;case 'p':
+			s_minpasses = strtoul(lsi_b_optarg(), NULL, 10);
+		break;case 'j':
+			s_json = true;
+		break;case 'l':
+			list = true;
+		break;case 'h':
+			usage(stdout, a0, EXIT_SUCCESS);
+		break;case '?':default:
+			usage(stderr, a0, EXIT_FAILURE);
+		}
+	}
+	argc -= lsi_b_optind();
+	argv += lsi_b_optind();
+
+	if (!s_minpasses)
+		s_minpasses = 1;
+
+	if (!list && !load_corpus(corpus))
+		return EXIT_FAILURE;
+
+	if (!list && !s_json)
+		printf("# corpus: %s (%zu lines), allocations %s\n", corpus,
+		    g_ncorpus, bench_counting_allocs() ? "counted"
+		    : "not counted (needs glibc, no sanitizers)");
+
+	for (size_t i = 0; i < sizeof s_suites / sizeof *s_suites; i++)
+		for (const struct bench *b = s_suites[i]; b->name; b++) {
+			if (!selected(b->name, argc, argv))
+				continue;
+
+			if (list)
+				printf("%s\n", b->name);
+			else
+				runbench(b);
+		}
+
+	return EXIT_SUCCESS;
+}
+
+
+uint32_t
+bench_rand(void)
+{
+	/* xorshift32; good enough to pick keys, and the same everywhere */
+	s_rnd ^= s_rnd << 13;
+	s_rnd ^= s_rnd >> 17;
+	s_rnd ^= s_rnd << 5;
+	return s_rnd;
+}
+
+void
+bench_srand(uint32_t seed)
+{
+	s_rnd = seed ? seed : 2463534242u;
+	return;
+}
+
+
+static void
+usage(FILE *str, const char *a0, int ec)
+{
+	#define LH(STR) fputs(STR "\n", str)
+	LH("==============================");
+	LH("== lsibench - libsrsirc microbenchmarks ==");
+	LH("==============================");
+	fprintf(str, "usage: %s [-jlh] [-c <corpus>] [-t <ms>] [-p <num>] "
+	    "[<name prefix> ...]\n", a0);
+	LH("");
+	LH("\t-c <corpus>: Use the given file of IRC lines (default: "
+	    BENCH_CORPUS ")");
+	LH("\t-t <ms>: Keep each benchmark running for at least <ms> ms");
+	LH("\t-p <num>: ...and for at least <num> passes");
+	LH("\t-j: Machine-readable output, one JSON object per line");
+	LH("\t-l: List the benchmarks and terminate");
+	LH("\t-h: Display usage statement and terminate");
+	LH("");
+	LH("Only benchmarks whose name starts with one of the given prefixes");
+	LH("are run; all of them if none is given.");
+	#undef LH
+	exit(ec);
+}
+
+static bool
+load_corpus(const char *path)
+{
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		perror(path);
+		return false;
+	}
+
+	size_t sz = 0;
+	char buf[8192];
+	while (fgets(buf, sizeof buf, f)) {
+		size_t len = strcspn(buf, "\r\n");
+		buf[len] = '\0';
+		if (!len || strncmp(buf, "# ", 2) == 0)
+			continue;
+
+		if (g_ncorpus == sz) {
+			sz = sz ? sz * 2 : 1024;
+			struct cline *n = realloc(g_corpus, sz * sizeof *n);
+			if (!n)
+				goto fail;
+			g_corpus = n;
+		}
+
+		struct cline *l = &g_corpus[g_ncorpus];
+		if (!(l->line = malloc(len + 1)))
+			goto fail;
+
+		memcpy(l->line, buf, len + 1);
+		l->len = len;
+		l->body = l->line;
+		if (l->line[0] == '@' && (l->body = strchr(l->line, ' ')))
+			while (*l->body == ' ')
+				l->body++;
+
+		if (!l->body || !*l->body) {
+			fprintf(stderr, "%s: just tags: '%s'\n", path, buf);
+			free(l->line);
+			continue;
+		}
+
+		l->bodylen = len - (size_t)(l->body - l->line);
+		g_ncorpus++;
+	}
+
+	fclose(f);
+	if (!g_ncorpus) {
+		fprintf(stderr, "%s: no lines\n", path);
+		return false;
+	}
+
+	return true;
+
+fail:
+	perror("malloc");
+	fclose(f);
+	return false;
+}
+
+static bool
+selected(const char *name, int nfilt, char **filt)
+{
+	if (!nfilt)
+		return true;
+
+	for (int i = 0; i < nfilt; i++)
+		if (strncmp(name, filt[i], strlen(filt[i])) == 0)
+			return true;
+
+	return false;
+}
+
+static void
+runbench(const struct bench *b)
+{
+	static double nsop[MAX_PASSES];
+	uint64_t tottime = 0, totallocs = 0;
+	size_t npass = 0, ops = 0, totops = 0;
+
+	/* one pass to warm up caches and the allocator */
+	bench_srand(0);
+	if (b->setup)
+		b->setup();
+	b->run();
+	if (b->teardown)
+		b->teardown();
+
+	while (npass < MAX_PASSES
+	    && (npass < s_minpasses || tottime < s_mintime_ns)) {
+		bench_srand(0);
+		if (b->setup)
+			b->setup();
+
+		uint64_t a0 = bench_nallocs();
+		uint64_t t0 = lsi_b_mono_ns();
+		ops = b->run();
+		uint64_t t1 = lsi_b_mono_ns();
+		uint64_t a1 = bench_nallocs();
+
+		if (b->teardown)
+			b->teardown();
+
+		if (!ops)
+			break;
+
+		tottime += t1 - t0;
+		totallocs += a1 - a0;
+		totops += ops;
+		nsop[npass++] = (double)(t1 - t0) / ops;
+	}
+
+	if (!npass) {
+		fprintf(stderr, "%s: nothing to do\n", b->name);
+		return;
+	}
+
+	qsort(nsop, npass, sizeof *nsop, cmpdbl);
+	double med = npass % 2 ? nsop[npass/2]
+	    : (nsop[npass/2 - 1] + nsop[npass/2]) / 2;
+	double apo = (double)totallocs / totops;
+
+	if (s_json) {
+		printf("{\"name\":\"%s\",\"ns_per_op\":%.2f,"
+		    "\"ns_per_op_min\":%.2f,", b->name, med, nsop[0]);
+		if (bench_counting_allocs())
+			printf("\"allocs_per_op\":%.3f,", apo);
+		else
+			printf("\"allocs_per_op\":null,");
+		printf("\"ops_per_pass\":%zu,\"passes\":%zu}\n", ops, npass);
+	} else {
+		printf("%-24s %10.1f ns/op (min %9.1f) ", b->name, med,
+		    nsop[0]);
+		if (bench_counting_allocs())
+			printf("%8.3f allocs/op", apo);
+		else
+			printf("%8s allocs/op", "n/a");
+		printf(" %7zu ops x %zu\n", ops, npass);
+	}
+
+	fflush(stdout);
+	return;
+}
+
+static int
+cmpdbl(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+	return (x > y) - (x < y);
+}
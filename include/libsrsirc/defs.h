@@ -54,6 +54,14 @@
  *  (cf. irc_set_connect_timeout()) */
 #define DEF_SCTO_US 15000000ul
 
+/** \brief Default lifetime of cached DNS lookups in microsecs
+ *  (cf. irc_set_dns_ttl()) */
+#define DEF_DNSTTL_US 60000000ul
+
+/** \brief Default lifetime of cached DNS failures in microsecs
+ *  (cf. irc_set_dns_ttl()) */
+#define DEF_DNSNEGTTL_US 5000000ul
+
 /** \brief RFC1459 case mapping as per the 005 ISUPPORT spec.
  *
  * In the RFC1459 case mapping, which is the default, the characters
@@ -143,6 +151,89 @@
  * holds the complete context and state associated with an IRC connection. */
 typedef struct irc_s irc;
 
+/** \brief Socket tuning profile (cf. irc_set_sockopts())
+ *
+ * Zero-valued members leave the respective setting at the system default.
+ * Options the platform doesn't support are skipped with a warning. */
+struct irc_sockopts {
+	/** Disable Nagle's algorithm (TCP_NODELAY) */
+	bool nodelay;
+	/** Enable TCP keepalive and send the first probe after the connection
+	 *  was idle for this many seconds (SO_KEEPALIVE, TCP_KEEPIDLE) */
+	unsigned ka_idle_s;
+	/** Seconds between keepalive probes (TCP_KEEPINTVL) */
+	unsigned ka_intvl_s;
+	/** Number of unanswered probes after which the connection is
+	 *  considered dead (TCP_KEEPCNT) */
+	unsigned ka_cnt;
+	/** Milliseconds that sent data may remain unacknowledged before the
+	 *  connection is considered dead (TCP_USER_TIMEOUT, Linux only) */
+	unsigned user_timeout_ms;
+	/** Socket receive buffer size in bytes (SO_RCVBUF) */
+	unsigned rcvbuf;
+	/** Socket send buffer size in bytes (SO_SNDBUF) */
+	unsigned sndbuf;
+};
+
+/** \brief Performance counters of an IRC context (cf. irc_stats())
+ *
+ * All counters start at zero when the context is created and only ever go
+ * up, across reconnects.  Times are in nanoseconds on a monotonic clock. */
+struct irc_stats {
+	uint64_t bytes_in;    /**< \brief Bytes read from the server */
+	uint64_t bytes_out;   /**< \brief Bytes sent to the server */
+	uint64_t lines_in;    /**< \brief Protocol lines read */
+	uint64_t lines_out;   /**< \brief Protocol lines sent */
+	uint64_t reads;       /**< \brief Socket (or TLS) read calls */
+	uint64_t writes;      /**< \brief Socket (or TLS) write calls */
+	uint64_t compactions; /**< \brief Times the unprocessed input had to be
+	                           moved to the front of the read buffer */
+	uint64_t parse_errors; /**< \brief Lines that could not be tokenized */
+	uint64_t disp_core;   /**< \brief Messages dispatched to the core
+	                           (logon, nick, ping...) handlers */
+	uint64_t disp_track;  /**< \brief ...to the tracking handlers */
+	uint64_t disp_v3;     /**< \brief ...to the IRCv3 handlers */
+	uint64_t disp_user;   /**< \brief ...to irc_reg_msghnd() handlers */
+	uint64_t tokenize_ns; /**< \brief Time spent splitting lines into
+	                           tokens (and tags) */
+	uint64_t dispatch_ns; /**< \brief Time spent in message handlers, except
+	                           the tracking ones */
+	uint64_t track_ns;    /**< \brief Time spent updating the tracking state */
+};
+
+/** \brief Number of sub-buckets per power of two in struct irc_hist */
+#define IRC_HIST_SUB 8
+/** \brief Number of buckets in struct irc_hist */
+#define IRC_HIST_BUCKETS ((64 - 3 + 1) * IRC_HIST_SUB)
+
+/** \brief Latency histogram (cf. irc_set_histograms())
+ *
+ * Values (nanoseconds) are counted in log-linear buckets: each power of two
+ * is split into IRC_HIST_SUB equally wide buckets, so a bucket's width is
+ * at most 1/IRC_HIST_SUB of its lower bound.  Use irc_hist_bounds() to
+ * find out which values a bucket covers, or irc_hist_quantile(). */
+struct irc_hist {
+	uint64_t count;  /**< \brief Number of values recorded */
+	uint64_t sum_ns; /**< \brief Their sum */
+	uint64_t max_ns; /**< \brief The largest of them */
+	uint64_t bucket[IRC_HIST_BUCKETS]; /**< \brief The counts per bucket */
+};
+
+/** \brief Round trip figures of the lag monitor (cf. irc_set_lagmon())
+ *
+ * These start over with every connection. */
+struct irc_lag {
+	uint64_t cur_us;     /**< \brief Round trip time of the last PING that
+	                          was answered; 0 if none was, yet */
+	uint64_t min_us;     /**< \brief The smallest round trip time seen */
+	uint64_t ewma_us;    /**< \brief Moving average (weight 1/8 for the
+	                          latest) of the round trip times */
+	uint64_t pending_us; /**< \brief How long the PING currently waiting
+	                          for its PONG has been doing so; 0 if none */
+	uint64_t npings;     /**< \brief PINGs sent */
+	uint64_t npongs;     /**< \brief Matching PONGs received */
+};
+
 /** \brief Field array for the parts of incoming IRC protocol messages
  *
  * This is the array that holds the result of field-splitting an incoming
@@ -214,6 +305,24 @@ typedef bool (*fp_con_read)(tokarr *msg, void *tag);
  */ //XXX return true or false to proceed/abort?
 typedef void (*fp_mut_nick)(char *nick, size_t nick_sz);
 
+/** \brief Lag monitor callback type
+ *
+ * This is the type of a callback function that can be registered to be
+ * told when the lag crosses the threshold given to irc_set_lagmon().  The
+ * lag is the round trip time of the last PING, or the time the current one
+ * has been waiting for its PONG, whichever is larger.
+ *
+ * \param ctx    The IRC context
+ * \param lag    The current figures
+ * \param breach true if the lag just rose above the threshold, false if it
+ *               just went back down
+ * \param tag    Userdata as passed to irc_regcb_lag()
+ *
+ * \sa irc_regcb_lag(), irc_set_lagmon()
+ */
+typedef void (*fp_lag)(irc *ctx, const struct irc_lag *lag, bool breach,
+    void *tag);
+
 /** \brief User-registered protocol command callback type
  *
  * As an alternative to interpreting messages right after irc_read(), the user
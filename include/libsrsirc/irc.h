@@ -256,6 +256,9 @@ bool irc_online(irc *ctx);
  *
  * In the case of failure, an implicit call to irc_reset() is performed.
  *
+ * If the lag monitor is enabled (see irc_set_lagmon()), this is also where
+ * its PINGs are sent; a PING going unanswered for too long counts as failure.
+ *
  * \sa tokarr, irc_write(), irc_printf(), irc_reset()
  */
 int irc_read(irc *ctx, tokarr *tok, uint64_t to_us);
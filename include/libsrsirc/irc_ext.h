@@ -397,6 +397,116 @@ bool irc_set_ssl(irc *ctx, bool on);
  */
 void irc_set_connect_timeout(irc *ctx, uint64_t soft, uint64_t hard);
 
+/** \brief Set lifetimes of cached DNS lookups
+ *
+ * Name lookups done by irc_connect() (for the server, or the proxy if one
+ * is set) go through a small cache that is shared by all irc contexts of
+ * the process.  This way, a bunch of contexts reconnecting to the same
+ * server (or one context trying over and over) don't cause a resolver
+ * query each.  Failed lookups are cached as well, but for a shorter time.
+ *
+ * The system resolver doesn't tell us the actual TTLs of the records, so
+ * the lifetimes are what you set here.
+ *
+ * \param ttl_us    How long to keep a successful lookup, in microseconds
+ * \param negttl_us How long to keep a failed lookup, in microseconds
+ *
+ * Setting both to 0 makes this context bypass the cache altogether.
+ * Defaults are DEF_DNSTTL_US and DEF_DNSNEGTTL_US, respectively.
+ */
+void irc_set_dns_ttl(irc *ctx, uint64_t ttl_us, uint64_t negttl_us);
+
+/** \brief Resolve the server's (or proxy's) name in the background
+ *
+ * irc_connect() blocks while resolving.  Applications with an event loop
+ * can avoid that by calling this function first; it starts the lookup in
+ * a separate thread and returns a file descriptor that becomes readable
+ * once the result is in the DNS cache (see irc_set_dns_ttl()).  A
+ * subsequent irc_connect() will then not wait for the resolver.
+ *
+ * The descriptor yields one byte, '+' if the lookup succeeded, '-' if it
+ * failed.  It is the caller's job to close() it.
+ *
+ * If libsrsirc was built without thread support, the lookup happens
+ * synchronously and the returned descriptor is readable right away.
+ *
+ * \return A file descriptor as described above, or -1 on failure
+ */
+int irc_dns_prefetch(irc *ctx);
+
+/** \brief Tune the TCP socket(s) used for the IRC connection
+ *
+ * By default, a connection that silently died (e.g. because a NAT box in
+ * between lost its state, or the server was powered off) is only noticed
+ * when the application gives up waiting for a reply to a PING, or when the
+ * kernel gives up retransmitting, which may take many minutes.  With TCP
+ * keepalive and TCP_USER_TIMEOUT, the kernel can be asked to notice within
+ * seconds, without any IRC-level traffic.  For example:
+ * \code
+ *   struct irc_sockopts so = {
+ *       .nodelay = true,
+ *       .ka_idle_s = 10, .ka_intvl_s = 5, .ka_cnt = 3,
+ *       .user_timeout_ms = 30000
+ *   };
+ *   irc_set_sockopts(ctx, &so);
+ * \endcode
+ * A read on a connection found dead this way fails just as if the server
+ * had closed it.
+ *
+ * The options are applied to every socket created by irc_connect(),
+ * including the ones to proxies.  If a connection is currently
+ * established, they are applied to it as well.  Only the non-zero members
+ * are, though: going back to a system default (e.g. by passing NULL, or by
+ * zeroing a member that was set before) only affects future connections,
+ * the live one keeps the previously applied setting until it is closed.
+ *
+ * \param so   The profile to use (it's copied); NULL means system defaults
+ *             for future connections
+ * \sa struct irc_sockopts
+ */
+void irc_set_sockopts(irc *ctx, const struct irc_sockopts *so);
+
+/** \brief Hand the live connection over to another process
+ *
+ * Lets a program be replaced by (e.g.) a newer version of itself without
+ * dropping off IRC.  The state of `ctx' -- what the server told us at logon
+ * (including 005 attributes and IRCv3 capabilities), input that was read
+ * but not yet processed, and, if enabled, the channel/user tracking state
+ * -- is serialized and sent, along with the socket itself, over
+ * `unixsck', which must be a connected UNIX domain socket.  The receiving
+ * process picks it up using irc_handoff_recv() and continues reading where
+ * this one left off; the ircd won't notice a thing.
+ *
+ * On success, `ctx' is left disconnected (as if irc_reset() had been
+ * called, except that the connection stays up for the receiver).  On
+ * failure, it is left untouched.
+ *
+ * SSL connections can't be handed off, as there is no (portable) way to
+ * move the TLS session along with the socket.
+ *
+ * \param unixsck  A connected UNIX domain (stream) socket
+ * \return true if the connection has been handed off
+ * \sa irc_handoff_recv()
+ */
+bool irc_handoff_send(irc *ctx, int unixsck);
+
+/** \brief Take over a connection handed off by irc_handoff_send()
+ *
+ * `ctx' should be a fresh (or disconnected) context, configured the same
+ * way as the sender's was: things like the nickname, callbacks and message
+ * handlers are not transferred.  In particular, tracking state is only
+ * restored if irc_set_track() was used to enable tracking on `ctx'.
+ *
+ * When this succeeds, `ctx' is online and irc_read() resumes the stream
+ * exactly where the sender stopped reading.
+ *
+ * \param unixsck  A connected UNIX domain (stream) socket
+ * \param to_us    Timeout in microseconds (0 means wait forever)
+ * \return true if the connection was taken over
+ * \sa irc_handoff_send()
+ */
+bool irc_handoff_recv(irc *ctx, int unixsck, uint64_t to_us);
+
 /** \brief Set proxy server to use
  *
  * libsrsirc supports redirecting the IRC connection through a proxy server.
@@ -413,6 +523,58 @@ void irc_set_connect_timeout(irc *ctx, uint64_t soft, uint64_t hard);
  */
 bool irc_set_px(irc *ctx, const char *host, uint16_t port, int ptype);
 
+/** \brief Append a proxy server to the proxy chain
+ *
+ * Instead of a single proxy, a chain of proxies can be used; e.g. a SOCKS5
+ * proxy which we ask to connect to an HTTP proxy, which we then ask to
+ * connect to the IRC server.  The first proxy is the one set with
+ * irc_set_px() (or picked from the pool, see irc_add_pxpool()), further
+ * ones are added in order with this function.
+ *
+ * If no proxy is set yet, this is equivalent to irc_set_px().
+ * irc_set_px() clears the chain.
+ *
+ * \param host   Proxy host, may be an IPv4 or IPv6 address or a DNS name.
+ * \param port   Proxy port (1 <= `port' <= 65535)
+ * \param ptype   Proxy type, one of IRCPX_HTTP, IRCPX_SOCKS4, IRCPX_SOCKS5.
+ * \return true on success, false on failure (out of memory, illegal args,
+ *         too many proxies)
+ */
+bool irc_add_px(irc *ctx, const char *host, uint16_t port, int ptype);
+
+/** \brief Add an alternative for the first proxy
+ *
+ * The first proxy of the chain can be chosen from a pool of proxies.  The
+ * proxy set with irc_set_px() is the first member of the pool; this
+ * function adds more.
+ *
+ * For each proxy in the pool, we keep track of how long connecting and
+ * logging on took, and how often it failed.  On irc_connect(), the proxies
+ * are tried in order of their latency (penalized by their failure rate),
+ * with proxies that failed several times in a row put last for a while.
+ * Each but the last attempt is limited to the soft connect timeout (see
+ * irc_set_connect_timeout()), so a dead proxy doesn't eat up the whole
+ * hard timeout.
+ *
+ * irc_set_px() clears the pool.
+ *
+ * \return true on success, false on failure (out of memory, illegal args,
+ *         too many proxies)
+ */
+bool irc_add_pxpool(irc *ctx, const char *host, uint16_t port, int ptype);
+
+/** \brief Tell how a proxy in the pool has been doing
+ *
+ * \param idx    Index into the pool, in the order the proxies were added
+ * \param lat_us If non-NULL, the moving average of the time it took to get
+ *               through this proxy is stored here (in microseconds)
+ * \param nok    If non-NULL, the number of successful uses is stored here
+ * \param nfail  If non-NULL, the number of failed attempts is stored here
+ * \return true if `idx' is valid, false otherwise
+ */
+bool irc_pxpool_stat(irc *ctx, size_t idx, uint64_t *lat_us, unsigned *nok,
+    unsigned *nfail);
+
 /** \brief Set flags for the USER message at log on time.
  *
  * This is a bit mask for which RFC2812 defines two bits: bit 3 (i.e. 8) leads
@@ -625,6 +787,108 @@ bool irc_reg_msghnd(irc *ctx, const char *cmd, uhnd_fn hndfn, bool pre);
  */
 bool irc_eof(irc *ctx);
 
+/** \brief Get the performance counters of the context
+ *
+ * Counting is cheap (plain per-context increments, no locking), so this can
+ * be scraped periodically.  The counters must only be read from the thread
+ * using the context.
+ *
+ * \param dest   Where to put the counters
+ * \sa struct irc_stats
+ */
+void irc_stats(irc *ctx, struct irc_stats *dest);
+
+/** \brief Enable or disable latency histograms
+ *
+ * When enabled, the context records
+ *  - the time from the arrival of the data which completed a line (i.e. the
+ *    read that returned it) until the message handlers for that line have
+ *    finished, see irc_latency_hist(), and
+ *  - the run time of each handler registered with irc_reg_msghnd(), see
+ *    irc_handler_hist().
+ *
+ * Lines that sit in the read buffer until the application gets around to
+ * calling irc_read() again therefore show up with their whole waiting
+ * time, which is the point: a slow handler delays everything behind it.
+ *
+ * Disabling (or re-enabling) discards what has been recorded so far.
+ *
+ * \return true on success, false if memory could not be allocated.
+ */
+bool irc_set_histograms(irc *ctx, bool on);
+
+/** \brief Get the read-to-dispatch latency histogram
+ * \param dest   Where to put it
+ * \return false if histograms are not enabled (cf. irc_set_histograms())
+ */
+bool irc_latency_hist(irc *ctx, struct irc_hist *dest);
+
+/** \brief Get the run time histogram of a message handler
+ * \param cmd   The command the handler was registered for
+ * \param hndfn The handler, as given to irc_reg_msghnd()
+ * \param pre   Whether it was registered as a pre-handler
+ * \param dest  Where to put the histogram
+ * \return false if histograms are not enabled, or there is no such handler
+ */
+bool irc_handler_hist(irc *ctx, const char *cmd, uhnd_fn hndfn, bool pre,
+    struct irc_hist *dest);
+
+/** \brief Tell which values a histogram bucket covers
+ * \param idx  The bucket (< IRC_HIST_BUCKETS)
+ * \param lo   The smallest value counted in it
+ * \param hi   The largest value counted in it
+ */
+void irc_hist_bounds(size_t idx, uint64_t *lo, uint64_t *hi);
+
+/** \brief Estimate a quantile from a histogram
+ * \param q   The quantile, from 0.0 to 1.0 (e.g. 0.99 for the 99th
+ *            percentile)
+ * \return An upper bound for the q-quantile (nanoseconds), i.e. the upper
+ *         end of the bucket it falls in, but no more than the maximum seen.
+ *         0 if the histogram is empty.
+ */
+uint64_t irc_hist_quantile(const struct irc_hist *h, double q);
+
+/** \brief Enable or disable the built-in keepalive and lag monitor
+ *
+ * When enabled, irc_read() sends a PING every `interval_us' microseconds
+ * and matches the PONGs to measure the round trip time (see irc_lag()).
+ * It also answers the server's PINGs, so the application doesn't need to.
+ *
+ * If a PING is still unanswered when the next one would be due, the
+ * connection is considered dead: irc_read() resets it and fails.
+ *
+ * PINGs are only sent from within irc_read(), which therefore limits its
+ * timeout accordingly (and keeps reading until the timeout the caller gave
+ * is reached).  Applications that multiplex the socket themselves can use
+ * irc_lagmon_wait() to find out when to call irc_read() next.
+ *
+ * \param interval_us  Time between PINGs; 0 disables the monitor (default)
+ * \param threshold_us Lag above which the callback registered with
+ *                     irc_regcb_lag() is called; 0 for no threshold
+ * \sa struct irc_lag, fp_lag
+ */
+void irc_set_lagmon(irc *ctx, uint64_t interval_us, uint64_t threshold_us);
+
+/** \brief Register a callback for lag threshold breaches
+ * \param cb   The callback, or NULL to unregister
+ * \param tag  Userdata handed back to the callback as-is
+ * \sa fp_lag, irc_set_lagmon()
+ */
+void irc_regcb_lag(irc *ctx, fp_lag cb, void *tag);
+
+/** \brief Get the round trip figures of the lag monitor
+ * \param dest   Where to put them
+ * \return false if the lag monitor isn't enabled
+ */
+bool irc_lag(irc *ctx, struct irc_lag *dest);
+
+/** \brief Tell when the lag monitor needs irc_read() to be called
+ * \return Microseconds until then (at least 1), or 0 if the lag monitor
+ *         isn't enabled
+ */
+uint64_t irc_lagmon_wait(irc *ctx);
+
 /** @} */
 
 #endif /* LIBSRSIRC_IRC_EXT_H */
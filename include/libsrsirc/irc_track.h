@@ -25,6 +25,12 @@ struct chanrep {
 	uint64_t tscreate; /**< \brief Channel creation time (ms since Epoch) */
 	uint64_t tstopic; /**< \brief Topic timestamp (ms since Epoch) */
 	void *tag; /**< \brief Opaque user data */
+	/** \brief Set while the membership information may be outdated,
+	 * e.g. if it was restored by irc_track_load() and not yet confirmed
+	 * by NAMES.  (Added after 0.0.14, at the end so the other members
+	 * keep their offsets; the struct did grow, though, so code built
+	 * against 0.0.14 has to be recompiled.) */
+	bool desync;
 };
 
 /** \brief Object representation of an IRC user
@@ -57,6 +63,107 @@ typedef struct chanrep chanrep;
 /** \brief Convenience typedef for struct userrep. Probably a bad idea. */
 typedef struct userrep userrep;
 
+/** \brief Object representation of an entry in a channel's list mode
+ *
+ * List modes are those of CHANMODE_CLASS_A, like bans (+b), ban exceptions
+ * (+e) and invite exceptions (+I).
+ */
+struct listrep {
+	char mode; /**< \brief The mode char, e.g. 'b' */
+	const char *mask; /**< \brief The mask, e.g. "*!*@example.org" */
+	const char *setter; /**< \brief Who set it, or NULL if unknown */
+	uint64_t ts; /**< \brief When (seconds since Epoch), or 0 if unknown */
+};
+
+/** \brief Convenience typedef for struct listrep. */
+typedef struct listrep listrep;
+
+/** \brief Memory used by the tracking state, see irc_track_memusage()
+ *
+ * All figures are in bytes and count what was requested from the
+ * allocator, i.e. they do not include the allocator's own overhead.
+ */
+struct irc_trkmem {
+	size_t chans; /**< \brief Channel records, mode lists and topics */
+	size_t users; /**< \brief User records, nicknames, user/host names */
+	size_t membs; /**< \brief Membership records */
+	size_t maps;  /**< \brief Lookup structures (hash buckets and keys) */
+	size_t total; /**< \brief The sum of the above */
+};
+
+
+/** \defgroup trkev Tracking event types, see struct trkev
+ * @{ */
+#define TRKEV_CHAN_ADD 1    /**< \brief Started tracking `chan' (we joined) */
+#define TRKEV_CHAN_DROP 2   /**< \brief Stopped tracking `chan', including
+                                 all of its memberships */
+#define TRKEV_CHAN_SYNC 3   /**< \brief Membership of `chan' is complete
+                                 (end of NAMES) */
+#define TRKEV_USER_ADD 4    /**< \brief Started tracking `nick' */
+#define TRKEV_USER_DROP 5   /**< \brief Stopped tracking `nick' */
+#define TRKEV_USER_RENAME 6 /**< \brief `nick' is now known as `arg' */
+#define TRKEV_USER_UPDATE 7 /**< \brief Username, host or full name of
+                                 `nick' changed */
+#define TRKEV_MEMB_ADD 8    /**< \brief `nick' is now in `chan', with mode
+                                 prefix `arg' */
+#define TRKEV_MEMB_DROP 9   /**< \brief `nick' is no longer in `chan' */
+#define TRKEV_MEMB_CLEAR 10 /**< \brief All memberships of `chan' were
+                                 dropped (a NAMES reply follows) */
+#define TRKEV_MEMB_MODE 11  /**< \brief The mode prefix of `nick' in `chan'
+                                 changed to `arg' */
+#define TRKEV_MODE_SET 12   /**< \brief Channel mode `arg' (e.g. "k key")
+                                 was set on `chan' */
+#define TRKEV_MODE_UNSET 13 /**< \brief Channel mode `arg' was unset */
+#define TRKEV_MODE_CLEAR 14 /**< \brief All modes of `chan' except for list
+                                 modes (bans etc.) were dropped (a full mode
+                                 listing follows) */
+#define TRKEV_TOPIC 15      /**< \brief The topic of `chan' is now `arg'
+                                 (may be NULL), set by `nick' (may be NULL) */
+#define TRKEV_RESET 16      /**< \brief All tracking state was dropped */
+#define TRKEV_LIST_CLEAR 17 /**< \brief All entries of list mode `arg' (e.g.
+                                 "b") on `chan' were dropped (a full listing
+                                 of them follows) */
+/** @} */
+
+/** \brief A single change to the tracking state
+ *
+ * The members not mentioned in the description of the respective event type
+ * are NULL.  All strings are only valid for the duration of the callback.
+ */
+struct trkev {
+	int type;         /**< \brief One of the TRKEV_* constants */
+	const char *chan; /**< \brief Channel name, where applicable */
+	const char *nick; /**< \brief Nickname, where applicable */
+	const char *arg;  /**< \brief Type-dependent argument */
+};
+
+/** \brief Tracking event callback function type
+ *
+ * \param ctx   The context whose tracking state changed
+ * \param ev   Describes the change.  It has already been applied, i.e. the
+ *             accessors below reflect the new state (except in the case of
+ *             the *_DROP events, which are emitted just before the
+ *             respective objects go away)
+ * \param tag   The `tag' given to irc_regcb_trkevent()
+ *
+ * The callback must not call functions which change the tracking state (that
+ * includes irc_read()).
+ *
+ * \sa irc_regcb_trkevent()
+ */
+typedef void (*fp_trk_event)(irc *ctx, const struct trkev *ev, void *tag);
+
+/** \brief Tracking filter callback function type
+ *
+ * \param ctx   The context which is about to start tracking `chan'
+ * \param chan   Name of a channel we just joined
+ * \param tag   The `tag' given to irc_regcb_trkfilter()
+ * \return true if `chan' is to be tracked
+ *
+ * \sa irc_regcb_trkfilter()
+ */
+typedef bool (*fp_trk_filter)(irc *ctx, const char *chan, void *tag);
+
 
 /* the results of these functions (i.e. the strings pointed to by the various
  * members of the structs above) are only valid until the next time irc_read
@@ -87,6 +194,52 @@ size_t irc_all_chans(irc *ctx, chanrep *chanarr, size_t chanarr_cnt);
  *         only valid until the next call to irc_read() */
 chanrep *irc_chan(irc *ctx, chanrep *dest, const char *name);
 
+/** \brief Tell whether a channel mode is set on a channel
+ * \param chname   Name of the channel
+ * \param mode   The mode char, e.g. 'n', 'l' or 'b'
+ * \param mask   For list modes (CHANMODE_CLASS_A, e.g. +b), the entry to look
+ *               for, e.g. "*!*@example.org".  Ignored otherwise.
+ * \param arg   If non-NULL, the mode's argument (e.g. "123" for +l) is put
+ *              here, or NULL if it has none.  Only valid until the next call
+ *              to irc_read()
+ * \return true if the mode (or list entry) is set */
+bool irc_chanmode(irc *ctx, const char *chname, char mode, const char *mask,
+    const char **arg);
+
+/** \brief Retrieve the entries of a channel's list mode (e.g. the bans)
+ *
+ * Entries are picked up from MODE messages as well as from the replies to
+ * list queries (367/368 for +b, 348/349 for +e, 346/347 for +I), which
+ * replace what we had.  The tracker doesn't ask for the lists by itself; send
+ * e.g. "MODE #chan b" after joining if you need them to be complete.
+ *
+ * \param mode   The list mode, e.g. 'b'
+ * \param dest   Pointer into an array of at least `dest_cnt' elements
+ * \param dest_cnt   Maximum number of entries to retrieve
+ * \return The number of entries put into `dest'
+ *
+ * *NOTE:* The information contained in the retrieved listrep structures is
+ *         only valid until the next call to irc_read() */
+size_t irc_chanlist(irc *ctx, const char *chname, char mode, listrep *dest,
+    size_t dest_cnt);
+
+/** \brief Find an entry of a channel's list mode that matches someone
+ *
+ * The masks are indexed by their literal beginning or end, so this is cheap
+ * even for long lists; checking someone against thousands of bans doesn't
+ * mean trying thousands of masks.  Matching respects the casemapping.
+ *
+ * \param mode   The list mode, e.g. 'b'
+ * \param ident   Who to match, as nick!uname\@host.  If just a nick is given
+ *                and we know the user's uname and host, those are used.
+ * \param dest   If non-NULL, the matching entry is put here
+ * \return true if there is a matching entry
+ *
+ * *NOTE:* The information contained in the retrieved listrep structure is
+ *         only valid until the next call to irc_read() */
+bool irc_chanlist_match(irc *ctx, const char *chname, char mode,
+    const char *ident, listrep *dest);
+
 /** \brief Associate opaque user data with a channel
  *
  * This is a general-purpose mechanism to associate a piece of user-defined
@@ -177,6 +330,262 @@ size_t irc_all_members(irc *ctx, const char *chnam, userrep *userarr,
  *         only valid until the next call to irc_read() */
 userrep *irc_member(irc *ctx, userrep *dest, const char *chnam, const char *ident);
 
+/** \brief Restrict tracking to channels matching a list of patterns
+ *
+ * By default, every channel we're in is tracked, along with every user in
+ * it.  When only a few of many channels are of interest, this makes the
+ * tracker ignore the rest: no state is kept for them, and users we only
+ * share untracked channels with are not tracked either.
+ *
+ * Whether a channel is tracked is decided once, when we join it, so changes
+ * take effect for subsequently joined channels only.
+ *
+ * \param pats   Space- and/or comma-separated list of channel names or
+ *               wildcard patterns (see lsi_ut_globmatch()), e.g.
+ *               "#ops,#dev-*".  NULL to track all channels again.
+ * \return false on memory allocation failure (the filter is left unchanged)
+ * \sa irc_regcb_trkfilter()
+ */
+bool irc_track_filter(irc *ctx, const char *pats);
+
+/** \brief Register a callback to decide which channels to track
+ *
+ * Like irc_track_filter(), but more flexible.  If patterns are set as well,
+ * a channel is only tracked if it matches one of them *and* the callback
+ * agrees.
+ *
+ * \param cb   The callback, or NULL to unregister
+ * \param tag   Userdata handed back to the callback
+ * \sa fp_trk_filter
+ */
+void irc_regcb_trkfilter(irc *ctx, fp_trk_filter cb, void *tag);
+
+/** \brief Find out how much memory the tracking state uses
+ * \param dest   Where to put the figures.  This is kept up to date as the
+ *               state changes, so it is cheap to call. */
+void irc_track_memusage(irc *ctx, struct irc_trkmem *dest);
+
+/** \brief Limit the memory used by the tracking state
+ *
+ * When the limit is reached, the tracker stops adding members to channels.
+ * Instead, the channel that was about to grow loses all of its members and
+ * is marked desync (see struct chanrep); it stays tracked otherwise (topic,
+ * modes).  Its membership is tried again with the next NAMES reply for it,
+ * if we're below the limit by then.
+ *
+ * The limit is not enforced exactly: a single event may still add a few
+ * hundred bytes in excess of it.
+ *
+ * \param maxbytes   The limit, as per the `total' in struct irc_trkmem.
+ *                   0 (the default) means no limit.
+ */
+void irc_track_memlimit(irc *ctx, size_t maxbytes);
+
+/** \brief Set how long to hold on to users lost in a netsplit
+ *
+ * Users which QUIT with a netsplit reason ("<server> <server>") are not
+ * dropped right away.  Instead they are collected and removed in one pass
+ * once the burst of QUITs is over and `us' microseconds have passed since
+ * the last of them.  A user who rejoins a channel before that (the netjoin)
+ * simply keeps their place in it, less their channel modes, instead of being
+ * dropped and added back.  The channels they don't rejoin are left for them
+ * when the grace period is over, and they are dropped if that leaves them in
+ * none.  Until then, they still appear in the channels they were in.
+ *
+ * The users are only dropped as messages come in (or irc_read() times out),
+ * so a timeout on irc_read() makes this happen in time.
+ *
+ * \param us   Grace period in microseconds.  0 (the default) drops them as
+ *             soon as something other than a netsplit QUIT arrives.
+ */
+void irc_track_splitgrace(irc *ctx, uint64_t us);
+
+/** \brief Register a callback to be told about every tracking change
+ *
+ * This makes it possible to mirror the tracking state (e.g. into a database)
+ * incrementally, without re-parsing the messages that caused the changes,
+ * and without having to compare periodic irc_all_chans()/irc_all_users()
+ * dumps.  Events are delivered from within irc_read() (and irc_connect()),
+ * in the order the changes happen.
+ *
+ * \param cb   The callback, or NULL to unregister
+ * \param tag   Userdata handed back to the callback
+ * \sa fp_trk_event, struct trkev
+ */
+void irc_regcb_trkevent(irc *ctx, fp_trk_event cb, void *tag);
+
+/** \brief Cursor for iterating over channels, users or members
+ *
+ * Obtained from irc_cur_chans(), irc_cur_users() or irc_cur_members(), and
+ * advanced with irc_cur_nextchan() or irc_cur_nextuser(), respectively.
+ * Unlike irc_all_chans() and friends, this does not copy anything; each step
+ * yields a view of one element, which is only valid until the next step.
+ *
+ * Cursors live wherever the caller puts them (e.g. on the stack), need no
+ * cleanup, and any number of them may be in use at the same time.  Once the
+ * tracking state changes (i.e. after irc_read()), a cursor becomes invalid;
+ * stepping an invalid cursor yields NULL.  See irc_cur_valid().
+ *
+ * The members of this struct are implementation details.
+ */
+struct irc_cur {
+	irc *ctx;
+	void *map;
+	size_t bucket;
+	void *pos;
+	uint64_t gen;
+	chanrep cr;
+	userrep ur;
+};
+
+/** \brief Convenience typedef for struct irc_cur. */
+typedef struct irc_cur irc_cur;
+
+/** \brief Start iterating over all channels
+ * \param cur   The cursor to initialize */
+void irc_cur_chans(irc *ctx, irc_cur *cur);
+
+/** \brief Start iterating over all users
+ * \param cur   The cursor to initialize */
+void irc_cur_users(irc *ctx, irc_cur *cur);
+
+/** \brief Start iterating over the members of a channel
+ * \param cur   The cursor to initialize
+ * \param chnam   Name of the channel
+ * \return false if we don't know that channel (the cursor then yields
+ *         nothing) */
+bool irc_cur_members(irc *ctx, irc_cur *cur, const char *chnam);
+
+/** \brief Step a cursor obtained from irc_cur_chans()
+ * \return The next channel, or NULL at the end or if the cursor is no
+ *         longer valid */
+const chanrep *irc_cur_nextchan(irc_cur *cur);
+
+/** \brief Step a cursor obtained from irc_cur_users() or irc_cur_members()
+ * \return The next user or member (with `modepfx' set in the latter case),
+ *         or NULL at the end or if the cursor is no longer valid */
+const userrep *irc_cur_nextuser(irc_cur *cur);
+
+/** \brief Check whether the tracking state changed since `cur' was made
+ *
+ * This is a cheap comparison of generation counters.  Note that a cursor
+ * which reached the end stays valid until the tracking state changes.
+ *
+ * \return true if the cursor can still be stepped */
+bool irc_cur_valid(const irc_cur *cur);
+
+/** \brief Save a snapshot of the tracking state to a file
+ *
+ * Rebuilding the tracking state from scratch after a restart means a NAMES
+ * (and, for user details, WHO) for every channel, which ircds tend to
+ * rate-limit heavily.  Saving a snapshot before shutting down (or every so
+ * often) and restoring it with irc_track_load() after starting up avoids
+ * having to wait for that.
+ *
+ * The file is replaced atomically; a reader never sees a partial snapshot.
+ *
+ * \param path   Where to write the snapshot
+ * \return true on success, false on failure or if tracking isn't enabled
+ * \sa irc_track_load()
+ */
+bool irc_track_save(irc *ctx, const char *path);
+
+/** \brief Restore a snapshot of the tracking state made by irc_track_save()
+ *
+ * The file is mapped into memory.  If tracking is already enabled, its
+ * contents are merged into the tracking state right away, otherwise as soon
+ * as tracking gets enabled on the next connection (which happens on the 005
+ * carrying the server's CASEMAPPING, so usually still during the logon).
+ * Channels and users we already know are left alone.
+ *
+ * Restored channels are marked desync (see struct chanrep); the information
+ * about them is usable immediately, but may be outdated.  Once we (re)join
+ * such a channel, the NAMES reply that comes with it replaces the restored
+ * membership and clears the flag.
+ *
+ * \param path   Where to read the snapshot from
+ * \return true if the snapshot was (or will be) restored
+ * \sa irc_track_save()
+ */
+bool irc_track_load(irc *ctx, const char *path);
+
+/** \brief Opaque handle to a read-only snapshot of the tracking state
+ * \sa irc_track_publish() */
+typedef struct irc_tsnap irc_tsnap;
+
+/** \brief Publish a snapshot of the tracking state for other threads
+ *
+ * None of the functions above may be used by any thread other than the one
+ * calling irc_read(), as that is where the tracking state changes.  For
+ * threads which merely want to look at it (say, a web frontend showing who
+ * is in which channel), this function makes an immutable copy of the whole
+ * tracking state and publishes it, replacing the previously published one.
+ *
+ * Other threads obtain the current snapshot with irc_tsnap_get(), which
+ * takes no lock and never blocks, and release it with irc_tsnap_put().
+ * A replaced snapshot stays valid until its last holder releases it.
+ *
+ * This must be called from the thread that calls irc_read(); how often is up
+ * to the caller (e.g. after every irc_read() that returned a message
+ * which changed something, or once a second).  It never waits for other
+ * threads: if one is in the middle of irc_tsnap_get() (which is only ever
+ * a handful of instructions), the replaced snapshot is released by a later
+ * call to this function instead, or by irc_dispose().
+ *
+ * \return true on success, false on allocation failure or if tracking
+ *         isn't enabled
+ */
+bool irc_track_publish(irc *ctx);
+
+/** \brief Obtain the most recently published tracking snapshot
+ *
+ * May be called from any thread, but not during or after irc_dispose() on
+ * the same context.
+ *
+ * \return The snapshot, or NULL if none was published yet.  A non-NULL
+ *         result must be released with irc_tsnap_put() once no longer
+ *         needed; until then, it (and everything retrieved from it) remains
+ *         valid and unchanged.
+ */
+const irc_tsnap *irc_tsnap_get(irc *ctx);
+
+/** \brief Release a snapshot obtained with irc_tsnap_get()
+ * \param snap   The snapshot to release, may be NULL */
+void irc_tsnap_put(const irc_tsnap *snap);
+
+/** \brief Tell snapshots apart
+ * \return The sequence number of `snap'; it increases by one with every
+ *         call to irc_track_publish() on the same context. */
+uint64_t irc_tsnap_seq(const irc_tsnap *snap);
+
+/** \brief Retrieve all channels contained in a snapshot
+ * \param num   Pointer to where the number of channels is stored
+ * \return An array of `*num' channels, sorted by name */
+const chanrep *irc_tsnap_chans(const irc_tsnap *snap, size_t *num);
+
+/** \brief Look up a channel in a snapshot
+ * \param name   Name of the channel
+ * \return The channel, or NULL if the snapshot doesn't contain it */
+const chanrep *irc_tsnap_chan(const irc_tsnap *snap, const char *name);
+
+/** \brief Retrieve all users contained in a snapshot
+ * \param num   Pointer to where the number of users is stored
+ * \return An array of `*num' users, sorted by nickname */
+const userrep *irc_tsnap_users(const irc_tsnap *snap, size_t *num);
+
+/** \brief Look up a user in a snapshot
+ * \param ident   Nickname or nick!user\@host-style identity of the user
+ * \return The user, or NULL if the snapshot doesn't contain them */
+const userrep *irc_tsnap_user(const irc_tsnap *snap, const char *ident);
+
+/** \brief Retrieve the members of a channel contained in a snapshot
+ * \param chnam   Name of the channel
+ * \param num   Pointer to where the number of members is stored
+ * \return An array of `*num' members (with `modepfx' set), sorted by
+ *         nickname, or NULL if the snapshot doesn't contain the channel */
+const userrep *irc_tsnap_members(const irc_tsnap *snap, const char *chnam,
+    size_t *num);
+
 /* for debugging */
 
 /** \brief Dump tracking state for debugging purposes
@@ -22,6 +22,7 @@
  * int lsi_ut_istrncmp(const char *n1, const char *n2, size_t len, int casemap);
  * char lsi_ut_tolower(char c, int casemap);
  * void lsi_ut_strtolower(char *dest, size_t destsz, const char *str, int cmap);
+ * bool lsi_ut_globmatch(const char *pat, const char *str, int casemap);
  *
  * void lsi_ut_parse_hostspec(char *hoststr, size_t hoststr_sz, uint16_t *port,
  *     bool *ssl, const char *hostspec);
@@ -77,6 +78,14 @@ int lsi_ut_istrncmp(const char *n1, const char *n2, size_t len, int casemap);
 /** \brief casemap-aware translate a char to lowercase, if uppercase */
 char lsi_ut_tolower(char c, int casemap);
 
+/** \brief case-insensitively match a string against an IRC-style wildcard
+ * pattern (`*' matches any sequence of characters, `?' any single one)
+ * \param pat   The pattern, e.g. "#foo-*" or "*!*\@*.example.org"
+ * \param str   The string to match
+ * \param casemap   CMAP_* constant (usually what irc_casemap() returns)
+ * \return true if `str' matches `pat' */
+bool lsi_ut_globmatch(const char *pat, const char *str, int casemap);
+
 /** \brief casemap-aware translate a string to lowercase
  * \param dest   buffer where the resulting lowercase string will be put in
  * \param destsz   size of `dest` (\0-termination is ensured)
@@ -185,6 +194,55 @@ void lsi_ut_mut_nick(char *nick, size_t nick_sz);
  */
 char **lsi_ut_parse_MODE(irc *ctx, tokarr *msg, size_t *num, bool is324);
 
+/** \brief One mode change, as produced by lsi_ut_modeiter_next() */
+typedef struct modechg {
+	bool enab;   /**< true if the mode is being set, false if unset */
+	char mode;   /**< The mode letter */
+	int cls;     /**< One of the CHANMODE_CLASS_* constants, or 0 for
+	              *   modes which grant channel privileges (e.g. +o) */
+	char pfx;    /**< For the latter, the corresponding nick prefix
+	              *   (e.g. '@'), '\0' otherwise */
+	const char *arg; /**< The argument, or NULL if none.  This points into
+	                  *   the tokarr being iterated over */
+} modechg;
+
+/** \brief State of an iteration over the mode changes in a MODE message */
+typedef struct modeiter {
+	tokarr *msg;
+	const char *next; /* next mode char */
+	size_t argi;      /* index of the next unused argument in msg */
+	bool enab;
+} modeiter;
+
+/** \brief Iterate over the mode changes in a MODE (or 324) message
+ *
+ * This does the same as lsi_ut_parse_MODE(), but without allocating (or
+ * copying) anything: the mode changes are produced one at a time, with
+ * their arguments pointing directly into `msg'.
+ *
+ * \code
+ * modeiter it;
+ * modechg mc;
+ * lsi_ut_modeiter_init(ctx, &it, &msg, false);
+ * while (lsi_ut_modeiter_next(ctx, &it, &mc))
+ *         printf("%c%c %s\n", mc.enab ? '+' : '-', mc.mode,
+ *             mc.arg ? mc.arg : "");
+ * \endcode
+ *
+ * \param it   The iterator to initialize
+ * \param msg   The MODE or 324 message.  Must remain unchanged while
+ *              iterating.
+ * \param is324   As for lsi_ut_parse_MODE()
+ */
+void lsi_ut_modeiter_init(irc *ctx, modeiter *it, tokarr *msg, bool is324);
+
+/** \brief Produce the next mode change
+ * \param it   The iterator (see lsi_ut_modeiter_init())
+ * \param dest   Where to put the mode change
+ * \return true if a mode change was produced, false if there are no more.
+ *         Modes the server didn't announce are skipped. */
+bool lsi_ut_modeiter_next(irc *ctx, modeiter *it, modechg *dest);
+
 /** \brief Determine class of a channel mode
  * \param c   The channel mode letter (b, n, etc) to classify
  * \return If `c` is a channel mode supported by the IRC server we're talking
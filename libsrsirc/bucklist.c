@@ -251,6 +251,33 @@ lsi_bucklist_next(bucklist *l, char **key, void **val)
 	return true;
 }
 
+bool
+lsi_bucklist_cfirst(bucklist *l, void **pos, char **key, void **val)
+{
+	struct pl_node *n = l->head;
+	if (!(*pos = n))
+		return false;
+
+	if (key) *key = n->key;
+	if (val) *val = n->val;
+
+	return true;
+}
+
+bool
+lsi_bucklist_cnext(void **pos, char **key, void **val)
+{
+	struct pl_node *n = *pos;
+	if (!n || !(n = n->next))
+		return false;
+
+	*pos = n;
+	if (key) *key = n->key;
+	if (val) *val = n->val;
+
+	return true;
+}
+
 void
 lsi_bucklist_del_iter(bucklist *l)
 {
@@ -265,6 +292,18 @@ lsi_bucklist_del_iter(bucklist *l)
 	return;
 }
 
+size_t
+lsi_bucklist_basesz(void)
+{
+	return sizeof (struct bucklist);
+}
+
+size_t
+lsi_bucklist_elemsz(void)
+{
+	return sizeof (struct pl_node);
+}
+
 void
 lsi_bucklist_dump(bucklist *l, bucklist_op_fn op)
 {
@@ -288,17 +327,14 @@ lsi_bucklist_dump(bucklist *l, bucklist_op_fn op)
 }
 
 
+/* compare the nick part of two idents (i.e. up to '!' or '@'), the way
+ * the cmap tables do */
 static bool
 pfxeq(const char *n1, const char *n2, const uint8_t *cmap)
 {
-	unsigned char c1, c2;
-	while ((c1 = cmap[(unsigned char)*n1]) & /* avoid short circuit */
-	    (c2 = cmap[(unsigned char)*n2])) {
-		if (c1 != c2)
-			return false;
-
-		n1++; n2++;
-	}
+	size_t l1 = strcspn(n1, "!@");
+	if (strcspn(n2, "!@") != l1)
+		return false;
 
-	return c1 == c2;
+	return lsi_cmap_mismatch(n1, n2, l1, lsi_cmap_casemap(cmap)) == l1;
 }
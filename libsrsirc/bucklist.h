@@ -38,6 +38,16 @@ bool lsi_bucklist_first(bucklist *l, char **key, void **val);
 bool lsi_bucklist_next(bucklist *l, char **key, void **val);
 void lsi_bucklist_del_iter(bucklist *l);
 
+/* iteration with external state, any number at a time.  `pos' is opaque;
+ * the list must not be modified while a cursor is in use */
+bool lsi_bucklist_cfirst(bucklist *l, void **pos, char **key, void **val);
+bool lsi_bucklist_cnext(void **pos, char **key, void **val);
+
+/* memory footprint (in bytes, allocator overhead not included) of an empty
+ * list, and what each element adds on top (not counting its key) */
+size_t lsi_bucklist_basesz(void);
+size_t lsi_bucklist_elemsz(void);
+
 /* debug */
 void lsi_bucklist_dump(bucklist *l, bucklist_op_fn op);
 
@@ -6,7 +6,15 @@
 # include <config.h>
 #endif
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
+
+#if __SSE2__
+# include <emmintrin.h>
+#endif
+
+#include <libsrsirc/defs.h>
 
 #include "cmap.h"
 
@@ -60,11 +68,11 @@ static const uint8_t s_lower_rfc1459[256] = {
 	'\0',  'A',  'B',  'C',  'D',  'E',  'F',  'G',
 	 'H',  'I',  'J',  'K',  'L',  'M',  'N',  'O',
 	 'P',  'Q',  'R',  'S',  'T',  'U',  'V',  'W',
-	 'X',  'Y',  'Z',  '[', '\\',  ']', 0x5e, 0x5f,
+	 'X',  'Y',  'Z',  '[', '\\',  ']',  '^', 0x5f,
 	0x60,  'A',  'B',  'C',  'D',  'E',  'F',  'G',
 	 'H',  'I',  'J',  'K',  'L',  'M',  'N',  'O',
 	 'P',  'Q',  'R',  'S',  'T',  'U',  'V',  'W',
-	 'X',  'Y',  'Z',  '[', '\\',  ']', 0x7e, 0x7f,
+	 'X',  'Y',  'Z',  '[', '\\',  ']',  '^', 0x7f,
 	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
 	0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
 	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
@@ -95,11 +103,11 @@ static const uint8_t s_lower_strict_rfc1459[256] = {
 	'\0',  'A',  'B',  'C',  'D',  'E',  'F',  'G',
 	 'H',  'I',  'J',  'K',  'L',  'M',  'N',  'O',
 	 'P',  'Q',  'R',  'S',  'T',  'U',  'V',  'W',
-	 'X',  'Y',  'Z',  '[', '\\',  ']',  '^', 0x5f,
+	 'X',  'Y',  'Z',  '[', '\\',  ']', 0x5e, 0x5f,
 	0x60,  'A',  'B',  'C',  'D',  'E',  'F',  'G',
 	 'H',  'I',  'J',  'K',  'L',  'M',  'N',  'O',
 	 'P',  'Q',  'R',  'S',  'T',  'U',  'V',  'W',
-	 'X',  'Y',  'Z',  '[', '\\',  ']',  '^', 0x7f,
+	 'X',  'Y',  'Z',  '[', '\\',  ']', 0x7e, 0x7f,
 	0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
 	0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
 	0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
@@ -120,3 +128,119 @@ static const uint8_t s_lower_strict_rfc1459[256] = {
 
 const uint8_t *g_cmap[3] =
     { s_lower_rfc1459, s_lower_strict_rfc1459, s_lower_ascii };
+
+
+/* All three casemappings fold a single range of characters onto the one 32
+ * above it: 'A'..'Z' for ascii, up to '^' for rfc1459 (taking "[\]^" to
+ * "{|}~"), and up to ']' for strict-rfc1459.  That is something we can do
+ * on a whole vector of characters at once. */
+static char
+foldhi(int casemap)
+{
+	return casemap == CMAP_RFC1459 ? '^'
+	    : casemap == CMAP_STRICT_RFC1459 ? ']' : 'Z';
+}
+
+int
+lsi_cmap_casemap(const uint8_t *tbl)
+{
+	for (int i = 0; i < 3; i++)
+		if (g_cmap[i] == tbl)
+			return i;
+
+	return CMAP_ASCII;
+}
+
+/* bytes of `x' in 'A'..hi get 0x20 added, eight at a time */
+static uint64_t
+fold64(uint64_t x, char hi)
+{
+	const uint64_t ones = UINT64_C(0x0101010101010101);
+	const uint64_t high = ones * 0x80;
+	uint64_t y = x & ~high; // so there are no carries between the bytes
+	uint64_t ge = y + ones * (0x80 - 'A');
+	uint64_t gt = y + ones * (0x7f - (unsigned char)hi);
+	uint64_t m = ge & ~gt & ~x & high;
+
+	return x + (m >> 2);
+}
+
+/* skip over the leading blocks of 16 (if we have SSE2) or 8 bytes that are
+ * equal; the index of the first block that isn't (or of the remainder that
+ * doesn't fill a block) is returned */
+static size_t
+mismatch_vec(const char *a, const char *b, size_t len, int casemap)
+{
+	char hi = foldhi(casemap);
+	size_t i = 0;
+
+#if __SSE2__
+	const __m128i lo16 = _mm_set1_epi8('A' - 1);
+	const __m128i hi16 = _mm_set1_epi8(hi + 1);
+	const __m128i d16 = _mm_set1_epi8('a' - 'A');
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+
+		/* signed compares; bytes >= 0x80 are never in range */
+		x = _mm_add_epi8(x, _mm_and_si128(d16, _mm_and_si128(
+		    _mm_cmpgt_epi8(x, lo16), _mm_cmplt_epi8(x, hi16))));
+		y = _mm_add_epi8(y, _mm_and_si128(d16, _mm_and_si128(
+		    _mm_cmpgt_epi8(y, lo16), _mm_cmplt_epi8(y, hi16))));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff)
+			return i;
+	}
+#endif
+
+	for (; i + 8 <= len; i += 8) {
+		uint64_t x, y;
+		memcpy(&x, a + i, sizeof x);
+		memcpy(&y, b + i, sizeof y);
+		if (x != y && fold64(x, hi) != fold64(y, hi))
+			break;
+	}
+
+	return i;
+}
+
+size_t
+lsi_cmap_mismatch(const char *a, const char *b, size_t len, int casemap)
+{
+	/* the vector part skips the block(s) that are equal; what's left
+	 * (including the block with the difference) we do one by one */
+	size_t i = mismatch_vec(a, b, len, casemap);
+	char hi = foldhi(casemap);
+
+	for (; i < len; i++) {
+		char c1 = a[i], c2 = b[i];
+		if (c1 == c2)
+			continue;
+
+		if (c1 >= 'A' && c1 <= hi)
+			c1 += 'a' - 'A';
+		if (c2 >= 'A' && c2 <= hi)
+			c2 += 'a' - 'A';
+		if (c1 != c2)
+			break;
+	}
+
+	return i;
+}
+
+size_t
+lsi_cmap_mismatch_ref(const char *a, const char *b, size_t len, int casemap)
+{
+	const uint8_t *tbl = g_cmap[casemap];
+	size_t i = 0;
+
+	for (; i < len; i++) {
+		unsigned char c1 = a[i], c2 = b[i];
+		/* '!' and '@' map to 0 in the tables, see top */
+		if (c1 != c2 && (tbl[c1] != tbl[c2] || !tbl[c1]))
+			break;
+	}
+
+	return i;
+}
@@ -6,7 +6,24 @@
 #define LIBSRSIRC_CMAP_H 1
 
 
+#include <stddef.h>
+#include <stdint.h>
+
+
 extern const uint8_t *g_cmap[];
 
+/* the CMAP_* constant `tbl' (one of g_cmap) is for */
+int lsi_cmap_casemap(const uint8_t *tbl);
+
+/* index of the first of the first `len' bytes at `a' and `b' that differ
+ * under casemapping `casemap' (CMAP_*), or `len' if there is no difference.
+ * NULs are not special.  this looks at 8 or 16 bytes at a time */
+size_t lsi_cmap_mismatch(const char *a, const char *b, size_t len,
+    int casemap);
+
+/* the same, one byte at a time through g_cmap; the reference for the above */
+size_t lsi_cmap_mismatch_ref(const char *a, const char *b, size_t len,
+    int casemap);
+
 
 #endif /* LIBSRSIRC_CMAP_H */
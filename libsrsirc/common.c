@@ -27,9 +27,11 @@
 
 #include <libsrsirc/defs.h>
 
+#include "resolv.h"
+
 
 static int tryhost(struct addrlist *ai, char *remaddr, size_t remaddr_sz,
-    uint16_t *peerport, uint64_t to_us);
+    uint16_t *peerport, uint64_t to_us, const struct irc_sockopts *so);
 
 
 size_t
@@ -45,12 +47,13 @@ lsi_com_strCchr(const char *str, char c)
 
 int
 lsi_com_consocket(const char *host, uint16_t port, char *remaddr,
-    size_t remaddr_sz, uint16_t *peerport, uint64_t softto, uint64_t hardto)
+    size_t remaddr_sz, uint16_t *peerport, uint64_t softto, uint64_t hardto,
+    uint64_t dnsttl, uint64_t dnsnegttl, const struct irc_sockopts *so)
 {
 	uint64_t hardtend = hardto ? lsi_b_tstamp_us() + hardto : 0;
 
 	struct addrlist *alist;
-	int count = lsi_b_mkaddrlist(host, port, &alist);
+	int count = lsi_res_lookup(host, port, dnsttl, dnsnegttl, &alist);
 	if (count <= 0)
 		return -1;
 
@@ -63,13 +66,13 @@ lsi_com_consocket(const char *host, uint16_t port, char *remaddr,
 
 		if (lsi_com_check_timeout(hardtend, &trem)) {
 			W("hard timeout");
-			return false;
+			break;
 		}
 
 		if (trem > softto)
 			trem = softto;
 
-		sck = tryhost(ai, remaddr, remaddr_sz, peerport, trem);
+		sck = tryhost(ai, remaddr, remaddr_sz, peerport, trem, so);
 
 		if (sck != -1)
 			break;
@@ -80,9 +83,45 @@ lsi_com_consocket(const char *host, uint16_t port, char *remaddr,
 	return sck;
 }
 
+/* apply what's set in `so' (may be NULL) to `sck'.  failing to set an
+ * option is not fatal, but the result tells whether everything went in */
+bool
+lsi_com_sockopts(int sck, const struct irc_sockopts *so)
+{
+	bool ok = true;
+	if (!so)
+		return true;
+
+	if (so->nodelay)
+		ok = lsi_b_sockopt(sck, LSI_B_SO_NODELAY, 1) && ok;
+
+	if (so->ka_idle_s) {
+		ok = lsi_b_sockopt(sck, LSI_B_SO_KEEPALIVE, 1) && ok;
+		ok = lsi_b_sockopt(sck, LSI_B_SO_KEEPIDLE, so->ka_idle_s) && ok;
+	}
+
+	if (so->ka_intvl_s)
+		ok = lsi_b_sockopt(sck, LSI_B_SO_KEEPINTVL, so->ka_intvl_s) && ok;
+
+	if (so->ka_cnt)
+		ok = lsi_b_sockopt(sck, LSI_B_SO_KEEPCNT, so->ka_cnt) && ok;
+
+	if (so->user_timeout_ms)
+		ok = lsi_b_sockopt(sck, LSI_B_SO_USERTIMEOUT,
+		    so->user_timeout_ms) && ok;
+
+	if (so->rcvbuf)
+		ok = lsi_b_sockopt(sck, LSI_B_SO_RCVBUF, so->rcvbuf) && ok;
+
+	if (so->sndbuf)
+		ok = lsi_b_sockopt(sck, LSI_B_SO_SNDBUF, so->sndbuf) && ok;
+
+	return ok;
+}
+
 static int
 tryhost(struct addrlist *ai, char *remaddr, size_t remaddr_sz,
-    uint16_t *peerport, uint64_t to_us)
+    uint16_t *peerport, uint64_t to_us, const struct irc_sockopts *so)
 {
 	D("trying host '%s' ('%s')", ai->reqname, ai->addrstr);
 	int sck = lsi_b_socket(ai->ipv6);
@@ -90,6 +129,11 @@ tryhost(struct addrlist *ai, char *remaddr, size_t remaddr_sz,
 	if (sck == -1)
 		return -1;
 
+	/* before connecting, so the buffer sizes make it into the
+	 * window scale negotiation */
+	if (!lsi_com_sockopts(sck, so))
+		W("failed to apply (some) socket options");
+
 	if (!lsi_b_blocking(sck, false))
 		W("failed to set socket non-blocking, timeout will not work");
 
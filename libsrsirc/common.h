@@ -10,6 +10,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include <libsrsirc/defs.h>
+
 
 #define COUNTOF(ARR) (sizeof (ARR) / sizeof (ARR)[0])
 
@@ -27,7 +29,9 @@ size_t lsi_com_strCchr(const char *dst, char c);
 bool lsi_com_check_timeout(uint64_t tend, uint64_t *trem);
 
 int lsi_com_consocket(const char *host, uint16_t port, char *remaddr,
-    size_t remaddr_sz, uint16_t *peerport, uint64_t softto, uint64_t hardto);
+    size_t remaddr_sz, uint16_t *peerport, uint64_t softto, uint64_t hardto,
+    uint64_t dnsttl, uint64_t dnsnegttl, const struct irc_sockopts *so);
+bool lsi_com_sockopts(int sck, const struct irc_sockopts *so);
 
 bool lsi_com_update_strprop(char **field, const char *val);
 
@@ -29,7 +29,9 @@
 
 #include "common.h"
 #include "io.h"
+#include "probes.h"
 #include "px.h"
+#include "resolv.h"
 
 #include <libsrsirc/util.h>
 
@@ -38,6 +40,26 @@
 #define ON 1
 
 
+/* a proxy that failed this many times in a row is considered unhealthy
+ * and put at the end of the line for PX_COOLDOWN_US */
+#define PX_MAXCFAIL 3
+#define PX_COOLDOWN_US 60000000ul
+
+
+static void keep_sslsess(iconn *ctx);
+static void drop_sslsess(iconn *ctx);
+static bool px_connect(iconn *ctx, uint16_t realport, uint64_t softto_us,
+    uint64_t tend);
+static bool px_try(iconn *ctx, struct pxent *px, uint16_t realport,
+    uint64_t softto_us, uint64_t tend);
+static void px_feedback(struct pxent *px, bool ok, uint64_t lat_us);
+static void rank_pxpool(iconn *ctx, size_t *order);
+static bool px_valid(const char *host, uint16_t port, int ptype);
+static bool add_px(struct pxent *arr, size_t *cnt, size_t max,
+    const char *host, uint16_t port, int ptype);
+static void clear_px(struct pxent *arr, size_t *cnt);
+
+
 iconn *
 lsi_conn_init(void)
 {
@@ -55,10 +77,9 @@ lsi_conn_init(void)
 
 	errno = preverrno;
 	r->rctx.wptr = r->rctx.eptr = r->rctx.workbuf;
+	r->rctx.tarrive = 0;
 	r->port = 0;
-	r->phost = NULL;
-	r->pport = 0;
-	r->ptype = -1;
+	r->npxpool = r->npxchain = r->pxcur = 0;
 	r->online = false;
 	r->eof = false;
 	r->colon_trail = false;
@@ -66,6 +87,11 @@ lsi_conn_init(void)
 	r->sh.shnd = NULL;
 	r->sh.sck = -1;
 	r->sctx = NULL;
+	r->ssess = NULL;
+	r->dnsttl_us = DEF_DNSTTL_US;
+	r->dnsnegttl_us = DEF_DNSNEGTTL_US;
+	memset(&r->sockopts, 0, sizeof r->sockopts);
+	memset(&r->stats, 0, sizeof r->stats);
 
 	D("Connection context initialized (%p)", (void *)r);
 
@@ -88,6 +114,7 @@ lsi_conn_reset(iconn *ctx)
 
 	if (ctx->ssl && ctx->sh.shnd) {
 		D("shutting down ssl");
+		keep_sslsess(ctx);
 		lsi_b_sslfin(ctx->sh.shnd);
 		ctx->sh.shnd = NULL;
 	}
@@ -111,7 +138,8 @@ lsi_conn_dispose(iconn *ctx)
 	lsi_conn_set_ssl(ctx, false); //dispose ssl context if existing
 
 	free(ctx->host);
-	free(ctx->phost);
+	clear_px(ctx->pxpool, &ctx->npxpool);
+	clear_px(ctx->pxchain, &ctx->npxchain);
 
 	D("disposed");
 	free(ctx);
@@ -132,88 +160,65 @@ lsi_conn_connect(iconn *ctx, uint64_t softto_us, uint64_t hardto_us)
 	if (!realport)
 		realport = ctx->ssl ? DEF_PORT_SSL : DEF_PORT_PLAIN;
 
-	char *host = ctx->ptype != -1 ? ctx->phost : ctx->host;
-	uint16_t port = ctx->ptype != -1 ? ctx->pport : realport;
-
 	{
 		char ps[64];
 		ps[0] = '\0';
-		if (ctx->ptype != -1)
-			snprintf(ps, sizeof ps, " via %s:%s:%" PRIu16,
-			    lsi_px_typestr(ctx->ptype), ctx->phost, ctx->pport);
+		if (ctx->npxpool)
+			snprintf(ps, sizeof ps, " via %zu proxy candidate(s), "
+			    "chain length %zu", ctx->npxpool, ctx->npxchain + 1);
 
 		I("wanna connect to %s:%"PRIu16"%s, "
 		    "sto: %"PRIu64"us, hto: %"PRIu64"us",
 		    ctx->host, realport, ps, softto_us, hardto_us);
 	}
 
-	char peerhost[256];
-	uint16_t peerport;
-
-	sckhld sh;
-	sh.sck = lsi_com_consocket(host, port, peerhost, sizeof peerhost,
-	    &peerport, softto_us, hardto_us);
-	sh.shnd = NULL;
-
-	if (sh.sck < 0) {
-		W("lsi_com_consocket failed for %s:%"PRIu16"", host, port);
-		return false;
-	}
-
-	D("connected socket %d for %s:%"PRIu16"", sh.sck, host, port);
+	ctx->rctx.wptr = ctx->rctx.eptr = ctx->rctx.workbuf;
+	ctx->sh.shnd = NULL;
 
-	ctx->sh = sh; //must be set here for px_logon
+	LSI_PROBE3(connect_start, ctx->host, realport, ctx->npxpool);
 
-	uint64_t trem = 0;
-	if (ctx->ptype != -1) {
-		if (lsi_com_check_timeout(tend, &trem)) {
-			W("timeout");
-			lsi_b_close(sh.sck);
-			ctx->sh.sck = -1;
+	if (ctx->npxpool) {
+		if (!px_connect(ctx, realport, softto_us, tend))
 			return false;
-		}
+	} else {
+		char peerhost[256];
+		uint16_t peerport;
 
-		if (!lsi_b_blocking(sh.sck, false)) {
-			WE("failed to set nonblocking mode");
-			lsi_b_close(sh.sck);
-			ctx->sh.sck = -1;
-			return false;
-		}
+		ctx->sh.sck = lsi_com_consocket(ctx->host, realport, peerhost,
+		    sizeof peerhost, &peerport, softto_us, hardto_us,
+		    ctx->dnsttl_us, ctx->dnsnegttl_us, &ctx->sockopts);
 
-		bool ok = false;
-		D("logging on to proxy");
-		if (ctx->ptype == IRCPX_HTTP)
-			ok = lsi_px_logon_http(ctx->sh.sck, ctx->host,
-			    realport, trem);
-		else if (ctx->ptype == IRCPX_SOCKS4)
-			ok = lsi_px_logon_socks4(ctx->sh.sck, ctx->host,
-			    realport, trem);
-		else if (ctx->ptype == IRCPX_SOCKS5)
-			ok = lsi_px_logon_socks5(ctx->sh.sck, ctx->host,
-			    realport, trem);
-
-		if (!ok) {
-			W("proxy logon failed");
-			lsi_b_close(sh.sck);
-			ctx->sh.sck = -1;
+		if (ctx->sh.sck < 0) {
+			W("lsi_com_consocket failed for %s:%"PRIu16"",
+			    ctx->host, realport);
 			return false;
 		}
-		D("sent proxy logon sequence");
 
+		D("connected socket %d for %s:%"PRIu16"",
+		    ctx->sh.sck, ctx->host, realport);
 	}
 
+	int sck = ctx->sh.sck;
+	LSI_PROBE3(connect_tcp, ctx->host, realport, sck);
+
 	if (ctx->ssl) {
 		D("setting to blocking mode for ssl connect");
 
-		if (!lsi_b_blocking(sh.sck, true)) {
+		if (!lsi_b_blocking(sck, true)) {
 			WE("failed to set blocking mode");
-			lsi_b_close(sh.sck);
+			lsi_b_close(sck);
 			ctx->sh.sck = -1;
 			return false;
 		}
 
-		if (!(ctx->sh.shnd = lsi_b_sslize(sh.sck, ctx->sctx))) {
-			lsi_b_close(sh.sck);
+		LSI_PROBE2(tls_start, sck, false);
+		ctx->sh.shnd = lsi_b_sslize(sck, ctx->sctx, ctx->ssess);
+		LSI_PROBE3(tls_done, sck, false, ctx->sh.shnd != NULL);
+		if (!ctx->sh.shnd) {
+			/* don't offer the same session again if it's what
+			 * made the server unhappy */
+			drop_sslsess(ctx);
+			lsi_b_close(sck);
 			ctx->sh.sck = -1;
 			W("connect bailing out; couldn't initiate ssl");
 			return false;
@@ -221,9 +226,9 @@ lsi_conn_connect(iconn *ctx, uint64_t softto_us, uint64_t hardto_us)
 
 		D("setting to nonblocking mode after ssl connect");
 
-		if (!lsi_b_blocking(sh.sck, false)) {
+		if (!lsi_b_blocking(sck, false)) {
 			WE("failed to clear blocking mode");
-			lsi_b_close(sh.sck);
+			lsi_b_close(sck);
 			ctx->sh.sck = -1;
 			return false;
 		}
@@ -231,7 +236,7 @@ lsi_conn_connect(iconn *ctx, uint64_t softto_us, uint64_t hardto_us)
 
 	ctx->online = true;
 
-	D("%s connection to ircd established", ctx->ptype == -1?"TCP":"proxy");
+	D("%s connection to ircd established", ctx->npxpool?"proxy":"TCP");
 
 	return true;
 }
@@ -246,7 +251,7 @@ lsi_conn_read(iconn *ctx, tokarr *tok, char **tags, size_t *ntags,
 	}
 
 	int n;
-	if (!(n = lsi_io_read(ctx->sh, &ctx->rctx, tok,
+	if (!(n = lsi_io_read(ctx->sh, &ctx->rctx, &ctx->stats, tok,
 	    tags, ntags, to_us)))
 		return 0; /* timeout */
 
@@ -276,7 +281,7 @@ lsi_conn_write(iconn *ctx, const char *line)
 		return false;
 	}
 
-	if (!lsi_io_write(ctx->sh, line)) {
+	if (!lsi_io_write(ctx->sh, &ctx->stats, line)) {
 		W("failed to write '%s'", line);
 		lsi_conn_reset(ctx);
 		ctx->eof = false;
@@ -308,39 +313,72 @@ lsi_conn_colon_trail(iconn *ctx)
 bool
 lsi_conn_set_px(iconn *ctx, const char *host, uint16_t port, int ptype)
 {
-	char *n = NULL;
+	if (host && !px_valid(host, port, ptype))
+		return false;
+
+	clear_px(ctx->pxpool, &ctx->npxpool);
+	clear_px(ctx->pxchain, &ctx->npxchain);
+	ctx->pxcur = 0;
+
 	if (!host) {
-		free(ctx->phost);
-		ctx->phost = NULL;
-		ctx->ptype = ptype;
-		ctx->pport = 0;
 		I("proxy disabled");
 		return true;
 	}
 
-	switch (ptype) {
-	case IRCPX_HTTP:
-	case IRCPX_SOCKS4:
-	case IRCPX_SOCKS5:
-		if (!host || !port) { //XXX `most' default port per type?
-			E("Missing %s for proxy", host ? "port" : "hostname");
-			return false;
-		}
+	if (!add_px(ctx->pxpool, &ctx->npxpool, MAX_PXPOOL, host, port, ptype))
+		return false;
 
-		if (!(n = STRDUP(host)))
-			return false;
+	I("set proxy to %s:%s:%"PRIu16, lsi_px_typestr(ptype), host, port);
+	return true;
+}
 
-		ctx->pport = port;
-		ctx->ptype = ptype;
-		free(ctx->phost);
-		ctx->phost = n;
-		I("set proxy to %s:%s:%"PRIu16,
-		    lsi_px_typestr(ctx->ptype), n, port);
-		break;
-	default:
-		E("illegal proxy type %d", ptype);
+/* append a proxy to the chain; the previous proxy (or the one picked from
+ * the pool) will be asked to connect to it, rather than to the ircd */
+bool
+lsi_conn_add_pxhop(iconn *ctx, const char *host, uint16_t port, int ptype)
+{
+	if (!ctx->npxpool)
+		return lsi_conn_set_px(ctx, host, port, ptype);
+
+	if (!px_valid(host, port, ptype)
+	    || !add_px(ctx->pxchain, &ctx->npxchain, MAX_PXCHAIN,
+	    host, port, ptype))
+		return false;
+
+	I("added proxy %s:%s:%"PRIu16" to chain (length now %zu)",
+	    lsi_px_typestr(ptype), host, port, ctx->npxchain + 1);
+	return true;
+}
+
+/* add an alternative for the first proxy.  we'll use whichever one has
+ * been doing best, see rank_pxpool() */
+bool
+lsi_conn_add_pxpool(iconn *ctx, const char *host, uint16_t port, int ptype)
+{
+	if (!px_valid(host, port, ptype)
+	    || !add_px(ctx->pxpool, &ctx->npxpool, MAX_PXPOOL,
+	    host, port, ptype))
 		return false;
-	}
+
+	I("added proxy %s:%s:%"PRIu16" to pool (size now %zu)",
+	    lsi_px_typestr(ptype), host, port, ctx->npxpool);
+	return true;
+}
+
+bool
+lsi_conn_pxpool_stat(iconn *ctx, size_t idx, uint64_t *lat_us,
+    unsigned *nok, unsigned *nfail)
+{
+	if (idx >= ctx->npxpool)
+		return false;
+
+	struct pxent *px = &ctx->pxpool[idx];
+	if (lat_us)
+		*lat_us = px->lat_us;
+	if (nok)
+		*nok = px->nok;
+	if (nfail)
+		*nfail = px->nfail;
 
 	return true;
 }
@@ -352,6 +390,9 @@ lsi_conn_set_server(iconn *ctx, const char *host, uint16_t port)
 	if (!(n = STRDUP(host?host:DEF_HOST)))
 		return false;
 
+	if (port != ctx->port || strcmp(n, ctx->host) != 0)
+		drop_sslsess(ctx);
+
 	free(ctx->host);
 	ctx->host = n;
 	ctx->port = port;
@@ -368,6 +409,7 @@ lsi_conn_set_ssl(iconn *ctx, bool on)
 			return false;
 		}
 	} else if (!on && ctx->sctx) {
+		drop_sslsess(ctx);
 		lsi_b_freesslctx(ctx->sctx);
 		ctx->sctx = NULL;
 	}
@@ -380,22 +422,96 @@ lsi_conn_set_ssl(iconn *ctx, bool on)
 	return true;
 }
 
+/* Remember the session of the current TLS connection (if resumable) so
+ * that the next lsi_conn_connect() to the same server can offer it */
+static void
+keep_sslsess(iconn *ctx)
+{
+	if (!ctx->ssl || !ctx->sh.shnd)
+		return;
+
+	SSLSESSTYPE sess = lsi_b_sslsess(ctx->sh.shnd);
+	if (!sess)
+		return;
+
+	drop_sslsess(ctx);
+	ctx->ssess = sess;
+	D("keeping ssl session %p for resumption", (void *)sess);
+	return;
+}
+
+static void
+drop_sslsess(iconn *ctx)
+{
+	if (!ctx->ssess)
+		return;
+
+	D("dropping ssl session %p", (void *)ctx->ssess);
+	lsi_b_freesslsess(ctx->ssess);
+	ctx->ssess = NULL;
+	return;
+}
+
+void
+lsi_conn_set_dnsttl(iconn *ctx, uint64_t ttl_us, uint64_t negttl_us)
+{
+	ctx->dnsttl_us = ttl_us;
+	ctx->dnsnegttl_us = negttl_us;
+	return;
+}
+
+/* takes effect on the next connect, but we also apply it to the
+ * current socket, if any.  NULL means system defaults; since we can't
+ * tell what those were, a live socket keeps what it has */
+void
+lsi_conn_set_sockopts(iconn *ctx, const struct irc_sockopts *so)
+{
+	if (!so) {
+		memset(&ctx->sockopts, 0, sizeof ctx->sockopts);
+		return;
+	}
+
+	ctx->sockopts = *so;
+	if (ctx->sh.sck != -1 && !lsi_com_sockopts(ctx->sh.sck, so))
+		W("failed to apply (some) socket options to live socket");
+
+	return;
+}
+
+/* resolve whatever lsi_conn_connect() would connect to first, in the
+ * background.  see lsi_res_prefetch() */
+int
+lsi_conn_prefetch(iconn *ctx)
+{
+	const char *host = ctx->host;
+	uint16_t port = ctx->port;
+	if (ctx->npxpool) {
+		size_t order[MAX_PXPOOL];
+		rank_pxpool(ctx, order);
+		host = ctx->pxpool[order[0]].host;
+		port = ctx->pxpool[order[0]].port;
+	} else if (!port)
+		port = ctx->ssl ? DEF_PORT_SSL : DEF_PORT_PLAIN;
+
+	return lsi_res_prefetch(host, port, ctx->dnsttl_us, ctx->dnsnegttl_us);
+}
+
 const char *
 lsi_conn_get_px_host(iconn *ctx)
 {
-	return ctx->phost;
+	return ctx->npxpool ? ctx->pxpool[ctx->pxcur].host : NULL;
 }
 
 uint16_t
 lsi_conn_get_px_port(iconn *ctx)
 {
-	return ctx->pport;
+	return ctx->npxpool ? ctx->pxpool[ctx->pxcur].port : 0;
 }
 
 int
 lsi_conn_get_px_type(iconn *ctx)
 {
-	return ctx->ptype;
+	return ctx->npxpool ? ctx->pxpool[ctx->pxcur].type : -1;
 }
 
 const char *
@@ -422,21 +538,275 @@ lsi_conn_sockfd(iconn *ctx)
 	return ctx->sh.sck;
 }
 
+/* take over an already connected plaintext socket (e.g. one that was handed
+ * over from another process).  the read buffer is left alone */
+bool
+lsi_conn_adopt(iconn *ctx, int sck)
+{
+	if (ctx->online) {
+		E("Can't adopt a socket when already online");
+		return false;
+	}
+
+	if (ctx->ssl) {
+		E("Can't adopt a socket for an ssl connection");
+		return false;
+	}
+
+	if (!lsi_b_blocking(sck, false))
+		return false;
+
+	ctx->sh.sck = sck;
+	ctx->sh.shnd = NULL;
+	ctx->online = true;
+	ctx->eof = false;
+
+	D("adopted socket %d", sck);
+	return true;
+}
+
+/* try the proxies in the pool, best one first, until one of them gets
+ * us through the chain to the ircd */
+static bool
+px_connect(iconn *ctx, uint16_t realport, uint64_t softto_us, uint64_t tend)
+{
+	size_t order[MAX_PXPOOL];
+	rank_pxpool(ctx, order);
+
+	for (size_t i = 0; i < ctx->npxpool; i++) {
+		struct pxent *px = &ctx->pxpool[order[i]];
+		bool last = i + 1 == ctx->npxpool;
+		uint64_t trem = 0;
+
+		if (lsi_com_check_timeout(tend, &trem)) {
+			W("timeout");
+			return false;
+		}
+
+		/* don't let a single bad proxy eat up all of our time if
+		 * there are others left to try */
+		if (!last && softto_us && (!trem || trem > softto_us))
+			trem = softto_us;
+
+		uint64_t tstart = lsi_b_tstamp_us();
+		bool ok = px_try(ctx, px, realport, softto_us,
+		    trem ? tstart + trem : 0);
+		px_feedback(px, ok, lsi_b_tstamp_us() - tstart);
+
+		if (ok) {
+			ctx->pxcur = order[i];
+			return true;
+		}
+
+		W("proxy %s:%s:%"PRIu16" failed%s", lsi_px_typestr(px->type),
+		    px->host, px->port, last ? "" : ", trying next one");
+	}
+
+	return false;
+}
+
+/* connect to `px' and log on to it and to every proxy in the chain, the
+ * last of which is asked to connect to the ircd */
+static bool
+px_try(iconn *ctx, struct pxent *px, uint16_t realport, uint64_t softto_us,
+    uint64_t tend)
+{
+	struct readctx *rctx = &ctx->rctx;
+	uint64_t trem = 0;
+	if (lsi_com_check_timeout(tend, &trem))
+		return false;
+
+	int sck = lsi_com_consocket(px->host, px->port, NULL, 0, NULL,
+	    softto_us, trem, ctx->dnsttl_us, ctx->dnsnegttl_us,
+	    &ctx->sockopts);
+
+	if (sck < 0) {
+		W("lsi_com_consocket failed for %s:%"PRIu16"",
+		    px->host, px->port);
+		return false;
+	}
+
+	D("connected socket %d for %s:%"PRIu16"", sck, px->host, px->port);
+
+	if (!lsi_b_blocking(sck, false)) {
+		WE("failed to set nonblocking mode");
+		goto fail;
+	}
+
+	/* anything the ircd sends right after the last proxy reply
+	 * ends up in our read buffer */
+	const struct pxent *cur = px;
+	for (size_t i = 0; i <= ctx->npxchain; i++) {
+		bool lasthop = i == ctx->npxchain;
+		const char *host = lasthop ? ctx->host : ctx->pxchain[i].host;
+		uint16_t port = lasthop ? realport : ctx->pxchain[i].port;
+		size_t ovlen = 0;
+
+		if (lsi_com_check_timeout(tend, &trem)) {
+			W("timeout");
+			goto fail;
+		}
+
+		D("logging on to %s proxy %s:%"PRIu16", target %s:%"PRIu16,
+		    lsi_px_typestr(cur->type), cur->host, cur->port,
+		    host, port);
+
+		if (!lsi_px_logon(cur->type, sck, host, port, trem,
+		    rctx->workbuf, WORKBUF_SZ, &ovlen)) {
+			W("proxy logon failed");
+			goto fail;
+		}
+
+		if (ovlen && (!lasthop || ctx->ssl)) {
+			W("got %zu bytes of unexpected early data", ovlen);
+			goto fail;
+		}
+
+		rctx->eptr = rctx->workbuf + ovlen;
+		if (!lasthop)
+			cur = &ctx->pxchain[i];
+	}
+
+	D("sent proxy logon sequence(s)");
+	ctx->sh.sck = sck;
+	return true;
+
+fail:
+	lsi_b_close(sck);
+	rctx->wptr = rctx->eptr = rctx->workbuf;
+	return false;
+}
+
+static void
+px_feedback(struct pxent *px, bool ok, uint64_t lat_us)
+{
+	if (ok) {
+		px->lat_us = px->nok ? (3 * px->lat_us + lat_us) / 4 : lat_us;
+		px->nok++;
+		px->cfail = 0;
+	} else {
+		px->nfail++;
+		px->cfail++;
+		px->tfail = lsi_b_tstamp_us();
+	}
+	return;
+}
+
+/* the lower, the better.  latency is penalized by the failure rate;
+ * untried proxies come first so we get to know them, and the ones which
+ * never worked come last */
+static uint64_t
+px_score(const struct pxent *px, uint64_t now)
+{
+	if (px->cfail >= PX_MAXCFAIL && now - px->tfail < PX_COOLDOWN_US)
+		return UINT64_MAX;
+
+	if (!px->nok)
+		return px->nfail ? UINT64_MAX - 1 : 0;
+
+	return px->lat_us * (px->nok + px->nfail) / px->nok;
+}
+
+/* fill `order' with pool indices, best proxy first */
+static void
+rank_pxpool(iconn *ctx, size_t *order)
+{
+	uint64_t now = lsi_b_tstamp_us();
+	uint64_t score[MAX_PXPOOL];
+
+	for (size_t i = 0; i < ctx->npxpool; i++) {
+		uint64_t sc = px_score(&ctx->pxpool[i], now);
+		size_t j = i;
+		for (; j > 0 && score[j-1] > sc; j--) {
+			score[j] = score[j-1];
+			order[j] = order[j-1];
+		}
+
+		score[j] = sc;
+		order[j] = i;
+	}
+	return;
+}
+
+static bool
+px_valid(const char *host, uint16_t port, int ptype)
+{
+	switch (ptype) {
+	case IRCPX_HTTP:
+	case IRCPX_SOCKS4:
+	case IRCPX_SOCKS5:
+		if (!host || !port) { //XXX `most' default port per type?
+			E("Missing %s for proxy", host ? "port" : "hostname");
+			return false;
+		}
+		return true;
+	default:
+		E("illegal proxy type %d", ptype);
+		return false;
+	}
+}
+
+static bool
+add_px(struct pxent *arr, size_t *cnt, size_t max,
+    const char *host, uint16_t port, int ptype)
+{
+	if (*cnt >= max) {
+		E("too many proxies (max. %zu)", max);
+		return false;
+	}
+
+	struct pxent *px = &arr[*cnt];
+	if (!(px->host = STRDUP(host)))
+		return false;
+
+	px->port = port;
+	px->type = ptype;
+	px->lat_us = px->tfail = 0;
+	px->nok = px->nfail = px->cfail = 0;
+	(*cnt)++;
+	return true;
+}
+
+static void
+clear_px(struct pxent *arr, size_t *cnt)
+{
+	for (size_t i = 0; i < *cnt; i++)
+		free(arr[i].host);
+	*cnt = 0;
+	return;
+}
+
 void
 irc_conn_dump(iconn *ctx)
 {
 	N("--- connection context %p dump---", (void *)ctx);
 	N("host: '%s'", ctx->host);
 	N("port: %"PRIu16, ctx->port);
-	N("phost: '%s'", ctx->phost);
-	N("pport: %"PRIu16, ctx->pport);
-	N("ptype: %d (%s)", ctx->ptype, ctx->ptype == -1 ? "NONE" : lsi_px_typestr(ctx->ptype));
+	for (size_t i = 0; i < ctx->npxpool; i++) {
+		struct pxent *px = &ctx->pxpool[i];
+		N("pxpool[%zu]: %s:%s:%"PRIu16" lat: %"PRIu64"us, ok: %u, "
+		    "fail: %u (%u in a row)%s", i, lsi_px_typestr(px->type),
+		    px->host, px->port, px->lat_us, px->nok, px->nfail,
+		    px->cfail, i == ctx->pxcur ? " (current)" : "");
+	}
+	for (size_t i = 0; i < ctx->npxchain; i++)
+		N("pxchain[%zu]: %s:%s:%"PRIu16, i,
+		    lsi_px_typestr(ctx->pxchain[i].type),
+		    ctx->pxchain[i].host, ctx->pxchain[i].port);
 	N("sh.sck: %d", ctx->sh.sck);
 	N("sh.shnd: %p", (void *)ctx->sh.shnd);
 	N("online: %d", ctx->online);
 	N("eof: %d", ctx->eof);
 	N("colon_trail: %d", ctx->colon_trail);
 	N("ssl: %d", ctx->ssl);
+	N("ssess: %p", (void *)ctx->ssess);
+	N("dnsttl_us: %"PRIu64, ctx->dnsttl_us);
+	N("dnsnegttl_us: %"PRIu64, ctx->dnsnegttl_us);
+	N("sockopts: nodelay: %d, keepalive: %u/%u/%u, user timeout: %ums, "
+	    "rcvbuf: %u, sndbuf: %u", ctx->sockopts.nodelay,
+	    ctx->sockopts.ka_idle_s, ctx->sockopts.ka_intvl_s,
+	    ctx->sockopts.ka_cnt, ctx->sockopts.user_timeout_ms,
+	    ctx->sockopts.rcvbuf, ctx->sockopts.sndbuf);
 	N("read buffer: %zu bytes in use", (size_t)(ctx->rctx.eptr - ctx->rctx.wptr));
 	N("--- end of connection context dump ---");
 	return;
@@ -30,12 +30,21 @@ uint16_t lsi_conn_get_px_port(iconn *ctx);
 int lsi_conn_get_px_type(iconn *ctx);
 bool lsi_conn_set_server(iconn *ctx, const char *host, uint16_t port);
 bool lsi_conn_set_px(iconn *ctx, const char *host, uint16_t port, int ptype);
+bool lsi_conn_add_pxhop(iconn *ctx, const char *host, uint16_t port, int ptype);
+bool lsi_conn_add_pxpool(iconn *ctx, const char *host, uint16_t port,
+    int ptype);
+bool lsi_conn_pxpool_stat(iconn *ctx, size_t idx, uint64_t *lat_us,
+    unsigned *nok, unsigned *nfail);
 bool lsi_conn_set_ssl(iconn *ctx, bool on);
 bool lsi_conn_get_ssl(iconn *ctx);
+void lsi_conn_set_dnsttl(iconn *ctx, uint64_t ttl_us, uint64_t negttl_us);
+int lsi_conn_prefetch(iconn *ctx);
+void lsi_conn_set_sockopts(iconn *ctx, const struct irc_sockopts *so);
 
 /* TODO: replace these by something less insane */
 bool lsi_conn_colon_trail(iconn *ctx);
 int lsi_conn_sockfd(iconn *ctx);
+bool lsi_conn_adopt(iconn *ctx, int sck);
 
 void irc_conn_dump(iconn *ctx);
 
@@ -0,0 +1,129 @@
+/* hist.c - log-bucketed latency histograms
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#define LOG_MODULE MOD_IRC
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "hist.h"
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <platform/base_misc.h>
+
+#include <logger/intlog.h>
+
+#include <libsrsirc/irc_ext.h>
+
+
+#define SUBBITS 3 /* log2 of IRC_HIST_SUB */
+
+
+static size_t bucket(uint64_t v);
+static int msb(uint64_t v);
+
+
+struct irc_hist *
+lsi_hist_init(void)
+{
+	struct irc_hist *h = MALLOC(sizeof *h);
+	if (h)
+		memset(h, 0, sizeof *h);
+
+	return h;
+}
+
+void
+lsi_hist_add(struct irc_hist *h, uint64_t ns)
+{
+	h->count++;
+	h->sum_ns += ns;
+	if (ns > h->max_ns)
+		h->max_ns = ns;
+
+	h->bucket[bucket(ns)]++;
+	return;
+}
+
+
+void
+irc_hist_bounds(size_t idx, uint64_t *lo, uint64_t *hi)
+{
+	if (idx < IRC_HIST_SUB) {
+		*lo = *hi = idx;
+		return;
+	}
+
+	int e = (int)(idx / IRC_HIST_SUB) + SUBBITS - 1;
+	uint64_t m = idx % IRC_HIST_SUB + IRC_HIST_SUB;
+
+	*lo = m << (e - SUBBITS);
+	*hi = *lo + ((uint64_t)1 << (e - SUBBITS)) - 1;
+	return;
+}
+
+uint64_t
+irc_hist_quantile(const struct irc_hist *h, double q)
+{
+	if (!h->count)
+		return 0;
+
+	if (q < 0.0)
+		q = 0.0;
+	else if (q > 1.0)
+		q = 1.0;
+
+	/* the rank of the value we're looking for, 1-based */
+	uint64_t rank = (uint64_t)(q * (double)h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	else if (rank > h->count)
+		rank = h->count;
+
+	uint64_t seen = 0, lo, hi = 0;
+	for (size_t i = 0; i < IRC_HIST_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen >= rank) {
+			irc_hist_bounds(i, &lo, &hi);
+			break;
+		}
+	}
+
+	return hi < h->max_ns ? hi : h->max_ns;
+}
+
+
+/* values below IRC_HIST_SUB get a bucket each; above that, each power of
+ * two [2^e, 2^(e+1)) is split into IRC_HIST_SUB buckets by the SUBBITS bits
+ * following the most significant one */
+static size_t
+bucket(uint64_t v)
+{
+	if (v < IRC_HIST_SUB)
+		return (size_t)v;
+
+	int e = msb(v);
+	return (size_t)(e - SUBBITS + 1) * IRC_HIST_SUB
+	    + (size_t)((v >> (e - SUBBITS)) - IRC_HIST_SUB);
+}
+
+static int
+msb(uint64_t v)
+{
+#ifdef __GNUC__
+	return 63 - __builtin_clzll(v);
+#else
+	int r = 0;
+	while (v >>= 1)
+		r++;
+	return r;
+#endif
+}
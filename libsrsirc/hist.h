@@ -0,0 +1,18 @@
+/* hist.h - log-bucketed latency histograms, interface (lib-internal)
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIBSRSIRC_HIST_H
+#define LIBSRSIRC_HIST_H 1
+
+
+#include <stdint.h>
+
+#include <libsrsirc/defs.h>
+
+
+struct irc_hist *lsi_hist_init(void);
+void lsi_hist_add(struct irc_hist *h, uint64_t ns);
+
+
+#endif /* LIBSRSIRC_HIST_H */
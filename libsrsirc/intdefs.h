@@ -11,6 +11,8 @@
 
 #include <platform/base_net.h>
 
+#include <libsrsirc/irc_track.h>
+
 #include "skmap.h"
 
 /* receive buffer size */
@@ -36,6 +38,8 @@
 #define MAX_005_CHTYP 16
 #define MAX_CHAN_LEN 256
 #define MAX_MODEPFX 8
+#define MAX_CMPARMS 8 // channel modes with a parameter (class B and C) per chan
+#define MAX_MODESTR 512 // one channel mode and its argument, e.g. "l 123"
 #define MAX_V3TAGS 16 // IRCv3 message tags
 #define MAX_V3CAPS 16
 #define MAX_V3TAGLEN 512
@@ -54,6 +58,7 @@ struct readctx {
 	char workbuf[WORKBUF_SZ + 1];
 	char *wptr; /* pointer to begin of current valid data */
 	char *eptr; /* pointer to one after end of current valid data */
+	uint64_t tarrive; /* lsi_b_mono_ns() of the last read that got data */
 };
 
 
@@ -63,12 +68,15 @@ struct msghnd {
 	char cmd[32];
 	hnd_fn hndfn;
 	const char *module;
+	uint64_t *ndisp; /* dispatch counter for `module' in the irc_stats */
+	bool track;      /* time spent counts as tracking */
 };
 
 /* protocol message handler function pointers */
 struct umsghnd {
 	char cmd[32];
 	uhnd_fn hndfn;
+	struct irc_hist *hist; /* run times, if irc_set_histograms() */
 };
 
 struct v3tag
@@ -86,15 +94,33 @@ struct v3cap
 	bool enabled;
 };
 
+#define MAX_PXPOOL 16
+#define MAX_PXCHAIN 8
+
+/* a proxy, plus some bookkeeping on how well it's been doing for us */
+struct pxent {
+	char *host;
+	uint16_t port;
+	int type;
+
+	uint64_t lat_us; /* moving avg of successful connect+logon times */
+	unsigned nok;
+	unsigned nfail;
+	unsigned cfail;  /* consecutive failures */
+	uint64_t tfail;  /* when the last failure happened */
+};
+
 /* this is a relict of the former design */
 typedef struct iconn_s iconn;
 struct iconn_s {
 	char *host;
 	uint16_t port;
 
-	char *phost;
-	uint16_t pport;
-	int ptype;
+	struct pxent pxpool[MAX_PXPOOL];   /* candidates for the first proxy */
+	size_t npxpool;
+	size_t pxcur;                      /* pool index of the one last used */
+	struct pxent pxchain[MAX_PXCHAIN]; /* proxies to tunnel through next */
+	size_t npxchain;
 
 	sckhld sh;
 	bool online;
@@ -104,6 +130,11 @@ struct iconn_s {
 	bool colon_trail;
 	bool ssl;
 	SSLCTXTYPE sctx;
+	SSLSESSTYPE ssess; /* last session with host:port, for resumption */
+	uint64_t dnsttl_us;
+	uint64_t dnsnegttl_us;
+	struct irc_sockopts sockopts;
+	struct irc_stats stats; /* performance counters, see irc_stats() */
 };
 
 /* this is our main IRC context context structure (typedef'd as `irc') */
@@ -165,6 +196,12 @@ struct irc_s {
 	fp_con_read cb_con_read; // Callback for incoming messages at logon time
 	void *tag_con_read;      // Userdata handed back to the above callback
 	fp_mut_nick cb_mut_nick; // Callback for unavailable nick at logon time
+	fp_trk_event cb_trkev;   // Callback for tracking changes
+	void *tag_trkev;         // Userdata handed back to the above callback
+	fp_trk_filter cb_trkfilt; // Callback deciding which channels to track
+	void *tag_trkfilt;        // Userdata handed back to the above callback
+	fp_lag cb_lag;           // Callback for lag threshold breaches
+	void *tag_lag;           // Userdata handed back to the above callback
 
 	struct umsghnd *uprehnds;  // User-registered PRE message handlers
 	size_t uprehnds_cnt;       // Amount of the above
@@ -172,12 +209,37 @@ struct irc_s {
 	size_t uposthnds_cnt;      // Amount of the above
 	struct msghnd *msghnds;    // System-registered message handlers
 	size_t msghnds_cnt;        // Amount of the above
+	struct irc_hist *lathist;  // Read-to-dispatch latency, if enabled
 
 
 
 	/* These are only used if irc_set_track() was used to enable tracking */
 	skmap *chans;       // The channels we're aware of (or in?)
 	skmap *users;       // The users we're aware of
+	skmap *untracked;   // Channels we're in but don't track (lsi_trk_wanted())
+	char **trkpats;     // Channel patterns to track, or NULL for all
+	struct irc_trkmem trkmem; // Memory used by the above (`total' unused)
+	size_t trkmax;      // Limit for the above (irc_track_memlimit())
+	void *trkseed;      // Snapshot to seed tracking with (irc_track_load())
+	size_t trkseed_len; // Size of the above
+	uint64_t trkgen;    // Bumped on every change to the above (irc_cur_valid())
+	size_t nsplit;      // Memberships lost in a netsplit, not yet dropped
+	uint64_t splitlast; // When we saw the latest netsplit QUIT (us)
+	uint64_t splitgrace; // How long to keep them (irc_track_splitgrace())
+	void *tsnap;        // Last snapshot published by irc_track_publish()
+	void *tsretired;    // Replaced ones we still have to release
+	unsigned long tsreaders; // Threads currently inside irc_tsnap_get()
+	uint64_t tsseq;     // Sequence number of the last published snapshot
+
+
+
+	/* These are only used if irc_set_lagmon() enabled the lag monitor */
+	uint64_t lagint;     // Time between PINGs (us), 0 if disabled
+	uint64_t lagmax;     // Threshold for cb_lag (us), 0 if none
+	uint64_t lagsent;    // When the outstanding PING was sent, 0 if none
+	uint64_t lagnext;    // When the next PING is due, 0 if not scheduled
+	bool lagbreach;      // Whether cb_lag was last told about a breach
+	struct irc_lag lag;  // The figures handed out by irc_lag()
 
 
 
@@ -24,6 +24,7 @@
 #include <logger/intlog.h>
 
 #include "common.h"
+#include "probes.h"
 
 #include <libsrsirc/util.h>
 
@@ -33,16 +34,17 @@
 
 /* local helpers */
 static char *find_delim(struct readctx *rctx);
-static int read_more(sckhld sh, struct readctx *rctx, uint64_t to_us);
-static bool write_str(sckhld sh, const char *str);
+static int read_more(sckhld sh, struct readctx *rctx, struct irc_stats *st,
+    uint64_t to_us);
+static bool write_str(sckhld sh, struct irc_stats *st, const char *str);
 static long read_wrap(sckhld sh, void *buf, size_t sz, uint64_t to_us);
 static long send_wrap(sckhld sh, const void *buf, size_t len);
 
 
 /* Documented in io.h */
 int
-lsi_io_read(sckhld sh, struct readctx *rctx, tokarr *tok,
-    char **tags, size_t *ntags, uint64_t to_us)
+lsi_io_read(sckhld sh, struct readctx *rctx, struct irc_stats *st,
+    tokarr *tok, char **tags, size_t *ntags, uint64_t to_us)
 {
 	uint64_t tend = to_us ? lsi_b_tstamp_us() + to_us : 0;
 	uint64_t tnow, trem = 0;
@@ -68,7 +70,7 @@ lsi_io_read(sckhld sh, struct readctx *rctx, tokarr *tok,
 				trem = tnow >= tend ? 1 : tend - tnow;
 			}
 
-			int r = read_more(sh, rctx, trem);
+			int r = read_more(sh, rctx, st, trem);
 			if (r <= 0)
 				return r;
 		}
@@ -81,37 +83,61 @@ lsi_io_read(sckhld sh, struct readctx *rctx, tokarr *tok,
 	rctx->wptr += linelen;
 
 	*delim = '\0';
+	st->lines_in++;
+	LSI_PROBE2(line_read, linestart, linelen);
 
 	I("Read: '%s'", linestart);
 
+	uint64_t tstart = lsi_b_mono_ns();
+	bool ok = true;
 	if (linestart[0] == '@') {
 		linestart = lsi_ut_extract_tags(linestart + 1,
 		    tags, ntags);
 
 		if (!linestart || !linestart[0]) {
 			E("protocol error (just tags?)");
-			return -1;
+			ok = false;
 		}
 	} else if (ntags)
 		*ntags = 0;
 
-	return lsi_ut_tokenize(linestart, tok) ? 1 : -1;
+	ok = ok && lsi_ut_tokenize(linestart, tok);
+	st->tokenize_ns += lsi_b_mono_ns() - tstart;
+	if (!ok)
+		st->parse_errors++;
+
+	return ok ? 1 : -1;
 }
 
 /* Documented in io.h */
 bool
-lsi_io_write(sckhld sh, const char *line)
+lsi_io_write(sckhld sh, struct irc_stats *st, const char *line)
 {
 	size_t len = strlen(line);
 	int needbr = len < 2 || line[len-2] != '\r' || line[len-1] != '\n';
 
 	V("Wanna write: '%s%s'", line, needbr ? "\r\n" : "");
 
-	bool suc = write_str(sh, line) && (!needbr || write_str(sh, "\r\n"));
-
-	if (suc)
+	bool suc;
+	char buf[1024];
+	if (needbr && len + 3 <= sizeof buf) {
+		/* send line and CRLF in one go; saves a syscall (and with SSL,
+		 * a record) per message, and keeps the line in one segment */
+		memcpy(buf, line, len);
+		memcpy(buf + len, "\r\n", 3);
+		suc = write_str(sh, st, buf);
+	} else
+		suc = write_str(sh, st, line)
+		    && (!needbr || write_str(sh, st, "\r\n"));
+
+	if (suc) {
+		/* `line' may hold several */
+		for (const char *p = line; (p = memchr(p, '\n', line + len - p));
+		    p++)
+			st->lines_out++;
+		st->lines_out += needbr;
 		I("Wrote: '%s%s'", line, needbr ? "\r\n" : "");
-	else
+	} else
 		W("Failed to write '%s%s'", line, needbr ? "\r\n" : "");
 
 	return suc;
@@ -133,7 +159,8 @@ find_delim(struct readctx *rctx)
 /* attempt to read more data from the ircd into our read buffer.
  * returns 1 if something was read; 0 on timeout; -1 on failure */
 static int
-read_more(sckhld sh, struct readctx *rctx, uint64_t to_us)
+read_more(sckhld sh, struct readctx *rctx, struct irc_stats *st,
+    uint64_t to_us)
 {
 	/* no sizeof rctx->workbuf here because it's one bigger than WORKBUF_SZ
 	 * and we don't want to fill the last byte with data; it's a dummy */
@@ -148,6 +175,7 @@ read_more(sckhld sh, struct readctx *rctx, uint64_t to_us)
 		/* make additional room by moving data to the beginning */
 		size_t datalen = (size_t)(rctx->eptr - rctx->wptr);
 		memmove(rctx->workbuf, rctx->wptr, datalen);
+		st->compactions++;
 		rctx->wptr = rctx->workbuf;
 		rctx->eptr = &rctx->workbuf[datalen];
 
@@ -157,6 +185,7 @@ read_more(sckhld sh, struct readctx *rctx, uint64_t to_us)
 
 	V("Reading more data (max. %zu bytes, timeout: %"PRIu64, remain, to_us);
 	long n = read_wrap(sh, rctx->eptr, remain, to_us);
+	st->reads++;
 	// >0: Amount of bytes read
 	// 0: timeout
 	// -1: Failure
@@ -171,6 +200,8 @@ read_more(sckhld sh, struct readctx *rctx, uint64_t to_us)
 
 	V("Got %ld more bytes", n);
 
+	st->bytes_in += (uint64_t)n;
+	rctx->tarrive = lsi_b_mono_ns();
 	rctx->eptr += n;
 	return 1;
 }
@@ -180,9 +211,15 @@ read_more(sckhld sh, struct readctx *rctx, uint64_t to_us)
  * everything is sent, well, buffered.
  * returns true on success, false on failure */
 static bool
-write_str(sckhld sh, const char *str)
+write_str(sckhld sh, struct irc_stats *st, const char *str)
 {
-	return send_wrap(sh, str, strlen(str)) > 0;
+	size_t len = strlen(str);
+	st->writes++;
+	if (send_wrap(sh, str, len) <= 0)
+		return false;
+
+	st->bytes_out += len;
+	return true;
 }
 
 /* wrap around either read() or SSL_read(), depending on whether
@@ -17,6 +17,7 @@
  *
  * Params: `sh':    Structure holding socket and, if enabled, SSL handle
  *         `rctx':  Read context structure primarily holding the read buffer
+ *         `st':    Performance counters to update
  *         `tok':   Pointer to result array, where pointers to the identified
  *                      tokens are stored in.
  *                  (*tok)[0] will point to the "prefix" (not including the
@@ -29,20 +30,21 @@
  *
  * Returns 1 on success; 0 on timeout; -1 on failure
  */
-int lsi_io_read(sckhld sh, struct readctx *rctx, tokarr *tok,
-    char **tags, size_t *ntags, uint64_t to_us); // XXX
+int lsi_io_read(sckhld sh, struct readctx *rctx, struct irc_stats *st,
+    tokarr *tok, char **tags, size_t *ntags, uint64_t to_us); // XXX
 
 /* lsi_io_write
  * Send a message to the ircd
  *
  * Params: `sh':   Structure holding socket and, if enabled, SSL handle
+ *         `st':   Performance counters to update
  *         `line': Data to send, typically a single IRC protocol line (but may
  *                     be multiple if properly separated by \r\n).
  *                     If the line does not end in \r\n, it will be appended.
  *
  * Returns true on success, false on failure
  */
-bool lsi_io_write(sckhld sh, const char *line);
+bool lsi_io_write(sckhld sh, struct irc_stats *st, const char *line);
 
 
 #endif /* LIBSRSIRC_IO_H */
@@ -16,6 +16,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <platform/base_io.h>
 #include <platform/base_misc.h>
 #include <platform/base_string.h>
 #include <platform/base_time.h>
@@ -26,16 +27,25 @@
 #include "conn.h"
 #include "irc_msghnd.h"
 #include "irc_track_int.h"
+#include "lag.h"
 #include "msg.h"
+#include "probes.h"
 #include "skmap.h"
+#include "state.h"
 #include "v3.h"
 
 #include <libsrsirc/irc_track.h>
 #include <libsrsirc/util.h>
 
 
+/* precedes the serialized state in a handoff, followed by its length */
+#define HANDOFF_MAGIC "LSIH"
+
+
 static bool send_logon(irc *ctx);
+static bool new_session(irc *ctx);
 static void reset_state(irc *ctx);
+static bool read_all(int sck, void *buf, size_t len, uint64_t tend);
 
 irc *
 irc_init(void)
@@ -58,7 +68,21 @@ irc_init(void)
 
 	r->msghnds = NULL;
 	r->uprehnds = r->uposthnds = NULL;
-	r->chans = r->users = NULL;
+	r->lathist = NULL;
+	r->chans = r->users = r->untracked = NULL;
+	r->trkpats = NULL;
+	memset(&r->trkmem, 0, sizeof r->trkmem);
+	r->trkmax = 0;
+	r->nsplit = 0;
+	r->splitlast = 0;
+	r->splitgrace = 0;
+	r->trkseed = NULL;
+	r->trkseed_len = 0;
+	r->trkgen = 0;
+	r->tsnap = NULL;
+	r->tsretired = NULL;
+	r->tsreaders = 0;
+	r->tsseq = 0;
 	r->m005chantypes = NULL;
 	r->m005attrs = NULL;
 
@@ -144,6 +168,13 @@ irc_init(void)
 	r->serv_con = false;
 	r->cb_con_read = NULL;
 	r->cb_mut_nick = lsi_ut_mut_nick;
+	r->cb_trkev = NULL;
+	r->tag_trkev = NULL;
+	r->cb_trkfilt = NULL;
+	r->tag_trkfilt = NULL;
+	r->cb_lag = NULL;
+	r->tag_lag = NULL;
+	r->lagint = r->lagmax = 0;
 	r->conflags = DEF_CONFLAGS;
 	r->serv_type = DEF_SERV_TYPE;
 	r->scto_us = DEF_SCTO_US;
@@ -196,6 +227,9 @@ void
 irc_dispose(irc *ctx)
 {
 	lsi_trk_deinit(ctx);
+	lsi_trk_unpublish(ctx);
+	irc_track_filter(ctx, NULL);
+	lsi_b_unmapfile(ctx->trkseed, ctx->trkseed_len);
 	lsi_conn_dispose(ctx->con);
 	free(ctx->lasterr);
 	free(ctx->banmsg);
@@ -207,6 +241,7 @@ irc_dispose(irc *ctx)
 	free(ctx->sasl_msg);
 	free(ctx->serv_dist);
 	free(ctx->serv_info);
+	lsi_msg_sethist(ctx, false);
 	free(ctx->msghnds);
 	free(ctx->uprehnds);
 	free(ctx->uposthnds);
@@ -237,35 +272,21 @@ irc_dispose(irc *ctx)
 	return;
 }
 
+int
+irc_dns_prefetch(irc *ctx)
+{
+	return lsi_conn_prefetch(ctx->con);
+}
+
 bool
 irc_connect(irc *ctx)
 {
 	uint64_t tend = ctx->hcto_us ?
 	    lsi_b_tstamp_us() + ctx->hcto_us : 0;
 
-	lsi_trk_deinit(ctx);
-	ctx->tracking_enab = false;
-
-	lsi_imh_unregall(ctx);
-	if (!lsi_imh_regall(ctx, ctx->dumb))
-		return false;
-
-	lsi_v3_unregall(ctx);
-	if (!lsi_v3_regall(ctx, ctx->dumb))
+	if (!new_session(ctx))
 		return false;
 
-	reset_state(ctx);
-
-	for (size_t i = 0; i < COUNTOF(ctx->logonconv); i++) {
-		lsi_ut_freearr(ctx->logonconv[i]);
-		ctx->logonconv[i] = NULL;
-	}
-
-	void *v;
-	if (lsi_skmap_first(ctx->m005attrs, NULL, &v))
-		do free(v); while (lsi_skmap_next(ctx->m005attrs, NULL, &v));
-	lsi_skmap_clear(ctx->m005attrs);
-
 	if (!lsi_conn_connect(ctx->con, ctx->scto_us, ctx->hcto_us))
 		return false;
 
@@ -274,6 +295,8 @@ irc_connect(irc *ctx)
 	if (ctx->dumb)
 		return true;
 
+	LSI_PROBE2(logon_start, ctx, ctx->nick);
+
 	bool logon_sent = false;
 	if (ctx->starttls_first) {
 		if (!lsi_conn_write(ctx->con, "STARTTLS\r\n"))
@@ -339,9 +362,110 @@ irc_connect(irc *ctx)
 	} while (!logged_on || (using_sasl && !sasl_authed));
 
 	N("logged on to IRC");
+	LSI_PROBE3(logon_done, ctx, ctx->mynick, true);
+	return true;
+
+fail:
+	LSI_PROBE3(logon_done, ctx, ctx->mynick, false);
+	irc_reset(ctx);
+	return false;
+}
+
+bool
+irc_handoff_send(irc *ctx, int unixsck)
+{
+	if (!lsi_conn_online(ctx->con)) {
+		E("not online, nothing to hand off");
+		return false;
+	}
+
+	if (lsi_conn_get_ssl(ctx->con)) {
+		E("can't hand off an ssl connection");
+		return false;
+	}
+
+	struct stbuf b = { NULL, 0, 0, false };
+	if (!lsi_st_save(ctx, &b, LSI_ST_ALL)) {
+		lsi_st_freebuf(&b);
+		return false;
+	}
+
+	unsigned char hdr[8] = HANDOFF_MAGIC;
+	for (size_t i = 0; i < 4; i++)
+		hdr[4 + i] = (b.len >> (24 - 8*i)) & 0xff;
+
+	bool ok = lsi_b_sendfd(unixsck, lsi_conn_sockfd(ctx->con),
+	    hdr, sizeof hdr) && lsi_b_write(unixsck, b.data, b.len) >= 0;
+	lsi_st_freebuf(&b);
+
+	if (!ok) {
+		E("failed to hand off connection");
+		return false;
+	}
+
+	N("handed off connection to %s:%"PRIu16,
+	    lsi_conn_get_host(ctx->con), lsi_conn_get_port(ctx->con));
+
+	/* The receiver holds its own reference to the socket now, so this
+	 * closes only ours; the connection itself stays up */
+	lsi_conn_reset(ctx->con);
+	return true;
+}
+
+bool
+irc_handoff_recv(irc *ctx, int unixsck, uint64_t to_us)
+{
+	uint64_t tend = to_us ? lsi_b_tstamp_us() + to_us : 0;
+	unsigned char *data = NULL;
+	unsigned char hdr[8];
+	int sck = -1;
+
+	if (lsi_conn_online(ctx->con)) {
+		E("Can't take over a connection when already online");
+		return false;
+	}
+
+	long n = lsi_b_recvfd(unixsck, &sck, hdr, sizeof hdr, to_us);
+	if (n <= 0) {
+		W("no handoff received (%ld)", n);
+		goto fail;
+	}
+
+	if (sck == -1) {
+		E("handoff came without a socket");
+		goto fail;
+	}
+
+	if (!read_all(unixsck, hdr + n, sizeof hdr - n, tend))
+		goto fail;
+
+	if (memcmp(hdr, HANDOFF_MAGIC, 4) != 0) {
+		E("not a handoff (bad magic)");
+		goto fail;
+	}
+
+	size_t len = (size_t)hdr[4] << 24 | (size_t)hdr[5] << 16
+	    | (size_t)hdr[6] << 8 | hdr[7];
+
+	if (!(data = MALLOC(len ? len : 1))
+	    || !read_all(unixsck, data, len, tend))
+		goto fail;
+
+	if (!new_session(ctx)
+	    || !lsi_st_load(ctx, data, len, LSI_ST_ALL)
+	    || !lsi_conn_adopt(ctx->con, sck))
+		goto fail;
+
+	free(data);
+	N("took over connection to %s:%"PRIu16" as '%s'",
+	    lsi_conn_get_host(ctx->con), lsi_conn_get_port(ctx->con),
+	    ctx->mynick);
 	return true;
 
 fail:
+	free(data);
+	if (sck != -1)
+		lsi_b_close(sck);
 	irc_reset(ctx);
 	return false;
 }
@@ -354,11 +478,42 @@ irc_read(irc *ctx, tokarr *tok, uint64_t to_us)
 	if (!tok)
 		tok = &dummy;
 
-	for (size_t i = 0; i < COUNTOF(ctx->v3tags_dec); i++)
-		ctx->v3tags_dec[i][0] = '\0';
-	ctx->v3ntags = COUNTOF(ctx->v3tags_raw);
+	uint64_t tend = to_us ? lsi_b_mono_ns() / 1000 + to_us : 0;
+	int r;
+
+	/* With the lag monitor on, we must not block past the next PING */
+	for (;;) {
+		if (!lsi_lag_tick(ctx)) {
+			irc_reset(ctx);
+			return -1;
+		}
+
+		uint64_t rto = to_us, lw = lsi_lag_wait(ctx);
+		if (tend) {
+			uint64_t now = lsi_b_mono_ns() / 1000;
+			rto = tend > now ? tend - now : 1;
+		}
 
-	int r = lsi_conn_read(ctx->con, tok, ctx->v3tags_raw, &ctx->v3ntags, to_us);
+		bool capped = lw && (!rto || lw < rto);
+		if (capped)
+			rto = lw;
+
+		for (size_t i = 0; i < COUNTOF(ctx->v3tags_dec); i++)
+			ctx->v3tags_dec[i][0] = '\0';
+		ctx->v3ntags = COUNTOF(ctx->v3tags_raw);
+
+		r = lsi_conn_read(ctx->con, tok, ctx->v3tags_raw,
+		    &ctx->v3ntags, rto);
+
+		if (r != 0 || !capped)
+			break;
+	}
+
+	if (r >= 0 && ctx->tracking_enab) {
+		uint64_t t = lsi_b_mono_ns();
+		lsi_trk_tick(ctx, r ? tok : NULL);
+		ctx->con->stats.track_ns += lsi_b_mono_ns() - t;
+	}
 
 	if (r == 0)
 		return 0;
@@ -479,6 +634,34 @@ irc_reg_msghnd(irc *ctx, const char *cmd, uhnd_fn hndfn, bool pre)
 	return lsi_msg_reguhnd(ctx, cmd, hndfn, pre);
 }
 
+bool
+irc_set_histograms(irc *ctx, bool on)
+{
+	return lsi_msg_sethist(ctx, on);
+}
+
+bool
+irc_latency_hist(irc *ctx, struct irc_hist *dest)
+{
+	if (!ctx->lathist)
+		return false;
+
+	*dest = *ctx->lathist;
+	return true;
+}
+
+bool
+irc_handler_hist(irc *ctx, const char *cmd, uhnd_fn hndfn, bool pre,
+    struct irc_hist *dest)
+{
+	const struct irc_hist *h = lsi_msg_uhndhist(ctx, cmd, hndfn, pre);
+	if (!h)
+		return false;
+
+	*dest = *h;
+	return true;
+}
+
 void
 irc_dump(irc *ctx)
 {
@@ -543,6 +726,59 @@ irc_dump(irc *ctx)
 	return;
 }
 
+/* forget about the previous session and put the message handlers in
+ * place for a new one */
+static bool
+new_session(irc *ctx)
+{
+	lsi_trk_deinit(ctx);
+	ctx->tracking_enab = false;
+
+	lsi_imh_unregall(ctx);
+	if (!lsi_imh_regall(ctx, ctx->dumb))
+		return false;
+
+	lsi_v3_unregall(ctx);
+	if (!lsi_v3_regall(ctx, ctx->dumb))
+		return false;
+
+	reset_state(ctx);
+
+	for (size_t i = 0; i < COUNTOF(ctx->logonconv); i++) {
+		lsi_ut_freearr(ctx->logonconv[i]);
+		ctx->logonconv[i] = NULL;
+	}
+
+	void *v;
+	if (lsi_skmap_first(ctx->m005attrs, NULL, &v))
+		do free(v); while (lsi_skmap_next(ctx->m005attrs, NULL, &v));
+	lsi_skmap_clear(ctx->m005attrs);
+
+	return true;
+}
+
+static bool
+read_all(int sck, void *buf, size_t len, uint64_t tend)
+{
+	uint64_t trem = 0;
+	size_t got = 0;
+
+	while (got < len) {
+		if (lsi_com_check_timeout(tend, &trem)) {
+			W("timeout reading from sck %d", sck);
+			return false;
+		}
+
+		long n = lsi_b_read(sck, (char *)buf + got, len - got, trem);
+		if (n < 0)
+			return false;
+
+		got += (size_t)n;
+	}
+
+	return true;
+}
+
 static void
 reset_state(irc *ctx)
 {
@@ -567,5 +803,6 @@ reset_state(irc *ctx)
 	for (size_t i = 0; i < COUNTOF(ctx->v3tags_dec); i++)
 		ctx->v3tags_dec[i][0] = '\0';
 	ctx->v3ntags = 0;
+	lsi_lag_reset(ctx);
 	return;
 }
@@ -325,6 +325,25 @@ irc_set_px(irc *ctx, const char *host, uint16_t port, int ptype)
 	return lsi_conn_set_px(ctx->con, host, port, ptype);
 }
 
+bool
+irc_add_px(irc *ctx, const char *host, uint16_t port, int ptype)
+{
+	return lsi_conn_add_pxhop(ctx->con, host, port, ptype);
+}
+
+bool
+irc_add_pxpool(irc *ctx, const char *host, uint16_t port, int ptype)
+{
+	return lsi_conn_add_pxpool(ctx->con, host, port, ptype);
+}
+
+bool
+irc_pxpool_stat(irc *ctx, size_t idx, uint64_t *lat_us, unsigned *nok,
+    unsigned *nfail)
+{
+	return lsi_conn_pxpool_stat(ctx->con, idx, lat_us, nok, nfail);
+}
+
 void
 irc_set_conflags(irc *ctx, uint8_t flags)
 {
@@ -373,6 +392,20 @@ irc_set_connect_timeout(irc *ctx, uint64_t soft, uint64_t hard)
 	return;
 }
 
+void
+irc_set_dns_ttl(irc *ctx, uint64_t ttl_us, uint64_t negttl_us)
+{
+	lsi_conn_set_dnsttl(ctx->con, ttl_us, negttl_us);
+	return;
+}
+
+void
+irc_set_sockopts(irc *ctx, const struct irc_sockopts *so)
+{
+	lsi_conn_set_sockopts(ctx->con, so);
+	return;
+}
+
 bool
 irc_set_ssl(irc *ctx, bool on)
 {
@@ -393,3 +426,10 @@ irc_set_dumb(irc *ctx, bool dumbmode)
 	ctx->dumb = dumbmode;
 	return;
 }
+
+void
+irc_stats(irc *ctx, struct irc_stats *dest)
+{
+	*dest = ctx->con->stats;
+	return;
+}
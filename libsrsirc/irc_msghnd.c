@@ -24,6 +24,7 @@
 #include "common.h"
 #include "conn.h"
 #include "irc_track_int.h"
+#include "lag.h"
 #include "msg.h"
 #include "v3.h"
 
@@ -108,8 +109,9 @@ handle_004(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 static uint16_t
 handle_PING(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 {
-	/* We only handle PINGs at logon. It's the user's job afterwards. */
-	if (!logon)
+	/* We only handle PINGs at logon. It's the user's job afterwards,
+	 * unless the lag monitor is on (which does keepalive for them) */
+	if (!logon && !ctx->lagint)
 		return 0;
 
 	if (nargs < 3)
@@ -117,11 +119,21 @@ handle_PING(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 
 	char buf[256];
 	snprintf(buf, sizeof buf, "PONG :%s\r\n", (*msg)[2]);
-	D("Replying to a logon-time PING (%s)", (*msg)[2]);
+	D("Replying to a PING (%s)", (*msg)[2]);
 
 	return lsi_conn_write(ctx->con, buf) ? 0 : IO_ERR;
 }
 
+/* Feeds the lag monitor; PONGs still make it to the user */
+static uint16_t
+handle_PONG(irc *ctx, tokarr *msg, size_t nargs, bool logon)
+{
+	if (nargs >= 3)
+		lsi_lag_pong(ctx, (*msg)[nargs-1]);
+
+	return 0;
+}
+
 /* This handles 432, 433, 436 and 437 all of which signal us that
  * we can't have the nickname we wanted */
 static uint16_t
@@ -400,6 +412,8 @@ handle_005(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 		else {
 			ctx->tracking_enab = true;
 			I("tracking enabled");
+			if (!lsi_trk_seed(ctx))
+				W("failed to restore tracking snapshot");
 		}
 	}
 
@@ -424,6 +438,7 @@ lsi_imh_regall(irc *ctx, bool dumb)
 		fail = fail || !lsi_msg_reghnd(ctx, "464", handle_464, "core");
 	}
 
+	fail = fail || !lsi_msg_reghnd(ctx, "PONG", handle_PONG, "core");
 	fail = fail || !lsi_msg_reghnd(ctx, "NICK", handle_NICK, "core");
 	fail = fail || !lsi_msg_reghnd(ctx, "ERROR", handle_ERROR, "core");
 	fail = fail || !lsi_msg_reghnd(ctx, "MODE", handle_MODE, "core");
@@ -13,10 +13,14 @@
 
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <platform/base_io.h>
+#include <platform/base_misc.h>
 #include <platform/base_string.h>
+#include <platform/base_time.h>
 
 #include <logger/intlog.h>
 
@@ -26,6 +30,7 @@
 #include "intdefs.h"
 #include "common.h"
 #include "msg.h"
+#include "state.h"
 #include "ucbase.h"
 #include "irc_track_int.h"
 
@@ -45,6 +50,22 @@ static uint16_t h_PRIVMSG(irc *ctx, tokarr *msg, size_t nargs, bool logon);
 static uint16_t h_NOTICE(irc *ctx, tokarr *msg, size_t nargs, bool logon);
 static uint16_t h_324(irc *ctx, tokarr *msg, size_t nargs, bool logon);
 static uint16_t h_TOPIC(irc *ctx, tokarr *msg, size_t nargs, bool logon);
+static uint16_t h_367(irc *ctx, tokarr *msg, size_t nargs, bool logon);
+static uint16_t h_368(irc *ctx, tokarr *msg, size_t nargs, bool logon);
+static uint16_t h_348(irc *ctx, tokarr *msg, size_t nargs, bool logon);
+static uint16_t h_349(irc *ctx, tokarr *msg, size_t nargs, bool logon);
+static uint16_t h_346(irc *ctx, tokarr *msg, size_t nargs, bool logon);
+static uint16_t h_347(irc *ctx, tokarr *msg, size_t nargs, bool logon);
+
+static chan *getchan(irc *ctx, const char *name);
+static void degrade(irc *ctx, chan *c);
+static bool strict(irc *ctx);
+static bool issplit(tokarr *msg, size_t nargs);
+static uint16_t listent(irc *ctx, tokarr *msg, size_t nargs, char mode,
+    unsigned bit);
+static uint16_t listend(irc *ctx, tokarr *msg, size_t nargs, char mode,
+    unsigned bit);
+static void collect(const struct mlinfo *e, void *tag);
 
 bool
 lsi_trk_init(irc *ctx)
@@ -66,6 +87,12 @@ lsi_trk_init(irc *ctx)
 	fail = fail || !lsi_msg_reghnd(ctx, "NOTICE", h_NOTICE, "track");
 	fail = fail || !lsi_msg_reghnd(ctx, "324", h_324, "track");
 	fail = fail || !lsi_msg_reghnd(ctx, "TOPIC", h_TOPIC, "track");
+	fail = fail || !lsi_msg_reghnd(ctx, "367", h_367, "track");
+	fail = fail || !lsi_msg_reghnd(ctx, "368", h_368, "track");
+	fail = fail || !lsi_msg_reghnd(ctx, "348", h_348, "track");
+	fail = fail || !lsi_msg_reghnd(ctx, "349", h_349, "track");
+	fail = fail || !lsi_msg_reghnd(ctx, "346", h_346, "track");
+	fail = fail || !lsi_msg_reghnd(ctx, "347", h_347, "track");
 
 	if (fail || !lsi_ucb_init(ctx)) {
 		lsi_msg_unregall(ctx, "track");
@@ -84,6 +111,115 @@ lsi_trk_deinit(irc *ctx)
 	return;
 }
 
+/* restore what irc_track_load() left for us, now that tracking is on */
+bool
+lsi_trk_seed(irc *ctx)
+{
+	if (!ctx->trkseed)
+		return true;
+
+	bool ok = lsi_st_load(ctx, ctx->trkseed, ctx->trkseed_len,
+	    LSI_ST_TRACK|LSI_ST_STALE);
+
+	lsi_b_unmapfile(ctx->trkseed, ctx->trkseed_len);
+	ctx->trkseed = NULL;
+	ctx->trkseed_len = 0;
+	return ok;
+}
+
+/* decide whether to track channel `chname' (when we join it) */
+bool
+lsi_trk_wanted(irc *ctx, const char *chname)
+{
+	if (ctx->trkpats) {
+		char **p = ctx->trkpats;
+		while (*p && !lsi_ut_globmatch(*p, chname, ctx->casemap))
+			p++;
+
+		if (!*p)
+			return false;
+	}
+
+	return !ctx->cb_trkfilt || ctx->cb_trkfilt(ctx, chname, ctx->tag_trkfilt);
+}
+
+/* called for every message read (before it is handled), or with msg NULL
+ * if irc_read() timed out.  drops the users lost in a netsplit once the
+ * burst of QUITs is over and the grace period has expired */
+void
+lsi_trk_tick(irc *ctx, tokarr *msg)
+{
+	if (!ctx->nsplit)
+		return;
+
+	if (msg && (*msg)[1] && strcmp((*msg)[1], "QUIT") == 0) {
+		size_t nargs = 2;
+		while (nargs < COUNTOF(*msg) && (*msg)[nargs])
+			nargs++;
+
+		if (issplit(msg, nargs))
+			return;
+	}
+
+	if (lsi_b_tstamp_us() - ctx->splitlast < ctx->splitgrace)
+		return;
+
+	lsi_ucb_drop_split(ctx);
+	return;
+}
+
+/* look up a channel a message refers to, without complaining about the
+ * ones we deliberately don't track */
+static chan *
+getchan(irc *ctx, const char *name)
+{
+	chan *c = lsi_ucb_get_chan(ctx, name, false);
+	if (!c && !lsi_skmap_get(ctx->untracked, name))
+		W("we don't know channel '%s'!", name);
+
+	return c;
+}
+
+/* we're over the memory limit; rather than growing any further, forget
+ * about the members of the channel that was about to grow */
+static void
+degrade(irc *ctx, chan *c)
+{
+	W("tracking memory limit (%zu) reached, dropping members of '%s'",
+	    ctx->trkmax, c->name);
+
+	lsi_ucb_clear_memb(ctx, c);
+	c->desync = c->nomemb = true;
+	return;
+}
+
+/* whether we track every channel we're in, i.e. should know every user we
+ * see in a channel context */
+static bool
+strict(irc *ctx)
+{
+	return lsi_skmap_count(ctx->untracked) == 0;
+}
+
+/* "<server> <server>" is what a QUIT says when it's due to a netsplit;
+ * many networks hide the server names as in "*.net *.split" */
+static bool
+issplit(tokarr *msg, size_t nargs)
+{
+	if (nargs < 3)
+		return false;
+
+	const char *r = (*msg)[2];
+	const char *sp = strchr(r, ' ');
+	if (!sp || sp == r || !sp[1] || strchr(sp + 1, ' '))
+		return false;
+
+	if (!memchr(r, '.', (size_t)(sp - r)) || !strchr(sp + 1, '.'))
+		return false;
+
+	return !strpbrk(r, "!@:/\\,");
+}
+
 
 static uint16_t
 h_JOIN(irc *ctx, tokarr *msg, size_t nargs, bool logon)
@@ -95,20 +231,49 @@ h_JOIN(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	lsi_ut_ident2nick(nick, sizeof nick, (*msg)[0]);
 
 	bool me = lsi_ut_istrcmp(nick, ctx->mynick, ctx->casemap) == 0;
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[2], !me);
+	chan *c = me ? lsi_ucb_get_chan(ctx, (*msg)[2], false)
+	    : getchan(ctx, (*msg)[2]);
 
 	if (me) {
-		if (!c && !lsi_ucb_add_chan(ctx, (*msg)[2])) {
+		if (c)
+			return 0;
+
+		if (!lsi_trk_wanted(ctx, (*msg)[2])) {
+			D("not tracking chan '%s' (filtered)", (*msg)[2]);
+			if (!lsi_skmap_put(ctx->untracked, (*msg)[2], ctx))
+				return ALLOC_ERR;
+			return 0;
+		}
+
+		if (!lsi_ucb_add_chan(ctx, (*msg)[2])) {
 			E("not tracking chan '%s'", (*msg)[2]);
 			return ALLOC_ERR;
 		}
 	} else {
-		if (!c) {
-			W("we don't know channel '%s'!", (*msg)[2]);
+		if (!c || c->nomemb)
+			return 0;
+
+		if (lsi_ucb_overlimit(ctx)) {
+			degrade(ctx, c);
 			return 0;
 		}
 
 		user *u = lsi_ucb_get_user(ctx, (*msg)[0], false);
+		memb *m;
+		if (u && (m = lsi_ucb_get_memb(ctx, c, u->nick, false))) {
+			/* back from a netsplit before we dropped them (or we
+			 * missed them leaving); they lost their channel modes
+			 * on the way though.  only this channel is back; the
+			 * ones they don't rejoin still go */
+			lsi_ucb_set_split(ctx, m, false);
+			if (m->modepfx[0]) {
+				m->modepfx[0] = '\0';
+				lsi_ucb_emit(ctx, TRKEV_MEMB_MODE, c->name,
+				    u->nick, m->modepfx);
+			}
+			return 0;
+		}
+
 		bool uadd = false;
 		if (!u) {
 			uadd = true;
@@ -139,16 +304,19 @@ h_352(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	if (!(*msg)[0] || nargs < 10)
 		return PROTO_ERR;
 
-	user *u = lsi_ucb_get_user(ctx, (*msg)[7], true);
+	user *u = lsi_ucb_get_user(ctx, (*msg)[7], strict(ctx));
 	if (!u)
 		return 0;
 
+	bool chg = false;
+
 	if (!u->uname || lsi_ut_istrcmp(u->uname, (*msg)[4], ctx->casemap) != 0) {
 		if (u->uname)
 			W("username for '%s' changed from '%s' to '%s'!",
 			    u->nick, u->uname, (*msg)[4]);
 
-		lsi_com_update_strprop(&u->uname, (*msg)[4]);
+		lsi_ucb_set_userstr(ctx, &u->uname, (*msg)[4]);
+		chg = true;
 	}
 
 	if (!u->host || lsi_ut_istrcmp(u->host, (*msg)[5], ctx->casemap) != 0) {
@@ -156,7 +324,8 @@ h_352(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 			W("host for '%s' changed from '%s' to '%s'!",
 			    u->nick, u->host, (*msg)[5]);
 
-		lsi_com_update_strprop(&u->host, (*msg)[5]);
+		lsi_ucb_set_userstr(ctx, &u->host, (*msg)[5]);
+		chg = true;
 	}
 
 	const char *fname = strchr((*msg)[9], ' ');
@@ -168,9 +337,13 @@ h_352(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 			W("fullname for '%s' changed from '%s' to '%s'!",
 			    u->nick, u->fname, fname+1);
 
-		lsi_com_update_strprop(&u->fname, fname+1);
+		lsi_ucb_set_userstr(ctx, &u->fname, fname+1);
+		chg = true;
 	}
 
+	if (chg)
+		lsi_ucb_emit(ctx, TRKEV_USER_UPDATE, NULL, u->nick, NULL);
+
 	return 0;
 }
 
@@ -184,15 +357,14 @@ h_332(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	if (!(*msg)[0] || nargs < 5)
 		return PROTO_ERR;
 
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[3], true);
-	if (!c) {
-		W("we don't know channel '%s'!", (*msg)[3]);
+	chan *c = getchan(ctx, (*msg)[3]);
+	if (!c)
 		return 0;
-	}
-	free(c->topic);
-	if (!(c->topic = STRDUP((*msg)[4])))
+
+	if (!lsi_ucb_set_chanstr(ctx, &c->topic, (*msg)[4]))
 		return ALLOC_ERR;
 
+	lsi_ucb_emit(ctx, TRKEV_TOPIC, c->name, c->topicnick, c->topic);
 	return 0;
 }
 
@@ -202,17 +374,16 @@ h_333(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	if (!(*msg)[0] || nargs < 6)
 		return PROTO_ERR;
 
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[3], true);
-	if (!c) {
-		W("we don't know channel '%s'!", (*msg)[3]);
+	chan *c = getchan(ctx, (*msg)[3]);
+	if (!c)
 		return 0;
-	}
-	free(c->topicnick);
-	if (!(c->topicnick = STRDUP((*msg)[4])))
+
+	if (!lsi_ucb_set_chanstr(ctx, &c->topicnick, (*msg)[4]))
 		return ALLOC_ERR;
 
 	c->tstopic = (uint64_t)strtoull((*msg)[5], NULL, 10);
 
+	lsi_ucb_emit(ctx, TRKEV_TOPIC, c->name, c->topicnick, c->topic);
 	return 0;
 }
 
@@ -222,17 +393,22 @@ h_353(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	if (!(*msg)[0] || nargs < 6)
 		return PROTO_ERR;
 
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[4], true);
-	if (!c) {
-		W("we don't know channel '%s'!", (*msg)[4]);
+	chan *c = getchan(ctx, (*msg)[4]);
+	if (!c)
 		return 0;
-	}
 
 	if (ctx->endofnames) {
-		lsi_ucb_clear_memb(ctx, c);
+		/* a fresh NAMES reply; try again if there's room now */
+		if (c->nomemb && !lsi_ucb_overlimit(ctx))
+			c->nomemb = false;
+		if (!c->nomemb)
+			lsi_ucb_clear_memb(ctx, c);
 		ctx->endofnames = false;
 	}
 
+	if (c->nomemb)
+		return 0;
+
 	char nick[MAX_NICK_LEN];
 	const char *p = (*msg)[5];
 	for (;;) {
@@ -251,6 +427,11 @@ h_353(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 
 		lsi_b_strNcpy(nick, p, len + 1);
 
+		if (lsi_ucb_overlimit(ctx)) {
+			degrade(ctx, c);
+			return 0;
+		}
+
 		user *u = lsi_ucb_get_user(ctx, nick, false);
 		bool uadd = false;
 		if (!u) {
@@ -281,13 +462,100 @@ h_366(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 
 	ctx->endofnames = true;
 
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[3], true);
-	if (!c) {
-		W("we don't know channel '%s'!", (*msg)[3]);
+	chan *c = getchan(ctx, (*msg)[3]);
+	if (!c)
 		return 0;
-	}
+
+	if (c->nomemb)
+		return 0;
+
 	c->desync = false;
 
+	lsi_ucb_emit(ctx, TRKEV_CHAN_SYNC, c->name, NULL, NULL);
+	return 0;
+}
+
+/* 367    RPL_BANLIST        "<channel> <banmask> [<setter> <time>]"
+ * 368    RPL_ENDOFBANLIST   "<channel> :End of channel ban list"
+ * 348    RPL_EXCEPTLIST     "<channel> <exceptionmask> [...]"
+ * 349    RPL_ENDOFEXCEPTLIST
+ * 346    RPL_INVITELIST     "<channel> <invitemask> [...]"
+ * 347    RPL_ENDOFINVITELIST
+ * (setter and time are not in the RFC, but everybody sends them) */
+static uint16_t
+h_367(irc *ctx, tokarr *msg, size_t nargs, bool logon)
+{
+	return listent(ctx, msg, nargs, 'b', 1u);
+}
+
+static uint16_t
+h_368(irc *ctx, tokarr *msg, size_t nargs, bool logon)
+{
+	return listend(ctx, msg, nargs, 'b', 1u);
+}
+
+static uint16_t
+h_348(irc *ctx, tokarr *msg, size_t nargs, bool logon)
+{
+	return listent(ctx, msg, nargs, 'e', 2u);
+}
+
+static uint16_t
+h_349(irc *ctx, tokarr *msg, size_t nargs, bool logon)
+{
+	return listend(ctx, msg, nargs, 'e', 2u);
+}
+
+static uint16_t
+h_346(irc *ctx, tokarr *msg, size_t nargs, bool logon)
+{
+	return listent(ctx, msg, nargs, 'I', 4u);
+}
+
+static uint16_t
+h_347(irc *ctx, tokarr *msg, size_t nargs, bool logon)
+{
+	return listend(ctx, msg, nargs, 'I', 4u);
+}
+
+static uint16_t
+listent(irc *ctx, tokarr *msg, size_t nargs, char mode, unsigned bit)
+{
+	if (!(*msg)[0] || nargs < 5)
+		return PROTO_ERR;
+
+	chan *c = getchan(ctx, (*msg)[3]);
+	if (!c)
+		return 0;
+
+	/* the first one replaces whatever we had */
+	if (!(c->lsync & bit)) {
+		lsi_ucb_clear_list(ctx, c, mode);
+		c->lsync |= bit;
+	}
+
+	uint64_t ts = nargs > 6 ? (uint64_t)strtoull((*msg)[6], NULL, 10) : 0;
+	if (!lsi_ucb_add_listent(ctx, c, mode, (*msg)[4],
+	    nargs > 5 ? (*msg)[5] : NULL, ts))
+		return ALLOC_ERR;
+
+	return 0;
+}
+
+static uint16_t
+listend(irc *ctx, tokarr *msg, size_t nargs, char mode, unsigned bit)
+{
+	if (!(*msg)[0] || nargs < 4)
+		return PROTO_ERR;
+
+	chan *c = getchan(ctx, (*msg)[3]);
+	if (!c)
+		return 0;
+
+	if (!(c->lsync & bit)) // the list is empty
+		lsi_ucb_clear_list(ctx, c, mode);
+
+	c->lsync &= ~bit;
 	return 0;
 }
 
@@ -299,20 +567,22 @@ h_PART(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 
 	char nick[MAX_NICK_LEN];
 	lsi_ut_ident2nick(nick, sizeof nick, (*msg)[0]);
-	lsi_ucb_touch_user(ctx, (*msg)[0], true);
+	lsi_ucb_touch_user(ctx, (*msg)[0], strict(ctx));
 
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[2], true);
-	if (!c) {
-		W("we don't know channel '%s'!", (*msg)[2]);
+	bool me = lsi_ut_istrcmp(nick, ctx->mynick, ctx->casemap) == 0;
+	if (me && lsi_skmap_del(ctx->untracked, (*msg)[2]))
 		return 0;
-	}
 
-	if (lsi_ut_istrcmp(nick, ctx->mynick, ctx->casemap) == 0)
+	chan *c = getchan(ctx, (*msg)[2]);
+	if (!c)
+		return 0;
+
+	if (me)
 		lsi_ucb_drop_chan(ctx, c);
 	else {
-		user *u = lsi_ucb_get_user(ctx, (*msg)[0], true);
+		user *u = lsi_ucb_get_user(ctx, (*msg)[0], strict(ctx));
 		if (u)
-			lsi_ucb_drop_memb(ctx, c, u, true, true);
+			lsi_ucb_drop_memb(ctx, c, u, true, !c->nomemb);
 	}
 
 	return 0;
@@ -324,10 +594,19 @@ h_QUIT(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	if (!(*msg)[0])
 		return PROTO_ERR;
 
-	lsi_ucb_touch_user(ctx, (*msg)[0], true);
+	lsi_ucb_touch_user(ctx, (*msg)[0], strict(ctx));
 
-	user *u = lsi_ucb_get_user(ctx, (*msg)[0], true);
-	if (u)
+	user *u = lsi_ucb_get_user(ctx, (*msg)[0], strict(ctx));
+	if (!u)
+		return 0;
+
+	/* a netsplit comes as a burst of these; rather than dropping the
+	 * users one at a time, collect them and let lsi_trk_tick() drop them
+	 * all at once when it's over (or when they didn't come back in time) */
+	if (issplit(msg, nargs) && u->nchans) {
+		lsi_ucb_split_user(ctx, u);
+		ctx->splitlast = lsi_b_tstamp_us();
+	} else
 		lsi_ucb_drop_user(ctx, u);
 
 	return 0;
@@ -339,19 +618,22 @@ h_KICK(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	if (!(*msg)[0] || nargs < 4)
 		return PROTO_ERR;
 
-	lsi_ucb_touch_user(ctx, (*msg)[0], true);
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[2], true);
-	if (!c) {
-		W("we don't know channel '%s'!", (*msg)[2]);
+	lsi_ucb_touch_user(ctx, (*msg)[0], strict(ctx));
+
+	bool me = lsi_ut_istrcmp((*msg)[3], ctx->mynick, ctx->casemap) == 0;
+	if (me && lsi_skmap_del(ctx->untracked, (*msg)[2]))
 		return 0;
-	}
 
-	if (lsi_ut_istrcmp((*msg)[3], ctx->mynick, ctx->casemap) == 0)
+	chan *c = getchan(ctx, (*msg)[2]);
+	if (!c)
+		return 0;
+
+	if (me)
 		lsi_ucb_drop_chan(ctx, c);
 	else {
 		user *u = lsi_ucb_get_user(ctx, (*msg)[3], true);
 		if (u)
-			lsi_ucb_drop_memb(ctx, c, u, true, true);
+			lsi_ucb_drop_memb(ctx, c, u, true, !c->nomemb);
 	}
 
 	return 0;
@@ -365,7 +647,11 @@ h_NICK(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	if (!(*msg)[0] || nargs < 3)
 		return PROTO_ERR;
 
-	lsi_ucb_touch_user(ctx, (*msg)[0], true);
+	lsi_ucb_touch_user(ctx, (*msg)[0], strict(ctx));
+
+	/* probably someone we only share untracked channels with */
+	if (!strict(ctx) && !lsi_ucb_get_user(ctx, (*msg)[0], false))
+		return 0;
 
 	bool aerr;
 	if (!lsi_ucb_rename_user(ctx, (*msg)[0], (*msg)[2], &aerr)) {
@@ -382,22 +668,19 @@ h_TOPIC(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	if (!(*msg)[0] || nargs < 4)
 		return PROTO_ERR;
 
-	lsi_ucb_touch_user(ctx, (*msg)[0], true);
+	lsi_ucb_touch_user(ctx, (*msg)[0], strict(ctx));
 	char nick[MAX_NICK_LEN];
 	lsi_ut_ident2nick(nick, sizeof nick, (*msg)[0]);
 
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[2], true);
-	if (!c) {
-		W("we don't know channel '%s'!", (*msg)[2]);
+	chan *c = getchan(ctx, (*msg)[2]);
+	if (!c)
 		return 0;
-	}
-	free(c->topic);
-	free(c->topicnick);
-	c->topicnick = NULL;
-	if (!(c->topic = STRDUP((*msg)[3]))
-	    || !(c->topicnick = STRDUP(nick)))
+
+	if (!lsi_ucb_set_chanstr(ctx, &c->topic, (*msg)[3])
+	    || !lsi_ucb_set_chanstr(ctx, &c->topicnick, nick))
 		return ALLOC_ERR;
 
+	lsi_ucb_emit(ctx, TRKEV_TOPIC, c->name, c->topicnick, c->topic);
 	return 0;
 }
 
@@ -413,39 +696,31 @@ h_MODE_chanmode(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	lsi_ut_ident2nick(nick, sizeof nick, (*msg)[0]);
 
 	if (!strchr(nick, '.')) //servermode
-		lsi_ucb_touch_user(ctx, (*msg)[0], true);
+		lsi_ucb_touch_user(ctx, (*msg)[0], strict(ctx));
 
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[2], true);
-	if (!c) {
-		W("we don't know channel '%s'!", (*msg)[2]);
+	chan *c = getchan(ctx, (*msg)[2]);
+	if (!c)
 		return 0;
-	}
 
-	size_t num;
-	char **p = lsi_ut_parse_MODE(ctx, msg, &num, false);
-	if (!p)
-		return ALLOC_ERR;
-
-	for (size_t i = 0; i < num; i++) {
-		bool enab = p[i][0] == '+';
-		char *ptr = strchr(ctx->m005modepfx[0], p[i][1]);
-		if (ptr) {
-			char sym = ctx->m005modepfx[1][ptr - ctx->m005modepfx[0]];
-			lsi_ucb_update_modepfx(ctx, c, p[i] + 3, sym, enab); //XXX chk
-		} else {
-			if (enab) {
-				if (!lsi_ucb_add_chanmode(ctx, c, p[i] + 1))
-					res |= ALLOC_ERR;
-			} else
-				lsi_ucb_drop_chanmode(ctx, c, p[i] + 1);
-		}
+	modeiter it;
+	modechg mc;
+	lsi_ut_modeiter_init(ctx, &it, msg, false);
+	while (lsi_ut_modeiter_next(ctx, &it, &mc)) {
+		if (mc.pfx) {
+			if (!c->nomemb) //XXX chk
+				lsi_ucb_update_modepfx(ctx, c, mc.arg, mc.pfx,
+				    mc.enab);
+		} else if (mc.enab && mc.cls == CHANMODE_CLASS_A) {
+			if (!lsi_ucb_add_listent(ctx, c, mc.mode, mc.arg, nick,
+			    lsi_b_tstamp_us() / 1000000))
+				res |= ALLOC_ERR;
+		} else if (mc.enab) {
+			if (!lsi_ucb_add_chanmode(ctx, c, mc.mode, mc.arg))
+				res |= ALLOC_ERR;
+		} else
+			lsi_ucb_drop_chanmode(ctx, c, mc.mode, mc.arg);
 	}
 
-	for (size_t i = 0; i < num; i++)
-		free(p[i]);
-
-	free(p);
-
 	return res;
 }
 
@@ -502,33 +777,23 @@ h_324(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 
 	uint16_t res = 0;
 
-	chan *c = lsi_ucb_get_chan(ctx, (*msg)[3], true);
-	if (!c) {
-		W("we don't know channel '%s'!", (*msg)[3]);
+	chan *c = getchan(ctx, (*msg)[3]);
+	if (!c)
 		return 0;
-	}
-
-	size_t num;
-	char **p = lsi_ut_parse_MODE(ctx, msg, &num, true);
-	if (!p)
-		return ALLOC_ERR;
 
 	lsi_ucb_clear_chanmodes(ctx, c);
 
-	for (size_t i = 0; i < num; i++) {
-		bool enab = p[i][0] == '+';
-		if (enab) {
-			if (!lsi_ucb_add_chanmode(ctx, c, p[i] + 1))
+	modeiter it;
+	modechg mc;
+	lsi_ut_modeiter_init(ctx, &it, msg, true);
+	while (lsi_ut_modeiter_next(ctx, &it, &mc)) {
+		if (mc.enab) {
+			if (!lsi_ucb_add_chanmode(ctx, c, mc.mode, mc.arg))
 				res |= ALLOC_ERR;
 		} else
-			lsi_ucb_drop_chanmode(ctx, c, p[i] + 1);
+			lsi_ucb_drop_chanmode(ctx, c, mc.mode, mc.arg);
 	}
 
-	for (size_t i = 0; i < num; i++)
-		free(p[i]);
-
-	free(p);
-
 	return res;
 }
 
@@ -554,12 +819,15 @@ h_311(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 	if (!u)
 		return 0;
 
+	bool chg = false;
+
 	if (!u->uname || lsi_ut_istrcmp(u->uname, (*msg)[4], ctx->casemap) != 0) {
 		if (u->uname)
 			W("username for '%s' changed from '%s' to '%s'!",
 			    u->nick, u->uname, (*msg)[4]);
 
-		lsi_com_update_strprop(&u->uname, (*msg)[4]);
+		lsi_ucb_set_userstr(ctx, &u->uname, (*msg)[4]);
+		chg = true;
 	}
 
 	if (!u->host || lsi_ut_istrcmp(u->host, (*msg)[5], ctx->casemap) != 0) {
@@ -567,7 +835,8 @@ h_311(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 			W("host for '%s' changed from '%s' to '%s'!",
 			    u->nick, u->host, (*msg)[5]);
 
-		lsi_com_update_strprop(&u->host, (*msg)[5]);
+		lsi_ucb_set_userstr(ctx, &u->host, (*msg)[5]);
+		chg = true;
 	}
 
 	if (!u->fname || lsi_ut_istrcmp(u->fname, (*msg)[7], ctx->casemap) != 0) {
@@ -575,9 +844,13 @@ h_311(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 			W("fullname for '%s' changed from '%s' to '%s'!",
 			    u->nick, u->fname, (*msg)[7]);
 
-		lsi_com_update_strprop(&u->fname, (*msg)[7]);
+		lsi_ucb_set_userstr(ctx, &u->fname, (*msg)[7]);
+		chg = true;
 	}
 
+	if (chg)
+		lsi_ucb_emit(ctx, TRKEV_USER_UPDATE, NULL, u->nick, NULL);
+
 	return 0;
 }
 
@@ -643,6 +916,7 @@ mkchanrep(chanrep *dest, chan *c)
 	dest->topicnick = c->topicnick;
 	dest->tscreate = c->tscreate;
 	dest->tstopic = c->tstopic;
+	dest->desync = c->desync;
 	dest->tag = c->tag;
 	return dest;
 }
@@ -657,6 +931,87 @@ irc_chan(irc *ctx, chanrep *dest, const char *name)
 	return mkchanrep(dest, c);
 }
 
+bool
+irc_chanmode(irc *ctx, const char *chname, char mode, const char *mask,
+    const char **arg)
+{
+	if (arg)
+		*arg = NULL;
+
+	chan *c = lsi_ucb_get_chan(ctx, chname, false);
+	if (!c)
+		return false;
+
+	return lsi_ucb_has_chanmode(ctx, c, mode, mask, arg);
+}
+
+struct listcoll {
+	char mode;
+	listrep *dest;
+	size_t cnt;
+	size_t max;
+};
+
+static void
+collect(const struct mlinfo *e, void *tag)
+{
+	struct listcoll *lc = tag;
+	if (e->mode != lc->mode || lc->cnt == lc->max)
+		return;
+
+	listrep *lr = &lc->dest[lc->cnt++];
+	lr->mode = e->mode;
+	lr->mask = e->mask;
+	lr->setter = e->setter;
+	lr->ts = e->ts;
+	return;
+}
+
+size_t
+irc_chanlist(irc *ctx, const char *chname, char mode, listrep *dest,
+    size_t dest_cnt)
+{
+	chan *c = lsi_ucb_get_chan(ctx, chname, false);
+	if (!c || !c->cmlists)
+		return 0;
+
+	struct listcoll lc = { mode, dest, 0, dest_cnt };
+	lsi_mlist_each(c->cmlists, collect, &lc);
+	return lc.cnt;
+}
+
+bool
+irc_chanlist_match(irc *ctx, const char *chname, char mode,
+    const char *ident, listrep *dest)
+{
+	chan *c = lsi_ucb_get_chan(ctx, chname, false);
+	if (!c || !c->cmlists)
+		return false;
+
+	char full[MAX_NICK_LEN + MAX_UNAME_LEN + MAX_HOST_LEN];
+	if (!strchr(ident, '!')) {
+		user *u = lsi_ucb_get_user(ctx, ident, false);
+		if (u && u->uname && u->host) {
+			snprintf(full, sizeof full, "%s!%s@%s",
+			    u->nick, u->uname, u->host);
+			ident = full;
+		}
+	}
+
+	struct mlinfo mi;
+	if (!lsi_mlist_match(c->cmlists, mode, ident, &mi))
+		return false;
+
+	if (dest) {
+		dest->mode = mi.mode;
+		dest->mask = mi.mask;
+		dest->setter = mi.setter;
+		dest->ts = mi.ts;
+	}
+
+	return true;
+}
+
 
 size_t
 irc_num_users(irc *ctx)
@@ -761,6 +1116,222 @@ irc_member(irc *ctx, userrep *dest, const char *chname, const char *ident)
 }
 
 
+static void
+cur_init(irc *ctx, irc_cur *cur, skmap *m)
+{
+	cur->ctx = ctx;
+	cur->map = m;
+	cur->bucket = 0;
+	cur->pos = NULL;
+	cur->gen = ctx->trkgen;
+	return;
+}
+
+static void *
+cur_step(irc_cur *cur)
+{
+	if (!cur->map || !irc_cur_valid(cur))
+		return NULL;
+
+	void *e;
+	bool ok = cur->pos
+	    ? lsi_skmap_cnext(cur->map, &cur->bucket, &cur->pos, NULL, &e)
+	    : lsi_skmap_cfirst(cur->map, &cur->bucket, &cur->pos, NULL, &e);
+
+	if (!ok) {
+		cur->map = NULL; // exhausted
+		return NULL;
+	}
+
+	return e;
+}
+
+void
+irc_cur_chans(irc *ctx, irc_cur *cur)
+{
+	cur_init(ctx, cur, ctx->chans);
+	return;
+}
+
+void
+irc_cur_users(irc *ctx, irc_cur *cur)
+{
+	cur_init(ctx, cur, ctx->users);
+	return;
+}
+
+bool
+irc_cur_members(irc *ctx, irc_cur *cur, const char *chname)
+{
+	chan *c = ctx->chans ? lsi_ucb_get_chan(ctx, chname, false) : NULL;
+	cur_init(ctx, cur, c ? c->memb : NULL);
+	return c;
+}
+
+const chanrep *
+irc_cur_nextchan(irc_cur *cur)
+{
+	chan *c = cur_step(cur);
+	return c ? mkchanrep(&cur->cr, c) : NULL;
+}
+
+const userrep *
+irc_cur_nextuser(irc_cur *cur)
+{
+	void *e = cur_step(cur);
+	if (!e)
+		return NULL;
+
+	if (cur->map == cur->ctx->users)
+		return mkuserrep(&cur->ur, e, NULL);
+
+	memb *m = e;
+	return mkuserrep(&cur->ur, m->u, m->modepfx);
+}
+
+bool
+irc_cur_valid(const irc_cur *cur)
+{
+	return cur->gen == cur->ctx->trkgen;
+}
+
+
+bool
+irc_track_filter(irc *ctx, const char *pats)
+{
+	char **arr = NULL;
+	size_t n = 0;
+
+	if (pats) {
+		/* upper bound on the number of patterns */
+		for (const char *p = pats; *p; p++)
+			n += *p == ' ' || *p == ',';
+
+		if (!(arr = MALLOC((n + 2) * sizeof *arr)))
+			return false;
+
+		n = 0;
+		const char *p = pats;
+		while (*p) {
+			size_t len = strcspn(p, " ,");
+			if (len) {
+				if (!(arr[n] = MALLOC(len + 1))) {
+					while (n)
+						free(arr[--n]);
+					free(arr);
+					return false;
+				}
+
+				memcpy(arr[n], p, len);
+				arr[n++][len] = '\0';
+			}
+
+			p += len;
+			if (*p)
+				p++;
+		}
+
+		arr[n] = NULL;
+		if (!n) { // nothing but separators
+			free(arr);
+			arr = NULL;
+		}
+	}
+
+	if (ctx->trkpats) {
+		for (char **p = ctx->trkpats; *p; p++)
+			free(*p);
+		free(ctx->trkpats);
+	}
+
+	ctx->trkpats = arr;
+	return true;
+}
+
+void
+irc_regcb_trkfilter(irc *ctx, fp_trk_filter cb, void *tag)
+{
+	ctx->cb_trkfilt = cb;
+	ctx->tag_trkfilt = tag;
+	return;
+}
+
+void
+irc_track_memusage(irc *ctx, struct irc_trkmem *dest)
+{
+	*dest = ctx->trkmem;
+	dest->total = dest->chans + dest->users + dest->membs + dest->maps;
+	return;
+}
+
+void
+irc_track_memlimit(irc *ctx, size_t maxbytes)
+{
+	ctx->trkmax = maxbytes;
+	return;
+}
+
+void
+irc_track_splitgrace(irc *ctx, uint64_t us)
+{
+	ctx->splitgrace = us;
+	return;
+}
+
+void
+irc_regcb_trkevent(irc *ctx, fp_trk_event cb, void *tag)
+{
+	ctx->cb_trkev = cb;
+	ctx->tag_trkev = tag;
+	return;
+}
+
+bool
+irc_track_save(irc *ctx, const char *path)
+{
+	if (!ctx->tracking_enab) {
+		W("tracking not enabled, nothing to save");
+		return false;
+	}
+
+	struct stbuf b = { NULL, 0, 0, false };
+	bool ok = lsi_st_save(ctx, &b, LSI_ST_TRACK)
+	    && lsi_b_writefile(path, b.data, b.len);
+
+	if (ok)
+		I("saved tracking snapshot to '%s' (%zu bytes)", path, b.len);
+
+	lsi_st_freebuf(&b);
+	return ok;
+}
+
+bool
+irc_track_load(irc *ctx, const char *path)
+{
+	size_t len;
+	void *p = lsi_b_mapfile(path, &len);
+	if (!p)
+		return false;
+
+	/* wanting nothing makes this a mere sanity check of the framing */
+	if (!lsi_st_load(ctx, p, len, 0)) {
+		E("'%s' is not a usable snapshot", path);
+		lsi_b_unmapfile(p, len);
+		return false;
+	}
+
+	lsi_b_unmapfile(ctx->trkseed, ctx->trkseed_len);
+	ctx->trkseed = p;
+	ctx->trkseed_len = len;
+
+	if (!ctx->tracking_enab) {
+		D("will restore '%s' once tracking is enabled", path);
+		return true;
+	}
+
+	return lsi_trk_seed(ctx);
+}
+
 bool
 irc_tag_chan(irc *ctx, const char *chname, void *tag, bool autofree)
 {
@@ -8,6 +8,10 @@
 
 bool lsi_trk_init(irc *ctx);
 void lsi_trk_deinit(irc *ctx);
+bool lsi_trk_seed(irc *ctx);
+void lsi_trk_unpublish(irc *ctx);
+bool lsi_trk_wanted(irc *ctx, const char *chname);
+void lsi_trk_tick(irc *ctx, tokarr *msg);
 
 
 #endif /* LIBSRSIRC_IRC_TRACK_INT_H */
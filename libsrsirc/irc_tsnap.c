@@ -0,0 +1,401 @@
+/* irc_tsnap.c - immutable snapshots of the tracking state for other threads
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#define LOG_MODULE MOD_TRACK
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include <libsrsirc/irc_track.h>
+
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <platform/base_misc.h>
+#include <platform/base_thread.h>
+
+#include <logger/intlog.h>
+
+#include <libsrsirc/util.h>
+
+#include "intdefs.h"
+#include "common.h"
+#include "ucbase.h"
+#include "irc_track_int.h"
+
+
+/* A snapshot is a single allocation: this header, followed by the arrays it
+ * points to, followed by the strings.  Once published it is never modified
+ * again, so any number of threads can read it without locking; it is freed
+ * when the last reference is dropped. */
+struct irc_tsnap {
+	unsigned long refs;
+	struct irc_tsnap *next; // on the retired list, see retire()
+	uint64_t seq;
+	int casemap;
+	size_t nchans;
+	chanrep *chans;   // sorted by name
+	size_t nusers;
+	userrep *users;   // sorted by nick
+	userrep *membs;   // all memberships, grouped by channel
+	size_t *memboff;  // where the members of chans[i] start in membs
+	size_t *nmemb;    // and how many there are (sorted by nick)
+};
+
+struct skey {
+	const char *key;
+	void *p;
+};
+
+
+/* qsort(3) doesn't pass a context argument, hence one per casemapping */
+static int
+cmp_rfc1459(const void *a, const void *b)
+{
+	return lsi_ut_istrcmp(((const struct skey *)a)->key,
+	    ((const struct skey *)b)->key, CMAP_RFC1459);
+}
+
+static int
+cmp_strict(const void *a, const void *b)
+{
+	return lsi_ut_istrcmp(((const struct skey *)a)->key,
+	    ((const struct skey *)b)->key, CMAP_STRICT_RFC1459);
+}
+
+static int
+cmp_ascii(const void *a, const void *b)
+{
+	return lsi_ut_istrcmp(((const struct skey *)a)->key,
+	    ((const struct skey *)b)->key, CMAP_ASCII);
+}
+
+static void
+sortkeys(struct skey *k, size_t n, int casemap)
+{
+	int (*cmp)(const void *, const void *) =
+	    casemap == CMAP_RFC1459 ? cmp_rfc1459 :
+	    casemap == CMAP_STRICT_RFC1459 ? cmp_strict : cmp_ascii;
+
+	qsort(k, n, sizeof *k, cmp);
+	return;
+}
+
+/* binary search over an array of `n' elements of size `esz', each with a
+ * `const char *' sort key at offset `keyoff'.  returns n if not found */
+static size_t
+lookup(const void *arr, size_t n, size_t esz, size_t keyoff, const char *key,
+    int casemap)
+{
+	size_t lo = 0, hi = n;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		const char *k =
+		    *(const char *const *)((const char *)arr + mid*esz + keyoff);
+		int r = lsi_ut_istrcmp(key, k, casemap);
+		if (r == 0)
+			return mid;
+		if (r < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return n;
+}
+
+static size_t
+slen(const char *s)
+{
+	return s ? strlen(s) + 1 : 0;
+}
+
+static const char *
+acopy(char **arena, const char *s)
+{
+	if (!s)
+		return NULL;
+
+	size_t len = strlen(s) + 1;
+	char *r = *arena;
+	memcpy(r, s, len);
+	*arena += len;
+	return r;
+}
+
+static irc_tsnap *
+build(irc *ctx)
+{
+	size_t nc = lsi_ucb_num_chans(ctx);
+	size_t nu = lsi_ucb_num_users(ctx);
+	size_t nm = 0, maxnm = 0, strsz = 0, i;
+	struct skey *ck = NULL, *uk = NULL, *mk = NULL;
+	irc_tsnap *s = NULL;
+
+	if (!(ck = MALLOC((nc + 1) * sizeof *ck))
+	    || !(uk = MALLOC((nu + 1) * sizeof *uk)))
+		goto fail;
+
+	/* first pass: collect and measure */
+	i = 0;
+	for (chan *c = lsi_ucb_first_chan(ctx); c && i < nc;
+	    c = lsi_ucb_next_chan(ctx)) {
+		ck[i].key = c->name;
+		ck[i++].p = c;
+		strsz += slen(c->name) + slen(c->topic) + slen(c->topicnick);
+
+		size_t n = 0;
+		for (memb *m = lsi_ucb_first_memb(ctx, c); m;
+		    m = lsi_ucb_next_memb(ctx, c)) {
+			strsz += slen(m->modepfx);
+			n++;
+		}
+
+		nm += n;
+		if (n > maxnm)
+			maxnm = n;
+	}
+	nc = i;
+
+	i = 0;
+	for (user *u = lsi_ucb_first_user(ctx); u && i < nu;
+	    u = lsi_ucb_next_user(ctx)) {
+		uk[i].key = u->nick;
+		uk[i++].p = u;
+		strsz += slen(u->nick) + slen(u->uname) + slen(u->host)
+		    + slen(u->fname);
+	}
+	nu = i;
+
+	if (!(mk = MALLOC((maxnm + 1) * sizeof *mk)))
+		goto fail;
+
+	size_t sz = sizeof *s + nc * sizeof *s->chans + nu * sizeof *s->users
+	    + nm * sizeof *s->membs + 2 * nc * sizeof (size_t) + strsz;
+
+	if (!(s = MALLOC(sz)))
+		goto fail;
+
+	s->refs = 0;
+	s->seq = 0;
+	s->casemap = ctx->casemap;
+	s->nchans = nc;
+	s->nusers = nu;
+	s->chans = (chanrep *)(s + 1);
+	s->users = (userrep *)(s->chans + nc);
+	s->membs = s->users + nu;
+	s->memboff = (size_t *)(s->membs + nm);
+	s->nmemb = s->memboff + nc;
+	char *arena = (char *)(s->nmemb + nc);
+
+	/* second pass: fill in, in sorted order */
+	sortkeys(uk, nu, ctx->casemap);
+	for (i = 0; i < nu; i++) {
+		user *u = uk[i].p;
+		userrep *ur = &s->users[i];
+		ur->modepfx = NULL;
+		ur->nick = acopy(&arena, u->nick);
+		ur->uname = acopy(&arena, u->uname);
+		ur->host = acopy(&arena, u->host);
+		ur->fname = acopy(&arena, u->fname);
+		ur->nchans = u->nchans;
+		ur->tag = u->tag;
+	}
+
+	sortkeys(ck, nc, ctx->casemap);
+	size_t moff = 0;
+	for (i = 0; i < nc; i++) {
+		chan *c = ck[i].p;
+		chanrep *cr = &s->chans[i];
+		cr->name = acopy(&arena, c->name);
+		cr->topic = acopy(&arena, c->topic);
+		cr->topicnick = acopy(&arena, c->topicnick);
+		cr->tscreate = c->tscreate;
+		cr->tstopic = c->tstopic;
+		cr->desync = c->desync;
+		cr->tag = c->tag;
+
+		size_t n = 0;
+		for (memb *m = lsi_ucb_first_memb(ctx, c); m && n < maxnm;
+		    m = lsi_ucb_next_memb(ctx, c)) {
+			mk[n].key = m->u->nick;
+			mk[n++].p = m;
+		}
+
+		sortkeys(mk, n, ctx->casemap);
+
+		s->memboff[i] = moff;
+		for (size_t j = 0; j < n; j++) {
+			memb *m = mk[j].p;
+			size_t ui = lookup(s->users, nu, sizeof *s->users,
+			    offsetof(userrep, nick), m->u->nick, ctx->casemap);
+			if (ui == nu) {
+				W("member '%s' of '%s' not in the user base",
+				    m->u->nick, c->name);
+				continue;
+			}
+
+			/* share the strings with the user entry */
+			s->membs[moff] = s->users[ui];
+			s->membs[moff++].modepfx = acopy(&arena, m->modepfx);
+		}
+		s->nmemb[i] = moff - s->memboff[i];
+	}
+
+	free(ck);
+	free(uk);
+	free(mk);
+	return s;
+
+fail:
+	free(ck);
+	free(uk);
+	free(mk);
+	return NULL;
+}
+
+/* take `old' out of circulation; it must already be unreachable via
+ * ctx->tsnap.  readers which did get hold of it own a reference by the time
+ * they leave the get() section, so once nobody is inside that, the publisher
+ * reference is the only one we need to care about.  if somebody is, we don't
+ * wait for them; `old' goes on the retired list, which is released the next
+ * time around that nobody is (or when the context goes away, `final') */
+static void
+retire(irc *ctx, irc_tsnap *old, bool final)
+{
+	if (old) {
+		old->next = ctx->tsretired;
+		ctx->tsretired = old;
+	}
+
+	if (!final && lsi_b_atomic_load(&ctx->tsreaders)) {
+		D("readers about, deferring release of retired snapshot(s)");
+		return;
+	}
+
+	irc_tsnap *s = ctx->tsretired;
+	ctx->tsretired = NULL;
+	while (s) {
+		irc_tsnap *next = s->next;
+		irc_tsnap_put(s);
+		s = next;
+	}
+
+	return;
+}
+
+void
+lsi_trk_unpublish(irc *ctx)
+{
+	retire(ctx, lsi_b_atomic_xchgptr(&ctx->tsnap, NULL), true);
+	return;
+}
+
+
+bool
+irc_track_publish(irc *ctx)
+{
+	if (!ctx->tracking_enab) {
+		W("tracking not enabled, nothing to publish");
+		return false;
+	}
+
+	irc_tsnap *s = build(ctx);
+	if (!s) {
+		E("failed to build tracking snapshot");
+		return false;
+	}
+
+	s->refs = 1; // the publisher's
+	s->seq = ++ctx->tsseq;
+
+	D("publishing snapshot %"PRIu64" (%zu chans, %zu users)",
+	    s->seq, s->nchans, s->nusers);
+
+	retire(ctx, lsi_b_atomic_xchgptr(&ctx->tsnap, s), false);
+	return true;
+}
+
+const irc_tsnap *
+irc_tsnap_get(irc *ctx)
+{
+	lsi_b_atomic_add(&ctx->tsreaders, 1);
+	irc_tsnap *s = lsi_b_atomic_loadptr(&ctx->tsnap);
+	if (s)
+		lsi_b_atomic_add(&s->refs, 1);
+	lsi_b_atomic_add(&ctx->tsreaders, -1);
+
+	return s;
+}
+
+void
+irc_tsnap_put(const irc_tsnap *snap)
+{
+	irc_tsnap *s = (irc_tsnap *)snap;
+	if (s && lsi_b_atomic_add(&s->refs, -1) == 0)
+		free(s);
+
+	return;
+}
+
+uint64_t
+irc_tsnap_seq(const irc_tsnap *snap)
+{
+	return snap->seq;
+}
+
+const chanrep *
+irc_tsnap_chans(const irc_tsnap *snap, size_t *num)
+{
+	*num = snap->nchans;
+	return snap->chans;
+}
+
+const chanrep *
+irc_tsnap_chan(const irc_tsnap *snap, const char *name)
+{
+	size_t i = lookup(snap->chans, snap->nchans, sizeof *snap->chans,
+	    offsetof(chanrep, name), name, snap->casemap);
+
+	return i == snap->nchans ? NULL : &snap->chans[i];
+}
+
+const userrep *
+irc_tsnap_users(const irc_tsnap *snap, size_t *num)
+{
+	*num = snap->nusers;
+	return snap->users;
+}
+
+const userrep *
+irc_tsnap_user(const irc_tsnap *snap, const char *ident)
+{
+	char nick[MAX_NICK_LEN];
+	lsi_ut_ident2nick(nick, sizeof nick, ident);
+
+	size_t i = lookup(snap->users, snap->nusers, sizeof *snap->users,
+	    offsetof(userrep, nick), nick, snap->casemap);
+
+	return i == snap->nusers ? NULL : &snap->users[i];
+}
+
+const userrep *
+irc_tsnap_members(const irc_tsnap *snap, const char *chname, size_t *num)
+{
+	size_t i = lookup(snap->chans, snap->nchans, sizeof *snap->chans,
+	    offsetof(chanrep, name), chname, snap->casemap);
+
+	if (i == snap->nchans) {
+		*num = 0;
+		return NULL;
+	}
+
+	*num = snap->nmemb[i];
+	return &snap->membs[snap->memboff[i]];
+}
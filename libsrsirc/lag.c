@@ -0,0 +1,209 @@
+/* lag.c - keepalive and round trip time measurement
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#define LOG_MODULE MOD_IRC
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "lag.h"
+
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <platform/base_time.h>
+
+#include <logger/intlog.h>
+
+#include <libsrsirc/irc_ext.h>
+
+#include "conn.h"
+#include "intdefs.h"
+
+
+/* our PINGs carry this, followed by the (monotonic) time they were sent */
+#define PINGPFX "LSI-"
+
+
+static uint64_t now_us(void);
+static void check(irc *ctx, uint64_t now);
+
+
+/* called from irc_read() before every read; sends the next PING when it is
+ * due.  returns false if the previous one went unanswered (dead link) or
+ * the write failed */
+bool
+lsi_lag_tick(irc *ctx)
+{
+	if (!ctx->lagint || !ctx->con->online)
+		return true;
+
+	uint64_t now = now_us();
+	if (!ctx->lagnext)
+		ctx->lagnext = now + ctx->lagint;
+
+	if (now >= ctx->lagnext) {
+		if (ctx->lagsent) {
+			W("PING unanswered for %"PRIu64" us, assuming dead link",
+			    now - ctx->lagsent);
+			return false;
+		}
+
+		char buf[64];
+		snprintf(buf, sizeof buf, "PING :"PINGPFX"%"PRIu64"\r\n", now);
+		if (!lsi_conn_write(ctx->con, buf))
+			return false;
+
+		ctx->lagsent = now;
+		ctx->lagnext = now + ctx->lagint;
+		ctx->lag.npings++;
+	}
+
+	check(ctx, now);
+	return true;
+}
+
+/* how long (us) irc_read() may block before it has to tick again.
+ * 0 if the monitor is disabled */
+uint64_t
+lsi_lag_wait(irc *ctx)
+{
+	if (!ctx->lagint)
+		return 0;
+
+	if (!ctx->lagnext)
+		return ctx->lagint;
+
+	uint64_t due = ctx->lagnext;
+
+	/* wake up in time to notice the outstanding PING crossing the
+	 * threshold, rather than only when the next one is due */
+	if (ctx->lagsent && ctx->lagmax && !ctx->lagbreach
+	    && ctx->lagsent + ctx->lagmax + 1 < due)
+		due = ctx->lagsent + ctx->lagmax + 1;
+
+	uint64_t now = now_us();
+	return due > now ? due - now : 1;
+}
+
+/* `arg' is the last argument of a PONG; ignored unless it answers our
+ * outstanding PING */
+void
+lsi_lag_pong(irc *ctx, const char *arg)
+{
+	if (!ctx->lagsent || strncmp(arg, PINGPFX, strlen(PINGPFX)) != 0)
+		return;
+
+	char *end;
+	uint64_t ts = strtoull(arg + strlen(PINGPFX), &end, 10);
+	if (*end || ts != ctx->lagsent) {
+		D("ignoring stale or foreign PONG '%s'", arg);
+		return;
+	}
+
+	uint64_t now = now_us();
+	uint64_t rtt = now - ts;
+
+	ctx->lagsent = 0;
+	ctx->lag.cur_us = rtt;
+	if (!ctx->lag.npongs || rtt < ctx->lag.min_us)
+		ctx->lag.min_us = rtt;
+	ctx->lag.ewma_us = ctx->lag.npongs
+	    ? (ctx->lag.ewma_us * 7 + rtt) / 8 : rtt;
+	ctx->lag.npongs++;
+
+	D("PONG after %"PRIu64" us (min %"PRIu64", avg %"PRIu64")",
+	    rtt, ctx->lag.min_us, ctx->lag.ewma_us);
+
+	check(ctx, now);
+	return;
+}
+
+/* forget everything about the previous connection */
+void
+lsi_lag_reset(irc *ctx)
+{
+	ctx->lagsent = ctx->lagnext = 0;
+	ctx->lagbreach = false;
+	memset(&ctx->lag, 0, sizeof ctx->lag);
+	return;
+}
+
+
+void
+irc_set_lagmon(irc *ctx, uint64_t interval_us, uint64_t threshold_us)
+{
+	ctx->lagint = interval_us;
+	ctx->lagmax = threshold_us;
+	lsi_lag_reset(ctx);
+	return;
+}
+
+void
+irc_regcb_lag(irc *ctx, fp_lag cb, void *tag)
+{
+	ctx->cb_lag = cb;
+	ctx->tag_lag = tag;
+	return;
+}
+
+bool
+irc_lag(irc *ctx, struct irc_lag *dest)
+{
+	if (!ctx->lagint)
+		return false;
+
+	*dest = ctx->lag;
+	dest->pending_us = ctx->lagsent ? now_us() - ctx->lagsent : 0;
+	return true;
+}
+
+uint64_t
+irc_lagmon_wait(irc *ctx)
+{
+	return lsi_lag_wait(ctx);
+}
+
+
+static uint64_t
+now_us(void)
+{
+	return lsi_b_mono_ns() / 1000;
+}
+
+/* tell the user when the lag crosses the threshold, either way */
+static void
+check(irc *ctx, uint64_t now)
+{
+	if (!ctx->lagmax)
+		return;
+
+	uint64_t pend = ctx->lagsent ? now - ctx->lagsent : 0;
+	uint64_t lag = pend > ctx->lag.cur_us ? pend : ctx->lag.cur_us;
+	bool breach = lag > ctx->lagmax;
+
+	if (breach == ctx->lagbreach)
+		return;
+
+	ctx->lagbreach = breach;
+	if (breach)
+		W("lag of %"PRIu64" us exceeds %"PRIu64, lag, ctx->lagmax);
+	else
+		I("lag back to %"PRIu64" us", lag);
+
+	if (ctx->cb_lag) {
+		struct irc_lag l = ctx->lag;
+		l.pending_us = pend;
+		ctx->cb_lag(ctx, &l, breach, ctx->tag_lag);
+	}
+
+	return;
+}
@@ -0,0 +1,21 @@
+/* lag.h - keepalive and round trip time measurement, interface (lib-internal)
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIBSRSIRC_LAG_H
+#define LIBSRSIRC_LAG_H 1
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <libsrsirc/defs.h>
+
+
+bool lsi_lag_tick(irc *ctx);
+uint64_t lsi_lag_wait(irc *ctx);
+void lsi_lag_pong(irc *ctx, const char *arg);
+void lsi_lag_reset(irc *ctx);
+
+
+#endif /* LIBSRSIRC_LAG_H */
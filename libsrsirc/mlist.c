@@ -0,0 +1,483 @@
+/* mlist.c - sets of channel list mode entries (bans etc.)
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#define LOG_MODULE MOD_UCBASE
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "mlist.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <platform/base_misc.h>
+
+#include <logger/intlog.h>
+
+#include <libsrsirc/util.h>
+
+
+/* A chained hash set keyed by (mode char, mask), comparing masks according
+ * to the casemapping.  We can't use skmap for this since masks contain the
+ * very characters skmap treats as the end of a key ('!' and '@').
+ *
+ * For matching, there is a second hash table over the same entries.  It is
+ * keyed by the (up to MLIST_KEYLEN) literal characters a mask ends with, or
+ * if it ends with a wildcard, by those it starts with; e.g. "*!*@*.example"
+ * goes by "*.example" minus the wildcard, ".example", and "baduser!*@*" by
+ * "baduser!".  To match a string, we only need to look up its own prefix
+ * and suffix for each key length in use, and then glob-match the few masks
+ * we find there.  Masks with wildcards at both ends ("*!*ident@*") go on a
+ * plain list, which is searched in full. */
+
+#define MLIST_MINBUCK 8
+#define MLIST_KEYLEN 8
+
+#define IDX_NONE 0 // on the plain list
+#define IDX_SFX 1
+#define IDX_PFX 2
+
+struct ment {
+	struct ment *next;  // in the set
+	struct ment *inext; // in the index, or the plain list
+	size_t hash;        // set hash
+	size_t ihash;       // index hash
+	uint64_t ts;
+	const char *setter; // points behind the mask, or NULL
+	char mode;
+	unsigned char ikind; // IDX_*
+	unsigned char ilen;  // length of the index key
+	char mask[]; // flexible, followed by the setter
+};
+
+struct mlist {
+	struct ment **buck;
+	struct ment **ibuck; // index, same size as buck
+	struct ment *plain;  // masks we can't index
+	size_t nbuck;
+	size_t count;
+	size_t nkeys[3][MLIST_KEYLEN + 1]; // index entries per kind and length
+	int casemap;
+
+	size_t mem;   // what we use ourselves, including the entries
+	size_t *acct; // where to account for it, if anywhere
+};
+
+
+static size_t hash(char mode, const char *mask, int casemap);
+static size_t ihash(int kind, char mode, const char *key, size_t len,
+    int casemap);
+static struct ment **find(mlist *l, size_t h, char mode, const char *mask);
+static void mkkey(mlist *l, struct ment *e);
+static void link_idx(mlist *l, struct ment *e);
+static void unlink_idx(mlist *l, struct ment *e);
+static void drop(mlist *l, struct ment **link);
+static bool lookup(mlist *l, int kind, char mode, const char *str,
+    size_t slen, struct mlinfo *dest);
+static bool grow(mlist *l);
+static void mkinfo(struct mlinfo *dest, const struct ment *e);
+static size_t entsz(const struct ment *e);
+static void account(mlist *l, size_t add, size_t sub);
+
+
+mlist *
+lsi_mlist_init(int casemap)
+{
+	mlist *l = MALLOC(sizeof *l);
+	if (!l)
+		return NULL;
+
+	l->buck = MALLOC(MLIST_MINBUCK * sizeof *l->buck);
+	l->ibuck = MALLOC(MLIST_MINBUCK * sizeof *l->ibuck);
+	if (!l->buck || !l->ibuck) {
+		free(l->buck);
+		free(l->ibuck);
+		free(l);
+		return NULL;
+	}
+
+	for (size_t i = 0; i < MLIST_MINBUCK; i++)
+		l->buck[i] = l->ibuck[i] = NULL;
+
+	memset(l->nkeys, 0, sizeof l->nkeys);
+	l->plain = NULL;
+	l->nbuck = MLIST_MINBUCK;
+	l->count = 0;
+	l->casemap = casemap;
+	l->mem = sizeof *l + 2 * l->nbuck * sizeof *l->buck;
+	l->acct = NULL;
+	return l;
+}
+
+void
+lsi_mlist_clear(mlist *l)
+{
+	size_t sub = 0;
+	for (size_t i = 0; i < l->nbuck; i++) {
+		struct ment *e = l->buck[i];
+		while (e) {
+			struct ment *next = e->next;
+			sub += entsz(e);
+			free(e);
+			e = next;
+		}
+		l->buck[i] = l->ibuck[i] = NULL;
+	}
+
+	memset(l->nkeys, 0, sizeof l->nkeys);
+	l->plain = NULL;
+	l->count = 0;
+	account(l, 0, sub);
+	return;
+}
+
+void
+lsi_mlist_dispose(mlist *l)
+{
+	if (!l)
+		return;
+
+	lsi_mlist_clear(l);
+	account(l, 0, l->mem);
+	free(l->buck);
+	free(l->ibuck);
+	free(l);
+	return;
+}
+
+int
+lsi_mlist_add(mlist *l, char mode, const char *mask, const char *setter,
+    uint64_t ts)
+{
+	size_t h = hash(mode, mask, l->casemap);
+	if (*find(l, h, mode, mask))
+		return 0;
+
+	if (l->count >= l->nbuck && !grow(l))
+		W("failed to grow mode list, carrying on");
+
+	size_t len = strlen(mask) + 1;
+	size_t slen = setter ? strlen(setter) + 1 : 0;
+	struct ment *e = MALLOC(sizeof *e + len + slen);
+	if (!e)
+		return -1;
+
+	e->hash = h;
+	e->mode = mode;
+	e->ts = ts;
+	memcpy(e->mask, mask, len);
+	e->setter = NULL;
+	if (setter)
+		e->setter = memcpy(e->mask + len, setter, slen);
+
+	struct ment **b = &l->buck[h % l->nbuck];
+	e->next = *b;
+	*b = e;
+
+	mkkey(l, e);
+	link_idx(l, e);
+
+	l->count++;
+	account(l, entsz(e), 0);
+	return 1;
+}
+
+bool
+lsi_mlist_del(mlist *l, char mode, const char *mask)
+{
+	struct ment **p = find(l, hash(mode, mask, l->casemap), mode, mask);
+	if (!*p)
+		return false;
+
+	drop(l, p);
+	return true;
+}
+
+void
+lsi_mlist_delmode(mlist *l, char mode)
+{
+	for (size_t i = 0; i < l->nbuck; i++) {
+		struct ment **p = &l->buck[i];
+		while (*p)
+			if ((*p)->mode == mode)
+				drop(l, p);
+			else
+				p = &(*p)->next;
+	}
+
+	return;
+}
+
+bool
+lsi_mlist_has(mlist *l, char mode, const char *mask)
+{
+	return *find(l, hash(mode, mask, l->casemap), mode, mask);
+}
+
+size_t
+lsi_mlist_count(mlist *l)
+{
+	return l->count;
+}
+
+bool
+lsi_mlist_match(mlist *l, char mode, const char *str, struct mlinfo *dest)
+{
+	size_t slen = strlen(str);
+
+	if (lookup(l, IDX_SFX, mode, str, slen, dest)
+	    || lookup(l, IDX_PFX, mode, str, slen, dest))
+		return true;
+
+	for (struct ment *e = l->plain; e; e = e->inext)
+		if (e->mode == mode && lsi_ut_globmatch(e->mask, str, l->casemap)) {
+			if (dest)
+				mkinfo(dest, e);
+			return true;
+		}
+
+	return false;
+}
+
+void
+lsi_mlist_each(mlist *l, void (*fn)(const struct mlinfo *e, void *tag),
+    void *tag)
+{
+	struct mlinfo mi;
+	for (size_t i = 0; i < l->nbuck; i++)
+		for (struct ment *e = l->buck[i]; e; e = e->next) {
+			mkinfo(&mi, e);
+			fn(&mi, tag);
+		}
+
+	return;
+}
+
+void
+lsi_mlist_account(mlist *l, size_t *ctr)
+{
+	l->acct = ctr;
+	*ctr += l->mem;
+	return;
+}
+
+
+/* FNV-1a over the mode char and the casemapped mask */
+static size_t
+hash(char mode, const char *mask, int casemap)
+{
+	uint32_t h = 2166136261u;
+	h = (h ^ (unsigned char)mode) * 16777619u;
+	while (*mask)
+		h = (h ^ (unsigned char)lsi_ut_tolower(*mask++, casemap))
+		    * 16777619u;
+
+	return h;
+}
+
+static size_t
+ihash(int kind, char mode, const char *key, size_t len, int casemap)
+{
+	uint32_t h = 2166136261u;
+	h = (h ^ (unsigned)kind) * 16777619u;
+	h = (h ^ (unsigned char)mode) * 16777619u;
+	for (size_t i = 0; i < len; i++)
+		h = (h ^ (unsigned char)lsi_ut_tolower(key[i], casemap))
+		    * 16777619u;
+
+	return h;
+}
+
+/* returns a pointer to the link pointing to the entry, or to the NULL at the
+ * end of its bucket if there is none */
+static struct ment **
+find(mlist *l, size_t h, char mode, const char *mask)
+{
+	struct ment **p = &l->buck[h % l->nbuck];
+	while (*p && ((*p)->hash != h || (*p)->mode != mode
+	    || lsi_ut_istrcmp((*p)->mask, mask, l->casemap) != 0))
+		p = &(*p)->next;
+
+	return p;
+}
+
+/* figure out what to index `e' by */
+static void
+mkkey(mlist *l, struct ment *e)
+{
+	const char *m = e->mask;
+	size_t len = strlen(m), sfx = 0, pfx = 0;
+
+	while (sfx < len && m[len - 1 - sfx] != '*' && m[len - 1 - sfx] != '?')
+		sfx++;
+	while (pfx < len && m[pfx] != '*' && m[pfx] != '?')
+		pfx++;
+
+	e->ikind = IDX_NONE;
+	e->ilen = 0;
+	e->ihash = 0;
+
+	if (!sfx && !pfx)
+		return;
+
+	/* the end of a hostmask tends to tell them apart better */
+	e->ikind = sfx >= pfx || sfx >= MLIST_KEYLEN ? IDX_SFX : IDX_PFX;
+	size_t klen = e->ikind == IDX_SFX ? sfx : pfx;
+	if (klen > MLIST_KEYLEN)
+		klen = MLIST_KEYLEN;
+
+	e->ilen = (unsigned char)klen;
+	e->ihash = ihash(e->ikind, e->mode,
+	    e->ikind == IDX_SFX ? m + len - klen : m, klen, l->casemap);
+	return;
+}
+
+static void
+link_idx(mlist *l, struct ment *e)
+{
+	if (e->ikind == IDX_NONE) {
+		e->inext = l->plain;
+		l->plain = e;
+		return;
+	}
+
+	struct ment **b = &l->ibuck[e->ihash % l->nbuck];
+	e->inext = *b;
+	*b = e;
+	l->nkeys[e->ikind][e->ilen]++;
+	return;
+}
+
+static void
+unlink_idx(mlist *l, struct ment *e)
+{
+	struct ment **p = e->ikind == IDX_NONE ? &l->plain
+	    : &l->ibuck[e->ihash % l->nbuck];
+
+	while (*p && *p != e)
+		p = &(*p)->inext;
+
+	if (!*p) {
+		E("mode list entry '%c %s' not indexed", e->mode, e->mask);
+		return;
+	}
+
+	*p = e->inext;
+	if (e->ikind != IDX_NONE)
+		l->nkeys[e->ikind][e->ilen]--;
+	return;
+}
+
+static void
+drop(mlist *l, struct ment **link)
+{
+	struct ment *e = *link;
+	*link = e->next;
+	unlink_idx(l, e);
+	l->count--;
+	account(l, 0, entsz(e));
+	free(e);
+	return;
+}
+
+static bool
+lookup(mlist *l, int kind, char mode, const char *str, size_t slen,
+    struct mlinfo *dest)
+{
+	for (size_t klen = 1; klen <= MLIST_KEYLEN && klen <= slen; klen++) {
+		if (!l->nkeys[kind][klen])
+			continue;
+
+		const char *key = kind == IDX_SFX ? str + slen - klen : str;
+		size_t h = ihash(kind, mode, key, klen, l->casemap);
+		for (struct ment *e = l->ibuck[h % l->nbuck]; e; e = e->inext) {
+			if (e->ihash != h || e->ikind != kind || e->ilen != klen
+			    || e->mode != mode)
+				continue;
+
+			if (lsi_ut_globmatch(e->mask, str, l->casemap)) {
+				if (dest)
+					mkinfo(dest, e);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+static bool
+grow(mlist *l)
+{
+	size_t nsz = l->nbuck * 2;
+	struct ment **nb = MALLOC(nsz * sizeof *nb);
+	struct ment **nib = MALLOC(nsz * sizeof *nib);
+	if (!nb || !nib) {
+		free(nb);
+		free(nib);
+		return false;
+	}
+
+	for (size_t i = 0; i < nsz; i++)
+		nb[i] = nib[i] = NULL;
+
+	for (size_t i = 0; i < l->nbuck; i++) {
+		struct ment *e = l->buck[i];
+		while (e) {
+			struct ment *next = e->next;
+			e->next = nb[e->hash % nsz];
+			nb[e->hash % nsz] = e;
+			e = next;
+		}
+
+		e = l->ibuck[i];
+		while (e) {
+			struct ment *next = e->inext;
+			e->inext = nib[e->ihash % nsz];
+			nib[e->ihash % nsz] = e;
+			e = next;
+		}
+	}
+
+	account(l, 2 * nsz * sizeof *nb, 2 * l->nbuck * sizeof *l->buck);
+	free(l->buck);
+	free(l->ibuck);
+	l->buck = nb;
+	l->ibuck = nib;
+	l->nbuck = nsz;
+	return true;
+}
+
+static void
+mkinfo(struct mlinfo *dest, const struct ment *e)
+{
+	dest->mode = e->mode;
+	dest->mask = e->mask;
+	dest->setter = e->setter;
+	dest->ts = e->ts;
+	return;
+}
+
+static size_t
+entsz(const struct ment *e)
+{
+	return sizeof *e + strlen(e->mask) + 1
+	    + (e->setter ? strlen(e->setter) + 1 : 0);
+}
+
+static void
+account(mlist *l, size_t add, size_t sub)
+{
+	l->mem += add;
+	l->mem -= sub;
+	if (l->acct) {
+		*l->acct += add;
+		*l->acct -= sub;
+	}
+	return;
+}
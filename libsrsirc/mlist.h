@@ -0,0 +1,50 @@
+/* mlist.h - sets of channel list mode entries (bans etc.), interface
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIBSRSIRC_MLIST_H
+#define LIBSRSIRC_MLIST_H 1
+
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef struct mlist mlist;
+
+struct mlinfo {
+	char mode;
+	const char *mask;
+	const char *setter; // may be NULL
+	uint64_t ts;        // when it was set (seconds since Epoch), or 0
+};
+
+
+mlist *lsi_mlist_init(int casemap);
+void lsi_mlist_clear(mlist *l);
+void lsi_mlist_dispose(mlist *l);
+
+/* 1 if added, 0 if it was already there, -1 on failure */
+int lsi_mlist_add(mlist *l, char mode, const char *mask, const char *setter,
+    uint64_t ts);
+bool lsi_mlist_del(mlist *l, char mode, const char *mask);
+void lsi_mlist_delmode(mlist *l, char mode);
+bool lsi_mlist_has(mlist *l, char mode, const char *mask);
+size_t lsi_mlist_count(mlist *l);
+
+/* find an entry of `mode' whose mask matches `str' (usually a
+ * nick!uname@host), put it in `*dest' (if non-NULL).  this doesn't look at
+ * every entry; masks are indexed by their literal prefix or suffix */
+bool lsi_mlist_match(mlist *l, char mode, const char *str,
+    struct mlinfo *dest);
+
+/* call `fn' for every entry, in no particular order */
+void lsi_mlist_each(mlist *l, void (*fn)(const struct mlinfo *e, void *tag),
+    void *tag);
+
+/* same as lsi_skmap_account() */
+void lsi_mlist_account(mlist *l, size_t *ctr);
+
+
+#endif /* LIBSRSIRC_MLIST_H */
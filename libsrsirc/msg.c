@@ -19,16 +19,25 @@
 
 #include <platform/base_misc.h>
 #include <platform/base_string.h>
+#include <platform/base_time.h>
 
 #include <logger/intlog.h>
 
 #include "common.h"
 #include "conn.h"
+#include "hist.h"
+#include "probes.h"
 
 #include <libsrsirc/defs.h>
 #include <libsrsirc/util.h>
 
 
+static uint64_t *dispcnt(irc *ctx, const char *module);
+static void account(irc *ctx, uint64_t tstart, uint64_t ttrk);
+static void freehists(struct umsghnd *harr, size_t hcnt);
+static bool inithists(struct umsghnd *harr, size_t hcnt);
+
+
 bool
 lsi_msg_reghnd(irc *ctx, const char *cmd, hnd_fn hndfn, const char *module)
 {
@@ -56,6 +65,8 @@ lsi_msg_reghnd(irc *ctx, const char *cmd, hnd_fn hndfn, const char *module)
 
 	ctx->msghnds[i].module = module;
 	ctx->msghnds[i].hndfn = hndfn;
+	ctx->msghnds[i].ndisp = dispcnt(ctx, module);
+	ctx->msghnds[i].track = strcmp(module, "track") == 0;
 	STRACPY(ctx->msghnds[i].cmd, cmd);
 	return true;
 }
@@ -94,11 +105,50 @@ lsi_msg_reguhnd(irc *ctx, const char *cmd, uhnd_fn hndfn, bool pre)
 		}
 	}
 
+	harr[i].hist = NULL;
+	if (ctx->lathist && !(harr[i].hist = lsi_hist_init()))
+		return false;
+
 	harr[i].hndfn = hndfn;
 	STRACPY(harr[i].cmd, cmd);
 	return true;
 }
 
+bool
+lsi_msg_sethist(irc *ctx, bool on)
+{
+	freehists(ctx->uprehnds, ctx->uprehnds_cnt);
+	freehists(ctx->uposthnds, ctx->uposthnds_cnt);
+	free(ctx->lathist);
+	ctx->lathist = NULL;
+
+	if (!on)
+		return true;
+
+	if (!(ctx->lathist = lsi_hist_init())
+	    || !inithists(ctx->uprehnds, ctx->uprehnds_cnt)
+	    || !inithists(ctx->uposthnds, ctx->uposthnds_cnt)) {
+		lsi_msg_sethist(ctx, false);
+		return false;
+	}
+
+	return true;
+}
+
+const struct irc_hist *
+lsi_msg_uhndhist(irc *ctx, const char *cmd, uhnd_fn hndfn, bool pre)
+{
+	size_t hcnt = pre ? ctx->uprehnds_cnt : ctx->uposthnds_cnt;
+	struct umsghnd *harr = pre ? ctx->uprehnds : ctx->uposthnds;
+
+	for (size_t i = 0; i < hcnt; i++)
+		if (harr[i].cmd[0] && harr[i].hndfn == hndfn
+		    && strcmp(harr[i].cmd, cmd) == 0)
+			return harr[i].hist;
+
+	return NULL;
+}
+
 void
 lsi_msg_unregall(irc *ctx, const char *module)
 {
@@ -124,7 +174,21 @@ dispatch_uhnd(irc *ctx, tokarr *msg, size_t ac, bool pre)
 			continue;
 
 		D("dispatch a %s-'%s'", pre?"pre":"post", (*msg)[1]);
-		if (!harr[i].hndfn(ctx, msg, ac, pre))
+		ctx->con->stats.disp_user++;
+		LSI_PROBE3(handler_enter, ctx, (*msg)[1],
+		    pre ? "user-pre" : "user-post");
+
+		bool ok;
+		if (harr[i].hist) {
+			uint64_t t = lsi_b_mono_ns();
+			ok = harr[i].hndfn(ctx, msg, ac, pre);
+			lsi_hist_add(harr[i].hist, lsi_b_mono_ns() - t);
+		} else
+			ok = harr[i].hndfn(ctx, msg, ac, pre);
+
+		LSI_PROBE4(handler_exit, ctx, (*msg)[1],
+		    pre ? "user-pre" : "user-post", ok ? 0 : USER_ERR);
+		if (!ok)
 			return false;
 	}
 
@@ -134,12 +198,15 @@ dispatch_uhnd(irc *ctx, tokarr *msg, size_t ac, bool pre)
 uint16_t
 lsi_msg_handle(irc *ctx, tokarr *msg, bool logon)
 {
+	uint64_t tstart = lsi_b_mono_ns(), ttrk = 0;
 	uint16_t res = 0;
 	size_t i = 0;
 	size_t ac = 2;
 	while (ac < COUNTOF(*msg) && (*msg)[ac])
 		ac++;
 
+	LSI_PROBE4(msg_dispatch, ctx, (*msg)[0], (*msg)[1], logon);
+
 	if (!logon && !dispatch_uhnd(ctx, msg, ac, true)) {
 		res |= USER_ERR;
 		goto fail;
@@ -153,7 +220,21 @@ lsi_msg_handle(irc *ctx, tokarr *msg, bool logon)
 			continue;
 
 		D("dispatch a '%s' to '%s'", (*msg)[1], ctx->msghnds[i].module);
-		res |= ctx->msghnds[i].hndfn(ctx, msg, ac, logon);
+		(*ctx->msghnds[i].ndisp)++;
+		LSI_PROBE3(handler_enter, ctx, (*msg)[1], ctx->msghnds[i].module);
+
+		uint16_t hr;
+		if (ctx->msghnds[i].track) {
+			uint64_t t = lsi_b_mono_ns();
+			hr = ctx->msghnds[i].hndfn(ctx, msg, ac, logon);
+			ttrk += lsi_b_mono_ns() - t;
+		} else
+			hr = ctx->msghnds[i].hndfn(ctx, msg, ac, logon);
+
+		LSI_PROBE4(handler_exit, ctx, (*msg)[1], ctx->msghnds[i].module,
+		    hr);
+		res |= hr;
+
 		if (res & CANT_PROCEED)
 			goto fail;
 	}
@@ -163,9 +244,14 @@ lsi_msg_handle(irc *ctx, tokarr *msg, bool logon)
 		goto fail;
 	}
 
+	account(ctx, tstart, ttrk);
+	LSI_PROBE3(msg_done, ctx, (*msg)[1], res);
 	return res;
 
-fail:;
+fail:
+	account(ctx, tstart, ttrk);
+	LSI_PROBE3(msg_done, ctx, (*msg)[1], res);
+
 	uint16_t r = res & ~CANT_PROCEED;
 
 	if (r & USER_ERR) {
@@ -193,3 +279,59 @@ fail:;
 
 	return res;
 }
+
+/* the irc_stats dispatch counter for handlers registered by `module' */
+static uint64_t *
+dispcnt(irc *ctx, const char *module)
+{
+	struct irc_stats *st = &ctx->con->stats;
+
+	if (strcmp(module, "track") == 0)
+		return &st->disp_track;
+	if (strcmp(module, "v3") == 0)
+		return &st->disp_v3;
+
+	return &st->disp_core;
+}
+
+/* book the time spent in lsi_msg_handle() since `tstart', `ttrk' of which
+ * in tracking handlers; and the latency since the line was read */
+static void
+account(irc *ctx, uint64_t tstart, uint64_t ttrk)
+{
+	struct irc_stats *st = &ctx->con->stats;
+	uint64_t tend = lsi_b_mono_ns();
+
+	st->track_ns += ttrk;
+	st->dispatch_ns += tend - tstart - ttrk;
+
+	uint64_t tarr = ctx->con->rctx.tarrive;
+	if (ctx->lathist && tarr && tarr <= tend)
+		lsi_hist_add(ctx->lathist, tend - tarr);
+
+	return;
+}
+
+static void
+freehists(struct umsghnd *harr, size_t hcnt)
+{
+	for (size_t i = 0; i < hcnt; i++) {
+		if (!harr[i].cmd[0])
+			continue;
+
+		free(harr[i].hist);
+		harr[i].hist = NULL;
+	}
+
+	return;
+}
+
+static bool
+inithists(struct umsghnd *harr, size_t hcnt)
+{
+	for (size_t i = 0; i < hcnt; i++)
+		if (harr[i].cmd[0] && !(harr[i].hist = lsi_hist_init()))
+			return false;
+
+	return true;
+}
@@ -33,6 +33,12 @@ void lsi_msg_unregall(irc *ctx, const char *module);
 
 bool lsi_msg_reguhnd(irc *ctx, const char *cmd, uhnd_fn hndfn, bool pre);
 
+/* (de)allocate the latency histograms; see irc_set_histograms() */
+bool lsi_msg_sethist(irc *ctx, bool on);
+/* the run time histogram of a user handler, NULL if none */
+const struct irc_hist *lsi_msg_uhndhist(irc *ctx, const char *cmd,
+    uhnd_fn hndfn, bool pre);
+
 
 /* returns the bitwise OR of one or more of the above
  * bitmasks, or 0 for nothing special */
@@ -0,0 +1,32 @@
+/* probes.h - static (USDT) tracepoints, interface (lib-internal)
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIBSRSIRC_PROBES_H
+#define LIBSRSIRC_PROBES_H 1
+
+/* Where <sys/sdt.h> (systemtap) is available, these end up as a nop in the
+ * code plus a note in the ELF file telling perf(1), bpftrace(8) etc. where
+ * to patch in a breakpoint, and where to find the arguments.  Without it,
+ * or when configured with --disable-probes, they compile to nothing.
+ * The provider is "libsrsirc"; see doc/debugging.txt for the list. */
+
+#if HAVE_SYS_SDT_H
+# include <sys/sdt.h>
+# define LSI_PROBE0(N) DTRACE_PROBE(libsrsirc, N)
+# define LSI_PROBE1(N,A) DTRACE_PROBE1(libsrsirc, N, A)
+# define LSI_PROBE2(N,A,B) DTRACE_PROBE2(libsrsirc, N, A, B)
+# define LSI_PROBE3(N,A,B,C) DTRACE_PROBE3(libsrsirc, N, A, B, C)
+# define LSI_PROBE4(N,A,B,C,D) DTRACE_PROBE4(libsrsirc, N, A, B, C, D)
+# define LSI_PROBE5(N,A,B,C,D,E) DTRACE_PROBE5(libsrsirc, N, A, B, C, D, E)
+#else
+# define LSI_PROBE0(N) do {} while (0)
+# define LSI_PROBE1(N,A) do {} while (0)
+# define LSI_PROBE2(N,A,B) do {} while (0)
+# define LSI_PROBE3(N,A,B,C) do {} while (0)
+# define LSI_PROBE4(N,A,B,C,D) do {} while (0)
+# define LSI_PROBE5(N,A,B,C,D,E) do {} while (0)
+#endif
+
+
+#endif /* LIBSRSIRC_PROBES_H */
@@ -36,69 +36,73 @@
 
 #define DBGSPEC "(%d,%s,%"PRIu16")"
 
+/* Proxy replies are read in chunks, not byte by byte.  Whatever arrives
+ * after the reply already belongs to the IRC connection and is handed
+ * back to the caller through (ovbuf, ovbufsz, ovlen) */
+#define PXBUF_SZ 1024
+
+
+static bool px_write(int sck, const void *buf, size_t len,
+    const char *host, uint16_t port);
+static bool px_read(int sck, unsigned char *buf, size_t *len, size_t want,
+    uint64_t tend, const char *host, uint16_t port);
+static bool px_overflow(const unsigned char *buf, size_t len, size_t used,
+    char *ovbuf, size_t ovbufsz, size_t *ovlen);
+
 
 bool
-lsi_px_logon_http(int sck, const char *host, uint16_t port, uint64_t to_us)
+lsi_px_logon_http(int sck, const char *host, uint16_t port, uint64_t to_us,
+    char *ovbuf, size_t ovbufsz, size_t *ovlen)
 {
 	uint64_t tend = to_us ? lsi_b_tstamp_us() + to_us : 0;
-	uint64_t tnow, trem = 0;
-	char buf[256];
-	snprintf(buf, sizeof buf, "CONNECT %s:%d HTTP/1.0\r\nHost: %s:%d"
+	char req[600];
+	snprintf(req, sizeof req, "CONNECT %s:%d HTTP/1.0\r\nHost: %s:%d"
 	    "\r\n\r\n", host, port, host, port);
 
-	errno = 0;
-	long n = lsi_b_write(sck, buf, strlen(buf));
-	if (n <= -1) {
-		WE(DBGSPEC" write() failed", sck, host, port);
+	if (!px_write(sck, req, strlen(req), host, port))
 		return false;
-	} else if ((size_t)n < strlen(buf)) {
-		W(DBGSPEC" didn't send everything (%ld/%zu)",
-		    sck, host, port, n, strlen(buf));
-		return false;
-	}
-
-	memset(buf, 0, sizeof buf);
 
 	D(DBGSPEC" wrote HTTP CONNECT, reading response",
 	    sck, host, port);
-	size_t c = 0;
-	while (c < sizeof buf && (c < 4 || buf[c-4] != '\r' ||
-	    buf[c-3] != '\n' || buf[c-2] != '\r' || buf[c-1] != '\n')) {
-		errno = 0;
-		if (tend) {
-			tnow = lsi_b_tstamp_us();
-			trem = tnow >= tend ? 1 : tend - tnow;
-		}
-		n = lsi_b_read(sck, &buf[c], 1, trem);
-		if (n <= 0) {
-			if (n == 0)
-				W(DBGSPEC" timeout hit", sck, host, port);
-			else if (n == -2)
-				W(DBGSPEC" unexpected EOF", sck, host, port);
-			else WE(DBGSPEC" read failed",
-				    sck, host, port);
+
+	unsigned char buf[PXBUF_SZ+1];
+	size_t len = 0;
+	char *eoh;
+	for (;;) {
+		buf[len] = '\0';
+		if ((eoh = strstr((char *)buf, "\r\n\r\n")))
+			break;
+
+		if (len == PXBUF_SZ) {
+			W(DBGSPEC" response header too long", sck, host, port);
 			return false;
 		}
-		c++;
+
+		if (!px_read(sck, buf, &len, len + 1, tend, host, port))
+			return false;
 	}
 
-	char *sp = strchr(buf, ' ');
-	if (!sp) {
+	char *sp = strchr((char *)buf, ' ');
+	if (!sp || sp > eoh) {
 		W(DBGSPEC" parse error 1 (buf: '%s')", sck, host, port, buf);
 		return false;
 	}
 
 	D(DBGSPEC" http response: '%.3s' (should be '200')",
 	    sck, host, port, sp+1);
-	return strncmp(sp+1, "200", 3) == 0;
+	if (strncmp(sp+1, "200", 3) != 0)
+		return false;
+
+	return px_overflow(buf, len, (size_t)(eoh + 4 - (char *)buf),
+	    ovbuf, ovbufsz, ovlen);
 }
 
 /* SOCKS4 doesntsupport ipv6 */
 bool
-lsi_px_logon_socks4(int sck, const char *host, uint16_t port, uint64_t to_us)
+lsi_px_logon_socks4(int sck, const char *host, uint16_t port, uint64_t to_us,
+    char *ovbuf, size_t ovbufsz, size_t *ovlen)
 {
 	uint64_t tend = to_us ? lsi_b_tstamp_us() + to_us : 0;
-	uint64_t tnow, trem = 0;
 	unsigned char logon[14];
 	uint16_t nport = lsi_b_htons(port);
 
@@ -119,51 +123,35 @@ lsi_px_logon_socks4(int sck, const char *host, uint16_t port, uint64_t to_us)
 	memcpy(logon+c, name, strlen(name) + 1);
 	c += strlen(name) + 1;
 
-	errno = 0;
-	long n = lsi_b_write(sck, logon, c);
-	if (n <= -1) {
-		WE(DBGSPEC" write() failed", sck, host, port);
+	if (!px_write(sck, logon, c, host, port))
 		return false;
-	} else if ((size_t)n < c) {
-		W(DBGSPEC" didn't send everything (%ld/%zu)",
-		    sck, host, port, n, c);
-		return false;
-	}
 
 	D(DBGSPEC" wrote SOCKS4 logon sequence, reading response",
 	    sck, host, port);
-	char resp[8];
-	c = 0;
-	while (c < 8) {
-		if (tend) {
-			tnow = lsi_b_tstamp_us();
-			trem = tnow >= tend ? 1 : tend - tnow;
-		}
-		errno = 0;
-		n = lsi_b_read(sck, &resp+c, 8-c, trem);
-		if (n <= 0) {
-			if (n == 0)
-				W(DBGSPEC" timeout hit", sck, host, port);
-			else if (n == -2)
-			      W(DBGSPEC" unexpected EOF", sck, host, port);
-			else
-				WE(DBGSPEC" read failed", sck, host, port);
-			return false;
-		}
-		c += n;
-	}
+
+	unsigned char resp[PXBUF_SZ];
+	size_t len = 0;
+	if (!px_read(sck, resp, &len, 8, tend, host, port))
+		return false;
+
 	D(DBGSPEC" socks4 response: %"PRIu8" %"PRIu8" (should be: 0x00 0x5a)",
 	    sck, host, port, resp[0], resp[1]);
-	return resp[0] == 0 && resp[1] == 0x5a;
+	if (resp[0] != 0 || resp[1] != 0x5a)
+		return false;
+
+	return px_overflow(resp, len, 8, ovbuf, ovbufsz, ovlen);
 }
 
+/* We optimistically assume the proxy will let us in without
+ * authentication and send the CONNECT request right along with the
+ * greeting, saving a round trip.  Both replies are then parsed from
+ * whatever comes back */
 bool
-lsi_px_logon_socks5(int sck, const char *host, uint16_t port, uint64_t to_us)
+lsi_px_logon_socks5(int sck, const char *host, uint16_t port, uint64_t to_us,
+    char *ovbuf, size_t ovbufsz, size_t *ovlen)
 {
-	// This is horrible.  sanitize!
 	uint64_t tend = to_us ? lsi_b_tstamp_us() + to_us : 0;
-	uint64_t tnow, trem = 0;
-	unsigned char logon[14];
+	unsigned char logon[3 + 5 + 255 + 2];
 
 	if (!port) {
 		W(DBGSPEC" srsly what?!", sck, host, port);
@@ -172,44 +160,52 @@ lsi_px_logon_socks5(int sck, const char *host, uint16_t port, uint64_t to_us)
 
 	uint16_t nport = lsi_b_htons(port);
 	size_t c = 0;
+
+	/* greeting: version 5, one method, "no authentication" */
 	logon[c++] = 5;
+	logon[c++] = 1;
+	logon[c++] = 0;
 
+	/* CONNECT request */
+	logon[c++] = 5;
 	logon[c++] = 1;
 	logon[c++] = 0;
+	int type = lsi_com_guess_hosttype(host);
+	switch (type) {
+	case HOST_IPV4:
+		logon[c++] = 1;
+		if (!lsi_b_inet4_addr(&logon[c], 4, host))
+			return false;
+		c += 4;
+		break;
+	case HOST_IPV6:
+		logon[c++] = 4;
+		if (!lsi_b_inet6_addr(&logon[c], 16, host))
+			return false;
+		c += 16;
+		break;
+	case HOST_DNS:
+		if (strlen(host) > 255) {
+			W(DBGSPEC" hostname too long", sck, host, port);
+			return false;
+		}
+		logon[c++] = 3;
+		logon[c++] = (uint8_t)strlen(host);
+		memcpy(logon+c, host, strlen(host));
+		c += strlen(host);
+	}
+	memcpy(logon+c, &nport, 2); c += 2;
 
-	errno = 0;
-	long n = lsi_b_write(sck, logon, c);
-	if (n <= -1) {
-		WE(DBGSPEC" write() failed", sck, host, port);
-		return false;
-	} else if ((size_t)n < c) {
-		W(DBGSPEC" didn't send everything (%ld/%zu)",
-		    sck, host, port, n, c);
+	if (!px_write(sck, logon, c, host, port))
 		return false;
-	}
 
-	D(DBGSPEC" wrote SOCKS5 logon sequence 1, reading response",
+	D(DBGSPEC" wrote SOCKS5 greeting and CONNECT, reading response",
 	    sck, host, port);
-	char resp[128];
-	c = 0;
-	while (c < 2) {
-		errno = 0;
-		if (tend) {
-			tnow = lsi_b_tstamp_us();
-			trem = tnow >= tend ? 1 : tend - tnow;
-		}
-		n = lsi_b_read(sck, &resp+c, 2-c, trem);
-		if (n <= 0) {
-			if (n == 0)
-				W(DBGSPEC" timeout 1 hit", sck, host, port);
-			else if (n == -2)
-				W(DBGSPEC" unexpected EOF", sck, host, port);
-			else
-				WE(DBGSPEC" read failed", sck, host, port);
-			return false;
-		}
-		c += n;
-	}
+
+	unsigned char resp[PXBUF_SZ];
+	size_t len = 0;
+	if (!px_read(sck, resp, &len, 2, tend, host, port))
+		return false;
 
 	if (resp[0] != 5) {
 		W(DBGSPEC" unexpected response %"PRIu8" %"PRIu8" (no socks5?)",
@@ -223,121 +219,64 @@ lsi_px_logon_socks5(int sck, const char *host, uint16_t port, uint64_t to_us)
 	}
 	D(DBGSPEC" socks5 let us in", sck, host, port);
 
-	c = 0;
-	unsigned char conbuf[128];
-	conbuf[c++] = 5;
-	conbuf[c++] = 1;
-	conbuf[c++] = 0;
-	int type = lsi_com_guess_hosttype(host);
-	switch (type) {
-	case HOST_IPV4:
-		conbuf[c++] = 1;
-		if (!lsi_b_inet4_addr(&conbuf[c], 4, host))
-			return false;
-		c += 16;
-		break;
-	case HOST_IPV6:
-		conbuf[c++] = 4;
-		if (!lsi_b_inet6_addr(&conbuf[c], 16, host))
-			return false;
-		c += 16;
-		break;
-	case HOST_DNS:
-		conbuf[c++] = 3;
-		conbuf[c++] = (uint8_t)strlen(host);
-		memcpy(conbuf+c, host, strlen(host));
-		c += strlen(host);
-	}
-	memcpy(conbuf+c, &nport, 2); c += 2;
-
-	errno = 0;
-	n = lsi_b_write(sck, conbuf, c);
-	if (n <= -1) {
-		WE(DBGSPEC" write() failed",
-		    sck, host, port);
-		return false;
-	} else if ((size_t)n < c) {
-		W(DBGSPEC" didn't send everything (%ld/%zu)",
-		    sck, host, port, n, c);
+	/* CONNECT reply: ver, rep, rsv, atyp, addr, port */
+	unsigned char *rep = resp + 2;
+	if (!px_read(sck, resp, &len, 2 + 4, tend, host, port))
 		return false;
-	}
-	D(DBGSPEC" wrote SOCKS5 logon sequence 2, reading response",
-	    sck, host, port);
 
-	size_t l = 4;
-	c = 0;
-	while (c < l) {
-		errno = 0;
-		if (tend) {
-			tnow = lsi_b_tstamp_us();
-			trem = tnow >= tend ? 1 : tend - tnow;
-		}
-		n = lsi_b_read(sck, resp + c, l - c, trem);
-		if (n <= 0) {
-			if (n == 0)
-				W(DBGSPEC" timeout 2 hit", sck, host, port);
-			else if (n == -2)
-				W(DBGSPEC" unexpected EOF", sck, host, port);
-			else
-				WE(DBGSPEC" read failed", sck, host, port);
-			return false;
-		}
-		c += n;
-	}
-
-	if (resp[0] != 5 || resp[1] != 0) {
+	if (rep[0] != 5 || rep[1] != 0) {
 		W(DBGSPEC" socks5 deny/err %"PRIu8" %"PRIu8" %"PRIu8" %"PRIu8"",
-		    sck, host, port, resp[0], resp[1], resp[2], resp[3]);
+		    sck, host, port, rep[0], rep[1], rep[2], rep[3]);
 		return false;
 	}
 
-	bool dns = false;
-	switch (resp[3]) {
+	size_t need = 2 + 4;
+	switch (rep[3]) {
 	case 1: //ipv4
-		l = 4;
+		need += 4;
 		break;
 	case 4: //ipv6
-		l = 16;
+		need += 16;
 		break;
 	case 3: //dns
-		dns = true;
-		l = 1; //length
+		if (!px_read(sck, resp, &len, need + 1, tend, host, port))
+			return false;
+		need += 1 + rep[4];
 		break;
 	default:
 		W(DBGSPEC" socks returned illegal addrtype %d",
-		    sck, host, port, resp[3]);
+		    sck, host, port, rep[3]);
 		return false;
 	}
+	need += 2; //port
 
-	c = 0;
-	l += 2; //port
-	while (c < l) {
-		errno = 0;
-		/* read the very first byte seperately */
-		if (tend) {
-			tnow = lsi_b_tstamp_us();
-			trem = tnow >= tend ? 1 : tend - tnow;
-		}
-		n = lsi_b_read(sck, resp + c, c ? l - c : 1, trem);
-		if (n <= 0) {
-			if (n == 0)
-				W(DBGSPEC" timeout 2 hit", sck, host, port);
-			else if (n == 0)
-				W(DBGSPEC" unexpected EOF", sck, host, port);
-			else
-				WE(DBGSPEC" read failed", sck, host, port);
-			return false;
-		}
-		if (!c && dns)
-			l += (uint8_t)resp[c];
-		c += n;
-	}
-
-	/* not that we'd care about what we just have read but we want to
-	 * make sure to read the correct amount of characters */
+	/* not that we'd care about the bound address, but we must not
+	 * mistake it for IRC data */
+	if (!px_read(sck, resp, &len, need, tend, host, port))
+		return false;
 
 	D(DBGSPEC" socks5 success (apparently)", sck, host, port);
-	return true;
+	return px_overflow(resp, len, need, ovbuf, ovbufsz, ovlen);
+}
+
+bool
+lsi_px_logon(int ptype, int sck, const char *host, uint16_t port,
+    uint64_t to_us, char *ovbuf, size_t ovbufsz, size_t *ovlen)
+{
+	switch (ptype) {
+	case IRCPX_HTTP:
+		return lsi_px_logon_http(sck, host, port, to_us,
+		    ovbuf, ovbufsz, ovlen);
+	case IRCPX_SOCKS4:
+		return lsi_px_logon_socks4(sck, host, port, to_us,
+		    ovbuf, ovbufsz, ovlen);
+	case IRCPX_SOCKS5:
+		return lsi_px_logon_socks5(sck, host, port, to_us,
+		    ovbuf, ovbufsz, ovlen);
+	}
+
+	E("illegal proxy type %d", ptype);
+	return false;
 }
 
 int
@@ -355,3 +294,80 @@ lsi_px_typestr(int typenum)
 	       (typenum == IRCPX_SOCKS4) ? "SOCKS4" :
 	       (typenum == IRCPX_SOCKS5) ? "SOCKS5" : "unknown";
 }
+
+
+static bool
+px_write(int sck, const void *buf, size_t len, const char *host, uint16_t port)
+{
+	errno = 0;
+	long n = lsi_b_write(sck, buf, len);
+	if (n <= -1) {
+		WE(DBGSPEC" write() failed", sck, host, port);
+		return false;
+	} else if ((size_t)n < len) {
+		W(DBGSPEC" didn't send everything (%ld/%zu)",
+		    sck, host, port, n, len);
+		return false;
+	}
+
+	return true;
+}
+
+/* read into buf (of PXBUF_SZ bytes, *len of which are in use) until at
+ * least `want' bytes are there.  takes whatever is available, so we may
+ * well end up with more than that */
+static bool
+px_read(int sck, unsigned char *buf, size_t *len, size_t want,
+    uint64_t tend, const char *host, uint16_t port)
+{
+	uint64_t tnow, trem = 0;
+
+	if (want > PXBUF_SZ) {
+		W(DBGSPEC" response too long", sck, host, port);
+		return false;
+	}
+
+	while (*len < want) {
+		if (tend) {
+			tnow = lsi_b_tstamp_us();
+			trem = tnow >= tend ? 1 : tend - tnow;
+		}
+
+		errno = 0;
+		long n = lsi_b_read(sck, buf + *len, PXBUF_SZ - *len, trem);
+		if (n <= 0) {
+			if (n == 0)
+				W(DBGSPEC" timeout hit", sck, host, port);
+			else if (n == -2)
+				W(DBGSPEC" unexpected EOF", sck, host, port);
+			else
+				WE(DBGSPEC" read failed", sck, host, port);
+			return false;
+		}
+
+		*len += (size_t)n;
+	}
+
+	return true;
+}
+
+/* hand out what was read past the first `used' bytes */
+static bool
+px_overflow(const unsigned char *buf, size_t len, size_t used,
+    char *ovbuf, size_t ovbufsz, size_t *ovlen)
+{
+	size_t n = len - used;
+	*ovlen = 0;
+	if (!n)
+		return true;
+
+	if (n > ovbufsz) {
+		E("%zu bytes of early data, but only room for %zu", n, ovbufsz);
+		return false;
+	}
+
+	D("%zu bytes of early data after proxy reply", n);
+	memcpy(ovbuf, buf + used, n);
+	*ovlen = n;
+	return true;
+}
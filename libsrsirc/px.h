@@ -7,17 +7,21 @@
 
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
 bool lsi_px_logon_http(int sck, const char *host, uint16_t port,
-    uint64_t to_us);
+    uint64_t to_us, char *ovbuf, size_t ovbufsz, size_t *ovlen);
 
 bool lsi_px_logon_socks4(int sck, const char *host, uint16_t port,
-    uint64_t to_us);
+    uint64_t to_us, char *ovbuf, size_t ovbufsz, size_t *ovlen);
 
 bool lsi_px_logon_socks5(int sck, const char *host, uint16_t port,
-    uint64_t to_us);
+    uint64_t to_us, char *ovbuf, size_t ovbufsz, size_t *ovlen);
+
+bool lsi_px_logon(int ptype, int sck, const char *host, uint16_t port,
+    uint64_t to_us, char *ovbuf, size_t ovbufsz, size_t *ovlen);
 
 int lsi_px_typenum(const char *typestr);
 const char *lsi_px_typestr(int typenum);
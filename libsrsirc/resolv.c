@@ -0,0 +1,265 @@
+/* resolv.c - cached (and optionally backgrounded) name resolution
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#define LOG_MODULE MOD_RESOLV
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "resolv.h"
+
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#include <platform/base_misc.h>
+#include <platform/base_net.h>
+#include <platform/base_string.h>
+#include <platform/base_thread.h>
+#include <platform/base_time.h>
+
+#include <logger/intlog.h>
+
+
+/* The cache is shared between all irc contexts of the process (that's
+ * the point of it, after all) and may be touched by prefetch threads,
+ * hence the lock.  It is small, so a list does fine */
+#define MAX_RESENT 64
+
+struct resent {
+	char host[256];
+	uint16_t port;
+	struct addrlist *al; /* NULL for a cached failure */
+	int count;
+	uint64_t tadd;
+	uint64_t texp;
+	struct resent *next;
+};
+
+struct prefetch {
+	char host[256];
+	uint16_t port;
+	uint64_t ttl_us;
+	uint64_t negttl_us;
+	int wfd;
+};
+
+
+static lsi_b_mutex s_mtx = LSI_B_MUTEX_INIT;
+static struct resent *s_cache;
+static size_t s_ncache;
+static lsi_res_backend s_backend = lsi_b_mkaddrlist;
+
+
+static struct addrlist *clonelist(const struct addrlist *al);
+static struct resent *findent(const char *host, uint16_t port);
+static void storeent(const char *host, uint16_t port,
+    const struct addrlist *al, int count, uint64_t ttl_us);
+static void *prefetch_thr(void *arg);
+
+
+/* Like lsi_b_mkaddrlist(), but answers from the cache if it can.
+ * Successful lookups are cached for `ttl_us', failed ones for
+ * `negttl_us' microseconds; 0 for both bypasses the cache entirely */
+int
+lsi_res_lookup(const char *host, uint16_t port, uint64_t ttl_us,
+    uint64_t negttl_us, struct addrlist **res)
+{
+	if (!ttl_us && !negttl_us)
+		return s_backend(host, port, res);
+
+	bool hit = false;
+	int count = -1;
+
+	lsi_b_mutex_lock(&s_mtx);
+	struct resent *e = findent(host, port);
+	if (e && (!e->al || (*res = clonelist(e->al)))) {
+		hit = true;
+		count = e->al ? e->count : -1;
+	}
+	lsi_b_mutex_unlock(&s_mtx);
+
+	if (hit) {
+		D("cache hit for '%s:%"PRIu16"' (%s)", host, port,
+		    count > 0 ? "positive" : "negative");
+		return count;
+	}
+
+	count = s_backend(host, port, res);
+	uint64_t ttl = count > 0 ? ttl_us : negttl_us;
+	if (ttl) {
+		lsi_b_mutex_lock(&s_mtx);
+		storeent(host, port, count > 0 ? *res : NULL, count, ttl);
+		lsi_b_mutex_unlock(&s_mtx);
+	}
+
+	return count;
+}
+
+/* Resolve host:port in the background, so that a subsequent
+ * lsi_res_lookup() is answered from the cache.  Returns the read end of
+ * a pipe that becomes readable (one byte, '+' or '-') once the lookup
+ * is done, or -1 on failure.  The caller closes it.  Without thread
+ * support, the lookup happens right here */
+int
+lsi_res_prefetch(const char *host, uint16_t port, uint64_t ttl_us,
+    uint64_t negttl_us)
+{
+	int fds[2];
+	if (!lsi_b_pipe(fds))
+		return -1;
+
+	struct prefetch *pf = MALLOC(sizeof *pf);
+	if (!pf) {
+		lsi_b_fdclose(fds[0]);
+		lsi_b_fdclose(fds[1]);
+		return -1;
+	}
+
+	STRACPY(pf->host, host);
+	pf->port = port;
+	pf->ttl_us = ttl_us;
+	pf->negttl_us = negttl_us;
+	pf->wfd = fds[1];
+
+	if (!ttl_us)
+		W("prefetching '%s' with caching disabled", host);
+
+	if (!lsi_b_have_threads() || !lsi_b_thread(prefetch_thr, pf)) {
+		D("resolving '%s' in the foreground", host);
+		prefetch_thr(pf);
+	}
+
+	return fds[0];
+}
+
+void
+lsi_res_flush(void)
+{
+	lsi_b_mutex_lock(&s_mtx);
+	while (s_cache) {
+		struct resent *next = s_cache->next;
+		lsi_b_freeaddrlist(s_cache->al);
+		free(s_cache);
+		s_cache = next;
+	}
+	s_ncache = 0;
+	lsi_b_mutex_unlock(&s_mtx);
+	return;
+}
+
+/* mainly to make this testable without a real resolver */
+void
+lsi_res_set_backend(lsi_res_backend fn)
+{
+	s_backend = fn ? fn : lsi_b_mkaddrlist;
+	lsi_res_flush();
+	return;
+}
+
+
+static void *
+prefetch_thr(void *arg)
+{
+	struct prefetch *pf = arg;
+	struct addrlist *al = NULL;
+
+	int n = lsi_res_lookup(pf->host, pf->port, pf->ttl_us,
+	    pf->negttl_us, &al);
+	if (n > 0)
+		lsi_b_freeaddrlist(al);
+
+	char c = n > 0 ? '+' : '-';
+	lsi_b_fdwrite(pf->wfd, &c, 1);
+	lsi_b_fdclose(pf->wfd);
+	free(pf);
+	return NULL;
+}
+
+static struct addrlist *
+clonelist(const struct addrlist *al)
+{
+	struct addrlist *head = NULL, **tail = &head;
+
+	for (; al; al = al->next) {
+		struct addrlist *n = MALLOC(sizeof *n);
+		if (!n) {
+			lsi_b_freeaddrlist(head);
+			return NULL;
+		}
+
+		*n = *al;
+		n->next = NULL;
+		*tail = n;
+		tail = &n->next;
+	}
+
+	return head;
+}
+
+/* must hold s_mtx; only returns unexpired entries */
+static struct resent *
+findent(const char *host, uint16_t port)
+{
+	uint64_t now = lsi_b_tstamp_us();
+	for (struct resent *e = s_cache; e; e = e->next)
+		if (e->port == port && strcmp(e->host, host) == 0)
+			return e->texp > now ? e : NULL;
+
+	return NULL;
+}
+
+/* must hold s_mtx */
+static void
+storeent(const char *host, uint16_t port, const struct addrlist *al,
+    int count, uint64_t ttl_us)
+{
+	struct addrlist *copy = NULL;
+	if (al && !(copy = clonelist(al)))
+		return;
+
+	uint64_t now = lsi_b_tstamp_us();
+	struct resent *e, *victim = NULL;
+	for (e = s_cache; e; e = e->next) {
+		if (e->port == port && strcmp(e->host, host) == 0)
+			break;
+
+		/* expired entries go first, then the oldest one */
+		if (!victim || (victim->texp > now
+		    && (e->texp <= now || e->tadd < victim->tadd)))
+			victim = e;
+	}
+
+	if (!e) {
+		if (s_ncache >= MAX_RESENT) {
+			e = victim;
+			D("evicting '%s:%"PRIu16"'", e->host, e->port);
+		} else if ((e = MALLOC(sizeof *e))) {
+			e->al = NULL;
+			e->next = s_cache;
+			s_cache = e;
+			s_ncache++;
+		} else {
+			lsi_b_freeaddrlist(copy);
+			return;
+		}
+	}
+
+	lsi_b_freeaddrlist(e->al);
+	STRACPY(e->host, host);
+	e->port = port;
+	e->al = copy;
+	e->count = count;
+	e->tadd = now;
+	e->texp = now + ttl_us;
+
+	D("cached %s result for '%s:%"PRIu16"' (%"PRIu64"us)",
+	    copy ? "positive" : "negative", host, port, ttl_us);
+	return;
+}
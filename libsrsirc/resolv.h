@@ -0,0 +1,27 @@
+/* resolv.h - cached (and optionally backgrounded) name resolution
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIBSRSIRC_RESOLV_H
+#define LIBSRSIRC_RESOLV_H 1
+
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <platform/base_net.h>
+
+
+/* same contract as lsi_b_mkaddrlist() */
+typedef int (*lsi_res_backend)(const char *host, uint16_t port,
+    struct addrlist **res);
+
+
+int lsi_res_lookup(const char *host, uint16_t port, uint64_t ttl_us,
+    uint64_t negttl_us, struct addrlist **res);
+int lsi_res_prefetch(const char *host, uint16_t port, uint64_t ttl_us,
+    uint64_t negttl_us);
+void lsi_res_flush(void);
+void lsi_res_set_backend(lsi_res_backend fn);
+
+#endif /* LIBSRSIRC_RESOLV_H */
@@ -39,11 +39,15 @@ struct skmap {
 	skmap_hash_fn hfn;
 
 	const uint8_t *cmap;
+
+	size_t mem;   // what we use ourselves
+	size_t *acct; // where to account for it, if anywhere
 };
 
 
 static size_t strhash_small(const char *s, const uint8_t *cmap);
 static size_t strhash_mid(const char *s, const uint8_t *cmap);
+static void account(skmap *h, size_t add, size_t sub);
 
 
 skmap *
@@ -58,6 +62,8 @@ lsi_skmap_init(size_t bsz, int cmap)
 	h->iterating = false;
 	h->cmap = g_cmap[cmap];
 	h->hfn = bsz <= 256 ? strhash_small : strhash_mid;
+	h->mem = sizeof *h + bsz * sizeof *h->buck;
+	h->acct = NULL;
 
 	h->buck = MALLOC(h->bsz * sizeof *h->buck);
 	if (!h->buck)
@@ -84,13 +90,16 @@ lsi_skmap_clear(skmap *h)
 		if (!h->buck[i])
 			continue;
 
+		size_t sub = lsi_bucklist_basesz();
 		if (lsi_bucklist_first(h->buck[i], &k, NULL))
 			do {
+				sub += strlen(k) + 1 + lsi_bucklist_elemsz();
 				free(k);
 			} while (lsi_bucklist_next(h->buck[i], &k, NULL));
 
 		lsi_bucklist_dispose(h->buck[i]);
 		h->buck[i] = NULL;
+		account(h, 0, sub);
 	}
 
 	h->count = 0;
@@ -104,6 +113,7 @@ lsi_skmap_dispose(skmap *h)
 		return;
 
 	lsi_skmap_clear(h);
+	account(h, 0, h->mem);
 
 	free(h->buck);
 	free(h);
@@ -137,6 +147,8 @@ lsi_skmap_put(skmap *h, const char *key, void *elem)
 			goto fail;
 
 		h->count++;
+		account(h, (allocated ? lsi_bucklist_basesz() : 0)
+		    + strlen(kd) + 1 + lsi_bucklist_elemsz(), 0);
 	} else
 		lsi_bucklist_replace(kl, key, elem);
 
@@ -180,6 +192,7 @@ lsi_skmap_del(skmap *h, const char *key)
 	if (!e)
 		return NULL;
 
+	account(h, 0, strlen(okey) + 1 + lsi_bucklist_elemsz());
 	free(okey);
 	h->count--;
 	return e;
@@ -191,6 +204,14 @@ lsi_skmap_count(skmap *h)
 	return h->count;
 }
 
+void
+lsi_skmap_account(skmap *h, size_t *ctr)
+{
+	h->acct = ctr;
+	*ctr += h->mem;
+	return;
+}
+
 bool
 lsi_skmap_first(skmap *h, char **key, void **val)
 {
@@ -237,6 +258,37 @@ lsi_skmap_next(skmap *h, char **key, void **val)
 	return true;
 }
 
+bool
+lsi_skmap_cfirst(skmap *h, size_t *bit, void **pos, char **key, void **val)
+{
+	*bit = 0;
+	*pos = NULL;
+
+	for (; *bit < h->bsz; (*bit)++)
+		if (h->buck[*bit]
+		    && lsi_bucklist_cfirst(h->buck[*bit], pos, key, val))
+			return true;
+
+	return false;
+}
+
+bool
+lsi_skmap_cnext(skmap *h, size_t *bit, void **pos, char **key, void **val)
+{
+	if (*bit >= h->bsz)
+		return false;
+
+	if (lsi_bucklist_cnext(pos, key, val))
+		return true;
+
+	while (++*bit < h->bsz)
+		if (h->buck[*bit]
+		    && lsi_bucklist_cfirst(h->buck[*bit], pos, key, val))
+			return true;
+
+	return false;
+}
+
 void
 lsi_skmap_del_iter(skmap *h)
 {
@@ -328,6 +380,18 @@ lsi_skmap_dumpstat(skmap *h, const char *dbgname)
 }
 
 
+static void
+account(skmap *h, size_t add, size_t sub)
+{
+	h->mem += add;
+	h->mem -= sub;
+	if (h->acct) {
+		*h->acct += add;
+		*h->acct -= sub;
+	}
+	return;
+}
+
 static size_t
 strhash_small(const char *s, const uint8_t *cmap)
 {
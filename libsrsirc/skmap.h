@@ -26,10 +26,23 @@ void *lsi_skmap_get(skmap *m, const char *key);
 void *lsi_skmap_del(skmap *m, const char *key);
 size_t lsi_skmap_count(skmap *m);
 
+/* have the map keep `*ctr' up to date with the amount of memory (in bytes,
+ * excluding allocator overhead) used by its own structures, i.e. everything
+ * but the elements.  the current amount is added right away */
+void lsi_skmap_account(skmap *m, size_t *ctr);
+
 bool lsi_skmap_first(skmap *m, char **key, void **val);
 bool lsi_skmap_next(skmap *m, char **key, void **val);
 void lsi_skmap_del_iter(skmap *h);
 
+/* like the above, but with the iteration state kept by the caller, so that
+ * several iterations can be in progress at once.  the map must not be
+ * modified while one is */
+bool lsi_skmap_cfirst(skmap *m, size_t *bit, void **pos, char **key,
+    void **val);
+bool lsi_skmap_cnext(skmap *m, size_t *bit, void **pos, char **key,
+    void **val);
+
 void lsi_skmap_dump(skmap *m, skmap_op_fn valop);
 void lsi_skmap_stat(skmap *h, size_t *nbuck, size_t *nbuckused, size_t *nitems,
     double *loadfac, double *avglistlen, size_t *maxlistlen);
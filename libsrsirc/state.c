@@ -0,0 +1,749 @@
+/* state.c - (de)serialization of IRC context state
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#define LOG_MODULE MOD_STATE
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "state.h"
+
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <platform/base_misc.h>
+#include <platform/base_string.h>
+#include <platform/base_time.h>
+
+#include <logger/intlog.h>
+
+#include "common.h"
+#include "conn.h"
+#include "irc_track_int.h"
+#include "skmap.h"
+#include "ucbase.h"
+#include "v3.h"
+
+#include <libsrsirc/util.h>
+
+
+/* The format is a header (magic, version) followed by any number of
+ * sections, each being a one-byte tag (LSI_ST_*), a 32-bit length and that
+ * many bytes of payload.  Integers are big endian; strings are a 32-bit
+ * length followed by the bytes (no terminator), ST_NULLSTR denotes NULL.
+ * Readers skip sections they don't know or don't want. */
+#define ST_MAGIC "LSIS"
+#define ST_VERSION 1
+#define ST_NULLSTR 0xffffffffu
+
+/* input cursor */
+struct strd {
+	const unsigned char *p;
+	const unsigned char *end;
+	bool err;
+};
+
+
+static void put_raw(struct stbuf *b, const void *data, size_t len);
+static void put_u8(struct stbuf *b, uint8_t v);
+static void put_u32(struct stbuf *b, uint32_t v);
+static void put_u64(struct stbuf *b, uint64_t v);
+static void put_str(struct stbuf *b, const char *s);
+static void put_mode(const char *modestr, void *tag);
+static void put_blob(struct stbuf *b, const void *data, size_t len);
+static const unsigned char *get_raw(struct strd *r, size_t len);
+static uint8_t get_u8(struct strd *r);
+static uint32_t get_u32(struct strd *r);
+static uint64_t get_u64(struct strd *r);
+static char *get_str(struct strd *r);
+static void get_strbuf(struct strd *r, char *dest, size_t destsz);
+
+static void save_session(irc *ctx, struct stbuf *b);
+static void save_conn(irc *ctx, struct stbuf *b);
+static void save_track(irc *ctx, struct stbuf *b);
+static bool load_session(irc *ctx, struct strd *r);
+static bool load_conn(irc *ctx, struct strd *r);
+static bool load_track(irc *ctx, struct strd *r, bool stale);
+
+
+bool
+lsi_st_save(irc *ctx, struct stbuf *b, unsigned what)
+{
+	static const struct {
+		unsigned tag;
+		void (*fn)(irc *, struct stbuf *);
+	} sects[] = {
+		{ LSI_ST_SESSION, save_session },
+		{ LSI_ST_CONN, save_conn },
+		{ LSI_ST_TRACK, save_track },
+	};
+
+	put_raw(b, ST_MAGIC, 4);
+	put_u32(b, ST_VERSION);
+
+	for (size_t i = 0; i < COUNTOF(sects); i++) {
+		if (!(what & sects[i].tag))
+			continue;
+
+		if (sects[i].tag == LSI_ST_TRACK && !ctx->tracking_enab) {
+			D("tracking not enabled, not saving tracking state");
+			continue;
+		}
+
+		put_u8(b, sects[i].tag);
+		size_t at = b->len;
+		put_u32(b, 0); // length, filled in below
+		sects[i].fn(ctx, b);
+
+		if (b->err)
+			break;
+
+		uint32_t slen = b->len - at - 4;
+		for (size_t j = 0; j < 4; j++)
+			b->data[at + j] = (slen >> (24 - 8*j)) & 0xff;
+
+		D("saved section %u (%"PRIu32" bytes)", sects[i].tag, slen);
+	}
+
+	if (b->err)
+		E("failed to serialize state");
+
+	return !b->err;
+}
+
+bool
+lsi_st_load(irc *ctx, const void *data, size_t len, unsigned what)
+{
+	struct strd r = { data, (const unsigned char *)data + len, false };
+
+	const unsigned char *magic = get_raw(&r, 4);
+	if (!magic || memcmp(magic, ST_MAGIC, 4) != 0) {
+		E("not a serialized state (bad magic)");
+		return false;
+	}
+
+	uint32_t ver = get_u32(&r);
+	if (r.err || ver != ST_VERSION) {
+		E("unsupported state version %"PRIu32" (want %d)",
+		    ver, ST_VERSION);
+		return false;
+	}
+
+	while (!r.err && r.p < r.end) {
+		uint8_t tag = get_u8(&r);
+		uint32_t slen = get_u32(&r);
+		const unsigned char *sp = get_raw(&r, slen);
+		if (!sp)
+			break;
+
+		struct strd s = { sp, sp + slen, false };
+		bool ok = true;
+
+		if (!(what & tag)) {
+			D("skipping section %"PRIu8" (not wanted)", tag);
+			continue;
+		}
+
+		switch (tag) {
+		case LSI_ST_SESSION:
+			ok = load_session(ctx, &s);
+			break;
+		case LSI_ST_CONN:
+			ok = load_conn(ctx, &s);
+			break;
+		case LSI_ST_TRACK:
+			ok = load_track(ctx, &s, what & LSI_ST_STALE);
+			break;
+		default:
+			W("skipping unknown section %"PRIu8, tag);
+		}
+
+		if (!ok || s.err) {
+			E("failed to load section %"PRIu8, tag);
+			return false;
+		}
+
+		D("loaded section %"PRIu8" (%"PRIu32" bytes)", tag, slen);
+	}
+
+	if (r.err) {
+		E("serialized state truncated");
+		return false;
+	}
+
+	return true;
+}
+
+void
+lsi_st_freebuf(struct stbuf *b)
+{
+	free(b->data);
+	b->data = NULL;
+	b->len = b->sz = 0;
+	b->err = false;
+	return;
+}
+
+
+static void
+save_tokarr(struct stbuf *b, tokarr *arr)
+{
+	put_u8(b, !!arr);
+	if (!arr)
+		return;
+
+	put_u32(b, COUNTOF(*arr));
+	for (size_t i = 0; i < COUNTOF(*arr); i++)
+		put_str(b, (*arr)[i]);
+	return;
+}
+
+static tokarr *
+load_tokarr(struct strd *r)
+{
+	if (!get_u8(r))
+		return NULL;
+
+	uint32_t n = get_u32(r);
+	tokarr *arr = MALLOC(sizeof *arr);
+	if (!arr) {
+		r->err = true;
+		return NULL;
+	}
+
+	for (size_t i = 0; i < COUNTOF(*arr); i++)
+		(*arr)[i] = NULL;
+
+	for (uint32_t i = 0; i < n && !r->err; i++) {
+		char *s = get_str(r);
+		if (i < COUNTOF(*arr))
+			(*arr)[i] = s;
+		else
+			free(s);
+	}
+
+	return arr;
+}
+
+static void
+save_session(irc *ctx, struct stbuf *b)
+{
+	put_str(b, ctx->mynick);
+	put_str(b, ctx->myhost);
+	put_u8(b, ctx->service);
+	put_str(b, ctx->cmodes);
+	put_str(b, ctx->umodes);
+	put_str(b, ctx->myumodes);
+	put_str(b, ctx->ver);
+	put_str(b, ctx->lasterr);
+	put_u8(b, ctx->restricted);
+	put_u8(b, ctx->banned);
+	put_str(b, ctx->banmsg);
+	put_u32(b, (uint32_t)ctx->casemap);
+	put_u8(b, ctx->endofnames);
+
+	for (size_t i = 0; i < COUNTOF(ctx->logonconv); i++)
+		save_tokarr(b, ctx->logonconv[i]);
+
+	for (size_t i = 0; i < COUNTOF(ctx->m005chanmodes); i++)
+		put_str(b, ctx->m005chanmodes[i]);
+
+	for (size_t i = 0; i < COUNTOF(ctx->m005modepfx); i++)
+		put_str(b, ctx->m005modepfx[i]);
+
+	put_str(b, ctx->m005chantypes);
+
+	char *key;
+	void *val;
+	put_u32(b, lsi_skmap_count(ctx->m005attrs));
+	if (lsi_skmap_first(ctx->m005attrs, &key, &val))
+		do {
+			put_str(b, key);
+			put_str(b, val);
+		} while (lsi_skmap_next(ctx->m005attrs, &key, &val));
+
+	uint32_t ncaps = 0;
+	while (ncaps < COUNTOF(ctx->v3caps) && ctx->v3caps[ncaps])
+		ncaps++;
+
+	put_u32(b, ncaps);
+	for (size_t i = 0; i < ncaps; i++) {
+		put_str(b, ctx->v3caps[i]->name);
+		put_str(b, ctx->v3caps[i]->adddata);
+		put_u8(b, ctx->v3caps[i]->musthave);
+		put_u8(b, ctx->v3caps[i]->offered);
+		put_u8(b, ctx->v3caps[i]->enabled);
+	}
+	return;
+}
+
+static bool
+load_session(irc *ctx, struct strd *r)
+{
+	char *s;
+
+	get_strbuf(r, ctx->mynick, sizeof ctx->mynick);
+	get_strbuf(r, ctx->myhost, sizeof ctx->myhost);
+	ctx->service = get_u8(r);
+	get_strbuf(r, ctx->cmodes, sizeof ctx->cmodes);
+	get_strbuf(r, ctx->umodes, sizeof ctx->umodes);
+	get_strbuf(r, ctx->myumodes, sizeof ctx->myumodes);
+	get_strbuf(r, ctx->ver, sizeof ctx->ver);
+	free(ctx->lasterr);
+	ctx->lasterr = get_str(r);
+	ctx->restricted = get_u8(r);
+	ctx->banned = get_u8(r);
+	free(ctx->banmsg);
+	ctx->banmsg = get_str(r);
+	ctx->casemap = (int)get_u32(r);
+	ctx->endofnames = get_u8(r);
+
+	for (size_t i = 0; i < COUNTOF(ctx->logonconv); i++) {
+		lsi_ut_freearr(ctx->logonconv[i]);
+		ctx->logonconv[i] = load_tokarr(r);
+	}
+
+	for (size_t i = 0; i < COUNTOF(ctx->m005chanmodes); i++)
+		get_strbuf(r, ctx->m005chanmodes[i], MAX_005_CHMD);
+
+	for (size_t i = 0; i < COUNTOF(ctx->m005modepfx); i++)
+		get_strbuf(r, ctx->m005modepfx[i], MAX_005_MDPFX);
+
+	get_strbuf(r, ctx->m005chantypes, MAX_005_CHTYP);
+
+	void *val;
+	if (lsi_skmap_first(ctx->m005attrs, NULL, &val))
+		do free(val); while (lsi_skmap_next(ctx->m005attrs, NULL, &val));
+	lsi_skmap_clear(ctx->m005attrs);
+
+	uint32_t nattrs = get_u32(r);
+	for (uint32_t i = 0; i < nattrs && !r->err; i++) {
+		char *key = get_str(r);
+		s = get_str(r);
+		bool ok = key && s && lsi_skmap_put(ctx->m005attrs, key, s);
+		free(key);
+		if (!ok) {
+			free(s);
+			return false;
+		}
+	}
+
+	lsi_v3_reset_caps(ctx);
+	uint32_t ncaps = get_u32(r);
+	for (uint32_t i = 0; i < ncaps && !r->err; i++) {
+		struct v3cap *cap = MALLOC(sizeof *cap);
+		if (!cap)
+			return false;
+
+		get_strbuf(r, cap->name, sizeof cap->name);
+		get_strbuf(r, cap->adddata, sizeof cap->adddata);
+		cap->musthave = get_u8(r);
+		cap->offered = get_u8(r);
+		cap->enabled = get_u8(r);
+
+		if (i < COUNTOF(ctx->v3caps))
+			ctx->v3caps[i] = cap;
+		else {
+			W("too many caps, dropping '%s'", cap->name);
+			free(cap);
+		}
+	}
+
+	return !r->err;
+}
+
+static void
+save_conn(irc *ctx, struct stbuf *b)
+{
+	iconn *con = ctx->con;
+	put_str(b, lsi_conn_get_host(con));
+	put_u32(b, lsi_conn_get_port(con));
+	put_u8(b, con->colon_trail);
+	put_blob(b, con->rctx.wptr, (size_t)(con->rctx.eptr - con->rctx.wptr));
+	return;
+}
+
+static bool
+load_conn(irc *ctx, struct strd *r)
+{
+	iconn *con = ctx->con;
+	char *host = get_str(r);
+	uint32_t port = get_u32(r);
+	bool colon_trail = get_u8(r);
+	uint32_t nunread = get_u32(r);
+	const unsigned char *unread = get_raw(r, nunread);
+
+	bool ok = !r->err && host && port <= 65535 && nunread <= WORKBUF_SZ
+	    && lsi_conn_set_server(con, host, (uint16_t)port);
+	free(host);
+
+	if (!ok)
+		return false;
+
+	con->colon_trail = colon_trail;
+	memcpy(con->rctx.workbuf, unread, nunread);
+	con->rctx.wptr = con->rctx.workbuf;
+	con->rctx.eptr = con->rctx.workbuf + nunread;
+	con->rctx.tarrive = lsi_b_mono_ns(); // as far as we're concerned
+	D("restored %"PRIu32" bytes of unread input", nunread);
+
+	return true;
+}
+
+static void
+save_track(irc *ctx, struct stbuf *b)
+{
+	void *e;
+	put_u32(b, lsi_ucb_num_users(ctx));
+	if (lsi_skmap_first(ctx->users, NULL, &e))
+		do {
+			user *u = e;
+			put_str(b, u->nick);
+			put_str(b, u->uname);
+			put_str(b, u->host);
+			put_str(b, u->fname);
+		} while (lsi_skmap_next(ctx->users, NULL, &e));
+
+	put_u32(b, lsi_ucb_num_chans(ctx));
+	if (lsi_skmap_first(ctx->chans, NULL, &e))
+		do {
+			chan *c = e;
+			put_str(b, c->name);
+			put_str(b, c->topic);
+			put_str(b, c->topicnick);
+			put_u64(b, c->tscreate);
+			put_u64(b, c->tstopic);
+			put_u8(b, c->desync);
+
+			put_u32(b, lsi_ucb_num_chanmodes(c));
+			lsi_ucb_each_chanmode(c, put_mode, b);
+
+			void *me;
+			put_u32(b, lsi_ucb_num_memb(ctx, c));
+			if (lsi_skmap_first(c->memb, NULL, &me))
+				do {
+					memb *m = me;
+					put_str(b, m->u->nick);
+					put_str(b, m->modepfx);
+				} while (lsi_skmap_next(c->memb, NULL, &me));
+		} while (lsi_skmap_next(ctx->chans, NULL, &e));
+	return;
+}
+
+/* Merges into what's there (if anything), live information wins: channels
+ * and users we already know are left alone.  Users are only created once
+ * seen as a member of a restored channel, so none end up dangling */
+static bool
+load_track(irc *ctx, struct strd *r, bool stale)
+{
+	if (!ctx->tracking) {
+		D("tracking not wanted, ignoring tracking state");
+		return true;
+	}
+
+	if (!ctx->tracking_enab) {
+		/* relies on the session (and thus the casemapping) having
+		 * been loaded first */
+		if (!lsi_trk_init(ctx))
+			return false;
+		ctx->tracking_enab = true;
+	}
+
+	bool ok = false;
+	uint32_t nusers = get_u32(r);
+	skmap *urecs = lsi_skmap_init(nusers / 4 + 1, ctx->casemap);
+	if (!urecs)
+		return false;
+
+	for (uint32_t i = 0; i < nusers && !r->err; i++) {
+		char *nick = get_str(r);
+		char **urec = MALLOC(3 * sizeof *urec);
+		if (urec) {
+			urec[0] = get_str(r); // uname
+			urec[1] = get_str(r); // host
+			urec[2] = get_str(r); // fname
+		}
+
+		bool put = nick && urec && lsi_skmap_put(urecs, nick, urec);
+		free(nick);
+		if (!put) {
+			if (urec)
+				free(urec[0]), free(urec[1]), free(urec[2]);
+			free(urec);
+			goto out;
+		}
+	}
+
+	size_t nrestored = 0;
+	uint32_t nchans = get_u32(r);
+	for (uint32_t i = 0; i < nchans && !r->err; i++) {
+		char name[MAX_CHAN_LEN];
+		get_strbuf(r, name, sizeof name);
+		if (r->err)
+			break;
+
+		/* still parse what we skip, to get past it */
+		bool skip = lsi_ucb_get_chan(ctx, name, false)
+		    || !lsi_trk_wanted(ctx, name);
+		chan *c = skip ? NULL : lsi_ucb_add_chan(ctx, name);
+		if (!skip && !c)
+			goto out;
+
+		char *topic = get_str(r);
+		char *topicnick = get_str(r);
+		uint64_t tscreate = get_u64(r);
+		uint64_t tstopic = get_u64(r);
+		bool desync = get_u8(r);
+
+		if (skip)
+			D("not restoring '%s'", name);
+		else if (!lsi_ucb_set_chanstr(ctx, &c->topic, topic)
+		    || !lsi_ucb_set_chanstr(ctx, &c->topicnick, topicnick)) {
+			free(topic);
+			free(topicnick);
+			goto out;
+		} else {
+			c->tscreate = tscreate;
+			c->tstopic = tstopic;
+			c->desync = desync || stale;
+			nrestored++;
+		}
+
+		free(topic);
+		free(topicnick);
+
+		uint32_t nmodes = get_u32(r);
+		for (uint32_t j = 0; j < nmodes && !r->err; j++) {
+			/* "<mode>" or "<mode> <arg>"; an empty one is corrupt */
+			char *s = get_str(r);
+			bool fail = !s || !s[0] || (!skip
+			    && !lsi_ucb_add_chanmode(ctx, c, s[0],
+			    s[1] == ' ' ? s + 2 : NULL));
+			free(s);
+			if (fail)
+				goto out;
+		}
+
+		uint32_t nmemb = get_u32(r);
+		for (uint32_t j = 0; j < nmemb && !r->err; j++) {
+			char nick[MAX_NICK_LEN];
+			char mpfx[MAX_MODEPFX];
+			get_strbuf(r, nick, sizeof nick);
+			get_strbuf(r, mpfx, sizeof mpfx);
+			if (r->err || skip)
+				continue;
+
+			user *u = lsi_ucb_get_user(ctx, nick, false);
+			if (!u) {
+				char **urec = lsi_skmap_get(urecs, nick);
+				if (!urec) {
+					E("member '%s' of '%s' is no known user",
+					    nick, name);
+					r->err = true;
+					break;
+				}
+
+				if (!(u = lsi_ucb_add_user(ctx, nick)))
+					goto out;
+
+				if (!lsi_ucb_set_userstr(ctx, &u->uname, urec[0])
+				    || !lsi_ucb_set_userstr(ctx, &u->host, urec[1])
+				    || !lsi_ucb_set_userstr(ctx, &u->fname,
+				    urec[2]))
+					goto out;
+			}
+
+			if (!lsi_ucb_add_memb(ctx, c, u, mpfx))
+				goto out;
+		}
+	}
+
+	I("restored %zu channels (now %zu users, %zu channels)",
+	    nrestored, lsi_ucb_num_users(ctx), lsi_ucb_num_chans(ctx));
+	ok = !r->err;
+
+out:;
+	void *e;
+	if (lsi_skmap_first(urecs, NULL, &e))
+		do {
+			char **urec = e;
+			free(urec[0]);
+			free(urec[1]);
+			free(urec[2]);
+			free(urec);
+		} while (lsi_skmap_next(urecs, NULL, &e));
+	lsi_skmap_dispose(urecs);
+
+	return ok;
+}
+
+
+static void
+put_raw(struct stbuf *b, const void *data, size_t len)
+{
+	if (b->err)
+		return;
+
+	if (b->sz - b->len < len) {
+		size_t nsz = b->sz ? b->sz : 4096;
+		while (nsz - b->len < len)
+			nsz *= 2;
+
+		unsigned char *nd = MALLOC(nsz);
+		if (!nd) {
+			b->err = true;
+			return;
+		}
+
+		if (b->len)
+			memcpy(nd, b->data, b->len);
+		free(b->data);
+		b->data = nd;
+		b->sz = nsz;
+	}
+
+	memcpy(b->data + b->len, data, len);
+	b->len += len;
+	return;
+}
+
+static void
+put_u8(struct stbuf *b, uint8_t v)
+{
+	put_raw(b, &v, 1);
+	return;
+}
+
+static void
+put_u32(struct stbuf *b, uint32_t v)
+{
+	unsigned char d[4];
+	for (size_t i = 0; i < sizeof d; i++)
+		d[i] = (v >> (24 - 8*i)) & 0xff;
+	put_raw(b, d, sizeof d);
+	return;
+}
+
+static void
+put_u64(struct stbuf *b, uint64_t v)
+{
+	put_u32(b, v >> 32);
+	put_u32(b, v & 0xffffffffu);
+	return;
+}
+
+static void
+put_str(struct stbuf *b, const char *s)
+{
+	if (!s)
+		put_u32(b, ST_NULLSTR);
+	else
+		put_blob(b, s, strlen(s));
+	return;
+}
+
+/* lsi_ucb_each_chanmode() callback */
+static void
+put_mode(const char *modestr, void *tag)
+{
+	put_str(tag, modestr);
+	return;
+}
+
+static void
+put_blob(struct stbuf *b, const void *data, size_t len)
+{
+	if (len >= ST_NULLSTR) {
+		b->err = true;
+		return;
+	}
+
+	put_u32(b, (uint32_t)len);
+	put_raw(b, data, len);
+	return;
+}
+
+static const unsigned char *
+get_raw(struct strd *r, size_t len)
+{
+	if (r->err || (size_t)(r->end - r->p) < len) {
+		r->err = true;
+		return NULL;
+	}
+
+	const unsigned char *p = r->p;
+	r->p += len;
+	return p;
+}
+
+static uint8_t
+get_u8(struct strd *r)
+{
+	const unsigned char *p = get_raw(r, 1);
+	return p ? p[0] : 0;
+}
+
+static uint32_t
+get_u32(struct strd *r)
+{
+	const unsigned char *p = get_raw(r, 4);
+	if (!p)
+		return 0;
+
+	return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16
+	    | (uint32_t)p[2] << 8 | (uint32_t)p[3];
+}
+
+static uint64_t
+get_u64(struct strd *r)
+{
+	uint64_t hi = get_u32(r);
+	return hi << 32 | get_u32(r);
+}
+
+/* returns a freshly allocated string, or NULL if it was NULL or on error */
+static char *
+get_str(struct strd *r)
+{
+	uint32_t len = get_u32(r);
+	if (r->err || len == ST_NULLSTR)
+		return NULL;
+
+	const unsigned char *p = get_raw(r, len);
+	char *s = p ? MALLOC((size_t)len + 1) : NULL;
+	if (!s) {
+		r->err = true;
+		return NULL;
+	}
+
+	memcpy(s, p, len);
+	s[len] = '\0';
+	return s;
+}
+
+/* reads a string into a fixed size buffer; NULL and overlong strings are
+ * considered errors */
+static void
+get_strbuf(struct strd *r, char *dest, size_t destsz)
+{
+	uint32_t len = get_u32(r);
+	const unsigned char *p = NULL;
+	if (!r->err && (len == ST_NULLSTR || len >= destsz))
+		r->err = true;
+	else
+		p = get_raw(r, len);
+
+	if (!p) {
+		dest[0] = '\0';
+		return;
+	}
+
+	memcpy(dest, p, len);
+	dest[len] = '\0';
+	return;
+}
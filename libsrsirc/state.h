@@ -0,0 +1,40 @@
+/* state.h - (de)serialization of IRC context state, interface (lib-internal)
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIBSRSIRC_STATE_H
+#define LIBSRSIRC_STATE_H 1
+
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <libsrsirc/defs.h>
+#include "intdefs.h"
+
+
+/* sections of serialized state, to be or'ed together */
+#define LSI_ST_SESSION 0x01u /* what the server told us (004, 005, caps...) */
+#define LSI_ST_CONN 0x02u    /* server address and not yet processed input */
+#define LSI_ST_TRACK 0x04u   /* the tracking base (channels, users, members) */
+#define LSI_ST_ALL (LSI_ST_SESSION|LSI_ST_CONN|LSI_ST_TRACK)
+
+/* modifier for lsi_st_load(): the state may be outdated (e.g. it comes from
+ * a snapshot taken before a restart), mark restored channels desync'ed */
+#define LSI_ST_STALE 0x100u
+
+/* growable output buffer; zero-initialize before first use */
+struct stbuf {
+	unsigned char *data;
+	size_t len;
+	size_t sz;
+	bool err;
+};
+
+
+bool lsi_st_save(irc *ctx, struct stbuf *b, unsigned what);
+bool lsi_st_load(irc *ctx, const void *data, size_t len, unsigned what);
+void lsi_st_freebuf(struct stbuf *b);
+
+
+#endif /* LIBSRSIRC_STATE_H */
@@ -13,6 +13,7 @@
 
 
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -23,11 +24,45 @@
 
 #include "skmap.h"
 #include "common.h"
+#include "probes.h"
 
 #include <libsrsirc/util.h>
 
 
 static int compare_modepfx(irc *ctx, char c1, char c2);
+static void clear(irc *ctx);
+static void free_chan(irc *ctx, chan *c);
+static void free_user(irc *ctx, user *u);
+static void free_memb(irc *ctx, memb *m);
+static size_t strsz(const char *s);
+static int modebit(char mode);
+static char modechr(int bit);
+static const char *modestr(char *dest, size_t destsz, char mode,
+    const char *arg);
+static struct cmparm *findparm(chan *c, char mode);
+static void dumpmode(const char *modestr, void *tag);
+static void eachlistmode(const struct mlinfo *e, void *tag);
+
+struct eachmode {
+	void (*fn)(const char *modestr, void *tag);
+	void *tag;
+};
+
+
+void
+lsi_ucb_emit(irc *ctx, int type, const char *chname, const char *nick,
+    const char *arg)
+{
+	ctx->trkgen++; // every change goes through here
+	LSI_PROBE5(track_mutation, ctx, type, chname, nick, arg);
+
+	if (!ctx->cb_trkev)
+		return;
+
+	struct trkev ev = { type, chname, nick, arg };
+	ctx->cb_trkev(ctx, &ev, ctx->tag_trkev);
+	return;
+}
 
 
 bool
@@ -39,6 +74,15 @@ lsi_ucb_init(irc *ctx)
 	if (!(ctx->users = lsi_skmap_init(4096, ctx->casemap)))
 		return lsi_skmap_dispose(ctx->chans), false;
 
+	if (!(ctx->untracked = lsi_skmap_init(256, ctx->casemap))) {
+		lsi_skmap_dispose(ctx->chans);
+		lsi_skmap_dispose(ctx->users);
+		return false;
+	}
+
+	lsi_skmap_account(ctx->chans, &ctx->trkmem.maps);
+	lsi_skmap_account(ctx->users, &ctx->trkmem.maps);
+	lsi_skmap_account(ctx->untracked, &ctx->trkmem.maps);
 	return true;
 }
 
@@ -53,35 +97,35 @@ lsi_ucb_add_chan(irc *ctx, const char *name)
 	c->topic = c->topicnick = NULL;
 	c->tscreate = c->tstopic = 0;
 	c->desync = false;
-	c->modes = NULL;
+	c->nomemb = false;
+	c->cmflags = 0;
+	for (size_t i = 0; i < COUNTOF(c->cmparm); i++) {
+		c->cmparm[i].mode = '\0';
+		c->cmparm[i].arg = NULL;
+	}
+	c->cmlists = NULL;
+	c->lsync = 0;
+	c->memb = NULL;
 	c->tag = NULL;
 	c->freetag = false;
 
 	if (!(c->memb = lsi_skmap_init(256, ctx->casemap)))
 		goto fail;
 
-	c->modes_sz = 16; //grows
-	if (!(c->modes = MALLOC(c->modes_sz * sizeof *c->modes)))
-		goto fail;
-
-	for (size_t i = 0; i < c->modes_sz; i++)
-		c->modes[i] = NULL;
+	lsi_skmap_account(c->memb, &ctx->trkmem.maps);
 
 	if (!lsi_skmap_put(ctx->chans, name, c))
 		goto fail;
 
+	ctx->trkmem.chans += sizeof *c;
 	D("added chan '%s'", c->name);
+	lsi_ucb_emit(ctx, TRKEV_CHAN_ADD, c->name, NULL, NULL);
 
 	return c;
 
 fail:
-	if (c) {
-		if (c->modes)
-			free(c->modes[0]);
-
-		free(c->modes);
+	if (c)
 		lsi_skmap_dispose(c->memb);
-	}
 
 	free(c);
 	return NULL;
@@ -95,6 +139,8 @@ lsi_ucb_drop_chan(irc *ctx, chan *c)
 		return false;
 	}
 
+	lsi_ucb_emit(ctx, TRKEV_CHAN_DROP, c->name, NULL, NULL);
+
 	void *e;
 	if (lsi_skmap_first(c->memb, NULL, &e)) {
 		do {
@@ -103,30 +149,18 @@ lsi_ucb_drop_chan(irc *ctx, chan *c)
 				if (!lsi_skmap_del(ctx->users, m->u->nick))
 					W("user '%s' not in umap", m->u->nick);
 				D("implicitly dropped user '%s'", m->u->nick);
-				free(m->u->nick);
-				free(m->u->uname);
-				free(m->u->host);
-				free(m->u->fname);
-				if (m->u->freetag)
-					free(m->u->tag);
-				free(m->u);
+				lsi_ucb_emit(ctx, TRKEV_USER_DROP, NULL,
+				    m->u->nick, NULL);
+				free_user(ctx, m->u);
 			}
-			free(m);
+			free_memb(ctx, m);
 		} while (lsi_skmap_next(c->memb, NULL, &e));
 		lsi_skmap_clear(c->memb);
 	}
-	lsi_skmap_dispose(c->memb);
 
 	D("dropped channel '%s'", c->name);
 
-	free(c->topic);
-	free(c->topicnick);
-	for (size_t i = 0; i < c->modes_sz; i++)
-		free(c->modes[i]);
-	free(c->modes);
-	if (c->freetag)
-		free(c->tag);
-	free(c);
+	free_chan(ctx, c);
 	return true;
 }
 
@@ -170,7 +204,9 @@ lsi_ucb_add_memb(irc *ctx, chan *c, user *u, const char *mpfxstr)
 	}
 
 	u->nchans++;
+	ctx->trkmem.membs += sizeof *m;
 	D("added member '%s' to chan '%s'", u->nick, c->name);
+	lsi_ucb_emit(ctx, TRKEV_MEMB_ADD, c->name, u->nick, m->modepfx);
 	return true;
 }
 
@@ -180,23 +216,23 @@ lsi_ucb_drop_memb(irc *ctx, chan *c, user *u, bool purge, bool complain)
 	memb *m = lsi_skmap_del(c->memb, u->nick);
 	if (m) {
 		D("dropped '%s' from '%s'", m->u->nick, c->name);
+		lsi_ucb_emit(ctx, TRKEV_MEMB_DROP, c->name, m->u->nick, NULL);
 		if (--m->u->nchans == 0 && purge) {
 			if (!lsi_skmap_del(ctx->users, m->u->nick))
 				W("user '%s' not in user map", m->u->nick);
 			D("implicitly dropped user '%s'", m->u->nick);
-			free(m->u->nick);
-			free(m->u->uname);
-			free(m->u->host);
-			free(m->u->fname);
-			if (m->u->freetag)
-				free(m->u->tag);
-			free(m->u);
+			lsi_ucb_emit(ctx, TRKEV_USER_DROP, NULL, m->u->nick,
+			    NULL);
+			free_user(ctx, m->u);
 		}
-	} else if (complain)
+		free_memb(ctx, m);
+		return true;
+	}
+
+	if (complain)
 		W("no such member '%s' in channel '%s'", u->nick, c->name);
 
-	free(m);
-	return m;
+	return false;
 }
 
 void
@@ -206,21 +242,19 @@ lsi_ucb_clear_memb(irc *ctx, chan *c)
 	if (!lsi_skmap_first(c->memb, NULL, &e))
 		return;
 
+	lsi_ucb_emit(ctx, TRKEV_MEMB_CLEAR, c->name, NULL, NULL);
+
 	do {
 		memb *m = e;
 		if (--m->u->nchans== 0) {
 			if (!lsi_skmap_del(ctx->users, m->u->nick))
 				W("user '%s' not in user map", m->u->nick);
 			D("implicitly dropped user '%s'", m->u->nick);
-			free(m->u->nick);
-			free(m->u->uname);
-			free(m->u->host);
-			free(m->u->fname);
-			if (m->u->freetag)
-				free(m->u->tag);
-			free(m->u);
+			lsi_ucb_emit(ctx, TRKEV_USER_DROP, NULL, m->u->nick,
+			    NULL);
+			free_user(ctx, m->u);
 		}
-		free(m);
+		free_memb(ctx, m);
 	} while (lsi_skmap_next(c->memb, NULL, &e));
 	lsi_skmap_clear(c->memb);
 	D("cleared members of channel '%s'", c->name);
@@ -236,6 +270,7 @@ lsi_ucb_alloc_memb(irc *ctx, user *u, const char *mpfxstr)
 
 	m->u = u;
 	STRACPY(m->modepfx, mpfxstr);
+	m->split = false;
 
 	return m;
 
@@ -283,6 +318,7 @@ lsi_ucb_update_modepfx(irc *ctx, chan *c, const char *nick, char mpfxsym, bool e
 		*p = mpfxsym;
 	}
 
+	lsi_ucb_emit(ctx, TRKEV_MEMB_MODE, c->name, m->u->nick, m->modepfx);
 	return true;
 }
 
@@ -300,100 +336,214 @@ compare_modepfx(irc *ctx, char c1, char c2)
 	return o1 < o2 ? 1 : o1 > o2 ? -1 : 0;
 }
 
+/* forget the flag and parameter modes, e.g. before getting them anew with
+ * 324.  list modes aren't part of that, see lsi_ucb_clear_list() */
 void
 lsi_ucb_clear_chanmodes(irc *ctx, chan *c)
 {
-	for (size_t i = 0; i < c->modes_sz; i++)
-		free(c->modes[i]), c->modes[i] = NULL;
+	c->cmflags = 0;
+	for (size_t i = 0; i < COUNTOF(c->cmparm); i++) {
+		ctx->trkmem.chans -= strsz(c->cmparm[i].arg);
+		free(c->cmparm[i].arg);
+		c->cmparm[i].arg = NULL;
+		c->cmparm[i].mode = '\0';
+	}
+
+	lsi_ucb_emit(ctx, TRKEV_MODE_CLEAR, c->name, NULL, NULL);
 	return;
 }
 
 bool
-lsi_ucb_add_chanmode(irc *ctx, chan *c, const char *modestr)
+lsi_ucb_add_chanmode(irc *ctx, chan *c, char mode, const char *arg)
 {
-	size_t ind = 0;
-	for (; ind < c->modes_sz; ind++)
-		if (!c->modes[ind])
-			break;
-
-	if (ind == c->modes_sz) {
-		size_t nsz = c->modes_sz * 2;
-		char **nmodes = MALLOC(nsz * sizeof *nmodes);
-		if (!nmodes)
+	char ms[MAX_MODESTR];
+	int cls = lsi_ut_classify_chanmode(ctx, mode);
+	int bit = modebit(mode);
+
+	if (cls == CHANMODE_CLASS_A)
+		return lsi_ucb_add_listent(ctx, c, mode, arg, NULL, 0);
+	else if (!arg && bit != -1) {
+		if (c->cmflags & (UINT64_C(1) << bit))
+			return true;
+
+		c->cmflags |= UINT64_C(1) << bit;
+		modestr(ms, sizeof ms, mode, NULL);
+	} else {
+		/* a mode which is already set just gets the new argument */
+		struct cmparm *p = findparm(c, mode);
+		if (!p && !(p = findparm(c, '\0'))) {
+			W("too many parameter modes on '%s', ignoring '%c'",
+			    c->name, mode);
 			return false;
+		}
 
-		size_t i;
-		for (i = 0; i < c->modes_sz; i++)
-			nmodes[i] = c->modes[i];
-
-		for (; i < nsz; i++)
-			nmodes[i] = NULL;
+		char *a = NULL;
+		if (arg && !(a = STRDUP(arg)))
+			return false;
 
-		free(c->modes);
-		c->modes = nmodes;
-		c->modes_sz = nsz;
+		ctx->trkmem.chans += strsz(a);
+		ctx->trkmem.chans -= strsz(p->arg);
+		free(p->arg);
+		p->arg = a;
+		p->mode = mode;
+		modestr(ms, sizeof ms, mode, a);
 	}
 
-	return (c->modes[ind] = STRDUP(modestr));
+	lsi_ucb_emit(ctx, TRKEV_MODE_SET, c->name, NULL, ms);
+	return true;
 }
 
+/* add an entry to a list mode (class A), e.g. a ban */
 bool
-lsi_ucb_drop_chanmode(irc *ctx, chan *c, const char *modestr)
-{
-	size_t i;
-	int cls = lsi_ut_classify_chanmode(ctx, modestr[0]);
-	switch (cls) {
-	case CHANMODE_CLASS_A: //always has an argument (list-modes)
-		for (i = 0; i < c->modes_sz; i++)
-			if (c->modes[i] && strcmp(c->modes[i], modestr) == 0)
-				break;
-		break;
-	case CHANMODE_CLASS_B: //has argument when unset but it's irrelevant
-	case CHANMODE_CLASS_C: //no argument when beig unset
-	case CHANMODE_CLASS_D: //never has an argument
-		for (i = 0; i < c->modes_sz; i++)
-			if (c->modes[i] && c->modes[i][0] == modestr[0])
-				break;
-		break;
-	default:
-		E("huh? illegal modestr '%s'", modestr);
+lsi_ucb_add_listent(irc *ctx, chan *c, char mode, const char *mask,
+    const char *setter, uint64_t ts)
+{
+	char ms[MAX_MODESTR];
+	if (!mask)
 		return false;
-	}
 
-	if (i == c->modes_sz) {
-		D("chanmode '%s' not found (for dropping)", modestr);
-		return false;
-	}
+	if (!c->cmlists) {
+		if (!(c->cmlists = lsi_mlist_init(ctx->casemap)))
+			return false;
 
-	size_t last;
-	for (last = c->modes_sz - 1; last > 0; last--)
-		if (c->modes[last])
-			break;
-
-	free(c->modes[i]);
-	if (last == i)
-		c->modes[i] = NULL;
-	else {
-		c->modes[i] = c->modes[last];
-		c->modes[last] = NULL;
+		lsi_mlist_account(c->cmlists, &ctx->trkmem.chans);
 	}
 
+	int r = lsi_mlist_add(c->cmlists, mode, mask, setter, ts);
+	if (r <= 0)
+		return r == 0; // already have it, or failure
+
+	lsi_ucb_emit(ctx, TRKEV_MODE_SET, c->name, NULL,
+	    modestr(ms, sizeof ms, mode, mask));
+	return true;
+}
+
+/* forget all entries of one list mode, e.g. before getting the list anew */
+void
+lsi_ucb_clear_list(irc *ctx, chan *c, char mode)
+{
+	char ms[2] = { mode, '\0' };
+	if (c->cmlists)
+		lsi_mlist_delmode(c->cmlists, mode);
+
+	lsi_ucb_emit(ctx, TRKEV_LIST_CLEAR, c->name, NULL, ms);
+	return;
+}
+
+bool
+lsi_ucb_drop_chanmode(irc *ctx, chan *c, char mode, const char *arg)
+{
+	char ms[MAX_MODESTR];
+	int cls = lsi_ut_classify_chanmode(ctx, mode);
+	int bit = modebit(mode);
+	struct cmparm *p;
+
+	if (cls == CHANMODE_CLASS_A) { //always has an argument (list-modes)
+		if (!arg)
+			arg = "*";
+		if (!c->cmlists || !lsi_mlist_del(c->cmlists, mode, arg))
+			goto notfound;
+
+		modestr(ms, sizeof ms, mode, arg);
+	} else if (bit != -1 && c->cmflags & (UINT64_C(1) << bit)) {
+		c->cmflags &= ~(UINT64_C(1) << bit);
+		modestr(ms, sizeof ms, mode, NULL);
+	} else if ((p = findparm(c, mode))) {
+		/* the argument (if any) is irrelevant for unsetting these */
+		modestr(ms, sizeof ms, mode, p->arg);
+		ctx->trkmem.chans -= strsz(p->arg);
+		free(p->arg);
+		p->arg = NULL;
+		p->mode = '\0';
+	} else
+		goto notfound;
+
+	lsi_ucb_emit(ctx, TRKEV_MODE_UNSET, c->name, NULL, ms);
 	return true;
+
+notfound:
+	D("chanmode '%c' not found (for dropping)", mode);
+	return false;
+}
+
+/* is `mode' set on `c'?  for list modes, is `arg' on the list?  if `parm' is
+ * non-NULL, the mode's parameter (if any) is put there */
+bool
+lsi_ucb_has_chanmode(irc *ctx, chan *c, char mode, const char *arg,
+    const char **parm)
+{
+	int bit = modebit(mode);
+	struct cmparm *p;
+	const char *a = NULL;
+	bool set;
+
+	if (lsi_ut_classify_chanmode(ctx, mode) == CHANMODE_CLASS_A)
+		set = arg && c->cmlists && lsi_mlist_has(c->cmlists, mode, arg);
+	else if (bit != -1 && c->cmflags & (UINT64_C(1) << bit))
+		set = true;
+	else if ((p = findparm(c, mode))) {
+		set = true;
+		a = p->arg;
+	} else
+		set = false;
+
+	if (parm)
+		*parm = a;
+
+	return set;
+}
+
+size_t
+lsi_ucb_num_chanmodes(chan *c)
+{
+	size_t n = 0;
+	for (uint64_t f = c->cmflags; f; f &= f - 1)
+		n++;
+
+	for (size_t i = 0; i < COUNTOF(c->cmparm); i++)
+		if (c->cmparm[i].mode)
+			n++;
+
+	return n + (c->cmlists ? lsi_mlist_count(c->cmlists) : 0);
+}
+
+/* call `fn' for every mode set on `c', as in "s" or "l 123" */
+void
+lsi_ucb_each_chanmode(chan *c, void (*fn)(const char *modestr, void *tag),
+    void *tag)
+{
+	char ms[MAX_MODESTR];
+
+	for (int bit = 0; bit < 64; bit++)
+		if (c->cmflags & (UINT64_C(1) << bit))
+			fn(modestr(ms, sizeof ms, modechr(bit), NULL), tag);
+
+	for (size_t i = 0; i < COUNTOF(c->cmparm); i++)
+		if (c->cmparm[i].mode)
+			fn(modestr(ms, sizeof ms, c->cmparm[i].mode,
+			    c->cmparm[i].arg), tag);
+
+	if (c->cmlists) {
+		struct eachmode em = { fn, tag };
+		lsi_mlist_each(c->cmlists, eachlistmode, &em);
+	}
+
+	return;
 }
 
 void
-lsi_ucb_touch_user_int(user *u, const char *ident)
+lsi_ucb_touch_user_int(irc *ctx, user *u, const char *ident)
 {
 	if (!u->uname && strchr(ident, '!')) {
 		char unam[MAX_UNAME_LEN];
 		lsi_ut_ident2uname(unam, sizeof unam, ident);
-		u->uname = STRDUP(unam); //pointless to check
+		lsi_ucb_set_userstr(ctx, &u->uname, unam); //pointless to check
 	}
 
 	if (!u->host && strchr(ident, '@')) {
 		char host[MAX_HOST_LEN];
 		lsi_ut_ident2host(host, sizeof host, ident);
-		u->host = STRDUP(host); //pointless to check
+		lsi_ucb_set_userstr(ctx, &u->host, host); //pointless to check
 	}
 	return;
 }
@@ -402,8 +552,13 @@ user *
 lsi_ucb_touch_user(irc *ctx, const char *ident, bool complain)
 {
 	user *u = lsi_ucb_get_user(ctx, ident, complain);
-	if (u)
-		lsi_ucb_touch_user_int(u, ident);
+	if (!u)
+		return NULL;
+
+	bool had = u->uname && u->host;
+	lsi_ucb_touch_user_int(ctx, u, ident);
+	if (!had && u->uname && u->host)
+		lsi_ucb_emit(ctx, TRKEV_USER_UPDATE, NULL, u->nick, NULL);
 	return u;
 }
 
@@ -429,9 +584,11 @@ lsi_ucb_add_user(irc *ctx, const char *ident) //ident may be a nick, or nick!una
 	if (!lsi_skmap_put(ctx->users, nick, u))
 		goto fail;
 
-	lsi_ucb_touch_user_int(u, ident);
+	ctx->trkmem.users += sizeof *u + strsz(u->nick);
+	lsi_ucb_touch_user_int(ctx, u, ident);
 
 	D("added user '%s' ('%s@%s')", u->nick, u->uname, u->host);
+	lsi_ucb_emit(ctx, TRKEV_USER_ADD, NULL, u->nick, NULL);
 
 	return u;
 
@@ -463,14 +620,9 @@ lsi_ucb_drop_user(irc *ctx, user *u)
 		W("dropping dangling user '%s'", u->nick);
 
 	D("dropped user '%s'", u->nick);
+	lsi_ucb_emit(ctx, TRKEV_USER_DROP, NULL, u->nick, NULL);
 
-	free(u->nick);
-	free(u->uname);
-	free(u->host);
-	free(u->fname);
-	if (u->freetag)
-		free(u->tag);
-	free(u);
+	free_user(ctx, u);
 
 	return true;
 }
@@ -478,16 +630,36 @@ lsi_ucb_drop_user(irc *ctx, user *u)
 void
 lsi_ucb_deinit(irc *ctx)
 {
-	lsi_ucb_clear(ctx);
+	ctx->trkgen++;
+	clear(ctx);
 	lsi_skmap_dispose(ctx->chans);
 	lsi_skmap_dispose(ctx->users);
-	ctx->chans = ctx->users = NULL;
+	lsi_skmap_dispose(ctx->untracked);
+	ctx->chans = ctx->users = ctx->untracked = NULL;
 	return;
 }
 
 void
 lsi_ucb_clear(irc *ctx)
 {
+	if (!ctx->chans)
+		return;
+
+	/* one event for all of it rather than one per object */
+	lsi_ucb_emit(ctx, TRKEV_RESET, NULL, NULL, NULL);
+	fp_trk_event cb = ctx->cb_trkev;
+	ctx->cb_trkev = NULL;
+	clear(ctx);
+	ctx->cb_trkev = cb;
+	return;
+}
+
+static void
+clear(irc *ctx)
+{
+	if (ctx->untracked)
+		lsi_skmap_clear(ctx->untracked);
+
 	void *e;
 	if (ctx->chans) {
 		if (!lsi_skmap_first(ctx->chans, NULL, &e))
@@ -496,13 +668,7 @@ lsi_ucb_clear(irc *ctx)
 		do {
 			chan *c = e;
 			lsi_ucb_clear_memb(ctx, c);
-			lsi_skmap_dispose(c->memb);
-			free(c->topicnick);
-			free(c->topic);
-			for (size_t i = 0; i < c->modes_sz; i++)
-				free(c->modes[i]);
-			free(c->modes);
-			free(c);
+			free_chan(ctx, c);
 		} while (lsi_skmap_next(ctx->chans, NULL, &e));
 		lsi_skmap_clear(ctx->chans);
 	}
@@ -512,12 +678,7 @@ lsi_ucb_clear(irc *ctx)
 			return;
 
 		do {
-			user *u = e;
-			free(u->nick);
-			free(u->uname);
-			free(u->host);
-			free(u->fname);
-			free(u);
+			free_user(ctx, e);
 		} while (lsi_skmap_next(ctx->users, NULL, &e));
 		lsi_skmap_clear(ctx->users);
 	}
@@ -555,12 +716,7 @@ lsi_ucb_dump(irc *ctx, bool full)
 			    lsi_skmap_count(c->memb), c->topic, c->topicnick,
 			    c->tscreate, c->tstopic);
 
-			for (size_t i = 0; i < c->modes_sz; i++) {
-				if (!c->modes[i])
-					break;
-
-				A("  mode '%s'", c->modes[i]);
-			}
+			lsi_ucb_each_chanmode(c, dumpmode, NULL);
 
 			char *k;
 			if (!lsi_skmap_first(c->memb, &k, &e2))
@@ -618,10 +774,13 @@ lsi_ucb_rename_user(irc *ctx, const char *ident, const char *newnick, bool *allo
 	char *nn = NULL;
 	if (justcase) {
 		lsi_b_strNcpy(u->nick, newnick, strlen(u->nick) + 1);
+		lsi_ucb_emit(ctx, TRKEV_USER_RENAME, NULL, nick, u->nick);
 		return true;
 	} else {
 		if (!(nn = STRDUP(newnick)))
 			return false; //oh shit.
+		ctx->trkmem.users += strsz(nn);
+		ctx->trkmem.users -= strsz(u->nick);
 		free(u->nick);
 		u->nick = nn;
 	}
@@ -651,9 +810,118 @@ lsi_ucb_rename_user(irc *ctx, const char *ident, const char *newnick, bool *allo
 			lsi_skmap_del(c->memb, ident);
 		} while (lsi_skmap_next(ctx->chans, NULL, &e));
 
+	lsi_ucb_emit(ctx, TRKEV_USER_RENAME, NULL, nick, u->nick);
+	return true;
+}
+
+/* these replace a string property of a channel or user, keeping track of
+ * the memory involved.  `val' may be NULL */
+bool
+lsi_ucb_set_chanstr(irc *ctx, char **field, const char *val)
+{
+	size_t old = strsz(*field);
+	if (!lsi_com_update_strprop(field, val))
+		return false;
+
+	ctx->trkmem.chans += strsz(*field);
+	ctx->trkmem.chans -= old;
 	return true;
 }
 
+bool
+lsi_ucb_set_userstr(irc *ctx, char **field, const char *val)
+{
+	size_t old = strsz(*field);
+	if (!lsi_com_update_strprop(field, val))
+		return false;
+
+	ctx->trkmem.users += strsz(*field);
+	ctx->trkmem.users -= old;
+	return true;
+}
+
+bool
+lsi_ucb_overlimit(irc *ctx)
+{
+	return ctx->trkmax && ctx->trkmem.chans + ctx->trkmem.users
+	    + ctx->trkmem.membs + ctx->trkmem.maps >= ctx->trkmax;
+}
+
+/* mark all of u's memberships as lost in a netsplit; lsi_ucb_drop_split()
+ * drops those they don't rejoin in time */
+void
+lsi_ucb_split_user(irc *ctx, user *u)
+{
+	size_t n = 0;
+	void *e;
+	if (lsi_skmap_first(ctx->chans, NULL, &e))
+		do {
+			memb *m = lsi_skmap_get(((chan *)e)->memb, u->nick);
+			if (m) {
+				lsi_ucb_set_split(ctx, m, true);
+				n++;
+			}
+		} while (n < u->nchans && lsi_skmap_next(ctx->chans, NULL, &e));
+
+	return;
+}
+
+void
+lsi_ucb_set_split(irc *ctx, memb *m, bool split)
+{
+	if (m->split == split)
+		return;
+
+	m->split = split;
+	if (split)
+		ctx->nsplit++;
+	else
+		ctx->nsplit--;
+	return;
+}
+
+/* drop all memberships marked split in one go, and with them the users who
+ * have no channels left.  unlike dropping the users one by one, which means
+ * looking them up in every channel, this is a single pass over all
+ * memberships */
+void
+lsi_ucb_drop_split(irc *ctx)
+{
+	size_t nsplit = ctx->nsplit;
+	if (!nsplit)
+		return;
+
+	user **v = MALLOC(nsplit * sizeof *v);
+	if (!v)
+		return; // try again later
+
+	void *e1, *e2;
+	if (lsi_skmap_first(ctx->chans, NULL, &e1))
+		do {
+			chan *c = e1;
+			size_t n = 0;
+			if (lsi_skmap_first(c->memb, NULL, &e2))
+				do {
+					memb *m = e2;
+					if (m->split && n < nsplit)
+						v[n++] = m->u;
+				} while (lsi_skmap_next(c->memb, NULL, &e2));
+
+			for (size_t i = 0; i < n; i++)
+				lsi_ucb_drop_memb(ctx, c, v[i], true, false);
+		} while (ctx->nsplit && lsi_skmap_next(ctx->chans, NULL, &e1));
+
+	free(v);
+
+	if (ctx->nsplit) {
+		E("%zu split memberships unaccounted for", ctx->nsplit);
+		ctx->nsplit = 0;
+	}
+
+	D("dropped %zu memberships lost in a netsplit", nsplit);
+	return;
+}
+
 chan *
 lsi_ucb_first_chan(irc *ctx)
 {
@@ -728,3 +996,113 @@ lsi_ucb_tag_user(user *u, void *tag, bool autofree)
 	u->freetag = autofree;
 	return;
 }
+
+
+static void
+free_chan(irc *ctx, chan *c)
+{
+	size_t sz = sizeof *c + strsz(c->topic) + strsz(c->topicnick);
+
+	for (size_t i = 0; i < COUNTOF(c->cmparm); i++) {
+		sz += strsz(c->cmparm[i].arg);
+		free(c->cmparm[i].arg);
+	}
+
+	lsi_mlist_dispose(c->cmlists);
+	lsi_skmap_dispose(c->memb);
+	free(c->topic);
+	free(c->topicnick);
+	if (c->freetag)
+		free(c->tag);
+	free(c);
+	ctx->trkmem.chans -= sz;
+	return;
+}
+
+static void
+free_user(irc *ctx, user *u)
+{
+	ctx->trkmem.users -= sizeof *u + strsz(u->nick) + strsz(u->uname)
+	    + strsz(u->host) + strsz(u->fname);
+
+	free(u->nick);
+	free(u->uname);
+	free(u->host);
+	free(u->fname);
+	if (u->freetag)
+		free(u->tag);
+	free(u);
+	return;
+}
+
+static void
+free_memb(irc *ctx, memb *m)
+{
+	if (m->split)
+		ctx->nsplit--;
+
+	ctx->trkmem.membs -= sizeof *m;
+	free(m);
+	return;
+}
+
+static size_t
+strsz(const char *s)
+{
+	return s ? strlen(s) + 1 : 0;
+}
+
+/* class D modes live in a bitset: a-z, A-Z and 0-9 get a bit each */
+static int
+modebit(char mode)
+{
+	if ('a' <= mode && mode <= 'z')
+		return mode - 'a';
+	if ('A' <= mode && mode <= 'Z')
+		return 26 + (mode - 'A');
+	if ('0' <= mode && mode <= '9')
+		return 52 + (mode - '0');
+	return -1;
+}
+
+static char
+modechr(int bit)
+{
+	return bit < 26 ? 'a' + bit : bit < 52 ? 'A' + (bit - 26)
+	    : '0' + (bit - 52);
+}
+
+static const char *
+modestr(char *dest, size_t destsz, char mode, const char *arg)
+{
+	if (arg)
+		snprintf(dest, destsz, "%c %s", mode, arg);
+	else
+		snprintf(dest, destsz, "%c", mode);
+	return dest;
+}
+
+static struct cmparm *
+findparm(chan *c, char mode)
+{
+	for (size_t i = 0; i < COUNTOF(c->cmparm); i++)
+		if (c->cmparm[i].mode == mode)
+			return &c->cmparm[i];
+	return NULL;
+}
+
+static void
+dumpmode(const char *modestr, void *tag)
+{
+	A("  mode '%s'", modestr);
+	return;
+}
+
+static void
+eachlistmode(const struct mlinfo *e, void *tag)
+{
+	struct eachmode *em = tag;
+	char ms[MAX_MODESTR];
+	em->fn(modestr(ms, sizeof ms, e->mode, e->mask), em->tag);
+	return;
+}
@@ -11,12 +11,18 @@
 
 #include <libsrsirc/defs.h>
 #include "intdefs.h"
+#include "mlist.h"
 
 
 typedef struct chan chan;
 typedef struct member memb;
 typedef struct user user;
 
+struct cmparm {
+	char mode; // '\0' if unused
+	char *arg; // may be NULL for modes that don't fit in chan.cmflags
+};
+
 struct chan {
 	char name[MAX_CHAN_LEN];
 	char *topic;
@@ -25,8 +31,11 @@ struct chan {
 	uint64_t tstopic;
 	skmap *memb; //map lnick to struct member
 	bool desync;
-	char **modes; //one modechar per elem, i.e. "s" or "l 123"
-	size_t modes_sz;
+	bool nomemb; // members dropped due to the memory limit
+	uint64_t cmflags; // class D modes, one bit per mode char (see modebit())
+	struct cmparm cmparm[MAX_CMPARMS]; // class B and C modes
+	mlist *cmlists; // class A modes, NULL until there are any
+	unsigned lsync; // list replies (367 etc.) being received, bit per list
 	void *tag;
 	bool freetag;
 };
@@ -34,6 +43,7 @@ struct chan {
 struct member {
 	user *u;
 	char modepfx[MAX_MODEPFX];
+	bool split; // QUIT in a netsplit, removal pending (lsi_ucb_drop_split())
 };
 
 struct user {
@@ -48,6 +58,8 @@ struct user {
 };
 
 bool   lsi_ucb_init(irc *ctx);
+void   lsi_ucb_emit(irc *ctx, int type, const char *chname, const char *nick,
+                    const char *arg);
 void   lsi_ucb_deinit(irc *ctx);
 void   lsi_ucb_clear(irc *ctx);
 void   lsi_ucb_dump(irc *ctx, bool full);
@@ -57,6 +69,7 @@ bool   lsi_ucb_drop_user(irc *ctx, user *u);
 size_t lsi_ucb_num_users(irc *ctx);
 user  *lsi_ucb_get_user(irc *ctx, const char *ident, bool complain);
 user  *lsi_ucb_touch_user(irc *ctx, const char *ident, bool complain);
+void   lsi_ucb_touch_user_int(irc *ctx, user *u, const char *ident);
 bool   lsi_ucb_rename_user(irc *ctx, const char *ident, const char *newnick,
                            bool *allocerr);
 
@@ -66,8 +79,17 @@ size_t lsi_ucb_num_chans(irc *ctx);
 chan  *lsi_ucb_get_chan(irc *ctx, const char *name, bool complain);
 
 void   lsi_ucb_clear_chanmodes(irc *ctx, chan *c);
-bool   lsi_ucb_add_chanmode(irc *ctx, chan *c, const char *modestr);
-bool   lsi_ucb_drop_chanmode(irc *ctx, chan *c, const char *modestr);
+bool   lsi_ucb_add_chanmode(irc *ctx, chan *c, char mode, const char *arg);
+bool   lsi_ucb_drop_chanmode(irc *ctx, chan *c, char mode, const char *arg);
+bool   lsi_ucb_add_listent(irc *ctx, chan *c, char mode, const char *mask,
+                           const char *setter, uint64_t ts);
+void   lsi_ucb_clear_list(irc *ctx, chan *c, char mode);
+bool   lsi_ucb_has_chanmode(irc *ctx, chan *c, char mode, const char *arg,
+                            const char **parm);
+size_t lsi_ucb_num_chanmodes(chan *c);
+void   lsi_ucb_each_chanmode(chan *c,
+                             void (*fn)(const char *modestr, void *tag),
+                             void *tag);
 
 size_t lsi_ucb_num_memb(irc *ctx, chan *c);
 memb  *lsi_ucb_get_memb(irc *ctx, chan *c, const char *nick, bool complain);
@@ -78,6 +100,14 @@ memb  *lsi_ucb_alloc_memb(irc *ctx, user *u, const char *mpfxstr);
 bool   lsi_ucb_update_modepfx(irc *ctx, chan *c, const char *nick, char sym,
                               bool enab);
 
+bool   lsi_ucb_set_chanstr(irc *ctx, char **field, const char *val);
+bool   lsi_ucb_set_userstr(irc *ctx, char **field, const char *val);
+bool   lsi_ucb_overlimit(irc *ctx);
+
+void   lsi_ucb_split_user(irc *ctx, user *u);
+void   lsi_ucb_set_split(irc *ctx, memb *m, bool split);
+void   lsi_ucb_drop_split(irc *ctx);
+
 /* these might be dangerous to use, be sure to complete the iteration
  * before any other state might change */
 chan *lsi_ucb_first_chan(irc *ctx);
@@ -24,6 +24,7 @@
 
 #include <logger/intlog.h>
 
+#include "cmap.h"
 #include "common.h"
 #include "intdefs.h"
 #include "px.h"
@@ -83,40 +84,65 @@ lsi_ut_ident2host(char *dest, size_t dest_sz, const char *pfx)
 	return;
 }
 
+/* compare the first `len' chars of strings of lengths l1 and l2 (<= len) */
+static int
+icmp(const char *n1, size_t l1, const char *n2, size_t l2, size_t len,
+    int casemap)
+{
+	size_t n = l1 < l2 ? l1 : l2;
+	size_t i = lsi_cmap_mismatch(n1, n2, n, casemap);
+
+	if (i < n)
+		return lsi_ut_tolower(n1[i], casemap)
+		    - lsi_ut_tolower(n2[i], casemap);
+
+	if (n == len)
+		return 0;
+
+	return l1 > n ? 1 : l2 > n ? -1 : 0;
+}
+
 int
 lsi_ut_istrcmp(const char *n1, const char *n2, int casemap)
 {
-	size_t l1 = strlen(n1);
-	size_t l2 = strlen(n2);
-
-	return lsi_ut_istrncmp(n1, n2, (l1 < l2 ? l1 : l2) + 1, casemap);
+	return icmp(n1, strlen(n1), n2, strlen(n2), (size_t)-1, casemap);
 }
 
 int
 lsi_ut_istrncmp(const char *n1, const char *n2, size_t len, int casemap)
 {
-	if (len == 0)
-		return 0;
-
-	while (len && *n1 && *n2) {
-		char c1 = lsi_ut_tolower(*n1, casemap);
-		char c2 = lsi_ut_tolower(*n2, casemap);
-		if (c1 != c2)
-			return c1 - c2;
+	return icmp(n1, strnlen(n1, len), n2, strnlen(n2, len), len, casemap);
+}
 
-		n1++;
-		n2++;
-		len--;
+bool
+lsi_ut_globmatch(const char *pat, const char *str, int casemap)
+{
+	const char *bt_pat = NULL, *bt_str = NULL;
+
+	/* iterative, backtracking only to the most recent `*' */
+	while (*str) {
+		if (*pat == '*') {
+			while (*pat == '*')
+				pat++;
+			if (!*pat)
+				return true;
+			bt_pat = pat;
+			bt_str = str;
+		} else if (*pat && (*pat == '?' || lsi_ut_tolower(*pat, casemap)
+		    == lsi_ut_tolower(*str, casemap))) {
+			pat++;
+			str++;
+		} else if (bt_pat) {
+			pat = bt_pat;
+			str = ++bt_str;
+		} else
+			return false;
 	}
 
-	if (!len)
-		return 0;
-	if (*n1)
-		return 1;
-	if (*n2)
-		return -1;
+	while (*pat == '*')
+		pat++;
 
-	return 0;
+	return !*pat;
 }
 
 char
@@ -275,106 +301,106 @@ lsi_ut_conread(tokarr *msg, void *tag)
 	return true;
 }
 
-char **
-lsi_ut_parse_MODE(irc *ctx, tokarr *msg, size_t *num, bool is324)
+void
+lsi_ut_modeiter_init(irc *ctx, modeiter *it, tokarr *msg, bool is324)
 {
-	size_t ac = 2;
-	while (ac < COUNTOF(*msg) && (*msg)[ac])
-		ac++;
-
-	char *modes = STRDUP((*msg)[3 + is324]);
-	if (!modes)
-		return NULL;
-
-	const char *arg;
-	size_t nummodes = strlen(modes) - (lsi_com_strCchr(modes,'-')
-	    + lsi_com_strCchr(modes,'+'));
+	it->msg = msg;
+	it->next = (*msg)[3 + is324] ? (*msg)[3 + is324] : "";
+	it->argi = 4 + is324;
+	it->enab = true;
+	return;
+}
 
-	char **modearr = MALLOC(nummodes * sizeof *modearr);
-	if (!modearr)
-		goto fail;
+bool
+lsi_ut_modeiter_next(irc *ctx, modeiter *it, modechg *dest)
+{
+	tokarr *msg = it->msg;
+	char c;
 
-	for (size_t i = 0; i < nummodes; i++)
-		modearr[i] = NULL; //for safe cleanup
-
-	size_t i = 4 + is324;
-	int j = 0, cl;
-	char *ptr = modes;
-	int enable = 1;
-	D("modes: '%s', nummodes: %zu, m005modepfx: '%s'",
-	    modes, nummodes, ctx->m005modepfx[0]);
-	while (*ptr) {
-		char c = *ptr;
-		D("next modechar is '%c', enable ATM: %d", c, enable);
-		arg = NULL;
-		switch (c) {
-		case '+':
-			enable = 1;
-			ptr++;
-			continue;
-		case '-':
-			enable = 0;
-			ptr++;
+	while ((c = *it->next++)) {
+		if (c == '+' || c == '-') {
+			it->enab = c == '+';
 			continue;
+		}
+
+		bool arg;
+		int cl = lsi_ut_classify_chanmode(ctx, c);
+		const char *pfx = NULL;
+		switch (cl) {
+		case CHANMODE_CLASS_A:
+		case CHANMODE_CLASS_B:
+			arg = true;
+			break;
+		case CHANMODE_CLASS_C:
+			arg = it->enab;
+			break;
+		case CHANMODE_CLASS_D:
+			arg = false;
+			break;
 		default:
-			cl = lsi_ut_classify_chanmode(ctx, c);
-			D("classified mode '%c' to class %d", c, cl);
-			switch (cl) {
-			case CHANMODE_CLASS_A:
-				arg = i >= ac ? "*" : (*msg)[i++];
-				break;
-			case CHANMODE_CLASS_B:
-				arg = i >= ac ? "*" : (*msg)[i++];
-				break;
-			case CHANMODE_CLASS_C:
-				if (enable)
-					arg = i >= ac ?  "*" : (*msg)[i++];
-				break;
-			case CHANMODE_CLASS_D:
-				break;
-			default:/*error?*/
-				if (strchr(ctx->m005modepfx[0], c))
-					arg = i >= ac ? "*" : (*msg)[i++];
-				else {
-					W("unknown chanmode '%c'", c);
-					nummodes--;
-					ptr++;
-					continue;
-				}
+			if (!(pfx = strchr(ctx->m005modepfx[0], c))) {
+				W("unknown chanmode '%c'", c);
+				continue;
 			}
+			arg = true;
 		}
+
+		dest->enab = it->enab;
+		dest->mode = c;
+		dest->cls = cl;
+		dest->pfx = pfx ? ctx->m005modepfx[1][pfx - ctx->m005modepfx[0]]
+		    : '\0';
+		dest->arg = NULL;
 		if (arg)
-			D("arg is '%s'", arg);
+			dest->arg = it->argi < COUNTOF(*msg) && (*msg)[it->argi]
+			    ? (*msg)[it->argi++] : "*";
+
+		return true;
+	}
 
-		modearr[j] = MALLOC((3 + (arg ? strlen(arg) + 1 : 0)));
+	it->next--; // stay on the '\0'
+	return false;
+}
+
+char **
+lsi_ut_parse_MODE(irc *ctx, tokarr *msg, size_t *num, bool is324)
+{
+	modeiter it;
+	modechg mc;
+	size_t nummodes = 0, j = 0;
+
+	lsi_ut_modeiter_init(ctx, &it, msg, is324);
+	while (lsi_ut_modeiter_next(ctx, &it, &mc))
+		nummodes++;
+
+	char **modearr = MALLOC((nummodes + 1) * sizeof *modearr);
+	if (!modearr)
+		return NULL;
+
+	lsi_ut_modeiter_init(ctx, &it, msg, is324);
+	while (j < nummodes && lsi_ut_modeiter_next(ctx, &it, &mc)) {
+		modearr[j] = MALLOC(3 + (mc.arg ? strlen(mc.arg) + 1 : 0));
 		if (!modearr[j])
 			goto fail;
 
-		modearr[j][0] = enable ? '+' : '-';
-		modearr[j][1] = c;
-		modearr[j][2] = arg ? ' ' : '\0';
-		if (arg)
-			strcpy(modearr[j] + 3, arg);
+		modearr[j][0] = mc.enab ? '+' : '-';
+		modearr[j][1] = mc.mode;
+		modearr[j][2] = mc.arg ? ' ' : '\0';
+		if (mc.arg)
+			strcpy(modearr[j] + 3, mc.arg);
 
+		D("modearr[%zu]: '%s'", j, modearr[j]);
 		j++;
-		ptr++;
-	}
-	D("done parsing, result:");
-	for (i = 0; i < nummodes; i++) {
-		D("modearr[%zu]: '%s'", i, modearr[i]);
 	}
 
 	*num = nummodes;
-	free(modes);
 	return modearr;
 
 fail:
-	if (modearr)
-		for (i = 0; i < nummodes; i++)
-			free(modearr[i]);
+	while (j > 0)
+		free(modearr[--j]);
 
 	free(modearr);
-	free(modes);
 	return NULL;
 }
 
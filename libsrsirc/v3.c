@@ -21,6 +21,7 @@
 #include "msg.h"
 #include "common.h"
 #include "irc_msghnd.h"
+#include "probes.h"
 
 static uint16_t handle_CAP(irc *ctx, tokarr *msg, size_t nargs, bool logon);
 static uint16_t handle_CAP_ACK(irc *ctx, tokarr *msg, size_t nargs, bool logon);
@@ -436,12 +437,15 @@ handle_670(irc *ctx, tokarr *msg, size_t nargs, bool logon)
 		return IO_ERR;
 	}
 
-	if (!(ctx->con->sctx = lsi_b_mksslctx())) {
+	if (!ctx->con->sctx && !(ctx->con->sctx = lsi_b_mksslctx())) {
 		E("could not create ssl context, ssl not enabled!");
 		return IO_ERR;
 	}
 
-	if (!(sh->shnd = lsi_b_sslize(sh->sck, ctx->con->sctx))) {
+	LSI_PROBE2(tls_start, sh->sck, true);
+	sh->shnd = lsi_b_sslize(sh->sck, ctx->con->sctx, ctx->con->ssess);
+	LSI_PROBE3(tls_done, sh->sck, true, sh->shnd != NULL);
+	if (!sh->shnd) {
 		E("connect bailing out; couldn't initiate ssl");
 		return IO_ERR;
 	}
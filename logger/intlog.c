@@ -13,9 +13,15 @@
 #include <errno.h>
 #include <limits.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include <platform/base_misc.h>
+#include <platform/base_thread.h>
 
 
 #define DEF_LVL LOG_CRIT
@@ -33,6 +39,12 @@
 
 #define COUNTOF(ARR) (sizeof (ARR) / sizeof (ARR)[0])
 
+/* deferred mode (see lsi_log_setasync()) */
+#define AL_SLOTS 1024 /* must be a power of 2 */
+#define AL_MAXARGS 16
+#define AL_DATASZ 480 /* for the %s arguments, or the preformatted message */
+#define AL_MAXSPEC 24
+
 
 const char *modnames[NUM_MODS] = {
 	[MOD_IRC] = "libsrsirc/irc",
@@ -47,11 +59,14 @@ const char *modnames[NUM_MODS] = {
 	[MOD_TRACK] = "libsrsirc/track",
 	[MOD_UCBASE] = "libsrsirc/ucbase",
 	[MOD_V3] = "libsrsirc/v3",
+	[MOD_RESOLV] = "libsrsirc/resolv",
+	[MOD_STATE] = "libsrsirc/state",
 	[MOD_BASEIO] = "libsrsirc/base-io",
 	[MOD_BASENET] = "libsrsirc/base-net",
 	[MOD_BASETIME] = "libsrsirc/base-time",
 	[MOD_BASESTR] = "libsrsirc/base-str",
 	[MOD_BASEMISC] = "libsrsirc/base-misc",
+	[MOD_BASETHR] = "libsrsirc/base-thread",
 	[MOD_ICATINIT] = "icat/init",
 	[MOD_ICATCORE] = "icat/core",
 	[MOD_ICATSERV] = "icat/serv",
@@ -66,7 +81,38 @@ static bool s_open;
 static bool s_stderr = true;
 static bool s_fancy;
 static bool s_init;
-static int s_lvlarr[NUM_MODS];
+
+/* see intlog.h; INT_MAX lets everything through until lsi_log_init() ran.
+ * like `modnames', this needs an entry per module */
+int lsi_log_lvlarr[NUM_MODS] = {
+	[MOD_IRC] = INT_MAX,
+	[MOD_COMMON] = INT_MAX,
+	[MOD_IRC_UTIL] = INT_MAX,
+	[MOD_ICONN] = INT_MAX,
+	[MOD_IIO] = INT_MAX,
+	[MOD_PROXY] = INT_MAX,
+	[MOD_IMSG] = INT_MAX,
+	[MOD_SKMAP] = INT_MAX,
+	[MOD_PLST] = INT_MAX,
+	[MOD_TRACK] = INT_MAX,
+	[MOD_UCBASE] = INT_MAX,
+	[MOD_V3] = INT_MAX,
+	[MOD_RESOLV] = INT_MAX,
+	[MOD_STATE] = INT_MAX,
+	[MOD_BASEIO] = INT_MAX,
+	[MOD_BASENET] = INT_MAX,
+	[MOD_BASETIME] = INT_MAX,
+	[MOD_BASESTR] = INT_MAX,
+	[MOD_BASEMISC] = INT_MAX,
+	[MOD_BASETHR] = INT_MAX,
+	[MOD_ICATINIT] = INT_MAX,
+	[MOD_ICATCORE] = INT_MAX,
+	[MOD_ICATSERV] = INT_MAX,
+	[MOD_ICATUSER] = INT_MAX,
+	[MOD_ICATMISC] = INT_MAX,
+	[MOD_IWAT] = INT_MAX,
+	[MOD_UNKNOWN] = INT_MAX,
+};
 
 static int s_w_modnam = 20;
 static int s_w_file = 0;
@@ -75,6 +121,66 @@ static int s_w_func = 0;
 
 static int s_calldepth = 0;
 
+
+/* one captured argument; strings are copied into the slot's data area */
+union alarg {
+	long long i;      // all integer conversions, and the `*' widths
+	double d;
+	long double ld;
+	const void *p;
+	size_t off;       // %s: offset into `data', SIZE_MAX for NULL
+};
+
+/* a deferred message.  `seq' tells whose turn it is: pos when the slot is
+ * free to be claimed for ring position `pos', pos+1 when it is filled */
+struct alslot {
+	unsigned long seq;
+	int mod, lvl, errn, line, depth;
+	const char *file, *func, *fmt;
+	time_t t;
+	bool pre;         // `data' holds the formatted payload, `fmt' not used
+	bool skip;        // nothing to write out, it didn't fit
+	size_t nargs, dlen;
+	union alarg args[AL_MAXARGS];
+	char data[AL_DATASZ];
+};
+
+/* a printf conversion specification, as far as we care */
+struct cspec {
+	const char *beg;  // the '%'
+	const char *lmod; // where the length modifier (if any) starts
+	const char *end;  // just past the conversion character
+	int nstar;        // number of `*' width/precision arguments
+	int prec;         // literal precision, -1 if none, -2 if `*'
+	char len;         // length modifier: H (hh), h, l, q (ll), j, z, t, L
+	char conv;
+};
+
+static bool s_async;
+static struct alslot *s_ring;
+static unsigned long s_rhead;     // next position to be claimed
+static unsigned long s_rtail;     // next position to be drained
+static unsigned long s_rdropped;  // since the last drain
+static lsi_b_mutex s_drainlck = LSI_B_MUTEX_INIT;
+static unsigned long s_ridle;     // the drainer waits for s_rwake
+static lsi_b_mutex s_idlelck = LSI_B_MUTEX_INIT;
+static lsi_b_cond s_rwake = LSI_B_COND_INIT;
+
+
+static void emit(int mod, int lvl, int errn, const char *file, int line,
+    const char *func, time_t t, int depth, char *payload);
+static bool defer(int mod, int lvl, int errn, const char *file, int line,
+    const char *func, const char *fmt, va_list *vl);
+static bool parsespec(const char *p, struct cspec *cs);
+static long long intarg(va_list *vl, char len, bool sgn);
+static bool capture(struct alslot *sl, const char *fmt, va_list *vl);
+static void render(const struct alslot *sl, char *dest, size_t destsz);
+static struct alslot *claim(void);
+static size_t drain(void);
+static bool pending(void);
+static void wake(void);
+static void *drainer(void *arg);
+static void flush_atexit(void);
 static const char *lvlnam(int lvl);
 static const char *lvlcol(int lvl);
 static int getenv_m(const char *nam, char *dest, size_t destsz);
@@ -132,13 +238,13 @@ lsi_log_getfancy(void)
 void
 lsi_log_setlvl(int mod, int lvl)
 {
-	s_lvlarr[mod] = lvl;
+	lsi_log_lvlarr[mod] = lvl;
 }
 
 int
 lsi_log_getlvl(int mod)
 {
-	return s_lvlarr[mod];
+	return lsi_log_lvlarr[mod];
 }
 
 void
@@ -148,91 +254,100 @@ lsi_log_log(int mod, int lvl, int errn, const char *file, int line,
 	if (!s_init)
 		lsi_log_init();
 
-	bool always = lvl == INT_MIN;
-
-	if (lvl > s_lvlarr[mod])
+	if (lvl > lsi_log_lvlarr[mod])
 		return;
 
-	char resmsg[4096];
-
-	char payload[4096];
 	va_list vl;
 	va_start(vl, fmt);
 
+	/* critical messages are followed by exit(), don't defer those */
+	if (s_async && lvl != LOG_CRIT) {
+		if (defer(mod, lvl, errn, file, line, func, fmt, &vl)) {
+			va_end(vl);
+			return;
+		}
+
+		/* it's written out right here after all; keep the order */
+		lsi_log_flush();
+	}
+
+	char payload[4096];
 	vsnprintf(payload, sizeof payload, fmt, vl);
-	char *c = payload;
-	while (*c) {
-		if (*c == '\n' || *c == '\r')
-			*c = '$';
-		c++;
+	va_end(vl);
+
+	emit(mod, lvl, errn, file, line, func, time(NULL), s_calldepth, payload);
+	return;
+}
+
+/* switch to (or back from) deferred logging: log calls only capture the
+ * format and the arguments into a lock-free ring, formatting and output is
+ * done by a background thread.  when the ring is full, messages less severe
+ * than warnings are dropped (and the loss reported later), everything else
+ * is written out synchronously.  so are messages whose string arguments
+ * don't fit in AL_DATASZ bytes, rather than being cut short. */
+bool
+lsi_log_setasync(bool async)
+{
+	if (!async) {
+		s_async = false;
+		lsi_log_flush();
+		return true;
 	}
 
-	char errmsg[256];
-	errmsg[0] = '\0';
-	if (errn >= 0) {
-		errmsg[0] = ':';
-		errmsg[1] = ' ';
-		lsi_b_strerror(errn, errmsg + 2, sizeof errmsg - 2);
+	if (s_ring) {
+		s_async = true;
+		return true;
 	}
 
-	if (s_stderr) {
-		if (always) {
-			fputs(payload, stderr);
-			fputs("\n", stderr);
-		} else {
-			char pad[256];
-			if (lvl == LOG_TRACE) {
-				size_t d = s_calldepth * 2;
-				if (d > sizeof pad)
-					d = sizeof pad - 1;
-				memset(pad, ' ', d);
-				pad[d] = '\0';
-			} else
-				pad[0] = '\0';
+	if (!lsi_b_have_threads())
+		return false;
 
-			char timebuf[27];
-			time_t t = time(NULL);
-			if (!lsi_b_ctime(&t, timebuf))
-				strcpy(timebuf, "(lsi_b_ctime() failed)");
-			char *ptr = strchr(timebuf, '\n');
-			if (ptr)
-				*ptr = '\0';
+	struct alslot *ring = calloc(AL_SLOTS, sizeof *ring);
+	if (!ring)
+		return false;
 
-			snprintf(resmsg, sizeof resmsg, "%s%s: %*s: "
-			    "%s: %s%*s:%*d:%*s(): %s%s%s\n",
-			    s_fancy ? lvlcol(lvl) : "",
-			    timebuf,
-			    s_w_modnam, modnames[mod],
-			    lvlnam(lvl),
-			    pad,
-			    s_w_file, file,
-			    s_w_line, line,
-			    s_w_func, func,
-			    payload,
-			    errmsg,
-			    s_fancy ? COL_RST : "");
+	for (unsigned long i = 0; i < AL_SLOTS; i++)
+		ring[i].seq = i;
 
-			fputs(resmsg, stderr);
-		}
-	} else {
-		if (always)
-			lsi_b_syslog(LOG_NOTICE, "%s", payload);
-		else {
-			snprintf(resmsg, sizeof resmsg, "%s: %s:%d:%s(): %s%s",
-			    modnames[mod], file, line, func, payload, errmsg);
-			lsi_b_syslog(lvl, "%s", resmsg);
-		}
+	s_ring = ring;
+	if (!lsi_b_thread(drainer, NULL)) {
+		s_ring = NULL;
+		free(ring);
+		return false;
 	}
 
-	va_end(vl);
+#if HAVE_ATEXIT
+	atexit(flush_atexit);
+#endif
+	s_async = true;
+	return true;
+}
+
+bool
+lsi_log_getasync(void)
+{
+	return s_async;
+}
+
+/* write out whatever is in the ring, in the calling thread */
+void
+lsi_log_flush(void)
+{
+	if (!s_ring)
+		return;
+
+	lsi_b_mutex_lock(&s_drainlck);
+	drain();
+	lsi_b_mutex_unlock(&s_drainlck);
+	return;
 }
 
 void
 lsi_log_init(void)
 {
 	int deflvl = DEF_LVL;
-	for (size_t i = 0; i < COUNTOF(s_lvlarr); i++)
-		s_lvlarr[i] = INT_MIN;
+	for (size_t i = 0; i < COUNTOF(lsi_log_lvlarr); i++)
+		lsi_log_lvlarr[i] = INT_MIN;
 
 	char v[128];
 	if (getenv_m("LIBSRSIRC_DEBUG", v, sizeof v) == 0 && v[0]) {
@@ -248,8 +363,8 @@ lsi_log_init(void)
 					if (strcmp(modnames[mod], tok) == 0)
 						break;
 
-				if (mod < COUNTOF(s_lvlarr))
-					s_lvlarr[mod] =
+				if (mod < COUNTOF(lsi_log_lvlarr))
+					lsi_log_lvlarr[mod] =
 					    (int)strtol(eq+1, NULL, 10);
 
 				*eq = '=';
@@ -283,9 +398,9 @@ lsi_log_init(void)
 		}
 	}
 
-	for (size_t i = 0; i < COUNTOF(s_lvlarr); i++)
-		if (s_lvlarr[i] == INT_MIN)
-			s_lvlarr[i] = deflvl;
+	for (size_t i = 0; i < COUNTOF(lsi_log_lvlarr); i++)
+		if (lsi_log_lvlarr[i] == INT_MIN)
+			lsi_log_lvlarr[i] = deflvl;
 
 	const char *vv = getenv("LIBSRSIRC_DEBUG_TARGET");
 	if (vv && strcmp(vv, "syslog") == 0)
@@ -300,6 +415,10 @@ lsi_log_init(void)
 		lsi_log_setfancy(false);
 
 	s_init = true;
+
+	vv = getenv("LIBSRSIRC_DEBUG_ASYNC");
+	if (vv && vv[0] != '0')
+		lsi_log_setasync(true);
 }
 
 void
@@ -319,6 +438,500 @@ lsi_log_tcall(void) {
 
 // ---- local helpers ----
 
+/* decorate and write out one formatted message */
+static void
+emit(int mod, int lvl, int errn, const char *file, int line,
+    const char *func, time_t t, int depth, char *payload)
+{
+	bool always = lvl == INT_MIN;
+	char resmsg[4096];
+
+	char *c = payload;
+	while (*c) {
+		if (*c == '\n' || *c == '\r')
+			*c = '$';
+		c++;
+	}
+
+	char errmsg[256];
+	errmsg[0] = '\0';
+	if (errn >= 0) {
+		errmsg[0] = ':';
+		errmsg[1] = ' ';
+		lsi_b_strerror(errn, errmsg + 2, sizeof errmsg - 2);
+	}
+
+	if (s_stderr) {
+		if (always) {
+			fputs(payload, stderr);
+			fputs("\n", stderr);
+		} else {
+			char pad[256];
+			if (lvl == LOG_TRACE) {
+				size_t d = depth * 2;
+				if (d > sizeof pad)
+					d = sizeof pad - 1;
+				memset(pad, ' ', d);
+				pad[d] = '\0';
+			} else
+				pad[0] = '\0';
+
+			char timebuf[27];
+			if (!lsi_b_ctime(&t, timebuf))
+				strcpy(timebuf, "(lsi_b_ctime() failed)");
+			char *ptr = strchr(timebuf, '\n');
+			if (ptr)
+				*ptr = '\0';
+
+			snprintf(resmsg, sizeof resmsg, "%s%s: %*s: "
+			    "%s: %s%*s:%*d:%*s(): %s%s%s\n",
+			    s_fancy ? lvlcol(lvl) : "",
+			    timebuf,
+			    s_w_modnam, modnames[mod],
+			    lvlnam(lvl),
+			    pad,
+			    s_w_file, file,
+			    s_w_line, line,
+			    s_w_func, func,
+			    payload,
+			    errmsg,
+			    s_fancy ? COL_RST : "");
+
+			fputs(resmsg, stderr);
+		}
+	} else {
+		if (always)
+			lsi_b_syslog(LOG_NOTICE, "%s", payload);
+		else {
+			snprintf(resmsg, sizeof resmsg, "%s: %s:%d:%s(): %s%s",
+			    modnames[mod], file, line, func, payload, errmsg);
+			lsi_b_syslog(lvl, "%s", resmsg);
+		}
+	}
+
+	return;
+}
+
+/* put a message into the ring.  false if it should be written out
+ * synchronously instead (the ring is full, and the message is too important
+ * to drop; or it is too big) */
+static bool
+defer(int mod, int lvl, int errn, const char *file, int line,
+    const char *func, const char *fmt, va_list *vl)
+{
+	struct alslot *sl = claim();
+	if (!sl) {
+		if (lvl == INT_MIN || lvl <= LOG_WARNING)
+			return false;
+
+		lsi_b_atomic_add(&s_rdropped, 1);
+		wake();
+		return true;
+	}
+
+	sl->mod = mod;
+	sl->lvl = lvl;
+	sl->errn = errn;
+	sl->file = file;
+	sl->line = line;
+	sl->func = func;
+	sl->fmt = fmt;
+	sl->depth = s_calldepth;
+	sl->t = time(NULL);
+
+	/* if we can't make sense of the format (or the strings don't fit),
+	 * format it right away.  if even that doesn't fit, the slot stays
+	 * empty and the caller writes the message out itself */
+	va_list cp;
+	va_copy(cp, *vl);
+	sl->pre = !capture(sl, fmt, &cp);
+	va_end(cp);
+	sl->skip = false;
+	if (sl->pre) {
+		va_copy(cp, *vl);
+		int len = vsnprintf(sl->data, sizeof sl->data, fmt, cp);
+		va_end(cp);
+		sl->skip = len < 0 || (size_t)len >= sizeof sl->data;
+	}
+
+	/* publish; we own the slot, so nobody else touched `seq' */
+	lsi_b_atomic_store(&sl->seq, sl->seq + 1);
+
+	wake();
+	return !sl->skip;
+}
+
+/* parse the conversion specification starting at the '%' at `p'.  false if
+ * it is one we can't capture (%n, wide chars/strings, anything unknown) */
+static bool
+parsespec(const char *p, struct cspec *cs)
+{
+	cs->beg = p++;
+	cs->nstar = 0;
+	cs->prec = -1;
+	cs->len = '\0';
+
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+
+	if (*p == '*') {
+		cs->nstar++;
+		p++;
+	} else
+		while (isdigit((unsigned char)*p))
+			p++;
+
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			cs->nstar++;
+			cs->prec = -2;
+			p++;
+		} else {
+			cs->prec = 0;
+			while (isdigit((unsigned char)*p) && cs->prec < 100000)
+				cs->prec = cs->prec * 10 + (*p++ - '0');
+		}
+	}
+
+	cs->lmod = p;
+	switch (*p) {
+	case 'h':
+	case 'l':
+		cs->len = p[1] == *p ? (*p == 'h' ? 'H' : 'q') : *p;
+		p += 1 + (p[1] == *p);
+		break;
+	case 'j':
+	case 'z':
+	case 't':
+	case 'L':
+		cs->len = *p++;
+	}
+
+	cs->conv = *p;
+	cs->end = *p ? p + 1 : p;
+
+	if (!cs->conv || !strchr("diouxXcsfFeEgGaAp", cs->conv))
+		return false;
+
+	if (cs->len == 'l' && (cs->conv == 'c' || cs->conv == 's'))
+		return false;
+
+	return cs->end - cs->beg < AL_MAXSPEC;
+}
+
+/* fetch an integer argument of the type implied by length modifier `len' */
+static long long
+intarg(va_list *vl, char len, bool sgn)
+{
+	switch (len) {
+	case 'H':
+		return sgn ? (signed char)va_arg(*vl, int)
+		    : (unsigned char)va_arg(*vl, int);
+	case 'h':
+		return sgn ? (short)va_arg(*vl, int)
+		    : (unsigned short)va_arg(*vl, int);
+	case 'l':
+		return sgn ? va_arg(*vl, long)
+		    : (long long)va_arg(*vl, unsigned long);
+	case 'q':
+		return va_arg(*vl, long long);
+	case 'j':
+		return sgn ? va_arg(*vl, intmax_t)
+		    : (long long)va_arg(*vl, uintmax_t);
+	case 'z':
+		return sgn ? (ptrdiff_t)va_arg(*vl, size_t)
+		    : (long long)va_arg(*vl, size_t);
+	case 't':
+		return sgn ? va_arg(*vl, ptrdiff_t)
+		    : (long long)(size_t)va_arg(*vl, ptrdiff_t);
+	default:
+		return sgn ? va_arg(*vl, int)
+		    : (long long)va_arg(*vl, unsigned);
+	}
+}
+
+/* pull the arguments for `fmt' out of `vl' and into `sl' */
+static bool
+capture(struct alslot *sl, const char *fmt, va_list *vl)
+{
+	struct cspec cs;
+
+	sl->nargs = sl->dlen = 0;
+	for (const char *p = fmt; (p = strchr(p, '%')); p = cs.end) {
+		if (p[1] == '%') {
+			cs.end = p + 2;
+			continue;
+		}
+
+		if (!parsespec(p, &cs) || sl->nargs + cs.nstar >= AL_MAXARGS)
+			return false;
+
+		union alarg *a = &sl->args[sl->nargs];
+		for (int i = 0; i < cs.nstar; i++)
+			a++->i = va_arg(*vl, int);
+
+		if (cs.prec == -2)
+			cs.prec = a[-1].i < 0 ? -1 : (int)a[-1].i;
+
+		switch (cs.conv) {
+		case 'd':
+		case 'i':
+			a->i = intarg(vl, cs.len, true);
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			a->i = intarg(vl, cs.len, false);
+			break;
+		case 'c':
+			a->i = va_arg(*vl, int);
+			break;
+		case 'p':
+			a->p = va_arg(*vl, void *);
+			break;
+		case 's': {
+			const char *str = va_arg(*vl, const char *);
+			if (!str) {
+				a->off = SIZE_MAX;
+				break;
+			}
+
+			size_t room = sizeof sl->data - sl->dlen;
+			if (!room)
+				return false;
+
+			size_t n = cs.prec >= 0 ? strnlen(str, cs.prec)
+			    : strlen(str);
+			if (n > room - 1)
+				return false; // won't be cut short, see defer()
+
+			memcpy(sl->data + sl->dlen, str, n);
+			sl->data[sl->dlen + n] = '\0';
+			a->off = sl->dlen;
+			sl->dlen += n + 1;
+			break;
+		}
+		default:
+			if (cs.len == 'L')
+				a->ld = va_arg(*vl, long double);
+			else
+				a->d = va_arg(*vl, double);
+		}
+
+		sl->nargs += cs.nstar + 1;
+	}
+
+	return true;
+}
+
+/* format a captured message, the same way vsnprintf(3) would have */
+static void
+render(const struct alslot *sl, char *dest, size_t destsz)
+{
+	if (sl->pre) {
+		snprintf(dest, destsz, "%s", sl->data);
+		return;
+	}
+
+	const union alarg *a = sl->args;
+	const char *p = sl->fmt;
+	struct cspec cs;
+	size_t len = 0;
+
+	while (*p && len + 1 < destsz) {
+		const char *q = strchr(p, '%');
+		size_t n = q ? (size_t)(q - p) : strlen(p);
+		if (n > destsz - 1 - len)
+			n = destsz - 1 - len;
+
+		memcpy(dest + len, p, n);
+		len += n;
+		if (!q || len + 1 >= destsz)
+			break;
+
+		if (q[1] == '%') {
+			dest[len++] = '%';
+			p = q + 2;
+			continue;
+		}
+
+		parsespec(q, &cs); // was fine when capturing
+
+		/* integers were widened to long long */
+		char spec[AL_MAXSPEC + 2];
+		bool isint = strchr("diouxX", cs.conv);
+		size_t speclen = isint ? (size_t)(cs.lmod - cs.beg)
+		    : (size_t)(cs.end - cs.beg);
+		memcpy(spec, cs.beg, speclen);
+		if (isint) {
+			spec[speclen++] = 'l';
+			spec[speclen++] = 'l';
+			spec[speclen++] = cs.conv;
+		}
+		spec[speclen] = '\0';
+
+		int st[2] = { 0, 0 };
+		for (int i = 0; i < cs.nstar; i++)
+			st[i] = (int)a++->i;
+
+		char *d = dest + len;
+		size_t sz = destsz - len;
+		int r;
+#define FMT(V) (cs.nstar == 2 ? snprintf(d, sz, spec, st[0], st[1], (V)) : \
+    cs.nstar == 1 ? snprintf(d, sz, spec, st[0], (V)) : snprintf(d, sz, spec, (V)))
+		switch (cs.conv) {
+		case 'd':
+		case 'i':
+			r = FMT(a->i);
+			break;
+		case 'o':
+		case 'u':
+		case 'x':
+		case 'X':
+			r = FMT((unsigned long long)a->i);
+			break;
+		case 'c':
+			r = FMT((int)a->i);
+			break;
+		case 'p':
+			r = FMT(a->p);
+			break;
+		case 's':
+			r = FMT(a->off == SIZE_MAX ? "(null)" : sl->data + a->off);
+			break;
+		default:
+			r = cs.len == 'L' ? FMT(a->ld) : FMT(a->d);
+		}
+#undef FMT
+		a++;
+
+		if (r > 0)
+			len += (size_t)r < sz ? (size_t)r : sz - 1;
+		p = cs.end;
+	}
+
+	dest[len] = '\0';
+	return;
+}
+
+/* claim the next free slot in the ring; NULL if it is full */
+static struct alslot *
+claim(void)
+{
+	unsigned long pos = lsi_b_atomic_load(&s_rhead);
+	for (;;) {
+		struct alslot *sl = &s_ring[pos & (AL_SLOTS - 1)];
+		long dif = (long)(lsi_b_atomic_load(&sl->seq) - pos);
+
+		if (dif == 0) {
+			if (lsi_b_atomic_cas(&s_rhead, pos, pos + 1))
+				return sl;
+		} else if (dif < 0)
+			return NULL; // the drainer didn't get to it yet
+
+		pos = lsi_b_atomic_load(&s_rhead);
+	}
+}
+
+/* write out the filled slots, in order.  s_drainlck must be held */
+static size_t
+drain(void)
+{
+	char payload[4096];
+	size_t n = 0;
+
+	for (;;) {
+		struct alslot *sl = &s_ring[s_rtail & (AL_SLOTS - 1)];
+		if (lsi_b_atomic_load(&sl->seq) != s_rtail + 1)
+			break;
+
+		if (!sl->skip) {
+			render(sl, payload, sizeof payload);
+			emit(sl->mod, sl->lvl, sl->errn, sl->file, sl->line,
+			    sl->func, sl->t, sl->depth, payload);
+		}
+
+		lsi_b_atomic_store(&sl->seq, s_rtail + AL_SLOTS);
+		s_rtail++;
+		n++;
+	}
+
+	unsigned long lost = lsi_b_atomic_load(&s_rdropped);
+	if (lost) {
+		lsi_b_atomic_add(&s_rdropped, -(long)lost);
+		snprintf(payload, sizeof payload,
+		    "(log ring full, %lu message%s dropped)",
+		    lost, lost == 1 ? "" : "s");
+		emit(-1, INT_MIN, -1, "", 0, "", time(NULL), 0, payload);
+	}
+
+	return n;
+}
+
+/* whether there is anything for drain() to do.  s_drainlck must be held */
+static bool
+pending(void)
+{
+	struct alslot *sl = &s_ring[s_rtail & (AL_SLOTS - 1)];
+	return lsi_b_atomic_load(&sl->seq) == s_rtail + 1
+	    || lsi_b_atomic_load(&s_rdropped);
+}
+
+/* called after a message was put into the ring (or dropped) */
+static void
+wake(void)
+{
+	if (lsi_b_atomic_load(&s_ridle)) {
+		lsi_b_mutex_lock(&s_idlelck);
+		lsi_b_cond_signal(&s_rwake);
+		lsi_b_mutex_unlock(&s_idlelck);
+	}
+
+	return;
+}
+
+/* sleeps while there's nothing to drain.  we announce that in s_ridle
+ * before looking at the ring a last time, and defer() publishes a message
+ * before looking at s_ridle; so either we see the message, or defer() sees
+ * us idle and wakes us up (which it does holding s_idlelck, so that can't
+ * happen between our look and the wait) */
+static void *
+drainer(void *arg)
+{
+	(void)arg;
+	for (;;) {
+		lsi_b_mutex_lock(&s_drainlck);
+		size_t n = drain();
+		lsi_b_mutex_unlock(&s_drainlck);
+
+		if (n)
+			continue;
+
+		lsi_b_mutex_lock(&s_idlelck);
+		lsi_b_atomic_store(&s_ridle, 1);
+
+		lsi_b_mutex_lock(&s_drainlck);
+		bool idle = !pending();
+		lsi_b_mutex_unlock(&s_drainlck);
+
+		if (idle)
+			lsi_b_cond_wait(&s_rwake, &s_idlelck);
+		lsi_b_atomic_store(&s_ridle, 0);
+		lsi_b_mutex_unlock(&s_idlelck);
+	}
+
+	return NULL;
+}
+
+static void
+flush_atexit(void)
+{
+	lsi_log_flush();
+	return;
+}
+
 
 static const char *
 lvlnam(int lvl)
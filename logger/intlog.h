@@ -26,19 +26,23 @@
 #define MOD_TRACK 9
 #define MOD_UCBASE 10
 #define MOD_V3 11
-#define MOD_BASEIO 12
-#define MOD_BASENET 13
-#define MOD_BASETIME 14
-#define MOD_BASESTR 15
-#define MOD_BASEMISC 16
-#define MOD_ICATINIT 17
-#define MOD_ICATCORE 18
-#define MOD_ICATSERV 19
-#define MOD_ICATUSER 20
-#define MOD_ICATMISC 21
-#define MOD_IWAT 22
-#define MOD_UNKNOWN 23
-#define NUM_MODS 24 /* when adding modules, don't forget intlog.c's `modnames' */
+#define MOD_RESOLV 12
+#define MOD_STATE 13
+#define MOD_BASEIO 14
+#define MOD_BASENET 15
+#define MOD_BASETIME 16
+#define MOD_BASESTR 17
+#define MOD_BASEMISC 18
+#define MOD_BASETHR 19
+#define MOD_ICATINIT 20
+#define MOD_ICATCORE 21
+#define MOD_ICATSERV 22
+#define MOD_ICATUSER 23
+#define MOD_ICATMISC 24
+#define MOD_IWAT 25
+#define MOD_UNKNOWN 26
+#define NUM_MODS 27 /* when adding modules, don't forget intlog.c's `modnames'
+                     * and `lsi_log_lvlarr' */
 
 /* our two higher-than-debug custom loglevels */
 #define LOG_TRACE (LOG_VIVI+1)
@@ -54,48 +58,54 @@
 
 // ----- logging interface -----
 
-#define V(...)                                                                 \
- lsi_log_log(LOG_MODULE,LOG_VIVI,-1,__FILE__,__LINE__,__func__,__VA_ARGS__)
+/* the per-module level array; exported so the macros below can skip the call
+ * (and the evaluation of the arguments) when the message would be dropped.
+ * it starts out as INT_MAX so that the first call gets through to
+ * lsi_log_log(), which initializes it from the environment */
+extern int lsi_log_lvlarr[];
 
-#define VE(...)                                                                \
- lsi_log_log(LOG_MODULE,LOG_VIVI,errno,__FILE__,__LINE__,__func__,__VA_ARGS__)
-
-#define D( ...)                                                                \
- lsi_log_log(LOG_MODULE,LOG_DEBUG,-1,__FILE__,__LINE__,__func__,__VA_ARGS__)
-
-#define DE(...)                                                                \
- lsi_log_log(LOG_MODULE,LOG_DEBUG,errno,__FILE__,__LINE__,__func__,__VA_ARGS__)
-
-#define I(...)                                                                 \
- lsi_log_log(LOG_MODULE,LOG_INFO,-1,__FILE__,__LINE__,__func__,__VA_ARGS__)
-
-#define IE(...)                                                                \
- lsi_log_log(LOG_MODULE,LOG_INFO,errno,__FILE__,__LINE__,__func__,__VA_ARGS__)
-
-#define N(...)                                                                 \
- lsi_log_log(LOG_MODULE,LOG_NOTICE,-1,__FILE__,__LINE__,__func__,__VA_ARGS__)
-
-#define NE(...)                                                                \
- lsi_log_log(LOG_MODULE,LOG_NOTICE,errno,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#ifdef __GNUC__
+# define LSI_LOG_UNLIKELY(X) __builtin_expect(!!(X), 0)
+#else
+# define LSI_LOG_UNLIKELY(X) (X)
+#endif
 
-#define W(...)                                                                 \
- lsi_log_log(LOG_MODULE,LOG_WARNING,-1,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#define LSI_LOG_ON(LVL) LSI_LOG_UNLIKELY((LVL) <= lsi_log_lvlarr[LOG_MODULE])
 
-#define WE(...)                                                                \
- lsi_log_log(LOG_MODULE,LOG_WARNING,errno,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#define LSI_LOG(LVL, ERRN, ...)                                                \
+ (LSI_LOG_ON(LVL) ? lsi_log_log(LOG_MODULE,(LVL),(ERRN),__FILE__,__LINE__,     \
+ __func__,__VA_ARGS__) : (void)0)
 
-#define E(...)                                                                 \
- lsi_log_log(LOG_MODULE,LOG_ERR,-1,__FILE__,__LINE__,__func__,__VA_ARGS__)
+/* configured with --disable-debug-log: vivi, debug and trace messages are
+ * compiled out entirely.  the arguments are still type-checked (so variables
+ * only used for logging don't trigger warnings), but never evaluated */
+#if NODEBUGLOG
+# define LSI_LOG_DBG(LVL, ERRN, ...)                                           \
+ (0 ? lsi_log_log(LOG_MODULE,(LVL),(ERRN),__FILE__,__LINE__,                   \
+ __func__,__VA_ARGS__) : (void)0)
+#else
+# define LSI_LOG_DBG LSI_LOG
+#endif
 
-#define EE(...)                                                                \
- lsi_log_log(LOG_MODULE,LOG_ERR,errno,__FILE__,__LINE__,__func__,__VA_ARGS__)
+#define V(...) LSI_LOG_DBG(LOG_VIVI, -1, __VA_ARGS__)
+#define VE(...) LSI_LOG_DBG(LOG_VIVI, errno, __VA_ARGS__)
+#define D(...) LSI_LOG_DBG(LOG_DEBUG, -1, __VA_ARGS__)
+#define DE(...) LSI_LOG_DBG(LOG_DEBUG, errno, __VA_ARGS__)
+#define I(...) LSI_LOG(LOG_INFO, -1, __VA_ARGS__)
+#define IE(...) LSI_LOG(LOG_INFO, errno, __VA_ARGS__)
+#define N(...) LSI_LOG(LOG_NOTICE, -1, __VA_ARGS__)
+#define NE(...) LSI_LOG(LOG_NOTICE, errno, __VA_ARGS__)
+#define W(...) LSI_LOG(LOG_WARNING, -1, __VA_ARGS__)
+#define WE(...) LSI_LOG(LOG_WARNING, errno, __VA_ARGS__)
+#define E(...) LSI_LOG(LOG_ERR, -1, __VA_ARGS__)
+#define EE(...) LSI_LOG(LOG_ERR, errno, __VA_ARGS__)
 
 #define C(...) do {                                                            \
- lsi_log_log(LOG_MODULE,LOG_CRIT,-1,__FILE__,__LINE__,__func__,__VA_ARGS__);   \
+ LSI_LOG(LOG_CRIT, -1, __VA_ARGS__);                                           \
  exit(EXIT_FAILURE); } while (0)
 
 #define CE(...) do {                                                           \
- lsi_log_log(LOG_MODULE,LOG_CRIT,errno,__FILE__,__LINE__,__func__,__VA_ARGS__);\
+ LSI_LOG(LOG_CRIT, errno, __VA_ARGS__);                                        \
  exit(EXIT_FAILURE); } while (0)
 
 /* special: always printed, never decorated */
@@ -103,24 +113,23 @@
     lsi_log_log(-1,INT_MIN,-1,__FILE__,__LINE__,__func__,__VA_ARGS__)
 
 /* tracing */
-#if NOTRACE
+#if NOTRACE || NODEBUGLOG
 # define T(...) do{}while(0)
 # define TC(...) do{}while(0)
 # define TR(...) do{}while(0)
 #else
-# define T(...)                                                                \
- lsi_log_log(LOG_MODULE,LOG_TRACE,-1,__FILE__,__LINE__,__func__,__VA_ARGS__)
+# define T(...) LSI_LOG(LOG_TRACE, -1, __VA_ARGS__)
 
 # define TC(...)                                                               \
  do{                                                                           \
- lsi_log_log(LOG_MODULE,LOG_TRACE,-1,__FILE__,__LINE__,__func__,__VA_ARGS__);  \
+ LSI_LOG(LOG_TRACE, -1, __VA_ARGS__);                                          \
  lsi_log_tcall();                                                              \
  } while (0)
 
 # define TR(...)                                                               \
  do{                                                                           \
  lsi_log_tret();                                                               \
- lsi_log_log(LOG_MODULE,LOG_TRACE,-1,__FILE__,__LINE__,__func__,__VA_ARGS__);  \
+ LSI_LOG(LOG_TRACE, -1, __VA_ARGS__);                                          \
  } while (0)
 #endif
 
@@ -138,6 +147,10 @@ bool lsi_log_getfancy(void);
 void lsi_log_tret(void);
 void lsi_log_tcall(void);
 
+bool lsi_log_setasync(bool async);
+bool lsi_log_getasync(void);
+void lsi_log_flush(void);
+
 // ----- backend -----
 void lsi_log_log(int mod, int lvl, int errn, const char *file, int line,
     const char *func, const char *fmt, ...)
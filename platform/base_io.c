@@ -14,8 +14,21 @@
 #include <inttypes.h>
 #include <limits.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 
+#if HAVE_FCNTL_H
+# include <fcntl.h>
+#endif
+
+#if HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#if HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+
 #if HAVE_SYS_SELECT_H
 # include <sys/select.h>
 #endif
@@ -30,6 +43,8 @@
 
 #include <logger/intlog.h>
 
+#include "base_misc.h"
+
 
 long
 lsi_b_stdin_read(void *buf, size_t nbytes)
@@ -113,3 +128,141 @@ lsi_b_stdin_canread(void)
 
 	return r;
 }
+
+
+/* map the file at `path' into memory, read-only, and store its size in
+ * `*len'.  release with lsi_b_unmapfile().  returns NULL on failure */
+void *
+lsi_b_mapfile(const char *path, size_t *len)
+{
+#if HAVE_FSTAT && HAVE_FCNTL_H
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		WE("open '%s'", path);
+		return NULL;
+	}
+
+	void *p = NULL;
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		EE("fstat '%s'", path);
+		goto out;
+	}
+
+	if (st.st_size <= 0 || (uintmax_t)st.st_size > SIZE_MAX) {
+		W("'%s' is empty or too large", path);
+		goto out;
+	}
+
+	*len = (size_t)st.st_size;
+
+# if HAVE_MMAP && HAVE_SYS_MMAN_H
+	if ((p = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0))
+	    == MAP_FAILED) {
+		EE("mmap '%s'", path);
+		p = NULL;
+	}
+# else
+	size_t got = 0;
+	if (!(p = MALLOC(*len)))
+		goto out;
+
+	while (got < *len) {
+		ssize_t r = read(fd, (char *)p + got, *len - got);
+		if (r <= 0) {
+			EE("read '%s'", path);
+			free(p);
+			p = NULL;
+			goto out;
+		}
+		got += (size_t)r;
+	}
+# endif
+
+	D("mapped '%s' (%zu bytes)", path, *len);
+
+out:
+	close(fd);
+	return p;
+#else
+	E("can't map files on this platform");
+	return NULL;
+#endif
+}
+
+void
+lsi_b_unmapfile(void *p, size_t len)
+{
+	if (!p)
+		return;
+
+#if HAVE_MMAP && HAVE_SYS_MMAN_H
+	munmap(p, len);
+#else
+	free(p);
+#endif
+	return;
+}
+
+/* replace the file at `path' by `len' bytes from `data', such that readers
+ * see either the old or the new contents in full, never a mix */
+bool
+lsi_b_writefile(const char *path, const void *data, size_t len)
+{
+#if HAVE_RENAME && HAVE_FCNTL_H
+	char tmp[1024];
+	if ((size_t)snprintf(tmp, sizeof tmp, "%s.tmp", path) >= sizeof tmp) {
+		E("path too long: '%s'", path);
+		return false;
+	}
+
+	int fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, 0600);
+	if (fd == -1) {
+		EE("open '%s'", tmp);
+		return false;
+	}
+
+	size_t done = 0;
+	while (done < len) {
+		ssize_t r = write(fd, (const char *)data + done, len - done);
+		if (r == -1 && errno == EINTR)
+			continue;
+		if (r <= 0) {
+			EE("write '%s'", tmp);
+			goto fail;
+		}
+		done += (size_t)r;
+	}
+
+# if HAVE_FSYNC
+	if (fsync(fd) != 0) {
+		EE("fsync '%s'", tmp);
+		goto fail;
+	}
+# endif
+
+	if (close(fd) != 0) {
+		fd = -1;
+		EE("close '%s'", tmp);
+		goto fail;
+	}
+	fd = -1;
+
+	if (rename(tmp, path) != 0) {
+		EE("rename '%s' to '%s'", tmp, path);
+		goto fail;
+	}
+
+	D("wrote '%s' (%zu bytes)", path, len);
+	return true;
+
+fail:
+	if (fd != -1)
+		close(fd);
+	remove(tmp);
+	return false;
+#else
+	E("can't (atomically) write files on this platform");
+	return false;
+#endif
+}
@@ -6,6 +6,7 @@
 #define LIBSRSIRC_BASE_IO_H 1
 
 
+#include <stdbool.h>
 #include <stddef.h>
 
 
@@ -13,5 +14,9 @@ long lsi_b_stdin_read(void *buf, size_t nbytes);
 int lsi_b_stdin_canread(void);
 int lsi_b_stdin_fd(void);
 
+void *lsi_b_mapfile(const char *path, size_t *len);
+void lsi_b_unmapfile(void *p, size_t len);
+bool lsi_b_writefile(const char *path, const void *data, size_t len);
+
 
 #endif /* LIBSRSIRC_BASE_IO_H */
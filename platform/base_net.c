@@ -14,6 +14,7 @@
 #include <ctype.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #if HAVE_ARPA_INET_H
@@ -32,6 +33,14 @@
 # include <netinet/in.h>
 #endif
 
+#if HAVE_NETINET_TCP_H
+# include <netinet/tcp.h>
+#endif
+
+#if HAVE_POLL_H
+# include <poll.h>
+#endif
+
 #if HAVE_SYS_SELECT_H
 # include <sys/select.h>
 #endif
@@ -145,6 +154,76 @@ lsi_b_socket(bool ipv6)
 }
 
 
+bool
+lsi_b_sockopt(int sck, int opt, unsigned val)
+{
+#if HAVE_SETSOCKOPT
+	int lvl = -1, name = -1;
+	const char *nam = "?";
+	int v = val > INT_MAX ? INT_MAX : (int)val;
+
+	switch (opt) {
+	case LSI_B_SO_NODELAY:
+# ifdef TCP_NODELAY
+		lvl = IPPROTO_TCP; name = TCP_NODELAY; nam = "TCP_NODELAY";
+# endif
+		break;
+	case LSI_B_SO_KEEPALIVE:
+		lvl = SOL_SOCKET; name = SO_KEEPALIVE; nam = "SO_KEEPALIVE";
+		break;
+	case LSI_B_SO_KEEPIDLE:
+# if defined(TCP_KEEPIDLE)
+		lvl = IPPROTO_TCP; name = TCP_KEEPIDLE; nam = "TCP_KEEPIDLE";
+# elif defined(TCP_KEEPALIVE) /* Darwin calls it that */
+		lvl = IPPROTO_TCP; name = TCP_KEEPALIVE; nam = "TCP_KEEPALIVE";
+# endif
+		break;
+	case LSI_B_SO_KEEPINTVL:
+# ifdef TCP_KEEPINTVL
+		lvl = IPPROTO_TCP; name = TCP_KEEPINTVL; nam = "TCP_KEEPINTVL";
+# endif
+		break;
+	case LSI_B_SO_KEEPCNT:
+# ifdef TCP_KEEPCNT
+		lvl = IPPROTO_TCP; name = TCP_KEEPCNT; nam = "TCP_KEEPCNT";
+# endif
+		break;
+	case LSI_B_SO_USERTIMEOUT:
+# ifdef TCP_USER_TIMEOUT
+		lvl = IPPROTO_TCP; name = TCP_USER_TIMEOUT;
+		nam = "TCP_USER_TIMEOUT";
+# endif
+		break;
+	case LSI_B_SO_RCVBUF:
+		lvl = SOL_SOCKET; name = SO_RCVBUF; nam = "SO_RCVBUF";
+		break;
+	case LSI_B_SO_SNDBUF:
+		lvl = SOL_SOCKET; name = SO_SNDBUF; nam = "SO_SNDBUF";
+		break;
+	default:
+		E("unknown socket option %d", opt);
+		return false;
+	}
+
+	if (lvl == -1) {
+		W("socket option %d not supported on this platform", opt);
+		return false;
+	}
+
+	if (setsockopt(sck, lvl, name, (const char *)&v, sizeof v) != 0) {
+		WE("setsockopt(%d, %s, %d)", sck, nam, v);
+		return false;
+	}
+
+	D("set %s to %d on socket %d", nam, v, sck);
+	return true;
+#else
+	W("no setsockopt(), can't set socket option %d", opt);
+	return false;
+#endif
+}
+
+
 int
 lsi_b_connect(int sck, const struct addrlist *srv)
 {
@@ -209,7 +288,75 @@ lsi_b_select(int *fds, size_t nfds, bool noresult, bool rdbl, uint64_t to_us)
 	uint64_t tend = to_us ? lsi_b_tstamp_us() + to_us : 0;
 	bool dopoll = to_us == 1; //mhhh.
 
-#if HAVE_SELECT || HAVE_LIBWS2_32
+#if HAVE_POLL && HAVE_POLL_H
+	/* preferred over select(), which can't cope with fds beyond
+	 * FD_SETSIZE -- not unlikely for a process that holds a few thousand
+	 * connections -- and makes us rebuild the fd_set every time around */
+	struct pollfd pfdbuf[16];
+	struct pollfd *pfd = pfdbuf;
+	short ev = rdbl ? POLLIN : POLLOUT;
+	int r = -1;
+
+	if (nfds > sizeof pfdbuf / sizeof *pfdbuf
+	    && !(pfd = MALLOC(nfds * sizeof *pfd)))
+		return -1;
+
+	for (size_t i = 0; i < nfds; i++) {
+		pfd[i].fd = fds[i];
+		pfd[i].events = ev;
+		pfd[i].revents = 0;
+	}
+
+	for (;;) {
+		int tout = -1;
+
+		if (dopoll)
+			tout = 0;
+		else if (tend) {
+			uint64_t now = lsi_b_tstamp_us();
+			if (now >= tend) {
+				r = 0;
+				break;
+			}
+
+			/* round up so we don't spin on sub-millisecond rests */
+			uint64_t trem = (tend - now + 999) / 1000;
+			tout = trem > INT_MAX ? INT_MAX : (int)trem;
+		}
+
+		V("poll()ing %zu fd(s) (first: %d) for %sability (to: %dms)",
+		    nfds, nfds ? fds[0] : -1, rdbl?"read":"writ", tout);
+
+		r = poll(pfd, (nfds_t)nfds, tout);
+
+		if (r < 0) {
+			int e = errno;
+			EE("poll() %zu fd(s) for %c", nfds, rdbl?'r':'w');
+			r = e == EINTR ? 0 : -1;
+			break;
+		}
+
+		if (r >= 1) {
+			if (!noresult)
+				for (size_t i = 0; i < nfds; i++)
+					if (!pfd[i].revents)
+						fds[i] = -1;
+
+			V("Polled (%d)!", r);
+			break;
+		}
+
+		if (dopoll)
+			break;
+
+		V("Nothing polled");
+	}
+
+	if (pfd != pfdbuf)
+		free(pfd);
+
+	return r;
+#elif HAVE_SELECT || HAVE_LIBWS2_32
 	struct timeval tout = {0, 0};
 	char dbgstr[32] = {0};
 	char dbgtmp[10] = {0};
@@ -343,33 +490,49 @@ lsi_b_sock_ok(int sck)
 }
 
 
-/* returns: >0 on success, 0 on timeout, -1 on failure, -2 on EOF */
-long
-lsi_b_read(int sck, void *buf, size_t sz, uint64_t to_us)
+/* one nonblocking read attempt.
+ * returns: >0 on success, 0 if it would block, -1 on failure, -2 on EOF */
+static long
+read_nb(int sck, void *buf, size_t sz)
 {
-	V("read()ing from sck %d (bufsz: %zu)", sck, sz);
-	int s;
-	uint64_t tend = to_us ? lsi_b_tstamp_us() + to_us : 0;
-
-	do
-	    s = lsi_b_select(&sck, 1, true, true, to_us);
-	while (s == 0 && (!tend || lsi_b_tstamp_us() < tend));
-
-	if (s <= 0)
-		return s;
-
 #if HAVE_LIBWS2_32
 	int r = recv(sck, buf, sz, 0);
 	if (r == SOCKET_ERROR) {
+		if (WSAGetLastError() == WSAEWOULDBLOCK)
+			return 0;
+
+#elif defined(MSG_DONTWAIT)
+	ssize_t r = recv(sck, buf, sz, MSG_DONTWAIT);
+	if (r < 0) {
+		if (
+# if HAVE_EWOULDBLOCK
+		    errno == EWOULDBLOCK ||
+# endif
+# if HAVE_EAGAIN
+		    errno == EAGAIN ||
+# endif
+		    errno == EINTR)
+			return 0;
 
 #elif HAVE_READ
 	ssize_t r = read(sck, buf, sz);
 	if (r < 0) {
+		if (
+# if HAVE_EWOULDBLOCK
+		    errno == EWOULDBLOCK ||
+# endif
+# if HAVE_EAGAIN
+		    errno == EAGAIN ||
+# endif
+		    errno == EINTR)
+			return 0;
+
 #else
 # error "We need something like read()"
 #endif
 
 		EE("read/recv() from sck %d (bufsz: %zu)", sck, sz);
+		return -1;
 	} else if (r > LONG_MAX) {
 		W("read too long, capping return value");
 		r = LONG_MAX;
@@ -382,6 +545,48 @@ lsi_b_read(int sck, void *buf, size_t sz, uint64_t to_us)
 }
 
 
+/* returns: >0 on success, 0 on timeout, -1 on failure, -2 on EOF */
+long
+lsi_b_read(int sck, void *buf, size_t sz, uint64_t to_us)
+{
+	V("read()ing from sck %d (bufsz: %zu)", sck, sz);
+	uint64_t tend = to_us ? lsi_b_tstamp_us() + to_us : 0;
+	long r;
+
+	/* Try reading right away; in the common case there is data waiting
+	 * (we're mostly called because there's a partial line in the buffer or
+	 * right after the caller's own select()), and this saves us a
+	 * select()/poll() round trip per read. */
+#if ! HAVE_LIBWS2_32 && defined(MSG_DONTWAIT)
+	/* (only where we can be sure this won't block regardless of the
+	 * socket's mode, as a blocking read would defeat our timeout) */
+	if ((r = read_nb(sck, buf, sz)) != 0)
+		return r;
+#endif
+
+	for (;;) {
+		int s;
+		do
+			s = lsi_b_select(&sck, 1, true, true, to_us);
+		while (s == 0 && (!tend || lsi_b_tstamp_us() < tend));
+
+		if (s <= 0)
+			return s;
+
+		if ((r = read_nb(sck, buf, sz)) != 0)
+			return r;
+
+		/* spurious readability; wait for the remainder of the time */
+		if (tend) {
+			uint64_t now = lsi_b_tstamp_us();
+			if (now >= tend)
+				return 0;
+			to_us = tend - now;
+		}
+	}
+}
+
+
 long
 lsi_b_write(int sck, const void *buf, size_t len)
 {
@@ -448,6 +653,132 @@ lsi_b_write(int sck, const void *buf, size_t len)
 }
 
 
+/* send `len' bytes from `buf' over the (UNIX domain) socket `sck', passing
+ * the file descriptor `fd' along with them */
+bool
+lsi_b_sendfd(int sck, int fd, const void *buf, size_t len)
+{
+#if HAVE_SENDMSG && defined(SCM_RIGHTS)
+	struct msghdr mh;
+	struct iovec iov;
+	union {
+		struct cmsghdr hdr;
+		unsigned char buf[CMSG_SPACE(sizeof (int))];
+	} cm;
+
+	memset(&mh, 0, sizeof mh);
+	memset(&cm, 0, sizeof cm);
+	iov.iov_base = (void *)buf;
+	iov.iov_len = len;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cm.buf;
+	mh.msg_controllen = sizeof cm.buf;
+
+	struct cmsghdr *c = CMSG_FIRSTHDR(&mh);
+	c->cmsg_level = SOL_SOCKET;
+	c->cmsg_type = SCM_RIGHTS;
+	c->cmsg_len = CMSG_LEN(sizeof (int));
+	memcpy(CMSG_DATA(c), &fd, sizeof fd);
+
+	int flags = 0;
+# if HAVE_MSG_NOSIGNAL
+	flags = MSG_NOSIGNAL;
+# endif
+
+	ssize_t r;
+	do
+		r = sendmsg(sck, &mh, flags);
+	while (r == -1 && errno == EINTR);
+
+	if (r == -1) {
+		EE("sendmsg() fd %d over sck %d", fd, sck);
+		return false;
+	}
+
+	D("passed fd %d over sck %d", fd, sck);
+
+	/* the fd went with the first byte, the rest is ordinary data */
+	if ((size_t)r < len
+	    && lsi_b_write(sck, (const char *)buf + r, len - r) < 0)
+		return false;
+
+	return true;
+#else
+	E("can't pass file descriptors on this platform");
+	return false;
+#endif
+}
+
+
+/* receive up to `sz' bytes into `buf' from the (UNIX domain) socket `sck',
+ * along with a file descriptor, which is stored in `*fd' (-1 if there was
+ * none).  returns like lsi_b_read() */
+long
+lsi_b_recvfd(int sck, int *fd, void *buf, size_t sz, uint64_t to_us)
+{
+	*fd = -1;
+#if HAVE_RECVMSG && defined(SCM_RIGHTS)
+	uint64_t tend = to_us ? lsi_b_tstamp_us() + to_us : 0;
+	int s;
+
+	do
+		s = lsi_b_select(&sck, 1, true, true, to_us);
+	while (s == 0 && (!tend || lsi_b_tstamp_us() < tend));
+
+	if (s <= 0)
+		return s;
+
+	struct msghdr mh;
+	struct iovec iov;
+	union {
+		struct cmsghdr hdr;
+		unsigned char buf[CMSG_SPACE(sizeof (int))];
+	} cm;
+
+	memset(&mh, 0, sizeof mh);
+	iov.iov_base = buf;
+	iov.iov_len = sz;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = cm.buf;
+	mh.msg_controllen = sizeof cm.buf;
+
+	ssize_t r;
+	do
+		r = recvmsg(sck, &mh, 0);
+	while (r == -1 && errno == EINTR);
+
+	if (r == -1) {
+		EE("recvmsg() from sck %d", sck);
+		return -1;
+	}
+
+	for (struct cmsghdr *c = CMSG_FIRSTHDR(&mh); c;
+	    c = CMSG_NXTHDR(&mh, c)) {
+		if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS
+		    && c->cmsg_len >= CMSG_LEN(sizeof (int))) {
+			memcpy(fd, CMSG_DATA(c), sizeof *fd);
+			D("received fd %d over sck %d", *fd, sck);
+		}
+	}
+
+	if (mh.msg_flags & MSG_CTRUNC)
+		W("control data truncated (more than one fd sent?)");
+
+	if (r == 0) {
+		W("recvmsg: EOF");
+		return -2;
+	}
+
+	return r > LONG_MAX ? LONG_MAX : (long)r;
+#else
+	E("can't pass file descriptors on this platform");
+	return -1;
+#endif
+}
+
+
 long
 lsi_b_read_ssl(SSLTYPE ssl, void *buf, size_t sz, uint64_t to_us)
 {
@@ -730,6 +1061,9 @@ lsi_b_mksslctx(void)
 	if (!sslctx)
 		E("SSL_CTX_new failed");
 	SSL_CTX_set_mode(sslctx, SSL_MODE_AUTO_RETRY); /*XXX blocking IO only*/
+	/* we keep sessions ourselves (see lsi_b_sslsess()), but let the
+	 * ctx know we're a client so it sets up the session bookkeeping */
+	SSL_CTX_set_session_cache_mode(sslctx, SSL_SESS_CACHE_CLIENT);
 #else
 	E("no ssl support compiled in");
 #endif
@@ -749,13 +1083,18 @@ lsi_b_freesslctx(SSLCTXTYPE sslctx)
 }
 
 
+/* `sess' may be NULL; if it isn't, it is offered to the server for
+ * an abbreviated handshake.  The caller retains ownership of `sess' */
 SSLTYPE
-lsi_b_sslize(int sck, SSLCTXTYPE sslctx)
+lsi_b_sslize(int sck, SSLCTXTYPE sslctx, SSLSESSTYPE sess)
 {
 	SSLTYPE shnd = NULL;
 #ifdef WITH_SSL
 	bool fail = !(shnd = SSL_new(sslctx));
 	fail = fail || !SSL_set_fd(shnd, sck);
+	if (!fail && sess && !SSL_set_session(shnd, sess))
+		W("SSL_set_session failed, doing a full handshake");
+
 	if (!fail) {
 		D("calling SSL_connect()");
 		int r = SSL_connect(shnd);
@@ -766,7 +1105,8 @@ lsi_b_sslize(int sck, SSLCTXTYPE sslctx)
 			else
 				E("SSL_connect() failed, error code %d", rr);
 		} else
-			D("SSL_connect: %d", r);
+			D("SSL_connect: %d (session %s)", r,
+			    SSL_session_reused(shnd) ? "resumed" : "new");
 		fail = fail || (r != 1);
 	}
 
@@ -800,6 +1140,41 @@ lsi_b_sslfin(SSLTYPE shnd)
 }
 
 
+/* Returns a new reference to `shnd's session if it can be resumed
+ * later on, NULL otherwise.  Call this before lsi_b_sslfin() and not
+ * right after the handshake; TLS 1.3 servers send their tickets after
+ * it's done, and we want to have seen them */
+SSLSESSTYPE
+lsi_b_sslsess(SSLTYPE shnd)
+{
+	SSLSESSTYPE sess = NULL;
+#ifdef WITH_SSL
+	if (!(sess = SSL_get1_session(shnd)))
+		return NULL;
+
+# if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	if (!SSL_SESSION_is_resumable(sess)) {
+		SSL_SESSION_free(sess);
+		return NULL;
+	}
+# endif
+#else
+	E("no ssl support compiled in");
+#endif
+	return sess;
+}
+
+
+void
+lsi_b_freesslsess(SSLSESSTYPE sess)
+{
+#ifdef WITH_SSL
+	SSL_SESSION_free(sess);
+#endif
+	return;
+}
+
+
 uint16_t
 lsi_b_htons(uint16_t h)
 {
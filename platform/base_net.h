@@ -29,13 +29,27 @@ struct addrlist {
 #ifdef WITH_SSL
 typedef SSL *SSLTYPE;
 typedef SSL_CTX *SSLCTXTYPE;
+typedef SSL_SESSION *SSLSESSTYPE;
 #else
 typedef void *SSLTYPE;
 typedef void *SSLCTXTYPE;
+typedef void *SSLSESSTYPE;
 #endif
 
 
+/* for lsi_b_sockopt() */
+#define LSI_B_SO_NODELAY 0
+#define LSI_B_SO_KEEPALIVE 1
+#define LSI_B_SO_KEEPIDLE 2
+#define LSI_B_SO_KEEPINTVL 3
+#define LSI_B_SO_KEEPCNT 4
+#define LSI_B_SO_USERTIMEOUT 5
+#define LSI_B_SO_RCVBUF 6
+#define LSI_B_SO_SNDBUF 7
+
+
 int lsi_b_socket(bool ipv6);
+bool lsi_b_sockopt(int sck, int opt, unsigned val);
 int lsi_b_connect(int sck, const struct addrlist *srv);
 int lsi_b_close(int sck);
 int lsi_b_select(int *fds, size_t nfds, bool noresult, bool rdbl,
@@ -47,6 +61,9 @@ bool lsi_b_sock_ok(int sck);
 long lsi_b_read(int sck, void *buf, size_t sz, uint64_t to_us);
 long lsi_b_write(int sck, const void *buf, size_t len);
 
+bool lsi_b_sendfd(int sck, int fd, const void *buf, size_t len);
+long lsi_b_recvfd(int sck, int *fd, void *buf, size_t sz, uint64_t to_us);
+
 bool lsi_b_have_ssl(void);
 long lsi_b_read_ssl(SSLTYPE ssl, void *buf, size_t sz, uint64_t to_us);
 long lsi_b_write_ssl(SSLTYPE ssl, const void *buf, size_t len);
@@ -57,9 +74,12 @@ void lsi_b_freeaddrlist(struct addrlist *al);
 SSLCTXTYPE lsi_b_mksslctx(void);
 void lsi_b_freesslctx(SSLCTXTYPE sslctx);
 
-SSLTYPE lsi_b_sslize(int sck, SSLCTXTYPE sslctx);
+SSLTYPE lsi_b_sslize(int sck, SSLCTXTYPE sslctx, SSLSESSTYPE sess);
 void lsi_b_sslfin(SSLTYPE shnd);
 
+SSLSESSTYPE lsi_b_sslsess(SSLTYPE shnd);
+void lsi_b_freesslsess(SSLSESSTYPE sess);
+
 uint16_t lsi_b_htons(uint16_t h);
 uint32_t lsi_b_inet_addr(const char *ip4str);
 bool lsi_b_inet4_addr(unsigned char *dest, size_t destsz, const char *ip4str);
@@ -0,0 +1,240 @@
+/* base_thread.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#define LOG_MODULE MOD_BASETHR
+
+#if HAVE_CONFIG_H
+# include <config.h>
+#endif
+
+
+#include "base_thread.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
+
+#if HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include <logger/intlog.h>
+
+
+bool
+lsi_b_have_threads(void)
+{
+#if HAVE_PTHREAD_H
+	return true;
+#else
+	return false;
+#endif
+}
+
+/* start a detached thread running fn(arg) */
+bool
+lsi_b_thread(void *(*fn)(void *), void *arg)
+{
+#if HAVE_PTHREAD_H
+	pthread_attr_t attr;
+	pthread_t tid;
+	int r;
+
+	if ((r = pthread_attr_init(&attr)) != 0) {
+		E("pthread_attr_init: %s", strerror(r));
+		return false;
+	}
+
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	r = pthread_create(&tid, &attr, fn, arg);
+	pthread_attr_destroy(&attr);
+
+	if (r != 0) {
+		E("pthread_create: %s", strerror(r));
+		return false;
+	}
+
+	return true;
+#else
+	E("no thread support compiled in");
+	return false;
+#endif
+}
+
+void
+lsi_b_mutex_lock(lsi_b_mutex *m)
+{
+#if HAVE_PTHREAD_H
+	int r = pthread_mutex_lock(m);
+	if (r != 0)
+		C("pthread_mutex_lock: %s", strerror(r));
+#endif
+	return;
+}
+
+void
+lsi_b_mutex_unlock(lsi_b_mutex *m)
+{
+#if HAVE_PTHREAD_H
+	int r = pthread_mutex_unlock(m);
+	if (r != 0)
+		C("pthread_mutex_unlock: %s", strerror(r));
+#endif
+	return;
+}
+
+void
+lsi_b_cond_wait(lsi_b_cond *c, lsi_b_mutex *m)
+{
+#if HAVE_PTHREAD_H
+	int r = pthread_cond_wait(c, m);
+	if (r != 0)
+		C("pthread_cond_wait: %s", strerror(r));
+#endif
+	return;
+}
+
+void
+lsi_b_cond_signal(lsi_b_cond *c)
+{
+#if HAVE_PTHREAD_H
+	int r = pthread_cond_signal(c);
+	if (r != 0)
+		C("pthread_cond_signal: %s", strerror(r));
+#endif
+	return;
+}
+
+#if ! HAVE_ATOMIC_BUILTINS
+static lsi_b_mutex s_atomlck = LSI_B_MUTEX_INIT;
+#endif
+
+unsigned long
+lsi_b_atomic_add(unsigned long *p, long delta)
+{
+#if HAVE_ATOMIC_BUILTINS
+	return __atomic_add_fetch(p, (unsigned long)delta, __ATOMIC_SEQ_CST);
+#else
+	lsi_b_mutex_lock(&s_atomlck);
+	unsigned long r = *p += (unsigned long)delta;
+	lsi_b_mutex_unlock(&s_atomlck);
+	return r;
+#endif
+}
+
+unsigned long
+lsi_b_atomic_load(unsigned long *p)
+{
+#if HAVE_ATOMIC_BUILTINS
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#else
+	lsi_b_mutex_lock(&s_atomlck);
+	unsigned long r = *p;
+	lsi_b_mutex_unlock(&s_atomlck);
+	return r;
+#endif
+}
+
+void
+lsi_b_atomic_store(unsigned long *p, unsigned long v)
+{
+#if HAVE_ATOMIC_BUILTINS
+	__atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+#else
+	lsi_b_mutex_lock(&s_atomlck);
+	*p = v;
+	lsi_b_mutex_unlock(&s_atomlck);
+#endif
+	return;
+}
+
+/* set *p to v if it is `old'; true if it was */
+bool
+lsi_b_atomic_cas(unsigned long *p, unsigned long old, unsigned long v)
+{
+#if HAVE_ATOMIC_BUILTINS
+	return __atomic_compare_exchange_n(p, &old, v, false,
+	    __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#else
+	lsi_b_mutex_lock(&s_atomlck);
+	bool r = *p == old;
+	if (r)
+		*p = v;
+	lsi_b_mutex_unlock(&s_atomlck);
+	return r;
+#endif
+}
+
+void *
+lsi_b_atomic_loadptr(void **p)
+{
+#if HAVE_ATOMIC_BUILTINS
+	return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#else
+	lsi_b_mutex_lock(&s_atomlck);
+	void *r = *p;
+	lsi_b_mutex_unlock(&s_atomlck);
+	return r;
+#endif
+}
+
+void *
+lsi_b_atomic_xchgptr(void **p, void *v)
+{
+#if HAVE_ATOMIC_BUILTINS
+	return __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST);
+#else
+	lsi_b_mutex_lock(&s_atomlck);
+	void *r = *p;
+	*p = v;
+	lsi_b_mutex_unlock(&s_atomlck);
+	return r;
+#endif
+}
+
+bool
+lsi_b_pipe(int *fds)
+{
+#if HAVE_PIPE
+	if (pipe(fds) != 0) {
+		EE("pipe");
+		return false;
+	}
+
+	return true;
+#else
+	E("no pipe() on this platform");
+	return false;
+#endif
+}
+
+long
+lsi_b_fdwrite(int fd, const void *buf, size_t len)
+{
+#if HAVE_UNISTD_H
+	ssize_t r;
+	do
+		r = write(fd, buf, len);
+	while (r == -1 && errno == EINTR);
+
+	if (r == -1)
+		EE("write to fd %d", fd);
+	else if (r > LONG_MAX)
+		r = LONG_MAX;
+
+	return (long)r;
+#else
+# error "We need something like write()"
+#endif
+}
+
+int
+lsi_b_fdclose(int fd)
+{
+#if HAVE_UNISTD_H
+	return close(fd);
+#else
+# error "We need something like close()"
+#endif
+}
@@ -0,0 +1,52 @@
+/* base_thread.h -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIBSRSIRC_BASE_THREAD_H
+#define LIBSRSIRC_BASE_THREAD_H 1
+
+
+#include <stdbool.h>
+
+#if HAVE_PTHREAD_H
+# include <pthread.h>
+#endif
+
+
+#if HAVE_PTHREAD_H
+typedef pthread_mutex_t lsi_b_mutex;
+# define LSI_B_MUTEX_INIT PTHREAD_MUTEX_INITIALIZER
+typedef pthread_cond_t lsi_b_cond;
+# define LSI_B_COND_INIT PTHREAD_COND_INITIALIZER
+#else
+typedef int lsi_b_mutex;
+# define LSI_B_MUTEX_INIT 0
+typedef int lsi_b_cond;
+# define LSI_B_COND_INIT 0
+#endif
+
+
+bool lsi_b_have_threads(void);
+bool lsi_b_thread(void *(*fn)(void *), void *arg);
+
+void lsi_b_mutex_lock(lsi_b_mutex *m);
+void lsi_b_mutex_unlock(lsi_b_mutex *m);
+
+/* `m' must be held; it is released while waiting.  may wake up spuriously */
+void lsi_b_cond_wait(lsi_b_cond *c, lsi_b_mutex *m);
+void lsi_b_cond_signal(lsi_b_cond *c);
+
+/* sequentially consistent; fall back to a global lock without compiler
+ * support.  _add returns the new value */
+unsigned long lsi_b_atomic_add(unsigned long *p, long delta);
+unsigned long lsi_b_atomic_load(unsigned long *p);
+void lsi_b_atomic_store(unsigned long *p, unsigned long v);
+bool lsi_b_atomic_cas(unsigned long *p, unsigned long old, unsigned long v);
+void *lsi_b_atomic_loadptr(void **p);
+void *lsi_b_atomic_xchgptr(void **p, void *v);
+
+bool lsi_b_pipe(int *fds);
+long lsi_b_fdwrite(int fd, const void *buf, size_t len);
+int lsi_b_fdclose(int fd);
+
+#endif /* LIBSRSIRC_BASE_THREAD_H */
@@ -19,6 +19,10 @@
 # include <sys/time.h>
 #endif
 
+#if HAVE_CLOCK_GETTIME
+# include <time.h>
+#endif
+
 #include <logger/intlog.h>
 
 #if HAVE_GETTIMEOFDAY
@@ -42,6 +46,18 @@ lsi_b_tstamp_us(void)
 #endif
 }
 
+/* nanoseconds on a clock that doesn't jump; only good for intervals */
+uint64_t
+lsi_b_mono_ns(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+	struct timespec t;
+	if (clock_gettime(CLOCK_MONOTONIC, &t) == 0)
+		return (uint64_t)t.tv_sec * 1000000000 + (uint64_t)t.tv_nsec;
+#endif
+	return lsi_b_tstamp_us() * 1000;
+}
+
 #if HAVE_GETTIMEOFDAY
 static void
 com_tconv(struct timeval *tv, uint64_t *ts, bool tv_to_ts)
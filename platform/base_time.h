@@ -7,6 +7,7 @@
 
 
 uint64_t lsi_b_tstamp_us(void);
+uint64_t lsi_b_mono_ns(void);
 
 
 #endif /* LIBSRSIRC_BASE_TIME_H */
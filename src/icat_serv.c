@@ -39,18 +39,14 @@ struct outline_s {
 static irc *s_irc;
 static bool s_on;
 static struct outline_s *s_outQ;
-static uint64_t s_nexthb;
 static uint64_t s_nextsend;
 static uint64_t s_quitat;
 static int s_casemap = CMAP_RFC1459;
-static bool s_gotpong;
 
 
 static bool handle_PING(irc *irchnd, tokarr *tok, size_t nargs, bool pre);
-static bool handle_PONG(irc *irchnd, tokarr *tok, size_t nargs, bool pre);
 static bool handle_005(irc *irchnd, tokarr *tok, size_t nargs, bool pre);
 static int process_sendq(void);
-static bool do_heartbeat(void);
 static bool to_srv(const char *line);
 static bool tryconnect(struct srvlist_s *s);
 static bool first_connect(void);
@@ -94,8 +90,11 @@ icat_serv_init(void)
 	}
 
 	irc_regcb_conread(s_irc, conread, 0);
-	irc_reg_msghnd(s_irc, "PING", handle_PING, true);
-	irc_reg_msghnd(s_irc, "PONG", handle_PONG, true);
+	/* with heartbeats on, the lag monitor does the PING/PONG business */
+	if (g_sett.hbeat_us)
+		irc_set_lagmon(s_irc, g_sett.hbeat_us, 0);
+	else
+		irc_reg_msghnd(s_irc, "PING", handle_PING, true);
 	irc_reg_msghnd(s_irc, "005", handle_005, false);
 
 	if (!first_connect())
@@ -119,7 +118,6 @@ icat_serv_destroy(void)
 	}
 
 	s_quitat = 0;
-	s_nexthb = 0;
 	s_on = false;
 	s_casemap = CMAP_RFC1459;
 	return;
@@ -149,11 +147,6 @@ icat_serv_operate(void)
 		return false;
 	}
 
-	if (!do_heartbeat()) {
-		E("do_heartbeat() failed");
-		return false;
-	}
-
 	return true;
 }
 
@@ -242,8 +235,9 @@ uint64_t
 icat_serv_attention_at(void)
 {
 	uint64_t attat = 0;
-	if (g_sett.hbeat_us)
-		attat = s_nexthb;
+	uint64_t lw = irc_lagmon_wait(s_irc);
+	if (lw)
+		attat = lsi_b_tstamp_us() + lw;
 
 	if (s_outQ && (!attat || s_nextsend < attat))
 		attat = s_nextsend;
@@ -269,13 +263,6 @@ handle_PING(irc *irchnd, tokarr *tok, size_t nargs, bool pre)
 	return true;
 }
 
-static bool
-handle_PONG(irc *irchnd, tokarr *tok, size_t nargs, bool pre)
-{
-	s_gotpong = true;
-	return true;
-}
-
 static bool
 handle_005(irc *irchnd, tokarr *tok, size_t nargs, bool pre)
 {
@@ -320,28 +307,6 @@ process_sendq(void)
 	return 0;
 }
 
-static bool
-do_heartbeat(void)
-{
-	if (g_sett.hbeat_us && s_nexthb <= lsi_b_tstamp_us()) {
-		D("Heartbeat time");
-		if (!s_gotpong) {
-			E("Heartbeat timeout, disconnecting");
-			irc_reset(s_irc);
-			return s_on = false;
-		}
-
-		s_gotpong = false;
-		char buf[512];
-		snprintf(buf, sizeof buf, "PING %s\r\n", irc_myhost(s_irc));
-		s_nexthb = lsi_b_tstamp_us() + g_sett.hbeat_us;
-		if (!to_srv(buf))
-			return s_on = false;
-	}
-
-	return true;
-}
-
 static bool
 to_srv(const char *line)
 {
@@ -374,9 +339,6 @@ tryconnect(struct srvlist_s *s)
 			I("Logged on, %sjoining channel(s)",
 			    g_sett.nojoin?"NOT ":"");
 
-			s_nexthb = lsi_b_tstamp_us() + g_sett.hbeat_us;
-			s_gotpong = true;
-
 			if (!g_sett.nojoin && g_sett.chanlist[0]) {
 				char jmsg[512];
 				snprintf(jmsg, sizeof jmsg, "JOIN %s %s\r\n",
@@ -54,7 +54,6 @@ static struct srvlist_s {
 } *g_srvlist;
 
 static irc *g_irc;
-static uint64_t g_nexthb;
 static bool g_dumpplx = 0;
 
 
@@ -197,6 +196,9 @@ init(int *argc, char ***argv, struct settings_s *sett)
 
 	process_args(argc, argv, sett);
 
+	/* keepalive (and answering PINGs) is left to the lag monitor */
+	irc_set_lagmon(g_irc, sett->heartbeat_us, 0);
+
 	if (!*argc)
 		C("no server given");
 
@@ -336,11 +338,8 @@ main(int argc, char **argv)
 		if (!irc_online(g_irc)) {
 			D("connecting...");
 
-			if (tryconnect()) {
-				g_nexthb =
-				    lsi_b_tstamp_us() + g_sett.heartbeat_us;
+			if (tryconnect())
 				continue;
-			}
 
 			W("failed to connect/logon (%s)",
 			    g_sett.recon ? "retrying" : "giving up");
@@ -353,8 +352,7 @@ main(int argc, char **argv)
 		}
 
 		tokarr tok;
-		uint64_t to = g_sett.heartbeat_us;
-		int r = irc_read(g_irc, &tok, to ? to : 1000000);
+		int r = irc_read(g_irc, &tok, 1000000);
 
 		if (r < 0)
 			break;
@@ -366,17 +364,10 @@ main(int argc, char **argv)
 			g_dumpplx = false;
 		}
 
-		if (r > 0)
-			g_nexthb = lsi_b_tstamp_us() + g_sett.heartbeat_us;
-		else if (g_sett.heartbeat_us && g_nexthb <= lsi_b_tstamp_us()) {
-			iprintf("PING %s\r\n", irc_myhost(g_irc));
-			g_nexthb = lsi_b_tstamp_us() + g_sett.heartbeat_us;
-		}
-
 		if (r == 0)
 			continue;
 
-		if (strcmp(tok[1], "PING") == 0)
+		if (strcmp(tok[1], "PING") == 0 && !g_sett.heartbeat_us)
 			iprintf("PONG :%s\r\n", tok[2]);
 		else if (strcmp(tok[1], "PRIVMSG") == 0) {
 			if (strncmp(tok[3], "ECHO ", 5) == 0) {
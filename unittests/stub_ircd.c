@@ -0,0 +1,99 @@
+/* stub_ircd.c - a stand-in ircd for tests that need a server
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "stub_ircd.h"
+
+#include <string.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <libsrsirc/irc.h>
+
+static bool pong_handoff(int sck, const char *line);
+static void serve(int sck, stub_linefn fn);
+
+pid_t
+stub_start(uint16_t *port, const char *script, stub_linefn fn)
+{
+	struct sockaddr_in sa;
+	socklen_t salen = sizeof sa;
+	memset(&sa, 0, sizeof sa);
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s == -1 || bind(s, (struct sockaddr *)&sa, sizeof sa) == -1
+	    || listen(s, 1) == -1
+	    || getsockname(s, (struct sockaddr *)&sa, &salen) == -1) {
+		if (s != -1)
+			close(s);
+		return -1;
+	}
+
+	*port = ntohs(sa.sin_port);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		int c = accept(s, NULL, NULL);
+		if (c == -1)
+			_exit(1);
+
+		write(c, script, strlen(script));
+		serve(c, fn ? fn : pong_handoff);
+		_exit(0);
+	}
+
+	close(s);
+	return pid;
+}
+
+bool
+read_until(irc *ctx, const char *cmd, const char *arg)
+{
+	tokarr msg;
+	while (irc_read(ctx, &msg, 3000000) > 0)
+		if (strcmp(msg[1], cmd) == 0 && msg[3] && strcmp(msg[3], arg) == 0)
+			return true;
+	return false;
+}
+
+static bool
+pong_handoff(int sck, const char *line)
+{
+	static const char pong[] = ":stub PONG stub :handoff\r\n";
+	if (strcmp(line, "PING :handoff") == 0)
+		write(sck, pong, sizeof pong - 1);
+	return true;
+}
+
+static void
+serve(int sck, stub_linefn fn)
+{
+	char buf[1024];
+	size_t n = 0;
+	buf[0] = '\0';
+
+	for (;;) {
+		char *eol;
+		while (!(eol = strstr(buf, "\r\n"))) {
+			if (n == sizeof buf - 1)
+				n = 0; /* overlong line; nobody cares about it */
+			ssize_t r = read(sck, buf + n, sizeof buf - 1 - n);
+			if (r <= 0)
+				return; /* the other end hung up */
+			n += (size_t)r;
+			buf[n] = '\0';
+		}
+
+		*eol = '\0';
+		if (!fn(sck, buf))
+			return;
+
+		n -= (size_t)(eol + 2 - buf);
+		memmove(buf, eol + 2, n + 1);
+	}
+}
@@ -0,0 +1,50 @@
+/* stub_ircd.h - a stand-in ircd for tests that need a server, interface
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#ifndef LIBSRSIRC_UNITTESTS_STUB_IRCD_H
+#define LIBSRSIRC_UNITTESTS_STUB_IRCD_H 1
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <libsrsirc/defs.h>
+
+/* what the stand-in ircd says to log us on as "me" */
+#define LOGON \
+    ":stub 001 me :Welcome\r\n" \
+    ":stub 002 me :Your host is stub\r\n" \
+    ":stub 003 me :This server was created today\r\n" \
+    ":stub 004 me stub stub-1.0 iswo opsitnmlbvk\r\n" \
+    ":stub 005 me CASEMAPPING=rfc1459 PREFIX=(ov)@+ NETWORK=Stub" \
+        " :are supported\r\n"
+
+/* ...and then puts us in #chan along with `other', who says "first" and
+ * "second" */
+#define LOGON_CHAN LOGON \
+    ":me!u@h JOIN #chan\r\n" \
+    ":stub 353 me = #chan :@me other\r\n" \
+    ":stub 366 me #chan :End of NAMES\r\n" \
+    ":other!u@h PRIVMSG #chan :first\r\n" \
+    ":other!u@h PRIVMSG #chan :second\r\n"
+
+/* Called by the stand-in ircd for every line (without the CRLF) it reads
+ * from us, with the socket to answer on.  Returning false ends the
+ * conversation. */
+typedef bool (*stub_linefn)(int sck, const char *line);
+
+/* Start a stand-in ircd on a loopback port (which is put in `*port').
+ * Once we connect, it sends `script', in one write so that some of it is
+ * still unprocessed in our read buffer for a while, then feeds what we
+ * send to `fn' until we hang up.  If `fn' is NULL, it only answers
+ * "PING :handoff".
+ * Returns the pid of the process serving it (to be killed and waited for
+ * by the caller), or -1 on failure */
+pid_t stub_start(uint16_t *port, const char *script, stub_linefn fn);
+
+/* irc_read() until a `cmd' message with `arg' as the first argument shows
+ * up.  Returns false if it didn't, within 3 seconds of the last message */
+bool read_until(irc *ctx, const char *cmd, const char *arg);
+
+#endif /* LIBSRSIRC_UNITTESTS_STUB_IRCD_H */
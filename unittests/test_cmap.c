@@ -0,0 +1,100 @@
+/* test_cmap.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+
+#include <libsrsirc/cmap.h>
+#include <libsrsirc/defs.h>
+#include <libsrsirc/util.h>
+
+static const int s_cmaps[] = { CMAP_RFC1459, CMAP_STRICT_RFC1459, CMAP_ASCII };
+
+/* every pair of bytes, at a position that varies, so that it ends up in
+ * all the different lanes of the vector compare */
+const char * /*UNITTEST*/
+test_mismatch_pairs(void)
+{
+	char a[40], b[40];
+
+	for (size_t m = 0; m < sizeof s_cmaps / sizeof *s_cmaps; m++)
+		for (int c1 = 0; c1 < 256; c1++)
+			for (int c2 = 0; c2 < 256; c2++) {
+				size_t pos = (size_t)(c1 * 7 + c2) % 32;
+				memset(a, 'x', sizeof a);
+				memset(b, 'X', sizeof b);
+				a[pos] = (char)c1;
+				b[pos] = (char)c2;
+
+				size_t len = pos + 1 + (size_t)c2 % 8;
+				if (lsi_cmap_mismatch(a, b, len, s_cmaps[m])
+				    != lsi_cmap_mismatch_ref(a, b, len, s_cmaps[m]))
+					return "mismatch differs from reference";
+			}
+
+	return NULL;
+}
+
+static uint32_t s_rnd = 42;
+
+static unsigned
+rnd(unsigned n)
+{
+	s_rnd = s_rnd * 1103515245u + 12345u;
+	return (s_rnd >> 16) % n;
+}
+
+/* random strings and their randomly case-changed (and maybe otherwise
+ * damaged) twins */
+const char * /*UNITTEST*/
+test_mismatch_random(void)
+{
+	static const char alpha[] = "aZ[]\\^{}|~!@*.-_0xX~^\x80\xc3\xff";
+	char a[100], b[100];
+
+	for (int n = 0; n < 200000; n++) {
+		int cm = s_cmaps[rnd(sizeof s_cmaps / sizeof *s_cmaps)];
+		size_t len = rnd(sizeof a);
+		for (size_t i = 0; i < len; i++) {
+			a[i] = alpha[rnd(sizeof alpha - 1)];
+			b[i] = lsi_ut_tolower(a[i], cm) == a[i] && rnd(2)
+			    ? a[i] ^ 0x20 : a[i];
+			if (rnd(4) == 0 && b[i] >= 0x40)
+				b[i] = lsi_ut_tolower(a[i], cm) ^ 0x20;
+		}
+
+		if (len && rnd(3) == 0)
+			b[rnd(len)] = alpha[rnd(sizeof alpha - 1)];
+
+		if (lsi_cmap_mismatch(a, b, len, cm)
+		    != lsi_cmap_mismatch_ref(a, b, len, cm))
+			return "mismatch differs from reference";
+	}
+
+	return NULL;
+}
+
+const char * /*UNITTEST*/
+test_istrcmp(void)
+{
+	if (lsi_ut_istrcmp("Nick[away]", "nick{AWAY}", CMAP_RFC1459) != 0
+	    || lsi_ut_istrcmp("a^", "A~", CMAP_RFC1459) != 0
+	    || lsi_ut_istrcmp("a^", "A~", CMAP_STRICT_RFC1459) == 0
+	    || lsi_ut_istrcmp("[x]", "{X}", CMAP_ASCII) == 0)
+		return "casemappings not applied";
+
+	if (lsi_ut_istrcmp("abc", "abd", CMAP_ASCII) >= 0
+	    || lsi_ut_istrcmp("abcd", "ABC", CMAP_ASCII) <= 0
+	    || lsi_ut_istrcmp("ab", "ABC", CMAP_ASCII) >= 0
+	    || lsi_ut_istrcmp("", "", CMAP_ASCII) != 0)
+		return "wrong order";
+
+	if (lsi_ut_istrncmp("LONGPREFIX-a", "longprefix-B", 11, CMAP_ASCII) != 0
+	    || lsi_ut_istrncmp("LONGPREFIX-a", "longprefix-B", 12,
+	    CMAP_ASCII) >= 0
+	    || lsi_ut_istrncmp("ab", "abc", 3, CMAP_ASCII) >= 0
+	    || lsi_ut_istrncmp("x", "y", 0, CMAP_ASCII) != 0)
+		return "wrong result for prefix compare";
+
+	return NULL;
+}
@@ -0,0 +1,95 @@
+/* test_handoff.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+#include "stub_ircd.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/irc_ext.h>
+#include <libsrsirc/irc_track.h>
+
+const char * /*UNITTEST*/
+test_handoff(void)
+{
+	const char *err = NULL;
+	irc *old = NULL, *new = NULL;
+	int sp[2] = { -1, -1 };
+	uint16_t port;
+	chanrep cr;
+
+	pid_t pid = stub_start(&port, LOGON_CHAN, NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == -1) {
+		err = "socketpair failed";
+		goto out;
+	}
+
+	old = irc_init();
+	irc_set_server(old, "127.0.0.1", port);
+	irc_set_nick(old, "me");
+	irc_set_track(old, true);
+	irc_set_connect_timeout(old, 3000000, 5000000);
+
+	if (!irc_connect(old)) {
+		err = "connecting to stand-in ircd failed";
+		goto out;
+	}
+
+	if (!read_until(old, "PRIVMSG", "first")) {
+		err = "didn't see the first message";
+		goto out;
+	}
+
+	new = irc_init();
+	irc_set_track(new, true);
+
+	if (!irc_handoff_send(old, sp[0])) {
+		err = "handoff (sending side) failed";
+		goto out;
+	}
+
+	if (irc_online(old)) {
+		err = "still online after handing off";
+		goto out;
+	}
+
+	if (!irc_handoff_recv(new, sp[1], 3000000)) {
+		err = "handoff (receiving side) failed";
+		goto out;
+	}
+
+	if (strcmp(irc_mynick(new), "me") != 0)
+		err = "nickname not transferred";
+	else if (!irc_005attr(new, "NETWORK")
+	    || strcmp(irc_005attr(new, "NETWORK"), "Stub") != 0)
+		err = "005 attributes not transferred";
+	else if (!irc_chan(new, &cr, "#CHAN") || irc_num_members(new, "#chan") != 2)
+		err = "tracking state not transferred";
+	else if (!read_until(new, "PRIVMSG", "second"))
+		err = "unread input lost in handoff";
+	else if (!irc_write(new, "PING :handoff"))
+		err = "writing after handoff failed";
+	else if (!read_until(new, "PONG", "handoff"))
+		err = "socket not usable after handoff";
+
+out:
+	if (old)
+		irc_dispose(old);
+	if (new)
+		irc_dispose(new);
+	if (sp[0] != -1) {
+		close(sp[0]);
+		close(sp[1]);
+	}
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
@@ -0,0 +1,87 @@
+/* test_hist.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+#include "stub_ircd.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/irc_ext.h>
+
+static bool
+slow_privmsg(irc *ctx, tokarr *msg, size_t nargs, bool pre)
+{
+	(void)ctx; (void)msg; (void)nargs; (void)pre;
+	usleep(2000);
+	return true;
+}
+
+const char * /*UNITTEST*/
+test_histograms(void)
+{
+	const char *err = NULL;
+	struct irc_hist lat, hnd;
+	uint64_t lo, hi, plo, phi;
+	uint16_t port;
+
+	/* the buckets must tile the whole range */
+	irc_hist_bounds(0, &plo, &phi);
+	for (size_t i = 1; i < IRC_HIST_BUCKETS; i++) {
+		irc_hist_bounds(i, &lo, &hi);
+		if (lo != phi + 1 || hi < lo || (hi - lo) * IRC_HIST_SUB > lo)
+			return "histogram buckets don't line up";
+		phi = hi;
+	}
+	if (phi != UINT64_MAX)
+		return "histogram doesn't cover the whole range";
+
+	pid_t pid = stub_start(&port, LOGON
+	    ":other!u@h PRIVMSG me :one\r\n"
+	    ":other!u@h PRIVMSG me :two\r\n"
+	    ":other!u@h NOTICE me :done\r\n", NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+	irc_reg_msghnd(ctx, "PRIVMSG", slow_privmsg, false);
+
+	if (irc_latency_hist(ctx, &lat)) {
+		err = "histogram without enabling it";
+		goto out;
+	}
+
+	if (!irc_set_histograms(ctx, true)) {
+		err = "failed to enable histograms";
+		goto out;
+	}
+
+	if (!irc_connect(ctx) || !read_until(ctx, "NOTICE", "done")) {
+		err = "didn't get the messages";
+		goto out;
+	}
+
+	if (!irc_latency_hist(ctx, &lat)
+	    || !irc_handler_hist(ctx, "PRIVMSG", slow_privmsg, false, &hnd))
+		err = "histograms not available";
+	else if (irc_handler_hist(ctx, "PRIVMSG", slow_privmsg, true, &hnd))
+		err = "histogram for a handler that doesn't exist";
+	else if (hnd.count != 2 || hnd.sum_ns < 4000000
+	    || irc_hist_quantile(&hnd, 0.5) < 2000000)
+		err = "handler run time not recorded";
+	else if (lat.count < 3 || irc_hist_quantile(&lat, 1.0) < 2000000
+	    || irc_hist_quantile(&lat, 1.0) != lat.max_ns)
+		err = "latency not recorded";
+
+out:
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
@@ -0,0 +1,224 @@
+/* test_intlog.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+
+#include <stdint.h>
+#include <unistd.h>
+
+#include <logger/intlog.h>
+
+static int s_savedfd = -1;
+
+/* send stderr to a temporary file, return that */
+static FILE *
+grab(void)
+{
+	FILE *f = tmpfile();
+	if (!f)
+		return NULL;
+
+	fflush(stderr);
+	s_savedfd = dup(2);
+	dup2(fileno(f), 2);
+	return f;
+}
+
+static void
+ungrab(FILE *f)
+{
+	fflush(stderr);
+	dup2(s_savedfd, 2);
+	close(s_savedfd);
+	rewind(f);
+	return;
+}
+
+/* only once; the drainer thread keeps running between the tests */
+static void
+setup(void)
+{
+	static bool done;
+	if (done)
+		return;
+
+	done = true;
+	lsi_log_init();
+	lsi_log_setfancy(false);
+	lsi_log_setlvl(LOG_MODULE, LOG_DEBUG);
+	return;
+}
+
+/* deferred messages must come out exactly as vsnprintf(3) formats them */
+const char * /*UNITTEST*/
+test_async_format(void)
+{
+	char exp[8][256], line[4096];
+	char nonterm[4] = { 'a', 'b', 'c', 'd' };
+	size_t n = 0;
+
+	setup();
+	FILE *f = grab();
+	if (!f)
+		return "tmpfile failed";
+
+	if (!lsi_log_setasync(true)) {
+		ungrab(f);
+		fclose(f);
+		return "could not enable deferred logging";
+	}
+
+#define CHK(...) do { snprintf(exp[n++], sizeof *exp, __VA_ARGS__); \
+    I(__VA_ARGS__); } while (0)
+	CHK("plain, 100%% literal");
+	CHK("%d %5i %-4u| %x %#lX %lld %hhd %hu", -7, 42, 3u, 0xbeefu,
+	    0xdeadUL, -1234567890123LL, (signed char)-3, (unsigned short)65535);
+	CHK("%zu %zd %jd %td %c%c", (size_t)12, (ssize_t)-1, (intmax_t)-5,
+	    (ptrdiff_t)9, 'o', 'k');
+	CHK("%s|%10s|%-6.2s|%.*s", "str", "right", "trunc", 3, nonterm);
+	CHK("%*d|%-*.*f|%e|%g|%Lf", 6, 17, 9, 3, 3.14159, 1e-10, 0.5,
+	    (long double)2.25);
+	CHK("%p %%d", (void *)&n);
+	CHK("emb\nedded");
+#undef CHK
+
+	lsi_log_setasync(false);
+	ungrab(f);
+
+	/* newlines are rewritten to '$' */
+	exp[n - 1][3] = '$';
+
+	size_t i = 0;
+	while (fgets(line, sizeof line, f) && i < n) {
+		char *e = strchr(line, '\n');
+		if (e)
+			*e = '\0';
+
+		size_t el = strlen(exp[i]), ll = strlen(line);
+		if (ll < el + 2 || strcmp(line + ll - el, exp[i]) != 0
+		    || line[ll - el - 2] != ':') {
+			fprintf(stderr, "got '%s', expected '%s'\n", line,
+			    exp[i]);
+			fclose(f);
+			return "deferred message formatted differently";
+		}
+		i++;
+	}
+
+	fclose(f);
+	return i == n ? NULL : "messages missing";
+}
+
+/* a full ring drops debug messages, but accounts for every one of them */
+const char * /*UNITTEST*/
+test_async_overflow(void)
+{
+	char line[4096];
+	unsigned long seen = 0, lost = 0;
+	const unsigned long total = 20000;
+
+	setup();
+	FILE *f = grab();
+	if (!f)
+		return "tmpfile failed";
+
+	lsi_log_setasync(true);
+	for (unsigned long i = 0; i < total; i++)
+		D("msg %lu", i);
+	W("done");
+	lsi_log_setasync(false);
+	ungrab(f);
+
+	bool warned = false;
+	while (fgets(line, sizeof line, f)) {
+		unsigned long d;
+		if (strstr(line, ": msg "))
+			seen++;
+		else if (sscanf(line, "(log ring full, %lu message", &d) == 1)
+			lost += d;
+		else if (strstr(line, ": done"))
+			warned = true;
+	}
+
+	fclose(f);
+
+	if (!warned)
+		return "warning lost";
+
+	if (seen + lost != total) {
+		fprintf(stderr, "seen %lu, lost %lu\n", seen, lost);
+		return "dropped messages not accounted for";
+	}
+
+	return NULL;
+}
+
+/* string arguments too big for a ring slot come out in full, not cut */
+const char * /*UNITTEST*/
+test_async_long(void)
+{
+	char big[2000], line[4096];
+	bool seen = false, after = false;
+
+	memset(big, 'x', sizeof big - 1);
+	big[sizeof big - 1] = '\0';
+
+	setup();
+	FILE *f = grab();
+	if (!f)
+		return "tmpfile failed";
+
+	lsi_log_setasync(true);
+	D("before");
+	D("big: %s|", big);
+	D("after");
+	lsi_log_setasync(false);
+	ungrab(f);
+
+	bool before = false;
+	while (fgets(line, sizeof line, f)) {
+		char *p = strstr(line, ": big: ");
+		if (strstr(line, ": before"))
+			before = true;
+		else if (p && before && strlen(p + 7) == sizeof big + 1
+		    && strncmp(p + 7, big, sizeof big - 1) == 0)
+			seen = true;
+		else if (strstr(line, ": after") && seen)
+			after = true;
+	}
+
+	fclose(f);
+	return !seen ? "long message cut short, or out of order"
+	    : !after ? "message after the long one lost" : NULL;
+}
+
+/* the drainer sleeps when there's nothing to do; a message must still come
+ * out on its own shortly after, without anyone flushing */
+const char * /*UNITTEST*/
+test_async_wakeup(void)
+{
+	char buf[4096];
+	bool seen = false;
+
+	setup();
+	FILE *f = grab();
+	if (!f)
+		return "tmpfile failed";
+
+	lsi_log_setasync(true);
+	usleep(50000); // let the drainer go idle
+	D("wakeup");
+	for (int i = 0; i < 100 && !seen; i++) {
+		usleep(10000);
+		/* pread(2), as the drainer writes to the same file */
+		ssize_t n = pread(fileno(f), buf, sizeof buf - 1, 0);
+		buf[n > 0 ? n : 0] = '\0';
+		seen = strstr(buf, ": wakeup");
+	}
+	lsi_log_setasync(false);
+	ungrab(f);
+	fclose(f);
+
+	return seen ? NULL : "message not written out by the idle drainer";
+}
@@ -0,0 +1,64 @@
+/* test_irc.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+#include "stub_ircd.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/irc_ext.h>
+#include <libsrsirc/irc_track.h>
+
+const char * /*UNITTEST*/
+test_stats(void)
+{
+	const char *err = NULL;
+	struct irc_stats st;
+	uint16_t port;
+
+	pid_t pid = stub_start(&port, LOGON
+	    ":me!u@h JOIN #chan\r\n"
+	    ":stub 353 me = #chan :@me other\r\n"
+	    ":stub 366 me #chan :End of NAMES\r\n"
+	    ":other!u@h PRIVMSG #chan :first\r\n", NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+
+	irc_stats(ctx, &st);
+	if (st.bytes_in || st.lines_out || st.disp_core) {
+		err = "counters don't start at zero";
+		goto out;
+	}
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first")) {
+		err = "failed to get into the channel";
+		goto out;
+	}
+
+	irc_stats(ctx, &st);
+	if (st.lines_in < 5 || st.bytes_in < st.lines_in * 10 || !st.reads)
+		err = "input not counted";
+	else if (st.lines_out < 2 || st.bytes_out < 10 || !st.writes)
+		err = "output not counted";
+	else if (!st.disp_core || !st.disp_track || st.disp_user)
+		err = "dispatches not counted per module";
+	else if (!st.tokenize_ns || !st.dispatch_ns || !st.track_ns)
+		err = "times not accounted";
+	else if (st.parse_errors)
+		err = "bogus parse errors";
+
+out:
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
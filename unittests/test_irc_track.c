@@ -0,0 +1,298 @@
+/* test_irc_track.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+#include "stub_ircd.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/irc_ext.h>
+#include <libsrsirc/irc_track.h>
+
+static void
+trkev_record(irc *ctx, const struct trkev *ev, void *tag)
+{
+	char *log = tag;
+	size_t len = strlen(log);
+	snprintf(log + len, 1024 - len, "%d:%s:%s:%s;", ev->type,
+	    ev->chan ? ev->chan : "", ev->nick ? ev->nick : "",
+	    ev->arg ? ev->arg : "");
+	return;
+}
+
+const char * /*UNITTEST*/
+test_trkevent(void)
+{
+	const char *err = NULL;
+	char log[1024] = "";
+	char exp[256];
+	uint16_t port;
+
+	pid_t pid = stub_start(&port, LOGON_CHAN, NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+	irc_regcb_trkevent(ctx, trkev_record, log);
+
+	/* the PRIVMSG tells us other's user and host */
+	snprintf(exp, sizeof exp,
+	    "%d:#chan::;%d::me:;%d:#chan:me:@;%d::other:;%d:#chan:other:;"
+	    "%d:#chan::;%d::other:;", TRKEV_CHAN_ADD, TRKEV_USER_ADD,
+	    TRKEV_MEMB_ADD, TRKEV_USER_ADD, TRKEV_MEMB_ADD, TRKEV_CHAN_SYNC,
+	    TRKEV_USER_UPDATE);
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first"))
+		err = "failed to get into the channel";
+	else if (strcmp(log, exp) != 0)
+		err = "unexpected event sequence";
+
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
+
+const char * /*UNITTEST*/
+test_cursor(void)
+{
+	const char *err = NULL;
+	const userrep *u1, *u2;
+	irc_cur c1, c2;
+	size_t n = 0;
+	uint16_t port;
+
+	pid_t pid = stub_start(&port, LOGON_CHAN, NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first")) {
+		err = "failed to get into the channel";
+		goto out;
+	}
+
+	if (irc_cur_members(ctx, &c1, "#nonexistent")
+	    || irc_cur_nextuser(&c1)) {
+		err = "cursor over nonexistent channel yielded something";
+		goto out;
+	}
+
+	/* two independent cursors over the same map */
+	if (!irc_cur_members(ctx, &c1, "#CHAN")) {
+		err = "no cursor for #chan";
+		goto out;
+	}
+
+	while ((u1 = irc_cur_nextuser(&c1))) {
+		irc_cur_members(ctx, &c2, "#chan");
+		while ((u2 = irc_cur_nextuser(&c2)))
+			n += strcmp(u1->nick, u2->nick) == 0 && u2->modepfx;
+	}
+
+	if (n != 2)
+		err = "nested member cursors didn't see both members";
+	else if (!irc_cur_valid(&c1))
+		err = "cursor invalid without a change";
+
+out:
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
+
+const char * /*UNITTEST*/
+test_trkfilter(void)
+{
+	const char *err = NULL;
+	chanrep cr;
+	userrep ur;
+	uint16_t port;
+
+	pid_t pid = stub_start(&port, LOGON
+	    ":me!u@h JOIN #chan\r\n"
+	    ":stub 353 me = #chan :@me other\r\n"
+	    ":stub 366 me #chan :End of NAMES\r\n"
+	    ":me!u@h JOIN #noise\r\n"
+	    ":stub 353 me = #noise :me other third\r\n"
+	    ":stub 366 me #noise :End of NAMES\r\n"
+	    ":third!u@h PRIVMSG #noise :hi\r\n"
+	    ":third!u@h NICK fourth\r\n"
+	    ":fourth!u@h PART #noise\r\n"
+	    ":other!u@h PRIVMSG #chan :first\r\n", NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+
+	if (!irc_track_filter(ctx, " #foo,#CH* "))
+		err = "setting the filter failed";
+	else if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first"))
+		err = "failed to get into the channel";
+	else if (irc_num_chans(ctx) != 1 || !irc_chan(ctx, &cr, "#chan"))
+		err = "filtered channel was tracked";
+	else if (irc_num_users(ctx) != 2 || !irc_user(ctx, &ur, "other")
+	    || irc_user(ctx, &ur, "third") || irc_user(ctx, &ur, "fourth"))
+		err = "users of filtered channel were tracked";
+
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
+
+const char * /*UNITTEST*/
+test_memlimit(void)
+{
+	const char *err = NULL;
+	struct irc_trkmem m1, m2;
+	chanrep cr;
+	userrep ur;
+	uint16_t port;
+
+	pid_t pid = stub_start(&port, LOGON
+	    ":me!u@h JOIN #chan\r\n"
+	    ":stub 353 me = #chan :@me other\r\n"
+	    ":stub 366 me #chan :End of NAMES\r\n"
+	    ":stub 332 me #chan :some topic\r\n"
+	    ":other!u@h PRIVMSG #chan :first\r\n"
+	    ":new!u@h JOIN #chan\r\n"
+	    ":other!u@h PART #chan\r\n"
+	    ":me!u@h PRIVMSG #chan :second\r\n", NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first")) {
+		err = "failed to get into the channel";
+		goto out;
+	}
+
+	irc_track_memusage(ctx, &m1);
+	if (!m1.chans || !m1.users || !m1.membs || !m1.maps
+	    || m1.total != m1.chans + m1.users + m1.membs + m1.maps) {
+		err = "implausible memory figures";
+		goto out;
+	}
+
+	/* no room for anyone else */
+	irc_track_memlimit(ctx, m1.total);
+
+	if (!read_until(ctx, "PRIVMSG", "second"))
+		err = "didn't see the second message";
+	else if (!irc_chan(ctx, &cr, "#chan") || !cr.desync
+	    || strcmp(cr.topic, "some topic") != 0)
+		err = "channel not kept, or not marked desync";
+	else if (irc_num_members(ctx, "#chan") != 0
+	    || irc_user(ctx, &ur, "new") || irc_user(ctx, &ur, "other"))
+		err = "members not dropped";
+	else {
+		irc_track_memusage(ctx, &m2);
+		if (m2.membs || m2.total >= m1.total)
+			err = "memory not accounted for as released";
+	}
+
+out:
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
+
+const char * /*UNITTEST*/
+test_netsplit(void)
+{
+	const char *err = NULL;
+	userrep ur;
+	tokarr msg;
+	uint16_t port;
+
+	/* a (replayed) netsplit taking a, b, c, e with it, only a coming back
+	 * to both its channels and e only to one of them */
+	pid_t pid = stub_start(&port, LOGON
+	    ":me!u@h JOIN #a\r\n"
+	    ":stub 353 me = #a :@me +a b @c e\r\n"
+	    ":stub 366 me #a :End of NAMES\r\n"
+	    ":me!u@h JOIN #b\r\n"
+	    ":stub 353 me = #b :me a c d e\r\n"
+	    ":stub 366 me #b :End of NAMES\r\n"
+	    ":me!u@h PRIVMSG #a :first\r\n"
+	    ":a!u@h QUIT :hub.example.net leaf.example.net\r\n"
+	    ":b!u@h QUIT :hub.example.net leaf.example.net\r\n"
+	    ":c!u@h QUIT :hub.example.net leaf.example.net\r\n"
+	    ":d!u@h QUIT :Quit: bye\r\n"
+	    ":e!u@h QUIT :hub.example.net leaf.example.net\r\n"
+	    ":a!u@h JOIN #a\r\n"
+	    ":a!u@h JOIN #b\r\n"
+	    ":e!u@h JOIN #a\r\n"
+	    ":me!u@h PRIVMSG #a :second\r\n", NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+	irc_track_splitgrace(ctx, 60000000);
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "second")) {
+		err = "failed to get through the netsplit";
+		goto out;
+	}
+
+	if (irc_user(ctx, &ur, "d"))
+		err = "user which actually quit was kept";
+	else if (!irc_user(ctx, &ur, "b") || !irc_user(ctx, &ur, "c")
+	    || irc_num_members(ctx, "#a") != 5
+	    || !irc_member(ctx, &ur, "#b", "e"))
+		err = "split users dropped before the grace period";
+	else if (!irc_member(ctx, &ur, "#a", "a") || ur.modepfx[0]
+	    || !irc_member(ctx, &ur, "#b", "a"))
+		err = "rejoined user not restored properly";
+
+	if (err)
+		goto out;
+
+	irc_track_splitgrace(ctx, 0);
+	if (irc_read(ctx, &msg, 100000) != 0)
+		err = "unexpected input";
+	else if (irc_user(ctx, &ur, "b") || irc_user(ctx, &ur, "c"))
+		err = "split users not dropped after the grace period";
+	else if (irc_num_members(ctx, "#a") != 3
+	    || irc_num_members(ctx, "#b") != 2 || irc_num_users(ctx) != 3)
+		err = "wrong membership after the netsplit";
+	else if (!irc_member(ctx, &ur, "#a", "a")
+	    || !irc_member(ctx, &ur, "#a", "e"))
+		err = "rejoined user dropped";
+	else if (irc_member(ctx, &ur, "#b", "e"))
+		err = "channel not rejoined after the netsplit was kept";
+
+out:
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
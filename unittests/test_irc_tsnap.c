@@ -0,0 +1,172 @@
+/* test_irc_tsnap.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+#include "stub_ircd.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/irc_ext.h>
+#include <libsrsirc/irc_track.h>
+
+static void *
+tsnap_reader(void *arg)
+{
+	const irc_tsnap *s = irc_tsnap_get(arg);
+	const char *err = NULL;
+	const userrep *m;
+	size_t n;
+
+	if (!s)
+		return "no snapshot published";
+
+	if (!irc_tsnap_chan(s, "#CHAN"))
+		err = "channel missing from snapshot";
+	else if (!(m = irc_tsnap_members(s, "#chan", &n)) || n != 2)
+		err = "wrong member count in snapshot";
+	else if (strcmp(m[0].nick, "me") != 0 || strcmp(m[0].modepfx, "@") != 0
+	    || strcmp(m[1].nick, "other") != 0)
+		err = "members not sorted, or modes missing";
+	else if (!irc_tsnap_user(s, "OTHER!u@h"))
+		err = "user missing from snapshot";
+
+	irc_tsnap_put(s);
+	return (void *)err;
+}
+
+const char * /*UNITTEST*/
+test_tsnap(void)
+{
+	const char *err = NULL;
+	const irc_tsnap *old = NULL;
+	irc *ctx = NULL;
+	uint16_t port;
+	pthread_t t;
+	void *res;
+
+	pid_t pid = stub_start(&port, LOGON_CHAN, NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+
+	if (irc_tsnap_get(ctx)) {
+		err = "got a snapshot before publishing one";
+		goto out;
+	}
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first")) {
+		err = "failed to get into the channel";
+		goto out;
+	}
+
+	if (!irc_track_publish(ctx) || !(old = irc_tsnap_get(ctx))) {
+		err = "publishing snapshot failed";
+		goto out;
+	}
+
+	if (pthread_create(&t, NULL, tsnap_reader, ctx) != 0) {
+		err = "pthread_create failed";
+		goto out;
+	}
+
+	pthread_join(t, &res);
+	if ((err = res))
+		goto out;
+
+	/* the old one has to stay intact while we hold it */
+	if (!irc_track_publish(ctx))
+		err = "republishing failed";
+	else if (irc_tsnap_seq(old) != 1)
+		err = "wrong sequence number";
+	else if (!irc_tsnap_chan(old, "#chan"))
+		err = "replaced snapshot not intact";
+
+out:
+	irc_tsnap_put(old);
+	if (ctx)
+		irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
+
+static void *
+tsnap_hammer(void *arg)
+{
+	uint64_t lastseq = 0;
+
+	for (int i = 0; i < 100000; i++) {
+		const irc_tsnap *s = irc_tsnap_get(arg);
+		if (!s)
+			return "snapshot vanished";
+
+		bool ok = irc_tsnap_seq(s) >= lastseq
+		    && irc_tsnap_chan(s, "#chan");
+		lastseq = irc_tsnap_seq(s);
+		irc_tsnap_put(s);
+		if (!ok)
+			return "bogus snapshot";
+	}
+
+	return NULL;
+}
+
+/* readers coming and going all the time must neither stall publishing nor
+ * get hold of a snapshot that was already released (run this under ASan or
+ * TSan to make the latter show) */
+const char * /*UNITTEST*/
+test_tsnap_contention(void)
+{
+	const char *err = NULL;
+	pthread_t t[4];
+	size_t nt = 0;
+	uint16_t port;
+	void *res;
+
+	pid_t pid = stub_start(&port, LOGON_CHAN, NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first")
+	    || !irc_track_publish(ctx)) {
+		err = "failed to get into the channel";
+		goto out;
+	}
+
+	for (; nt < sizeof t / sizeof *t; nt++)
+		if (pthread_create(&t[nt], NULL, tsnap_hammer, ctx) != 0) {
+			err = "pthread_create failed";
+			break;
+		}
+
+	for (int i = 0; i < 2000 && !err; i++)
+		if (!irc_track_publish(ctx))
+			err = "publishing failed";
+
+	while (nt--) {
+		pthread_join(t[nt], &res);
+		if (!err)
+			err = res;
+	}
+
+out:
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
@@ -0,0 +1,125 @@
+/* test_lag.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+#include "stub_ircd.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/irc_ext.h>
+
+/* The stand-in ircd's side of the lag monitor test: it PINGs us once (see
+ * test_lagmon()), then answers our PINGs 1, 2 and 5 right away, 3 and 4
+ * after 60ms and the rest not at all.  With a 30ms threshold that makes for
+ * a breach (3), a recovery (5) and another breach (6) before the link is
+ * found dead (7) */
+static bool
+lag_line(int sck, const char *line)
+{
+	static int npings;
+	char out[64];
+
+	if (strcmp(line, "PONG :srvping") == 0)
+		snprintf(out, sizeof out, ":stub NOTICE me :gotpong\r\n");
+	else if (strncmp(line, "PING :", 6) == 0 && ++npings <= 5) {
+		if (npings == 3 || npings == 4)
+			usleep(60000);
+		snprintf(out, sizeof out, ":stub PONG stub :%.32s\r\n",
+		    line + 6);
+	} else
+		return true;
+
+	write(sck, out, strlen(out));
+	return true;
+}
+
+struct lagrec {
+	int nev;
+	bool ev[4];
+	struct irc_lag at[4];
+};
+
+static void
+lag_record(irc *ctx, const struct irc_lag *lag, bool breach, void *tag)
+{
+	struct lagrec *r = tag;
+	(void)ctx;
+	if (r->nev < (int)(sizeof r->ev / sizeof *r->ev)) {
+		r->ev[r->nev] = breach;
+		r->at[r->nev++] = *lag;
+	}
+	return;
+}
+
+const char * /*UNITTEST*/
+test_lagmon(void)
+{
+	const char *err = NULL;
+	struct lagrec rec = { 0 };
+	struct irc_lag lag;
+	bool gotpong = false;
+	uint16_t port;
+	tokarr msg;
+	int r;
+
+	pid_t pid = stub_start(&port, LOGON "PING :srvping\r\n", lag_line);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+
+	if (irc_lag(ctx, &lag) || irc_lagmon_wait(ctx)) {
+		err = "lag monitor on by default";
+		goto out;
+	}
+
+	irc_set_lagmon(ctx, 100000, 30000);
+	irc_regcb_lag(ctx, lag_record, &rec);
+
+	if (!irc_connect(ctx)) {
+		err = "failed to connect";
+		goto out;
+	}
+
+	uint64_t w = irc_lagmon_wait(ctx);
+	if (!w || w > 100000) {
+		err = "bogus wait time";
+		goto out;
+	}
+
+	/* a long timeout must not keep it from PINGing */
+	while ((r = irc_read(ctx, &msg, 3000000)) > 0)
+		if (strcmp(msg[1], "NOTICE") == 0 && strcmp(msg[3], "gotpong") == 0)
+			gotpong = true;
+
+	if (r == 0)
+		err = "dead link not detected";
+	else if (!gotpong)
+		err = "server PING not answered";
+	else if (rec.nev != 3 || !rec.ev[0] || rec.ev[1] || !rec.ev[2])
+		err = "no breach, recovery and breach reported";
+	else if (rec.at[0].pending_us <= 30000 || rec.at[0].npongs != 2)
+		err = "breach reported at the wrong time";
+	else if (rec.at[2].npongs != 5 || rec.at[2].pending_us <= 30000)
+		err = "unanswered PING not reported";
+	else if (rec.at[1].npongs != 5 || rec.at[1].cur_us > 30000
+	    || rec.at[1].min_us > rec.at[1].cur_us
+	    || rec.at[1].ewma_us <= rec.at[1].min_us
+	    || rec.at[1].ewma_us >= 60000)
+		err = "bogus round trip figures";
+	else if (!irc_lag(ctx, &lag) || lag.npings != 6 || lag.npongs != 5)
+		err = "PINGs and PONGs miscounted";
+
+out:
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
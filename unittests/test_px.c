@@ -0,0 +1,210 @@
+/* test_px.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/irc_ext.h>
+
+/* A stand-in proxy which speaks SOCKS5 and, if asked to connect to
+ * "hop2.invalid", pretends to be that (HTTP) proxy as well, on the same
+ * connection.  Once through, it tells us which way we came. */
+
+static int
+listener(uint16_t *port, bool dolisten)
+{
+	struct sockaddr_in sa;
+	socklen_t salen = sizeof sa;
+	memset(&sa, 0, sizeof sa);
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	int s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s == -1 || bind(s, (struct sockaddr *)&sa, sizeof sa) == -1
+	    || (dolisten && listen(s, 8) == -1)
+	    || getsockname(s, (struct sockaddr *)&sa, &salen) == -1)
+		return -1;
+
+	*port = ntohs(sa.sin_port);
+	return s;
+}
+
+static bool
+readn(int s, unsigned char *buf, size_t n)
+{
+	while (n) {
+		ssize_t r = read(s, buf, n);
+		if (r <= 0)
+			return false;
+		buf += r;
+		n -= (size_t)r;
+	}
+	return true;
+}
+
+static void
+stub_serve(int c)
+{
+	unsigned char buf[512];
+	char target[300] = "";
+	char line[600];
+
+	/* greeting and CONNECT request, for a DNS name */
+	if (!readn(c, buf, 3 + 5) || buf[0] != 5 || buf[3] != 5 || buf[6] != 3)
+		return;
+	size_t hl = buf[7];
+	if (!readn(c, buf, hl + 2))
+		return;
+	snprintf(target, sizeof target, "%.*s:%u", (int)hl, (char *)buf,
+	    (unsigned)(buf[hl] << 8 | buf[hl+1]));
+
+	static const unsigned char rep[] =
+	    { 5, 0, 5, 0, 0, 1, 127, 0, 0, 1, 0, 0 };
+	write(c, rep, sizeof rep);
+
+	if (strcmp(target, "hop2.invalid:8080") == 0) {
+		size_t n = 0;
+		while (n < sizeof buf - 1 && (n < 4 || memcmp(buf + n - 4,
+		    "\r\n\r\n", 4) != 0))
+			if (!readn(c, buf + n++, 1))
+				return;
+		buf[n] = '\0';
+		if (sscanf((char *)buf, "CONNECT %299s", target) != 1)
+			return;
+		snprintf(line, sizeof line, "HTTP/1.0 200 OK\r\n\r\n"
+		    ":stub NOTICE * :via hop2.invalid:8080 to %s\r\n", target);
+	} else
+		snprintf(line, sizeof line, ":stub NOTICE * :to %s\r\n",
+		    target);
+
+	write(c, line, strlen(line));
+	readn(c, buf, 1); /* wait for the other end to hang up */
+	return;
+}
+
+static pid_t
+stub_start(uint16_t *port, int nconn)
+{
+	int s = listener(port, true);
+	if (s == -1)
+		return -1;
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		while (nconn--) {
+			int c = accept(s, NULL, NULL);
+			if (c == -1)
+				_exit(1);
+			stub_serve(c);
+			close(c);
+		}
+		_exit(0);
+	}
+
+	close(s);
+	return pid;
+}
+
+static const char *
+expect_notice(irc *ctx, const char *what)
+{
+	tokarr msg;
+	if (irc_read(ctx, &msg, 3000000) <= 0)
+		return "no message after connecting";
+	if (!msg[3] || strcmp(msg[3], what) != 0)
+		return "came through the wrong way";
+	return NULL;
+}
+
+const char * /*UNITTEST*/
+test_chain(void)
+{
+	const char *err = NULL;
+	uint16_t port;
+	pid_t pid = stub_start(&port, 1);
+	if (pid == -1)
+		return "failed to start stand-in proxy";
+
+	irc *ctx = irc_init();
+	irc_set_dumb(ctx, true);
+	irc_set_server(ctx, "irc.example.org", 6667);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+	irc_set_px(ctx, "127.0.0.1", port, IRCPX_SOCKS5);
+	irc_add_px(ctx, "hop2.invalid", 8080, IRCPX_HTTP);
+
+	if (!irc_connect(ctx))
+		err = "connecting through the chain failed";
+	else
+		err = expect_notice(ctx,
+		    "via hop2.invalid:8080 to irc.example.org:6667");
+
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
+
+const char * /*UNITTEST*/
+test_pool(void)
+{
+	const char *err = NULL;
+	uint16_t port, deadport;
+	unsigned nok, nfail;
+
+	/* bound, but not listening -- connection refused */
+	int dead = listener(&deadport, false);
+	if (dead == -1)
+		return "failed to set up dead proxy";
+
+	pid_t pid = stub_start(&port, 2);
+	if (pid == -1)
+		return "failed to start stand-in proxy";
+
+	irc *ctx = irc_init();
+	irc_set_dumb(ctx, true);
+	irc_set_server(ctx, "irc.example.org", 6667);
+	irc_set_connect_timeout(ctx, 1000000, 5000000);
+	irc_set_px(ctx, "127.0.0.1", deadport, IRCPX_SOCKS5);
+	irc_add_pxpool(ctx, "127.0.0.1", port, IRCPX_SOCKS5);
+
+	if (!irc_connect(ctx)) {
+		err = "failover to working proxy didn't happen";
+		goto out;
+	}
+
+	if ((err = expect_notice(ctx, "to irc.example.org:6667")))
+		goto out;
+
+	irc_reset(ctx);
+	if (!irc_pxpool_stat(ctx, 0, NULL, &nok, &nfail) || nok || nfail != 1) {
+		err = "dead proxy's failure wasn't recorded";
+		goto out;
+	}
+
+	/* the working one should now be tried first */
+	if (!irc_connect(ctx)) {
+		err = "reconnect failed";
+		goto out;
+	}
+	irc_reset(ctx);
+
+	if (!irc_pxpool_stat(ctx, 0, NULL, &nok, &nfail) || nfail != 1)
+		err = "dead proxy was tried again";
+	else if (!irc_pxpool_stat(ctx, 1, NULL, &nok, &nfail) || nok != 2)
+		err = "working proxy's successes weren't recorded";
+
+out:
+	irc_dispose(ctx);
+	close(dead);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
@@ -0,0 +1,123 @@
+/* test_resolv.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+
+#include <unistd.h>
+
+#include <libsrsirc/resolv.h>
+
+static int s_nlookups;
+
+/* stub resolver; knows exactly one host */
+static int
+stub(const char *host, uint16_t port, struct addrlist **res)
+{
+	s_nlookups++;
+	if (strcmp(host, "irc.example.org") != 0)
+		return -1;
+
+	struct addrlist *al = malloc(sizeof *al);
+	strcpy(al->addrstr, "192.0.2.1");
+	strcpy(al->reqname, host);
+	al->port = port;
+	al->ipv6 = false;
+	al->next = NULL;
+	*res = al;
+	return 1;
+}
+
+const char * /*UNITTEST*/
+test_cache(void)
+{
+	struct addrlist *al;
+	lsi_res_set_backend(stub);
+	s_nlookups = 0;
+
+	for (int i = 0; i < 3; i++) {
+		if (lsi_res_lookup("irc.example.org", 6667, 1000000, 0, &al) != 1)
+			return "lookup of known host failed";
+		if (strcmp(al->addrstr, "192.0.2.1") != 0 || al->port != 6667)
+			return "wrong lookup result";
+		lsi_b_freeaddrlist(al);
+	}
+
+	if (s_nlookups != 1)
+		return "positive result not cached";
+
+	if (lsi_res_lookup("irc.example.org", 6697, 1000000, 0, &al) != 1)
+		return "lookup of known host (other port) failed";
+	lsi_b_freeaddrlist(al);
+
+	if (s_nlookups != 2)
+		return "cache conflated different ports";
+
+	for (int i = 0; i < 3; i++)
+		if (lsi_res_lookup("bogus.example.org", 6667, 1000000, 1000000,
+		    &al) > 0)
+			return "lookup of unknown host succeeded";
+
+	if (s_nlookups != 3)
+		return "negative result not cached";
+
+	lsi_res_set_backend(NULL);
+	return NULL;
+}
+
+const char * /*UNITTEST*/
+test_expiry(void)
+{
+	struct addrlist *al;
+	lsi_res_set_backend(stub);
+	s_nlookups = 0;
+
+	if (lsi_res_lookup("irc.example.org", 6667, 20000, 0, &al) != 1)
+		return "lookup of known host failed";
+	lsi_b_freeaddrlist(al);
+
+	usleep(50000);
+
+	if (lsi_res_lookup("irc.example.org", 6667, 20000, 0, &al) != 1)
+		return "lookup of known host failed";
+	lsi_b_freeaddrlist(al);
+
+	if (s_nlookups != 2)
+		return "expired entry was used";
+
+	/* no caching at all when both TTLs are 0 */
+	lsi_res_lookup("bogus.example.org", 6667, 0, 0, &al);
+	lsi_res_lookup("bogus.example.org", 6667, 0, 0, &al);
+	if (s_nlookups != 4)
+		return "cached despite zero TTLs";
+
+	lsi_res_set_backend(NULL);
+	return NULL;
+}
+
+const char * /*UNITTEST*/
+test_prefetch(void)
+{
+	struct addrlist *al;
+	lsi_res_set_backend(stub);
+	s_nlookups = 0;
+
+	int fd = lsi_res_prefetch("irc.example.org", 6667, 1000000, 0);
+	if (fd < 0)
+		return "prefetch failed";
+
+	char c;
+	if (read(fd, &c, 1) != 1 || c != '+')
+		return "prefetch didn't signal success";
+	close(fd);
+
+	if (lsi_res_lookup("irc.example.org", 6667, 1000000, 0, &al) != 1)
+		return "lookup after prefetch failed";
+	lsi_b_freeaddrlist(al);
+
+	if (s_nlookups != 1)
+		return "prefetched result not cached";
+
+	lsi_res_set_backend(NULL);
+	return NULL;
+}
@@ -0,0 +1,90 @@
+/* test_state.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+#include "stub_ircd.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/irc_ext.h>
+#include <libsrsirc/irc_track.h>
+
+const char * /*UNITTEST*/
+test_snapshot(void)
+{
+	const char *err = NULL;
+	char path[] = "/tmp/lsi_snapshot_XXXXXX";
+	irc *old = NULL, *new = NULL;
+	pid_t pid2 = -1;
+	uint16_t port;
+	chanrep cr;
+	userrep ur;
+
+	int fd = mkstemp(path);
+	if (fd == -1)
+		return "mkstemp failed";
+	close(fd);
+
+	pid_t pid = stub_start(&port, LOGON_CHAN, NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	old = irc_init();
+	irc_set_server(old, "127.0.0.1", port);
+	irc_set_nick(old, "me");
+	irc_set_track(old, true);
+	irc_set_connect_timeout(old, 3000000, 5000000);
+
+	if (!irc_connect(old) || !read_until(old, "PRIVMSG", "first")) {
+		err = "failed to get into the channel";
+		goto out;
+	}
+
+	if (!irc_track_save(old, path)) {
+		err = "saving snapshot failed";
+		goto out;
+	}
+
+	/* this time around, the server doesn't put us in the channel */
+	pid2 = stub_start(&port, LOGON ":stub NOTICE me :first\r\n", NULL);
+	if (pid2 == -1) {
+		err = "failed to start second stand-in ircd";
+		goto out;
+	}
+
+	new = irc_init();
+	irc_set_server(new, "127.0.0.1", port);
+	irc_set_nick(new, "me");
+	irc_set_track(new, true);
+	irc_set_connect_timeout(new, 3000000, 5000000);
+
+	if (irc_track_load(new, "/nonexistent/snapshot"))
+		err = "loading a nonexistent snapshot succeeded";
+	else if (!irc_track_load(new, path))
+		err = "loading snapshot failed";
+	else if (!irc_connect(new) || !read_until(new, "NOTICE", "first"))
+		err = "connecting to second stand-in ircd failed";
+	else if (!irc_chan(new, &cr, "#chan") || !cr.desync)
+		err = "channel not restored, or not marked desync";
+	else if (irc_num_members(new, "#chan") != 2
+	    || !irc_user(new, &ur, "other"))
+		err = "membership not restored";
+
+out:
+	if (old)
+		irc_dispose(old);
+	if (new)
+		irc_dispose(new);
+	unlink(path);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	if (pid2 != -1) {
+		kill(pid2, SIGTERM);
+		waitpid(pid2, NULL, 0);
+	}
+	return err;
+}
@@ -0,0 +1,183 @@
+/* test_ucbase.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+#include "stub_ircd.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/irc_ext.h>
+#include <libsrsirc/irc_track.h>
+
+const char * /*UNITTEST*/
+test_chanmode(void)
+{
+	const char *err = NULL, *arg;
+	uint16_t port;
+
+	pid_t pid = stub_start(&port, LOGON
+	    ":me!u@h JOIN #chan\r\n"
+	    ":stub 353 me = #chan :@me other\r\n"
+	    ":stub 366 me #chan :End of NAMES\r\n"
+	    ":stub 324 me #chan +ntlk 10 key\r\n"
+	    ":other!u@h MODE #chan +bb-l+l *!*@a *!*@b 20\r\n"
+	    ":other!u@h MODE #chan +b-bs *!*@A *!*@B\r\n"
+	    ":other!u@h MODE #chan +v-n other\r\n"
+	    ":me!u@h PRIVMSG #chan :first\r\n", NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first"))
+		err = "failed to get into the channel";
+	else if (irc_chanmode(ctx, "#chan", 'n', NULL, NULL)
+	    || !irc_chanmode(ctx, "#chan", 't', NULL, &arg) || arg
+	    || irc_chanmode(ctx, "#chan", 's', NULL, NULL))
+		err = "wrong flag modes";
+	else if (!irc_chanmode(ctx, "#chan", 'l', NULL, &arg)
+	    || strcmp(arg, "20") != 0
+	    || !irc_chanmode(ctx, "#chan", 'k', NULL, &arg)
+	    || strcmp(arg, "key") != 0)
+		err = "wrong parameter modes";
+	else if (!irc_chanmode(ctx, "#chan", 'b', "*!*@a", NULL)
+	    || irc_chanmode(ctx, "#chan", 'b', "*!*@b", NULL)
+	    || irc_chanmode(ctx, "#chan", 'b', NULL, NULL))
+		err = "wrong ban list";
+	else if (irc_chanmode(ctx, "#chan", 'v', "other", NULL)
+	    || irc_chanmode(ctx, "#nosuch", 'n', NULL, NULL))
+		err = "mode set where it shouldn't be";
+
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
+
+const char * /*UNITTEST*/
+test_banlist(void)
+{
+	const char *err = NULL;
+	listrep lr[8];
+	uint16_t port;
+
+	pid_t pid = stub_start(&port, LOGON
+	    ":me!u@h JOIN #chan\r\n"
+	    ":stub 353 me = #chan :@me other\r\n"
+	    ":stub 366 me #chan :End of NAMES\r\n"
+	    ":other!u@h MODE #chan +b stale!*@*\r\n"
+	    ":stub 367 me #chan *!*@*.EXAMPLE.org op 1500000000\r\n"
+	    ":stub 367 me #chan troll!*@*\r\n"
+	    ":stub 367 me #chan *!*evil@*\r\n"
+	    ":stub 367 me #chan *!*@host.example.net op 1500000001\r\n"
+	    ":stub 368 me #chan :End of channel ban list\r\n"
+	    ":stub 349 me #chan :End of channel exception list\r\n"
+	    ":other!other@some.where PRIVMSG #chan :hi\r\n"
+	    ":other!u@h MODE #chan +b-b *!*@*.bad *!*@host.example.net\r\n"
+	    ":me!u@h PRIVMSG #chan :first\r\n", NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first")) {
+		err = "failed to get into the channel";
+		goto out;
+	}
+
+	if (irc_chanlist(ctx, "#chan", 'b', lr, 8) != 4
+	    || irc_chanlist(ctx, "#chan", 'e', lr, 8) != 0)
+		err = "wrong number of list entries";
+	else if (!irc_chanlist_match(ctx, "#chan", 'b', "x!y@Foo.Example.ORG", lr)
+	    || strcmp(lr[0].mask, "*!*@*.EXAMPLE.org") != 0
+	    || !lr[0].setter || strcmp(lr[0].setter, "op") != 0
+	    || lr[0].ts != 1500000000)
+		err = "suffix-indexed ban not matched";
+	else if (!irc_chanlist_match(ctx, "#chan", 'b', "TROLL!a@b", NULL)
+	    || !irc_chanlist_match(ctx, "#chan", 'b', "x!~evil@b", NULL)
+	    || !irc_chanlist_match(ctx, "#chan", 'b', "y!z@q.bad", lr)
+	    || strcmp(lr[0].setter, "other") != 0)
+		err = "prefix-indexed, unindexed or new ban not matched";
+	else if (irc_chanlist_match(ctx, "#chan", 'b', "stale!a@b", NULL)
+	    || irc_chanlist_match(ctx, "#chan", 'b', "a!b@host.example.net", NULL)
+	    || irc_chanlist_match(ctx, "#chan", 'b', "x!y@example.org", NULL)
+	    || irc_chanlist_match(ctx, "#chan", 'b', "other", NULL)
+	    || irc_chanlist_match(ctx, "#chan", 'e', "TROLL!a@b", NULL))
+		err = "matched what shouldn't be";
+
+out:
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
+
+static void
+count_listclear(irc *ctx, const struct trkev *ev, void *tag)
+{
+	int *n = tag;
+	if (ev->type == TRKEV_LIST_CLEAR && strcmp(ev->chan, "#chan") == 0
+	    && strcmp(ev->arg, "b") == 0)
+		(*n)++;
+	return;
+}
+
+/* a mode listing (324) replaces the flag and parameter modes, but says
+ * nothing about the lists */
+const char * /*UNITTEST*/
+test_banlist_324(void)
+{
+	const char *err = NULL;
+	const char *arg;
+	int nclear = 0;
+	uint16_t port;
+
+	pid_t pid = stub_start(&port, LOGON
+	    ":me!u@h JOIN #chan\r\n"
+	    ":stub 353 me = #chan :@me other\r\n"
+	    ":stub 366 me #chan :End of NAMES\r\n"
+	    ":other!u@h MODE #chan +s\r\n"
+	    ":stub 367 me #chan *!*@banned.example.org op 1500000000\r\n"
+	    ":stub 368 me #chan :End of channel ban list\r\n"
+	    ":stub 324 me #chan +ntl 10\r\n"
+	    ":me!u@h PRIVMSG #chan :first\r\n", NULL);
+	if (pid == -1)
+		return "failed to start stand-in ircd";
+
+	irc *ctx = irc_init();
+	irc_set_server(ctx, "127.0.0.1", port);
+	irc_set_nick(ctx, "me");
+	irc_set_track(ctx, true);
+	irc_set_connect_timeout(ctx, 3000000, 5000000);
+	irc_regcb_trkevent(ctx, count_listclear, &nclear);
+
+	if (!irc_connect(ctx) || !read_until(ctx, "PRIVMSG", "first"))
+		err = "failed to get into the channel";
+	else if (nclear != 1)
+		err = "clearing the ban list not reported once";
+	else if (!irc_chanmode(ctx, "#chan", 'b', "*!*@banned.example.org", NULL)
+	    || !irc_chanlist_match(ctx, "#chan", 'b', "x!y@banned.example.org",
+	    NULL))
+		err = "ban lost to the mode listing";
+	else if (irc_chanmode(ctx, "#chan", 's', NULL, NULL)
+	    || !irc_chanmode(ctx, "#chan", 'n', NULL, NULL)
+	    || !irc_chanmode(ctx, "#chan", 'l', NULL, &arg)
+	    || strcmp(arg, "10") != 0)
+		err = "mode listing not applied";
+
+	irc_dispose(ctx);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return err;
+}
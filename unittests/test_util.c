@@ -0,0 +1,38 @@
+/* test_util.c -
+ * libsrsirc - a lightweight serious IRC lib - (C) 2012-18, Timo Buhrmester
+ * See README for contact-, COPYING for license information. */
+
+#include "unittests_common.h"
+
+#include <libsrsirc/irc.h>
+#include <libsrsirc/util.h>
+
+const char * /*UNITTEST*/
+test_modeiter(void)
+{
+	char pfx[] = ":x!u@h", cmd[] = "MODE", chn[] = "#c";
+	char modes[] = "+olZn-kt+v", a1[] = "NewOp", a2[] = "42", a3[] = "OldKey";
+	tokarr msg = { pfx, cmd, chn, modes, a1, a2, a3, NULL };
+	char res[128] = "";
+	modeiter it;
+	modechg mc;
+
+	irc *ctx = irc_init(); // default 005: b,k,l,psitnm and (ov)@+
+	lsi_ut_modeiter_init(ctx, &it, &msg, false);
+	while (lsi_ut_modeiter_next(ctx, &it, &mc)) {
+		size_t len = strlen(res);
+		snprintf(res + len, sizeof res - len, "%c%c%s%s%s|",
+		    mc.enab ? '+' : '-', mc.mode, mc.pfx ? "@" : "",
+		    mc.arg ? " " : "", mc.arg ? mc.arg : "");
+	}
+
+	bool done = !lsi_ut_modeiter_next(ctx, &it, &mc);
+	irc_dispose(ctx);
+
+	if (strcmp(res, "+o@ NewOp|+l 42|+n|-k OldKey|-t|+v@ *|") != 0)
+		return "wrong mode changes";
+	if (!done)
+		return "iterator restarted after the end";
+
+	return NULL;
+}